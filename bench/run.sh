@@ -0,0 +1,420 @@
+#!/bin/sh
+#
+# Benchmark suite: runs the optimized builds of the examples ('make bench'
+# builds them, then runs this) through a fixed set of scenarios, and writes
+# the results to a JSON file along with the environment they were taken in
+# (CPU, Vulkan device, GLES renderer, commit). The 'gpu' scenarios also
+# have the pipeline statistics of a frame (vertex, clipping primitive,
+# fragment and compute invocations), from their last run.
+#
+# Every scenario is run a few times to warm up (caches, shader disk caches,
+# CPU frequency), then a few more times to measure. All samples are kept,
+# with their min, median and max.
+#
+# Everything runs headless, so it can run in CI: vulkan-triangle on the null
+# WSI backend, driven by a $WSI_NULL_SCRIPT (see common/wsi-null.c), the GLES
+# examples on the default render node, or on Mesa's surfaceless platform if
+# there is none (render-nodes-minimal included). With '-s', the software drivers (lavapipe and llvmpipe) are
+# used even if there is a GPU.
+#
+# Scenarios:
+#   startup      vulkan-triangle, from exec to exit after a single frame (ms)
+#   startup-gles render-nodes-minimal, from exec to exit (ms)
+#   fps          vulkan-triangle, frames redrawn one after the other (fps)
+#   fps-nbody    vulkan-triangle's N-body animation (fps)
+#   resize       vulkan-triangle, swapchain recreation and a frame (ms)
+#   draw         vulkan-triangle '-d', recording a draw (ns)
+#   draw-bind    the same, with a pipeline bind per draw (ns per command)
+#   draw-pass    the same, with a render pass per draw (ns per command)
+#   draw-submit  submitting a frame of draws (ms)
+#   submit-1     vulkan-triangle '-c', a command buffer per submit (us per
+#                command buffer)
+#   submit-8     the same, 8 command buffers per submit
+#   submit-all   the same, all command buffers of a frame in one submit
+#   gpu          vulkan-triangle '-p', the GPU time of a frame redrawn (ms)
+#   gpu-nbody    the same, of the N-body animation
+#   gpu-draw     the same, of frames of draws as in 'draw'
+#   bandwidth    compute-streaming, the best of its paths and sizes (MB/s)
+#   dispatch     compute-pool, a tiny job and its fence wait (us)
+#
+# This code is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public License
+# version 3, or (at your option) any later version as published by
+# the Free Software Foundation.
+#
+# THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+# LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+
+TOP=$(cd "$(dirname "$0")/.." && pwd)
+
+SCENARIOS="startup startup-gles fps fps-nbody resize draw draw-bind draw-pass
+draw-submit submit-1 submit-8 submit-all gpu gpu-nbody gpu-draw bandwidth
+dispatch"
+
+WARMUP=1
+REPEATS=5
+OUTPUT=bench-results.json
+SOFTWARE=no
+
+FRAMES=500
+NBODY_BODIES=4096
+RESIZES=100
+DRAWS=10000
+SUBMITS=64
+
+TRIANGLE=$TOP/vulkan-triangle/vulkan-triangle-bench
+RENDER_NODES=$TOP/render-nodes-minimal/render-nodes-minimal-bench
+STREAMING=$TOP/compute-streaming/compute-streaming
+POOL=$TOP/compute-pool/compute-pool
+
+print_usage () {
+   echo "Usage: $0 [options] [scenario...]"
+   echo "  -w <n>     warmup runs of each scenario (default: $WARMUP)"
+   echo "  -n <n>     measured runs of each scenario (default: $REPEATS)"
+   echo "  -o <file>  JSON results (default: $OUTPUT)"
+   echo "  -s         use the software drivers, lavapipe and llvmpipe"
+   echo "Scenarios: $SCENARIOS"
+}
+
+now_ns () {
+   date +%s%N
+}
+
+# Escapes a string into a JSON one
+json_string () {
+   printf '"%s"' "$(printf '%s' "$1" | sed 's/\\/\\\\/g; s/"/\\"/g' |
+      tr -d '\n\r\t')"
+}
+
+# Prints the frame rate, from the null backend's summary line
+null_fps () {
+   summary='s/^Null: .* \([0-9]*\) frames, \([0-9.]*\) s .*/\1 \2/p'
+
+   sed -n "$summary" "$OUT" |
+      awk '$1 > 1 && $2 > 0 { printf "%.1f\n", ($1 - 1) / $2 }'
+}
+
+# Each scenario runs once, with its output in $OUT, and prints its value
+
+scenario_startup () {
+   start=$(now_ns)
+   WSI_NULL_SCRIPT="expose; quit" "$TRIANGLE" -b null > "$OUT" 2>&1
+   end=$(now_ns)
+
+   grep -q '^Clean exit' "$OUT" &&
+      echo "$start $end" | awk '{ printf "%.3f\n", ($2 - $1) / 1e6 }'
+}
+
+scenario_startup_gles () {
+   start=$(now_ns)
+   "$RENDER_NODES" > "$OUT" 2>&1 || {
+      echo "exit status $?" >> "$OUT"
+      return 1
+   }
+   end=$(now_ns)
+
+   grep -q 'finished successfully' "$OUT" &&
+      echo "$start $end" | awk '{ printf "%.3f\n", ($2 - $1) / 1e6 }'
+}
+
+scenario_fps () {
+   WSI_NULL_SCRIPT="$FRAMES*expose; quit" "$TRIANGLE" -b null \
+      > "$OUT" 2>&1
+   null_fps
+}
+
+scenario_fps_nbody () {
+   WSI_NULL_SCRIPT="frames $FRAMES; quit" "$TRIANGLE" -b null \
+      -n "$NBODY_BODIES" > "$OUT" 2>&1
+   null_fps
+}
+
+# Sizes alternate, so that every resize recreates the swapchain
+scenario_resize () {
+   script=$(awk -v n="$RESIZES" 'BEGIN {
+      for (i = 0; i < n; i++)
+         printf "resize %u %u; ", i % 2 ? 640 : 800, i % 2 ? 480 : 600
+      print "quit"
+   }')
+
+   WSI_NULL_SCRIPT="$script" "$TRIANGLE" -b null > "$OUT" 2>&1
+   null_fps | awk '{ printf "%.3f\n", 1e3 / $1 }'
+}
+
+# Prints the mean of field 'field' over the reports (about one per second)
+# starting with 'report', of vulkan-triangle run with 'option' and 'spec'
+triangle_report () {
+   option=$1
+   spec=$2
+   report=$3
+   field=$4
+
+   WSI_NULL_SCRIPT="frames $FRAMES; quit" "$TRIANGLE" -b null \
+      "$option" "$spec" > "$OUT" 2>&1
+   grep "$report" "$OUT" | awk -v f="$field" '{
+      gsub (/[(,)]/, "")
+      sum += $f
+   }
+   END { if (NR > 0) print sum / NR }'
+}
+
+draw_report () {
+   triangle_report -d "$1" '^[0-9]* commands per frame: ' "$2"
+}
+
+submit_report () {
+   triangle_report -c "$1" '^[0-9.]* command buffers in ' 13
+}
+
+scenario_draw () {
+   draw_report "$DRAWS" 5
+}
+
+scenario_draw_bind () {
+   draw_report "$DRAWS,1" 5
+}
+
+scenario_draw_pass () {
+   draw_report "$DRAWS,0,1" 5
+}
+
+scenario_draw_submit () {
+   draw_report "$DRAWS" 18
+}
+
+scenario_submit_1 () {
+   submit_report "$SUBMITS,1"
+}
+
+scenario_submit_8 () {
+   submit_report "$SUBMITS,8"
+}
+
+scenario_submit_all () {
+   submit_report "$SUBMITS"
+}
+
+# Prints the GPU time of a frame, on average, of vulkan-triangle run with
+# '-p' (timestamp and pipeline statistics queries) on 'script' and 'args'
+triangle_gpu () {
+   script=$1
+   shift
+
+   WSI_NULL_SCRIPT="$script" "$TRIANGLE" -b null -p "$@" > "$OUT" 2>&1
+   sed -n 's/^GPU frame: [0-9]* frames, \([0-9.]*\) ms .*/\1/p' "$OUT"
+}
+
+scenario_gpu () {
+   triangle_gpu "$FRAMES*expose; quit"
+}
+
+scenario_gpu_nbody () {
+   triangle_gpu "frames $FRAMES; quit" -n "$NBODY_BODIES"
+}
+
+scenario_gpu_draw () {
+   triangle_gpu "frames $FRAMES; quit" -d "$DRAWS"
+}
+
+scenario_bandwidth () {
+   "$STREAMING" -n 200 > "$OUT" 2>&1 || return 1
+
+   awk 'NF == 6 && $6 == "ok" && $4 > best { best = $4 }
+        END { if (best > 0) print best }' "$OUT"
+}
+
+# Jobs of a single work group doing a single round, from the main thread
+scenario_dispatch () {
+   "$POOL" -t 1 -n 1024 -s 64 -r 1 > "$OUT" 2>&1 || return 1
+
+   awk '$1 == "main" && $NF == "ok" && $2 > 0 { printf "%.2f\n", 1e6 / $2 }' \
+      "$OUT"
+}
+
+# Runs a scenario with warmup, and appends its JSON object to $RESULTS
+run_scenario () {
+   name=$1
+   case $name in
+   startup|startup-gles|resize|draw-submit|gpu|gpu-nbody|gpu-draw)
+      unit=ms
+      better=lower
+      ;;
+   draw|draw-bind|draw-pass)
+      unit=ns
+      better=lower
+      ;;
+   submit-1|submit-8|submit-all)
+      unit=us
+      better=lower
+      ;;
+   fps|fps-nbody)
+      unit=fps
+      better=higher
+      ;;
+   bandwidth)
+      unit=MB/s
+      better=higher
+      ;;
+   dispatch)
+      unit=us
+      better=lower
+      ;;
+   *)
+      echo "Error: Unknown scenario '$name'"
+      return 1
+      ;;
+   esac
+
+   samples=""
+   error=""
+   i=0
+   while [ $i -lt $((WARMUP + REPEATS)) ]; do
+      value=$(scenario_$(echo "$name" | tr - _))
+      if [ -z "$value" ]; then
+         # the last error printed, or the last line at all
+         reason=$(grep -i 'error' "$OUT" | tail -n 1)
+         [ -z "$reason" ] && reason=$(tail -n 1 "$OUT")
+         error="run $((i + 1)) failed: ${reason:-no output}"
+         break
+      fi
+      if [ $i -ge $WARMUP ]; then
+         samples="$samples $value"
+      fi
+      i=$((i + 1))
+   done
+
+   # the devices the examples picked
+   device=$(sed -n 's/^Physical device: //p' "$OUT" | head -n 1)
+   [ -n "$device" ] && VULKAN_DEVICE=$device
+   renderer=$(sed -n 's/^Renderer: //p' "$OUT" | head -n 1)
+   [ -n "$renderer" ] && GLES_RENDERER=$renderer
+
+   # what the GPU did per frame, where counted
+   statistics=$(sed -n 's/^GPU frame statistics: //p' "$OUT" | awk '{
+      gsub (/,/, "")
+      printf "{\"vertex_invocations\": %s, \"clipping_primitives\": %s, ", \
+         $1, $4
+      printf "\"fragment_invocations\": %s, \"compute_invocations\": %s}", \
+         $7, $10
+   }')
+
+   if [ -n "$error" ]; then
+      echo "$name: $error"
+   else
+      echo "$name:$samples ($unit)"
+   fi
+
+   [ -s "$RESULTS" ] && printf ',\n' >> "$RESULTS"
+   {
+      printf '    {\n'
+      printf '      "name": "%s",\n' "$name"
+      printf '      "unit": "%s",\n' "$unit"
+      printf '      "better": "%s",\n' "$better"
+      if [ -n "$error" ]; then
+         printf '      "error": %s,\n' "$(json_string "$error")"
+      fi
+      if [ -n "$statistics" ]; then
+         printf '      "statistics": %s,\n' "$statistics"
+      fi
+      echo "$samples" | tr ' ' '\n' | sed '/^$/d' | sort -g | awk '
+         { v[NR] = $1 }
+         END {
+            printf "      \"samples\": ["
+            for (i = 1; i <= NR; i++)
+               printf "%s%s", (i > 1 ? ", " : ""), v[i]
+            printf "]"
+            if (NR > 0) {
+               if (NR % 2)
+                  median = v[(NR + 1) / 2]
+               else
+                  median = (v[NR / 2] + v[NR / 2 + 1]) / 2
+               printf ",\n      \"min\": %s,\n", v[1]
+               printf "      \"median\": %s,\n", median
+               printf "      \"max\": %s", v[NR]
+            }
+            printf "\n"
+         }'
+      printf '    }'
+   } >> "$RESULTS"
+}
+
+while getopts "w:n:o:sh" opt; do
+   case $opt in
+   w)
+      WARMUP=$OPTARG
+      ;;
+   n)
+      REPEATS=$OPTARG
+      ;;
+   o)
+      OUTPUT=$OPTARG
+      ;;
+   s)
+      SOFTWARE=yes
+      ;;
+   h)
+      print_usage
+      exit 0
+      ;;
+   *)
+      print_usage
+      exit 1
+      ;;
+   esac
+done
+shift $((OPTIND - 1))
+[ $# -gt 0 ] && SCENARIOS="$*"
+
+if [ "$SOFTWARE" = yes ]; then
+   for icd in /usr/share/vulkan/icd.d/lvp_icd.*.json; do
+      [ -f "$icd" ] && export VK_ICD_FILENAMES="$icd"
+   done
+   if [ -z "$VK_ICD_FILENAMES" ]; then
+      echo "Error: lavapipe is not installed"
+      exit 1
+   fi
+   export LIBGL_ALWAYS_SOFTWARE=1
+fi
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+OUT=$TMP/output
+RESULTS=$TMP/results
+: > "$RESULTS"
+
+VULKAN_DEVICE=""
+GLES_RENDERER=""
+
+for scenario in $SCENARIOS; do
+   run_scenario "$scenario"
+done
+
+COMMIT=$(git -C "$TOP" rev-parse HEAD 2> /dev/null)
+if git -C "$TOP" diff --quiet HEAD 2> /dev/null; then
+   DIRTY=false
+else
+   DIRTY=true
+fi
+CPU=$(sed -n 's/^model name[[:space:]]*: //p' /proc/cpuinfo | head -n 1)
+
+{
+   printf '{\n'
+   printf '  "date": "%s",\n' "$(date -u +%Y-%m-%dT%H:%M:%SZ)"
+   printf '  "commit": %s,\n' "$(json_string "$COMMIT")"
+   printf '  "dirty": %s,\n' "$DIRTY"
+   printf '  "cpu": %s,\n' "$(json_string "$CPU")"
+   printf '  "cpus": %s,\n' "$(nproc)"
+   printf '  "kernel": %s,\n' "$(json_string "$(uname -r)")"
+   printf '  "vulkan_device": %s,\n' "$(json_string "$VULKAN_DEVICE")"
+   printf '  "gles_renderer": %s,\n' "$(json_string "$GLES_RENDERER")"
+   printf '  "software": %s,\n' \
+      "$([ "$SOFTWARE" = yes ] && echo true || echo false)"
+   printf '  "warmup": %s,\n' "$WARMUP"
+   printf '  "repeats": %s,\n' "$REPEATS"
+   printf '  "scenarios": [\n'
+   cat "$RESULTS"
+   printf '\n  ]\n'
+   printf '}\n'
+} > "$OUTPUT"
+
+echo "Results written to $OUTPUT"
@@ -0,0 +1,232 @@
+/*
+ * Event loop over epoll, timerfd and eventfd
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "event-loop.h"
+
+#define TIMER_SOURCE 0
+#define WAKE_SOURCE  1
+
+/* The source's index is what epoll hands back, that of a removed one is
+ * reused
+ */
+static bool
+add_source (struct event_loop* loop,
+            int32_t fd,
+            EventLoopHandler handler,
+            void* data)
+{
+   uint32_t index = 0;
+   while (index < loop->sources_count && loop->sources[index].fd != -1)
+      index++;
+
+   if (index == EVENT_LOOP_MAX_SOURCES) {
+      printf ("Event loop: Error: No more than %u sources\n",
+              EVENT_LOOP_MAX_SOURCES);
+      return false;
+   }
+
+   struct epoll_event event = {
+      .events = EPOLLIN,
+      .data.u32 = index
+   };
+   if (epoll_ctl (loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+      printf ("Event loop: Error: Failed to watch fd %d: %s\n",
+              fd,
+              strerror (errno));
+      return false;
+   }
+
+   loop->sources[index] = (struct event_loop_source) {
+      fd, handler, data
+   };
+   if (index == loop->sources_count)
+      loop->sources_count++;
+
+   return true;
+}
+
+bool
+event_loop_init (struct event_loop* loop)
+{
+   memset (loop, 0, sizeof (struct event_loop));
+   loop->timer_fd = -1;
+   loop->wake_fd = -1;
+
+   loop->epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+   if (loop->epoll_fd == -1) {
+      printf ("Event loop: Error: Failed to create an epoll instance\n");
+      return false;
+   }
+
+   /* non-blocking, as both may be read after a wakeup already handled */
+   loop->timer_fd = timerfd_create (CLOCK_MONOTONIC,
+                                    TFD_NONBLOCK | TFD_CLOEXEC);
+   loop->wake_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+   if (loop->timer_fd == -1 || loop->wake_fd == -1) {
+      printf ("Event loop: Error: Failed to create the timer and wakeup "
+              "counter\n");
+      event_loop_finish (loop);
+      return false;
+   }
+
+   if (! add_source (loop, loop->timer_fd, NULL, NULL) ||
+       ! add_source (loop, loop->wake_fd, NULL, NULL)) {
+      event_loop_finish (loop);
+      return false;
+   }
+
+   return true;
+}
+
+bool
+event_loop_add_fd (struct event_loop* loop,
+                   int32_t fd,
+                   EventLoopHandler handler,
+                   void* data)
+{
+   return add_source (loop, fd, handler, data);
+}
+
+void
+event_loop_remove_fd (struct event_loop* loop, int32_t fd)
+{
+   /* the timer and the wakeup counter stay */
+   for (uint32_t i = WAKE_SOURCE + 1; i < loop->sources_count; i++) {
+      if (loop->sources[i].fd != fd)
+         continue;
+
+      epoll_ctl (loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+
+      /* events of it still to dispatch are skipped */
+      loop->sources[i] = (struct event_loop_source) { -1, NULL, NULL };
+      return;
+   }
+}
+
+bool
+event_loop_set_timer (struct event_loop* loop,
+                      uint64_t deadline,
+                      uint64_t interval,
+                      EventLoopHandler handler,
+                      void* data)
+{
+   struct itimerspec spec = {
+      .it_interval = {
+         interval / 1000000000, interval % 1000000000
+      },
+      .it_value = {
+         deadline / 1000000000, deadline % 1000000000
+      }
+   };
+
+   loop->sources[TIMER_SOURCE].handler = handler;
+   loop->sources[TIMER_SOURCE].data = data;
+   loop->timer_expirations = 0;
+
+   if (timerfd_settime (loop->timer_fd,
+                        TFD_TIMER_ABSTIME,
+                        &spec,
+                        NULL) == -1) {
+      printf ("Event loop: Error: Failed to set the timer: %s\n",
+              strerror (errno));
+      return false;
+   }
+
+   return true;
+}
+
+void
+event_loop_set_wake (struct event_loop* loop,
+                     EventLoopHandler handler,
+                     void* data)
+{
+   loop->sources[WAKE_SOURCE].handler = handler;
+   loop->sources[WAKE_SOURCE].data = data;
+}
+
+void
+event_loop_wake (struct event_loop* loop)
+{
+   uint64_t one = 1;
+   ssize_t size;
+
+   /* write() is safe in signal handlers, and only fails once the counter
+    * would overflow, which is just as good a wakeup
+    */
+   size = write (loop->wake_fd, &one, sizeof (one));
+   (void) size;
+}
+
+bool
+event_loop_dispatch (struct event_loop* loop, int32_t timeout)
+{
+   struct epoll_event events[EVENT_LOOP_MAX_SOURCES];
+
+   int32_t count = epoll_wait (loop->epoll_fd,
+                               events,
+                               EVENT_LOOP_MAX_SOURCES,
+                               timeout);
+   if (count == -1) {
+      if (errno == EINTR)
+         return true;
+
+      printf ("Event loop: Error: Failed to wait for events: %s\n",
+              strerror (errno));
+      return false;
+   }
+
+   for (int32_t i = 0; i < count; i++) {
+      uint32_t index = events[i].data.u32;
+      const struct event_loop_source* source = &loop->sources[index];
+
+      if (index == TIMER_SOURCE || index == WAKE_SOURCE) {
+         uint64_t value;
+
+         /* nothing to read: another handler got to it first */
+         if (read (source->fd, &value, sizeof (value)) != sizeof (value))
+            continue;
+
+         if (index == TIMER_SOURCE)
+            loop->timer_expirations = value;
+      }
+
+      if (source->handler != NULL && ! source->handler (source->data))
+         return false;
+   }
+
+   return true;
+}
+
+void
+event_loop_finish (struct event_loop* loop)
+{
+   if (loop->wake_fd != -1)
+      close (loop->wake_fd);
+   if (loop->timer_fd != -1)
+      close (loop->timer_fd);
+   if (loop->epoll_fd != -1)
+      close (loop->epoll_fd);
+
+   memset (loop, 0, sizeof (struct event_loop));
+   loop->epoll_fd = -1;
+   loop->timer_fd = -1;
+   loop->wake_fd = -1;
+}
@@ -0,0 +1,93 @@
+/*
+ * Event loop: a thread sleeps in epoll until one of its sources is ready,
+ * instead of spinning or blocking on a single one of them.
+ *
+ * Sources are file descriptors added with a handler, typically the window
+ * system connection (see wsi_get_fd()). Two more come with every loop: a
+ * timer, to wake up at frame deadlines, and a wakeup counter (an eventfd)
+ * that other threads (e.g, done compiling pipelines or uploading data) or
+ * signal handlers bump to get the loop to look at their results.
+ *
+ * Handlers run from event_loop_dispatch(), on its thread. The timer and the
+ * wakeup counter are read (and so reset) before their handler is called.
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define EVENT_LOOP_MAX_SOURCES 8
+
+/* Returns false to have event_loop_dispatch() return false, e.g. to quit */
+typedef bool (* EventLoopHandler) (void* data);
+
+struct event_loop_source {
+   int32_t fd;
+   EventLoopHandler handler;
+   void* data;
+};
+
+struct event_loop {
+   int32_t epoll_fd;
+   int32_t timer_fd;
+   int32_t wake_fd;
+
+   /* the timer and the wakeup counter are the first two */
+   struct event_loop_source sources[EVENT_LOOP_MAX_SOURCES];
+   uint32_t sources_count;
+
+   /* deadlines passed since the timer was last handled, more than 1 means
+    * frames were missed
+    */
+   uint64_t timer_expirations;
+};
+
+bool event_loop_init        (struct event_loop* loop);
+
+/* Calls 'handler' whenever 'fd' is readable */
+bool event_loop_add_fd      (struct event_loop* loop,
+                             int32_t fd,
+                             EventLoopHandler handler,
+                             void* data);
+
+/* Stops watching 'fd', e.g. once it hung up: it would stay readable */
+void event_loop_remove_fd   (struct event_loop* loop, int32_t fd);
+
+/* Calls 'handler' at 'deadline' (CLOCK_MONOTONIC, in nanoseconds, see
+ * wsi_get_time()), then every 'interval' nanoseconds if not 0. Deadlines are
+ * absolute, so that late handlers don't make the next ones drift. A
+ * 'deadline' of 0 stops the timer.
+ */
+bool event_loop_set_timer   (struct event_loop* loop,
+                             uint64_t deadline,
+                             uint64_t interval,
+                             EventLoopHandler handler,
+                             void* data);
+
+/* Calls 'handler' after event_loop_wake() */
+void event_loop_set_wake    (struct event_loop* loop,
+                             EventLoopHandler handler,
+                             void* data);
+
+/* Wakes the loop up, from any thread or a signal handler. Wakeups until the
+ * loop gets to them are handled once.
+ */
+void event_loop_wake        (struct event_loop* loop);
+
+/* Waits up to 'timeout' milliseconds (-1 for ever, 0 to only check) for
+ * sources to be ready, and calls their handlers. Returns false if one of
+ * them did, or if waiting failed. A signal interrupts the wait, and then
+ * nothing is handled.
+ */
+bool event_loop_dispatch    (struct event_loop* loop, int32_t timeout);
+
+void event_loop_finish      (struct event_loop* loop);
@@ -0,0 +1,268 @@
+/*
+ * GLES compute autotuner
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "gles-autotune.h"
+
+#define MAX_ENTRIES     128
+#define MAX_KERNEL_NAME 64
+
+struct entry {
+   char kernel[MAX_KERNEL_NAME];
+   struct gles_autotune_config cfg;
+};
+
+/* the file name is derived from the renderer string, e.g,
+ * 'autotune-llvmpipe-llvm-15-0-6-256-bits.txt'
+ */
+static bool
+get_path (const struct gles_compute* gc, char* path, size_t len, bool create)
+{
+   char dir[512];
+   const char* cache = getenv ("XDG_CACHE_HOME");
+   const char* home = getenv ("HOME");
+
+   if (cache != NULL && cache[0] != '\0')
+      snprintf (dir, sizeof (dir), "%s/gpu-playground", cache);
+   else if (home != NULL)
+      snprintf (dir, sizeof (dir), "%s/.cache/gpu-playground", home);
+   else
+      return false;
+
+   if (create) {
+      char parent[512];
+      snprintf (parent, sizeof (parent), "%s", dir);
+      *strrchr (parent, '/') = '\0';
+      mkdir (parent, 0755);
+      if (mkdir (dir, 0755) != 0 && errno != EEXIST)
+         return false;
+   }
+
+   char device[128];
+   size_t n = 0;
+   bool dash = false;
+   for (const char* c = gc->renderer; *c != '\0' && n < sizeof (device) - 1; c++) {
+      if ((*c >= 'a' && *c <= 'z') || (*c >= '0' && *c <= '9')) {
+         device[n++] = *c;
+         dash = false;
+      } else if (*c >= 'A' && *c <= 'Z') {
+         device[n++] = *c - 'A' + 'a';
+         dash = false;
+      } else if (! dash && n > 0) {
+         device[n++] = '-';
+         dash = true;
+      }
+   }
+   if (dash)
+      n--;
+   device[n] = '\0';
+
+   snprintf (path, len, "%s/autotune-%s.txt", dir, device);
+
+   return true;
+}
+
+static uint32_t
+read_entries (const struct gles_compute* gc, struct entry* entries)
+{
+   char path[768];
+   uint32_t count = 0;
+
+   if (! get_path (gc, path, sizeof (path), false))
+      return 0;
+
+   FILE* f = fopen (path, "r");
+   if (f == NULL)
+      return 0;
+
+   /* lines of 'kernel local_size_x local_size_y local_size_z tile_size' */
+   char line[256];
+   while (count < MAX_ENTRIES && fgets (line, sizeof (line), f) != NULL) {
+      struct entry* e = &entries[count];
+
+      if (line[0] == '#')
+         continue;
+      if (sscanf (line, "%63s %u %u %u %u",
+                  e->kernel,
+                  &e->cfg.local_size[0],
+                  &e->cfg.local_size[1],
+                  &e->cfg.local_size[2],
+                  &e->cfg.tile_size) == 5)
+         count++;
+   }
+   fclose (f);
+
+   return count;
+}
+
+bool
+gles_autotune_load (const struct gles_compute* gc,
+                    const char* kernel,
+                    struct gles_autotune_config* cfg)
+{
+   struct entry entries[MAX_ENTRIES];
+   uint32_t count = read_entries (gc, entries);
+
+   for (uint32_t i = 0; i < count; i++) {
+      if (strcmp (entries[i].kernel, kernel) == 0) {
+         *cfg = entries[i].cfg;
+         return true;
+      }
+   }
+
+   return false;
+}
+
+bool
+gles_autotune_store (const struct gles_compute* gc,
+                     const char* kernel,
+                     const struct gles_autotune_config* cfg)
+{
+   struct entry entries[MAX_ENTRIES];
+   uint32_t count = read_entries (gc, entries);
+   char path[768];
+
+   if (strlen (kernel) >= MAX_KERNEL_NAME || strchr (kernel, ' ') != NULL)
+      return false;
+
+   uint32_t i;
+   for (i = 0; i < count; i++) {
+      if (strcmp (entries[i].kernel, kernel) == 0)
+         break;
+   }
+   if (i == MAX_ENTRIES)
+      return false;
+   if (i == count) {
+      snprintf (entries[i].kernel, MAX_KERNEL_NAME, "%s", kernel);
+      count++;
+   }
+   entries[i].cfg = *cfg;
+
+   if (! get_path (gc, path, sizeof (path), true))
+      return false;
+
+   FILE* f = fopen (path, "w");
+   if (f == NULL) {
+      printf ("Autotune: Error: Failed to write '%s'\n", path);
+      return false;
+   }
+
+   fprintf (f, "# %s\n", gc->renderer);
+   fprintf (f, "# kernel local_size_x local_size_y local_size_z tile_size\n");
+   for (i = 0; i < count; i++) {
+      fprintf (f, "%s %u %u %u %u\n",
+               entries[i].kernel,
+               entries[i].cfg.local_size[0],
+               entries[i].cfg.local_size[1],
+               entries[i].cfg.local_size[2],
+               entries[i].cfg.tile_size);
+   }
+   fclose (f);
+
+   return true;
+}
+
+static uint32_t
+clamp_pow2 (uint32_t value, uint32_t max)
+{
+   uint32_t p = 1;
+
+   while (p * 2 <= value && p * 2 <= max)
+      p *= 2;
+
+   return p;
+}
+
+bool
+gles_autotune_run (const struct gles_compute* gc,
+                   const char* kernel,
+                   const struct gles_autotune_space* space,
+                   GlesAutotuneRun run,
+                   void* data,
+                   struct gles_autotune_config* best)
+{
+   uint32_t min[3], max[3];
+   uint64_t best_ns = 0;
+   uint32_t tried = 0;
+
+   for (unsigned i = 0; i < 3; i++) {
+      uint32_t limit = (uint32_t) gc->max_work_group_size[i];
+      max[i] = clamp_pow2 (space->max_local_size[i] > 0 ?
+                           space->max_local_size[i] : 1,
+                           limit);
+      min[i] = clamp_pow2 (space->min_local_size[i] > 0 ?
+                           space->min_local_size[i] : 1,
+                           max[i]);
+   }
+
+   printf ("Autotune: %s\n", kernel);
+
+   for (uint32_t z = min[2]; z <= max[2]; z *= 2)
+   for (uint32_t y = min[1]; y <= max[1]; y *= 2)
+   for (uint32_t x = min[0]; x <= max[0]; x *= 2) {
+      if (x * y * z > (uint32_t) gc->max_invocations)
+         continue;
+
+      for (uint32_t t = 0; t < space->num_tile_sizes; t++) {
+         struct gles_autotune_config cfg = {
+            .local_size = { x, y, z },
+            .tile_size = space->tile_sizes[t]
+         };
+
+         if (space->shared_size != NULL &&
+             space->shared_size (&cfg, data) >
+             (uint32_t) gc->max_shared_memory_size)
+            continue;
+
+         uint64_t ns = run (&cfg, data);
+         tried++;
+         if (ns == 0) {
+            printf ("   local size (%u, %u, %u), tile %u: failed\n",
+                    x, y, z, cfg.tile_size);
+            continue;
+         }
+         printf ("   local size (%u, %u, %u), tile %u: %.1f us\n",
+                 x, y, z, cfg.tile_size, ns / 1000.0);
+
+         if (best_ns == 0 || ns < best_ns) {
+            best_ns = ns;
+            *best = cfg;
+         }
+      }
+   }
+
+   if (best_ns == 0) {
+      printf ("Autotune: Error: None of %u variants of '%s' worked\n",
+              tried, kernel);
+      return false;
+   }
+
+   printf ("Autotune: %s: best local size (%u, %u, %u), tile %u\n",
+           kernel,
+           best->local_size[0],
+           best->local_size[1],
+           best->local_size[2],
+           best->tile_size);
+
+   /* still tuned for this run, if not the next ones */
+   if (! gles_autotune_store (gc, kernel, best))
+      printf ("Autotune: Warning: Failed to cache the configuration of "
+              "'%s'\n", kernel);
+
+   return true;
+}
@@ -0,0 +1,76 @@
+/*
+ * GLES compute autotuner: times the variants of a kernel over the legal work
+ * group sizes and tile sizes of the device, and persists the fastest one per
+ * device so that kernels can pick it up at load time.
+ *
+ * Tuned configurations are stored as plain text, one kernel per line, in
+ * '$XDG_CACHE_HOME/gpu-playground/autotune-<renderer>.txt' (or under
+ * '~/.cache' if XDG_CACHE_HOME is unset).
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "gles-compute.h"
+
+#define GLES_AUTOTUNE_MAX_TILE_SIZES 8
+
+struct gles_autotune_config {
+   uint32_t local_size[3];
+   uint32_t tile_size;
+};
+
+/* Builds and times one variant, returning nanoseconds per run, or 0 if the
+ * variant can't be used (e.g, it failed to compile or gave a wrong result).
+ */
+typedef uint64_t (* GlesAutotuneRun)        (const struct gles_autotune_config* cfg,
+                                             void* data);
+
+/* Shared memory, in bytes, a variant needs */
+typedef uint32_t (* GlesAutotuneSharedSize) (const struct gles_autotune_config* cfg,
+                                             void* data);
+
+/* The variants to try: every power of two between 'min_local_size' and
+ * 'max_local_size' on each axis (clamped to the device limits), combined with
+ * every tile size.
+ */
+struct gles_autotune_space {
+   uint32_t min_local_size[3];
+   uint32_t max_local_size[3];
+
+   uint32_t tile_sizes[GLES_AUTOTUNE_MAX_TILE_SIZES];
+   uint32_t num_tile_sizes;
+
+   GlesAutotuneSharedSize shared_size;
+};
+
+/* Looks up the tuned configuration of 'kernel' for the current device.
+ * Returns false (leaving 'cfg' untouched) if it was never tuned.
+ */
+bool gles_autotune_load  (const struct gles_compute* gc,
+                          const char* kernel,
+                          struct gles_autotune_config* cfg);
+
+bool gles_autotune_store (const struct gles_compute* gc,
+                          const char* kernel,
+                          const struct gles_autotune_config* cfg);
+
+/* Tries all legal variants in 'space', and stores the fastest one as the
+ * tuned configuration of 'kernel' (only warning if the cache can't be
+ * written). Returns false if no variant worked.
+ */
+bool gles_autotune_run   (const struct gles_compute* gc,
+                          const char* kernel,
+                          const struct gles_autotune_space* space,
+                          GlesAutotuneRun run,
+                          void* data,
+                          struct gles_autotune_config* best);
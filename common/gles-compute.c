@@ -0,0 +1,323 @@
+/*
+ * GLES compute helper
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <gbm.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "gles-compute.h"
+
+/* Prepended to every compute shader, after the '#version' line. Work groups
+ * are addressed linearly through GROUP_ID so that large 1D grids can be
+ * folded into 2D dispatches.
+ */
+#define SHADER_PRELUDE                                                  \
+   "#version 310 es\n"                                                  \
+   "precision highp float;\n"                                           \
+   "precision highp int;\n"                                             \
+   "#define GROUP_ID (gl_WorkGroupID.y * gl_NumWorkGroups.x + "         \
+   "gl_WorkGroupID.x)\n"
+
+static char*
+load_text_file (const char* filename)
+{
+   FILE* f = fopen (filename, "r");
+   if (f == NULL)
+      return NULL;
+
+   char* data = NULL;
+   size_t size = 0;
+   size_t read_size;
+   char buf[1024];
+
+   while ((read_size = fread (buf, 1, sizeof (buf), f)) > 0) {
+      char* new_data = realloc (data, size + read_size + 1);
+      if (new_data == NULL) {
+         free (data);
+         fclose (f);
+         return NULL;
+      }
+      data = new_data;
+
+      memcpy (data + size, buf, read_size);
+      size += read_size;
+   }
+   fclose (f);
+
+   if (data != NULL)
+      data[size] = '\0';
+
+   return data;
+}
+
+static bool
+has_extension (const char* extensions, const char* name)
+{
+   size_t len = strlen (name);
+   const char* p = extensions;
+
+   while (p != NULL && (p = strstr (p, name)) != NULL) {
+      if ((p == extensions || p[-1] == ' ') &&
+          (p[len] == ' ' || p[len] == '\0'))
+         return true;
+      p += len;
+   }
+
+   return false;
+}
+
+bool
+gles_compute_init (struct gles_compute* gc, const char* render_node)
+{
+   memset (gc, 0, sizeof (struct gles_compute));
+   gc->fd = -1;
+
+   if (render_node == NULL)
+      render_node = GLES_COMPUTE_DEFAULT_RENDER_NODE;
+
+   /* setup EGL from the GBM device of the render node, if any */
+   gc->fd = open (render_node, O_RDWR);
+   if (gc->fd >= 0) {
+      gc->gbm = gbm_create_device (gc->fd);
+      if (gc->gbm == NULL) {
+         printf ("GBM: Error: Failed to create device for %s\n", render_node);
+         return false;
+      }
+      gc->display = eglGetPlatformDisplay (EGL_PLATFORM_GBM_MESA,
+                                           gc->gbm,
+                                           NULL);
+   } else {
+      const char* client_ext = eglQueryString (EGL_NO_DISPLAY, EGL_EXTENSIONS);
+      if (! has_extension (client_ext, "EGL_MESA_platform_surfaceless")) {
+         printf ("EGL: Error: Failed to open %s\n", render_node);
+         return false;
+      }
+      printf ("EGL: %s not available, using surfaceless platform\n",
+              render_node);
+      gc->display = eglGetPlatformDisplay (EGL_PLATFORM_SURFACELESS_MESA,
+                                           EGL_DEFAULT_DISPLAY,
+                                           NULL);
+   }
+
+   if (gc->display == EGL_NO_DISPLAY ||
+       ! eglInitialize (gc->display, NULL, NULL)) {
+      printf ("EGL: Error: Failed to initialize display\n");
+      return false;
+   }
+
+   const char* egl_ext = eglQueryString (gc->display, EGL_EXTENSIONS);
+   if (! has_extension (egl_ext, "EGL_KHR_create_context") ||
+       ! has_extension (egl_ext, "EGL_KHR_surfaceless_context")) {
+      printf ("EGL: Error: Surfaceless contexts not supported\n");
+      return false;
+   }
+
+   /* the surfaceless platform exposes no configs, but we don't need one */
+   gc->config = EGL_NO_CONFIG_KHR;
+   if (! has_extension (egl_ext, "EGL_KHR_no_config_context")) {
+      static const EGLint config_attribs[] = {
+         EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT_KHR,
+         EGL_NONE
+      };
+      EGLint count = 0;
+
+      if (! eglChooseConfig (gc->display, config_attribs, &gc->config, 1,
+                             &count) || count == 0) {
+         printf ("EGL: Error: No suitable config found\n");
+         return false;
+      }
+   }
+
+   if (! eglBindAPI (EGL_OPENGL_ES_API)) {
+      printf ("EGL: Error: Failed to bind the GLES API\n");
+      return false;
+   }
+
+   gc->context = gles_compute_create_shared_context (gc);
+   if (gc->context == EGL_NO_CONTEXT) {
+      printf ("EGL: Error: Failed to create a GLES 3.1 context\n");
+      return false;
+   }
+
+   if (! eglMakeCurrent (gc->display,
+                         EGL_NO_SURFACE,
+                         EGL_NO_SURFACE,
+                         gc->context)) {
+      printf ("EGL: Error: Failed to make context current\n");
+      return false;
+   }
+
+   /* query compute limits */
+   for (unsigned i = 0; i < 3; i++) {
+      glGetIntegeri_v (GL_MAX_COMPUTE_WORK_GROUP_COUNT,
+                       i,
+                       &gc->max_work_group_count[i]);
+      glGetIntegeri_v (GL_MAX_COMPUTE_WORK_GROUP_SIZE,
+                       i,
+                       &gc->max_work_group_size[i]);
+   }
+   glGetIntegerv (GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &gc->max_invocations);
+   glGetIntegerv (GL_MAX_COMPUTE_SHARED_MEMORY_SIZE,
+                  &gc->max_shared_memory_size);
+   glGetInteger64v (GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &gc->max_ssbo_size);
+
+   gc->renderer = (const char*) glGetString (GL_RENDERER);
+
+   return true;
+}
+
+EGLContext
+gles_compute_create_shared_context (struct gles_compute* gc)
+{
+   static const EGLint attribs[] = {
+      EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+      EGL_CONTEXT_MINOR_VERSION_KHR, 1,
+      EGL_NONE
+   };
+
+   return eglCreateContext (gc->display,
+                            gc->config,
+                            gc->context, /* EGL_NO_CONTEXT the first time */
+                            attribs);
+}
+
+bool
+gles_compute_has_extension (const char* name)
+{
+   GLint count = 0;
+
+   glGetIntegerv (GL_NUM_EXTENSIONS, &count);
+   for (GLint i = 0; i < count; i++) {
+      const char* ext = (const char*) glGetStringi (GL_EXTENSIONS, i);
+      if (strcmp (ext, name) == 0)
+         return true;
+   }
+
+   return false;
+}
+
+GLuint
+gles_compute_create_program (const char* source, const char* defines)
+{
+   GLint status;
+   char log[4096];
+
+   GLuint shader = glCreateShader (GL_COMPUTE_SHADER);
+
+   const char* sources[3] = {
+      SHADER_PRELUDE,
+      defines != NULL ? defines : "",
+      source
+   };
+   glShaderSource (shader, 3, sources, NULL);
+   glCompileShader (shader);
+
+   glGetShaderiv (shader, GL_COMPILE_STATUS, &status);
+   if (! status) {
+      glGetShaderInfoLog (shader, sizeof (log), NULL, log);
+      printf ("GLES: Error: Failed to compile compute shader:\n%s\n", log);
+      glDeleteShader (shader);
+      return 0;
+   }
+
+   GLuint program = glCreateProgram ();
+   glAttachShader (program, shader);
+   glLinkProgram (program);
+   glDeleteShader (shader);
+
+   glGetProgramiv (program, GL_LINK_STATUS, &status);
+   if (! status) {
+      glGetProgramInfoLog (program, sizeof (log), NULL, log);
+      printf ("GLES: Error: Failed to link compute program:\n%s\n", log);
+      glDeleteProgram (program);
+      return 0;
+   }
+
+   return program;
+}
+
+GLuint
+gles_compute_load_program (const char* filename, const char* defines)
+{
+   char* source = load_text_file (filename);
+   if (source == NULL) {
+      printf ("Error: Failed to load shader source from '%s'\n", filename);
+      return 0;
+   }
+
+   GLuint program = gles_compute_create_program (source, defines);
+   if (program == 0)
+      printf ("Error: Failed to create program from '%s'\n", filename);
+   free (source);
+
+   return program;
+}
+
+void
+gles_compute_dispatch_1d (const struct gles_compute* gc, uint32_t groups)
+{
+   uint32_t max_x = (uint32_t) gc->max_work_group_count[0];
+
+   if (groups <= max_x) {
+      glDispatchCompute (groups, 1, 1);
+   } else {
+      /* GROUP_ID spans x * y >= groups, the tail is discarded by the shader */
+      uint32_t y = (groups + max_x - 1) / max_x;
+      uint32_t x = (groups + y - 1) / y;
+      glDispatchCompute (x, y, 1);
+   }
+}
+
+void
+gles_compute_wait (void)
+{
+   GLsync fence = glFenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+   glClientWaitSync (fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+   glDeleteSync (fence);
+}
+
+uint64_t
+gles_compute_get_time_ns (void)
+{
+   struct timespec ts;
+
+   clock_gettime (CLOCK_MONOTONIC, &ts);
+   return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void
+gles_compute_finish (struct gles_compute* gc)
+{
+   if (gc->display != EGL_NO_DISPLAY) {
+      eglMakeCurrent (gc->display,
+                      EGL_NO_SURFACE,
+                      EGL_NO_SURFACE,
+                      EGL_NO_CONTEXT);
+      if (gc->context != EGL_NO_CONTEXT)
+         eglDestroyContext (gc->display, gc->context);
+      eglTerminate (gc->display);
+   }
+
+   if (gc->gbm != NULL)
+      gbm_device_destroy (gc->gbm);
+
+   if (gc->fd >= 0)
+      close (gc->fd);
+
+   memset (gc, 0, sizeof (struct gles_compute));
+   gc->fd = -1;
+}
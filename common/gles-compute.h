@@ -0,0 +1,77 @@
+/*
+ * GLES compute helper: window-less EGL + GLES 3.1 context on a DRM render
+ * node, plus a few utilities shared by the compute examples.
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES3/gl31.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define GLES_COMPUTE_DEFAULT_RENDER_NODE "/dev/dri/renderD128"
+
+struct gles_compute {
+   int32_t fd;
+   struct gbm_device* gbm;
+
+   EGLDisplay display;
+   EGLConfig config;
+   EGLContext context;
+
+   /* compute limits, queried once at init */
+   GLint max_work_group_count[3];
+   GLint max_work_group_size[3];
+   GLint max_invocations;
+   GLint max_shared_memory_size;
+   GLint64 max_ssbo_size;
+
+   const char* renderer;
+};
+
+/* Opens 'render_node' (or the default one if NULL) and makes a GLES 3.1
+ * context current on the calling thread. If the render node cannot be opened,
+ * falls back to Mesa's surfaceless platform (e.g, llvmpipe on a headless box).
+ */
+bool       gles_compute_init                  (struct gles_compute* gc,
+                                               const char* render_node);
+
+/* Creates a new context sharing objects with the main one. It is not made
+ * current.
+ */
+EGLContext gles_compute_create_shared_context (struct gles_compute* gc);
+
+bool       gles_compute_has_extension         (const char* name);
+
+/* Compiles and links a compute program. '#version' and 'defines' (a string
+ * of '#define' lines, or NULL) are prepended to the source.
+ */
+GLuint     gles_compute_create_program        (const char* source,
+                                               const char* defines);
+
+GLuint     gles_compute_load_program          (const char* filename,
+                                               const char* defines);
+
+/* Dispatches a 1D grid of 'groups' work groups, folding it into 2D when it
+ * exceeds GL_MAX_COMPUTE_WORK_GROUP_COUNT. Shaders use GROUP_ID (see the
+ * prelude in gles-compute.c) and must ignore groups >= the real count.
+ */
+void       gles_compute_dispatch_1d           (const struct gles_compute* gc,
+                                               uint32_t groups);
+
+/* Blocks until all previously issued GL commands completed */
+void       gles_compute_wait                  (void);
+
+uint64_t   gles_compute_get_time_ns           (void);
+
+void       gles_compute_finish                (struct gles_compute* gc);
@@ -0,0 +1,170 @@
+/*
+ * GLES compute worker pool
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include "gles-pool.h"
+
+static void*
+worker_main (void* data)
+{
+   struct gles_pool_worker* worker = data;
+   struct gles_pool* pool = worker->pool;
+
+   bool current = eglMakeCurrent (pool->gc->display,
+                                  EGL_NO_SURFACE,
+                                  EGL_NO_SURFACE,
+                                  worker->context);
+   if (! current)
+      printf ("Pool: Error: Failed to make context of worker %u current\n",
+              worker->index);
+
+   pthread_mutex_lock (&pool->lock);
+   pool->started++;
+   pool->failed |= ! current;
+   pthread_cond_broadcast (&pool->done_cond);
+
+   while (true) {
+      while (pool->queued == 0 && ! pool->quit)
+         pthread_cond_wait (&pool->job_cond, &pool->lock);
+      if (pool->queued == 0)
+         break;
+
+      struct gles_pool_job job = pool->queue[pool->head];
+      pool->head = (pool->head + 1) % GLES_POOL_MAX_JOBS;
+      pool->queued--;
+      pthread_cond_broadcast (&pool->done_cond);
+      pthread_mutex_unlock (&pool->lock);
+
+      job.run (worker->index, job.data);
+
+      /* only this worker's commands are waited on, others keep going */
+      uint64_t start = gles_compute_get_time_ns ();
+      gles_compute_wait ();
+      worker->wait_ns += gles_compute_get_time_ns () - start;
+      worker->jobs++;
+
+      pthread_mutex_lock (&pool->lock);
+      pool->pending--;
+      pthread_cond_broadcast (&pool->done_cond);
+   }
+   pthread_mutex_unlock (&pool->lock);
+
+   if (current) {
+      eglMakeCurrent (pool->gc->display,
+                      EGL_NO_SURFACE,
+                      EGL_NO_SURFACE,
+                      EGL_NO_CONTEXT);
+   }
+   eglReleaseThread ();
+
+   return NULL;
+}
+
+bool
+gles_pool_init (struct gles_pool* pool,
+                struct gles_compute* gc,
+                uint32_t num_threads)
+{
+   memset (pool, 0, sizeof (struct gles_pool));
+   pool->gc = gc;
+
+   if (num_threads == 0 || num_threads > GLES_POOL_MAX_THREADS) {
+      printf ("Pool: Error: Invalid number of threads %u\n", num_threads);
+      return false;
+   }
+
+   pthread_mutex_init (&pool->lock, NULL);
+   pthread_cond_init (&pool->job_cond, NULL);
+   pthread_cond_init (&pool->done_cond, NULL);
+
+   for (uint32_t i = 0; i < num_threads; i++) {
+      struct gles_pool_worker* worker = &pool->workers[i];
+
+      worker->pool = pool;
+      worker->index = i;
+      worker->context = gles_compute_create_shared_context (gc);
+      if (worker->context == EGL_NO_CONTEXT) {
+         printf ("Pool: Error: Failed to create shared context %u\n", i);
+         break;
+      }
+
+      if (pthread_create (&worker->thread, NULL, worker_main, worker) != 0) {
+         printf ("Pool: Error: Failed to create worker thread %u\n", i);
+         eglDestroyContext (gc->display, worker->context);
+         break;
+      }
+      pool->num_workers++;
+   }
+
+   pthread_mutex_lock (&pool->lock);
+   while (pool->started < pool->num_workers)
+      pthread_cond_wait (&pool->done_cond, &pool->lock);
+   bool failed = pool->failed;
+   pthread_mutex_unlock (&pool->lock);
+
+   if (failed || pool->num_workers < num_threads) {
+      gles_pool_finish (pool);
+      return false;
+   }
+
+   return true;
+}
+
+void
+gles_pool_submit (struct gles_pool* pool, GlesPoolJob run, void* data)
+{
+   pthread_mutex_lock (&pool->lock);
+
+   while (pool->queued == GLES_POOL_MAX_JOBS)
+      pthread_cond_wait (&pool->done_cond, &pool->lock);
+
+   uint32_t tail = (pool->head + pool->queued) % GLES_POOL_MAX_JOBS;
+   pool->queue[tail].run = run;
+   pool->queue[tail].data = data;
+   pool->queued++;
+   pool->pending++;
+
+   pthread_cond_signal (&pool->job_cond);
+   pthread_mutex_unlock (&pool->lock);
+}
+
+void
+gles_pool_wait (struct gles_pool* pool)
+{
+   pthread_mutex_lock (&pool->lock);
+   while (pool->pending > 0)
+      pthread_cond_wait (&pool->done_cond, &pool->lock);
+   pthread_mutex_unlock (&pool->lock);
+}
+
+void
+gles_pool_finish (struct gles_pool* pool)
+{
+   pthread_mutex_lock (&pool->lock);
+   pool->quit = true;
+   pthread_cond_broadcast (&pool->job_cond);
+   pthread_mutex_unlock (&pool->lock);
+
+   for (uint32_t i = 0; i < pool->num_workers; i++) {
+      pthread_join (pool->workers[i].thread, NULL);
+      eglDestroyContext (pool->gc->display, pool->workers[i].context);
+   }
+
+   pthread_cond_destroy (&pool->done_cond);
+   pthread_cond_destroy (&pool->job_cond);
+   pthread_mutex_destroy (&pool->lock);
+
+   memset (pool, 0, sizeof (struct gles_pool));
+}
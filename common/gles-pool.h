@@ -0,0 +1,86 @@
+/*
+ * GLES compute worker pool: a set of threads, each owning an EGL context
+ * created with the main context of a 'struct gles_compute' as share context.
+ * Programs and buffers are therefore visible from every worker, while
+ * bindings, the current program and fences stay per-thread.
+ *
+ * Jobs are queued in order and picked by whichever worker is idle. After a
+ * job returns, its worker fences the commands it issued and waits on that
+ * fence, so a job is complete (and its results visible to every context)
+ * once gles_pool_wait() returns. Other workers keep submitting meanwhile,
+ * which is what lets the driver overlap independent submissions.
+ *
+ * Objects shared with the workers must be fully created on the main context
+ * (e.g, followed by gles_compute_wait()) before the jobs using them are
+ * submitted. Program uniforms are shared state too: jobs must not set them
+ * concurrently.
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "gles-compute.h"
+
+#define GLES_POOL_MAX_THREADS 32
+#define GLES_POOL_MAX_JOBS    256
+
+/* Runs on worker 'thread', with its context current */
+typedef void (* GlesPoolJob) (uint32_t thread, void* data);
+
+struct gles_pool_job {
+   GlesPoolJob run;
+   void* data;
+};
+
+struct gles_pool_worker {
+   struct gles_pool* pool;
+   uint32_t index;
+   pthread_t thread;
+   EGLContext context;
+
+   /* stats, only touched by the worker until gles_pool_wait() returns */
+   uint32_t jobs;
+   uint64_t wait_ns;
+};
+
+struct gles_pool {
+   struct gles_compute* gc;
+
+   uint32_t num_workers;
+   struct gles_pool_worker workers[GLES_POOL_MAX_THREADS];
+
+   pthread_mutex_t lock;
+   pthread_cond_t job_cond;    /* a job was queued, or quit */
+   pthread_cond_t done_cond;   /* a job completed, or room in the queue */
+
+   struct gles_pool_job queue[GLES_POOL_MAX_JOBS];
+   uint32_t head;
+   uint32_t queued;
+   uint32_t pending;           /* queued + running */
+   uint32_t started;           /* workers done making their context current */
+   bool failed;
+   bool quit;
+};
+
+/* Creates 'num_threads' workers, each with its own shared context */
+bool gles_pool_init   (struct gles_pool* pool,
+                       struct gles_compute* gc,
+                       uint32_t num_threads);
+
+/* Queues a job, blocking while the queue is full */
+void gles_pool_submit (struct gles_pool* pool, GlesPoolJob run, void* data);
+
+/* Blocks until all submitted jobs completed on the GPU */
+void gles_pool_wait   (struct gles_pool* pool);
+
+void gles_pool_finish (struct gles_pool* pool);
@@ -0,0 +1,167 @@
+/*
+ * GLES streaming ring buffer
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gles-ring.h"
+#include <GLES2/gl2ext.h>
+
+bool
+gles_ring_init (struct gles_ring* ring,
+                size_t region_size,
+                uint32_t num_regions,
+                bool persistent)
+{
+   memset (ring, 0, sizeof (struct gles_ring));
+
+   if (num_regions == 0 || num_regions > GLES_RING_MAX_REGIONS) {
+      printf ("Ring: Error: Invalid number of regions %u\n", num_regions);
+      return false;
+   }
+
+   /* every region must be bindable with glBindBufferRange() */
+   GLint alignment = 1;
+   glGetIntegerv (GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+   region_size = (region_size + alignment - 1) / alignment * alignment;
+
+   ring->num_regions = num_regions;
+   ring->region_size = region_size;
+
+   size_t size = region_size * num_regions;
+
+   PFNGLBUFFERSTORAGEEXTPROC BufferStorageEXT = NULL;
+   if (persistent && gles_compute_has_extension ("GL_EXT_buffer_storage")) {
+      BufferStorageEXT = (PFNGLBUFFERSTORAGEEXTPROC)
+         eglGetProcAddress ("glBufferStorageEXT");
+   }
+
+   glGenBuffers (1, &ring->buffer);
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, ring->buffer);
+
+   if (BufferStorageEXT != NULL) {
+      const GLbitfield flags = GL_MAP_WRITE_BIT |
+         GL_MAP_PERSISTENT_BIT_EXT |
+         GL_MAP_COHERENT_BIT_EXT;
+
+      BufferStorageEXT (GL_SHADER_STORAGE_BUFFER, size, NULL, flags);
+      ring->map = glMapBufferRange (GL_SHADER_STORAGE_BUFFER, 0, size, flags);
+      if (ring->map == NULL) {
+         printf ("Ring: Error: Failed to map the buffer persistently\n");
+         gles_ring_finish (ring);
+         return false;
+      }
+      ring->persistent = true;
+   } else {
+      if (persistent)
+         printf ("Ring: GL_EXT_buffer_storage not supported, "
+                 "falling back to glBufferSubData\n");
+
+      glBufferData (GL_SHADER_STORAGE_BUFFER, size, NULL, GL_STREAM_DRAW);
+      ring->map = malloc (size);
+      if (ring->map == NULL) {
+         gles_ring_finish (ring);
+         return false;
+      }
+   }
+
+   if (glGetError () != GL_NO_ERROR) {
+      printf ("Ring: Error: Failed to allocate %zu bytes\n", size);
+      gles_ring_finish (ring);
+      return false;
+   }
+
+   return true;
+}
+
+void*
+gles_ring_begin (struct gles_ring* ring, uint32_t* region)
+{
+   uint32_t r = ring->next;
+
+   ring->next = (r + 1) % ring->num_regions;
+
+   /* wait for the GPU to be done with the previous use of the region */
+   if (ring->fences[r] != NULL) {
+      uint64_t start = gles_compute_get_time_ns ();
+      glClientWaitSync (ring->fences[r],
+                        GL_SYNC_FLUSH_COMMANDS_BIT,
+                        GL_TIMEOUT_IGNORED);
+      ring->wait_ns += gles_compute_get_time_ns () - start;
+
+      glDeleteSync (ring->fences[r]);
+      ring->fences[r] = NULL;
+   }
+
+   *region = r;
+
+   return ring->map + r * ring->region_size;
+}
+
+void
+gles_ring_end (struct gles_ring* ring, uint32_t region, size_t size)
+{
+   assert (size <= ring->region_size);
+
+   /* coherent mappings need nothing: writes are seen by later commands */
+   if (ring->persistent)
+      return;
+
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, ring->buffer);
+   glBufferSubData (GL_SHADER_STORAGE_BUFFER,
+                    region * ring->region_size,
+                    size,
+                    ring->map + region * ring->region_size);
+}
+
+void
+gles_ring_bind (const struct gles_ring* ring,
+                uint32_t region,
+                GLuint binding,
+                size_t size)
+{
+   glBindBufferRange (GL_SHADER_STORAGE_BUFFER,
+                      binding,
+                      ring->buffer,
+                      region * ring->region_size,
+                      size);
+}
+
+void
+gles_ring_fence (struct gles_ring* ring, uint32_t region)
+{
+   if (ring->fences[region] != NULL)
+      glDeleteSync (ring->fences[region]);
+
+   ring->fences[region] = glFenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void
+gles_ring_finish (struct gles_ring* ring)
+{
+   for (uint32_t i = 0; i < GLES_RING_MAX_REGIONS; i++) {
+      if (ring->fences[i] != NULL)
+         glDeleteSync (ring->fences[i]);
+   }
+
+   if (ring->persistent) {
+      glBindBuffer (GL_SHADER_STORAGE_BUFFER, ring->buffer);
+      glUnmapBuffer (GL_SHADER_STORAGE_BUFFER);
+   } else {
+      free (ring->map);
+   }
+
+   glDeleteBuffers (1, &ring->buffer);
+
+   memset (ring, 0, sizeof (struct gles_ring));
+}
@@ -0,0 +1,77 @@
+/*
+ * GLES streaming ring buffer: a shader storage buffer split in regions that
+ * the CPU fills while the GPU consumes earlier ones, each region guarded by a
+ * fence.
+ *
+ * Where GL_EXT_buffer_storage is available, the buffer is immutable and
+ * persistently mapped (write, coherent), so the CPU writes straight into GPU
+ * visible memory: no map/unmap per job, no driver copy. Otherwise, each
+ * region is staged in host memory and uploaded with glBufferSubData().
+ *
+ * Typical use, per job:
+ *
+ *    void* ptr = gles_ring_begin (&ring, &region);
+ *    ... write up to 'ring.region_size' bytes of input to 'ptr' ...
+ *    gles_ring_end (&ring, region, size);
+ *    gles_ring_bind (&ring, region, binding, size);
+ *    glDispatchCompute (...);
+ *    gles_ring_fence (&ring, region);
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "gles-compute.h"
+
+#define GLES_RING_MAX_REGIONS 16
+
+struct gles_ring {
+   GLuint buffer;
+   bool persistent;
+
+   uint32_t num_regions;
+   size_t region_size;   /* rounded up to the SSBO offset alignment */
+
+   uint8_t* map;         /* persistent mapping, or host staging memory */
+   GLsync fences[GLES_RING_MAX_REGIONS];
+   uint32_t next;
+
+   /* time spent blocked on fences, i.e, the CPU ran ahead of the GPU */
+   uint64_t wait_ns;
+};
+
+/* 'persistent' requests a persistently mapped buffer, falling back to
+ * glBufferSubData() if GL_EXT_buffer_storage is missing.
+ */
+bool  gles_ring_init   (struct gles_ring* ring,
+                        size_t region_size,
+                        uint32_t num_regions,
+                        bool persistent);
+
+/* Waits until the next region is no longer in use by the GPU, and returns a
+ * pointer where to write its contents.
+ */
+void* gles_ring_begin  (struct gles_ring* ring, uint32_t* region);
+
+/* Makes the first 'size' bytes written to 'region' visible to the GPU */
+void  gles_ring_end    (struct gles_ring* ring, uint32_t region, size_t size);
+
+void  gles_ring_bind   (const struct gles_ring* ring,
+                        uint32_t region,
+                        GLuint binding,
+                        size_t size);
+
+/* Marks 'region' as in use by the commands issued so far */
+void  gles_ring_fence  (struct gles_ring* ring, uint32_t region);
+
+void  gles_ring_finish (struct gles_ring* ring);
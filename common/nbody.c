@@ -0,0 +1,40 @@
+/*
+ * N-body initial state
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#include <stdlib.h>
+#include "nbody.h"
+
+void
+nbody_init_bodies (float* pos, float* vel, uint32_t count)
+{
+   srand (count);
+
+   for (uint32_t i = 0; i < count; i++) {
+      float x, y, z;
+
+      do {
+         x = 2.0f * rand () / RAND_MAX - 1.0f;
+         y = 2.0f * rand () / RAND_MAX - 1.0f;
+         z = 2.0f * rand () / RAND_MAX - 1.0f;
+      } while (x * x + y * y + z * z > 1.0f);
+
+      pos[i * 4 + 0] = x;
+      pos[i * 4 + 1] = y;
+      pos[i * 4 + 2] = z;
+      pos[i * 4 + 3] = 1.0f / count;
+
+      vel[i * 4 + 0] = -y * 0.5f;
+      vel[i * 4 + 1] = x * 0.5f;
+      vel[i * 4 + 2] = 0.0f;
+      vel[i * 4 + 3] = 0.0f;
+   }
+}
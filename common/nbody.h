@@ -0,0 +1,24 @@
+/*
+ * N-body initial state, shared by the simulations of compute-nbody (GLES)
+ * and vulkan-triangle ('-n'): bodies are drawn at random (seeded by their
+ * count, so that every run starts the same) in a unit sphere, with equal
+ * masses totalling 1, rotating about the z axis.
+ *
+ * Positions and velocities are vec4s, as laid out in the storage buffers of
+ * both: the mass goes in the w of positions, and the w of velocities is 0.
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/* Fills 'pos' and 'vel', of 'count' vec4s each */
+void nbody_init_bodies (float* pos, float* vel, uint32_t count);
@@ -0,0 +1,94 @@
+/*
+ * Timeline trace
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#include <string.h>
+#include "trace.h"
+
+static const char* track_names[TRACE_TRACKS] = {
+   "CPU",
+   "GPU"
+};
+
+bool
+trace_open (struct trace* trace,
+            const char* path,
+            uint64_t first_frame,
+            uint64_t frames_count)
+{
+   memset (trace, 0, sizeof (struct trace));
+
+   trace->file = fopen (path, "w");
+   if (trace->file == NULL) {
+      printf ("Error: Failed to open trace file '%s'\n", path);
+      return false;
+   }
+   trace->first_frame = first_frame;
+   trace->frames_count = frames_count;
+
+   /* name the tracks, in that order */
+   fprintf (trace->file, "{\"traceEvents\": [\n");
+   for (uint32_t i = 0; i < TRACE_TRACKS; i++) {
+      fprintf (trace->file,
+               "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+               "\"tid\": %u, \"args\": {\"name\": \"%s\"}},\n"
+               "{\"name\": \"thread_sort_index\", \"ph\": \"M\", "
+               "\"pid\": 1, \"tid\": %u, \"args\": {\"sort_index\": %u}}%s\n",
+               i + 1,
+               track_names[i],
+               i + 1,
+               i,
+               i + 1 < TRACE_TRACKS ? "," : "");
+   }
+
+   return true;
+}
+
+void
+trace_event (struct trace* trace,
+             enum trace_track track,
+             const char* name,
+             uint64_t frame,
+             uint64_t start,
+             uint64_t end)
+{
+   if (trace->file == NULL ||
+       frame < trace->first_frame ||
+       frame >= trace->first_frame + trace->frames_count)
+      return;
+
+   /* in microseconds */
+   fprintf (trace->file,
+            ",{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, "
+            "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"frame\": %lu}}\n",
+            name,
+            track + 1,
+            start / 1e3,
+            end > start ? (end - start) / 1e3 : 0.0,
+            (unsigned long) frame);
+   trace->events++;
+}
+
+void
+trace_close (struct trace* trace)
+{
+   if (trace->file == NULL)
+      return;
+
+   fprintf (trace->file, "], \"displayTimeUnit\": \"ms\"}\n");
+   fclose (trace->file);
+
+   printf ("Trace of frames %lu to %lu written: %lu events\n",
+           (unsigned long) trace->first_frame,
+           (unsigned long) (trace->first_frame + trace->frames_count - 1),
+           (unsigned long) trace->events);
+   memset (trace, 0, sizeof (struct trace));
+}
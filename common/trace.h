@@ -0,0 +1,67 @@
+/*
+ * Timeline trace: CPU phases of frames (acquire, record, submit, present,
+ * event handling) and what the GPU executed for them, written as a Chrome
+ * trace (JSON array of complete events), which chrome://tracing and
+ * ui.perfetto.dev open.
+ *
+ * Events are tagged with their frame, and only those of a window of frames
+ * are kept, e.g. past the first ones (shader compilation, cache warmup), and
+ * few enough for the file to stay small. They may come in any order (GPU
+ * events come when their queries are read back, frames later), and each goes
+ * on a track: one for the CPU thread, one for the GPU queue, so that their
+ * overlap (or lack of it) shows.
+ *
+ * Times are in nanoseconds of CLOCK_MONOTONIC (wsi_get_time()), which GPU
+ * times must be converted to first (see vk_timestamps_calibrate()).
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum trace_track {
+   TRACE_CPU = 0,
+   TRACE_GPU,
+   TRACE_TRACKS
+};
+
+struct trace {
+   FILE* file;
+
+   /* the window of frames kept */
+   uint64_t first_frame;
+   uint64_t frames_count;
+
+   uint64_t events;
+};
+
+/* Starts the trace in file 'path', of 'frames_count' frames from
+ * 'first_frame' (counted from 0)
+ */
+bool trace_open   (struct trace* trace,
+                   const char* path,
+                   uint64_t first_frame,
+                   uint64_t frames_count);
+
+/* Adds 'name', from 'start' to 'end', to the 'track' of the trace, if
+ * 'frame' is within its window
+ */
+void trace_event  (struct trace* trace,
+                   enum trace_track track,
+                   const char* name,
+                   uint64_t frame,
+                   uint64_t start,
+                   uint64_t end);
+
+/* Ends the trace and closes its file, if open */
+void trace_close  (struct trace* trace);
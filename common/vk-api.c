@@ -44,6 +44,10 @@ vk_api_load_from_instance (struct vk_api* vk, VkInstance* instance)
    GET_INSTANCE_PROC_ADDR (*vk, *instance, CreateDevice);
    GET_INSTANCE_PROC_ADDR (*vk, *instance, EnumerateDeviceExtensionProperties);
    GET_INSTANCE_PROC_ADDR (*vk, *instance, GetPhysicalDeviceProperties);
+   GET_INSTANCE_PROC_ADDR (*vk, *instance, GetPhysicalDeviceFeatures);
+   GET_INSTANCE_PROC_ADDR (*vk, *instance,
+                           GetPhysicalDeviceCalibrateableTimeDomainsEXT);
+   GET_INSTANCE_PROC_ADDR (*vk, *instance, GetPhysicalDeviceMemoryProperties);
 
    GET_INSTANCE_PROC_ADDR (*vk, *instance, DestroySurfaceKHR);
    GET_INSTANCE_PROC_ADDR (*vk, *instance, GetPhysicalDeviceSurfaceSupportKHR);
@@ -53,9 +57,22 @@ vk_api_load_from_instance (struct vk_api* vk, VkInstance* instance)
    GET_INSTANCE_PROC_ADDR (*vk, (*instance),
                            GetPhysicalDeviceSurfaceCapabilitiesKHR);
 
+   GET_INSTANCE_PROC_ADDR (*vk, *instance,
+                           GetPhysicalDeviceDisplayPropertiesKHR);
+   GET_INSTANCE_PROC_ADDR (*vk, *instance,
+                           GetPhysicalDeviceDisplayPlanePropertiesKHR);
+   GET_INSTANCE_PROC_ADDR (*vk, *instance, GetDisplayPlaneSupportedDisplaysKHR);
+   GET_INSTANCE_PROC_ADDR (*vk, *instance, GetDisplayModePropertiesKHR);
+   GET_INSTANCE_PROC_ADDR (*vk, *instance, GetDisplayPlaneCapabilitiesKHR);
+   GET_INSTANCE_PROC_ADDR (*vk, *instance, CreateDisplayPlaneSurfaceKHR);
+
 #ifdef VK_USE_PLATFORM_XCB_KHR
    GET_INSTANCE_PROC_ADDR (*vk, *instance, CreateXcbSurfaceKHR);
 #endif
+
+#ifdef VK_USE_PLATFORM_WAYLAND_KHR
+   GET_INSTANCE_PROC_ADDR (*vk, *instance, CreateWaylandSurfaceKHR);
+#endif
 }
 
 void
@@ -93,6 +110,45 @@ vk_api_load_from_device (struct vk_api* vk, VkDevice* device)
    GET_DEVICE_PROC_ADDR (*vk, *device, DestroySemaphore);
    GET_DEVICE_PROC_ADDR (*vk, *device, QueueSubmit);
    GET_DEVICE_PROC_ADDR (*vk, *device, DeviceWaitIdle);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CreateBuffer);
+   GET_DEVICE_PROC_ADDR (*vk, *device, DestroyBuffer);
+   GET_DEVICE_PROC_ADDR (*vk, *device, GetBufferMemoryRequirements);
+   GET_DEVICE_PROC_ADDR (*vk, *device, AllocateMemory);
+   GET_DEVICE_PROC_ADDR (*vk, *device, FreeMemory);
+   GET_DEVICE_PROC_ADDR (*vk, *device, BindBufferMemory);
+   GET_DEVICE_PROC_ADDR (*vk, *device, MapMemory);
+   GET_DEVICE_PROC_ADDR (*vk, *device, UnmapMemory);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CreateDescriptorSetLayout);
+   GET_DEVICE_PROC_ADDR (*vk, *device, DestroyDescriptorSetLayout);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CreateDescriptorPool);
+   GET_DEVICE_PROC_ADDR (*vk, *device, DestroyDescriptorPool);
+   GET_DEVICE_PROC_ADDR (*vk, *device, AllocateDescriptorSets);
+   GET_DEVICE_PROC_ADDR (*vk, *device, UpdateDescriptorSets);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CreateComputePipelines);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CmdBindDescriptorSets);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CmdBindVertexBuffers);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CmdPushConstants);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CmdDispatch);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CmdPipelineBarrier);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CreateFence);
+   GET_DEVICE_PROC_ADDR (*vk, *device, DestroyFence);
+   GET_DEVICE_PROC_ADDR (*vk, *device, WaitForFences);
+   GET_DEVICE_PROC_ADDR (*vk, *device, ResetFences);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CmdSetScissor);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CmdClearAttachments);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CreateImage);
+   GET_DEVICE_PROC_ADDR (*vk, *device, DestroyImage);
+   GET_DEVICE_PROC_ADDR (*vk, *device, GetImageMemoryRequirements);
+   GET_DEVICE_PROC_ADDR (*vk, *device, BindImageMemory);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CmdCopyImageToBuffer);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CreateQueryPool);
+   GET_DEVICE_PROC_ADDR (*vk, *device, DestroyQueryPool);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CmdResetQueryPool);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CmdWriteTimestamp);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CmdBeginQuery);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CmdEndQuery);
+   GET_DEVICE_PROC_ADDR (*vk, *device, GetCalibratedTimestampsEXT);
+   GET_DEVICE_PROC_ADDR (*vk, *device, GetQueryPoolResults);
 
    GET_DEVICE_PROC_ADDR (*vk, *device, CreateSwapchainKHR);
    GET_DEVICE_PROC_ADDR (*vk, *device, DestroySwapchainKHR);
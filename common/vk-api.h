@@ -40,6 +40,8 @@ struct vk_api {
    PFN_vkCreateInstance                          CreateInstance;
    PFN_vkEnumeratePhysicalDevices                EnumeratePhysicalDevices;
    PFN_vkGetPhysicalDeviceProperties             GetPhysicalDeviceProperties;
+   PFN_vkGetPhysicalDeviceFeatures               GetPhysicalDeviceFeatures;
+   PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT GetPhysicalDeviceCalibrateableTimeDomainsEXT;
    PFN_vkGetPhysicalDeviceQueueFamilyProperties  GetPhysicalDeviceQueueFamilyProperties;
    PFN_vkCreateDevice                            CreateDevice;
    PFN_vkEnumerateDeviceExtensionProperties      EnumerateDeviceExtensionProperties;
@@ -72,6 +74,46 @@ struct vk_api {
    PFN_vkDestroySemaphore                        DestroySemaphore;
    PFN_vkQueueSubmit                             QueueSubmit;
    PFN_vkDeviceWaitIdle                          DeviceWaitIdle;
+   PFN_vkGetPhysicalDeviceMemoryProperties       GetPhysicalDeviceMemoryProperties;
+   PFN_vkCreateBuffer                            CreateBuffer;
+   PFN_vkDestroyBuffer                           DestroyBuffer;
+   PFN_vkGetBufferMemoryRequirements             GetBufferMemoryRequirements;
+   PFN_vkAllocateMemory                          AllocateMemory;
+   PFN_vkFreeMemory                              FreeMemory;
+   PFN_vkBindBufferMemory                        BindBufferMemory;
+   PFN_vkMapMemory                               MapMemory;
+   PFN_vkUnmapMemory                             UnmapMemory;
+   PFN_vkCreateDescriptorSetLayout               CreateDescriptorSetLayout;
+   PFN_vkDestroyDescriptorSetLayout              DestroyDescriptorSetLayout;
+   PFN_vkCreateDescriptorPool                    CreateDescriptorPool;
+   PFN_vkDestroyDescriptorPool                   DestroyDescriptorPool;
+   PFN_vkAllocateDescriptorSets                  AllocateDescriptorSets;
+   PFN_vkUpdateDescriptorSets                    UpdateDescriptorSets;
+   PFN_vkCreateComputePipelines                  CreateComputePipelines;
+   PFN_vkCmdBindDescriptorSets                   CmdBindDescriptorSets;
+   PFN_vkCmdBindVertexBuffers                    CmdBindVertexBuffers;
+   PFN_vkCmdPushConstants                        CmdPushConstants;
+   PFN_vkCmdDispatch                             CmdDispatch;
+   PFN_vkCmdPipelineBarrier                      CmdPipelineBarrier;
+   PFN_vkCreateFence                             CreateFence;
+   PFN_vkDestroyFence                            DestroyFence;
+   PFN_vkWaitForFences                           WaitForFences;
+   PFN_vkResetFences                             ResetFences;
+   PFN_vkCmdSetScissor                           CmdSetScissor;
+   PFN_vkCmdClearAttachments                     CmdClearAttachments;
+   PFN_vkCreateImage                             CreateImage;
+   PFN_vkDestroyImage                            DestroyImage;
+   PFN_vkGetImageMemoryRequirements              GetImageMemoryRequirements;
+   PFN_vkBindImageMemory                         BindImageMemory;
+   PFN_vkCmdCopyImageToBuffer                    CmdCopyImageToBuffer;
+   PFN_vkCreateQueryPool                         CreateQueryPool;
+   PFN_vkDestroyQueryPool                        DestroyQueryPool;
+   PFN_vkCmdResetQueryPool                       CmdResetQueryPool;
+   PFN_vkCmdWriteTimestamp                       CmdWriteTimestamp;
+   PFN_vkCmdBeginQuery                           CmdBeginQuery;
+   PFN_vkCmdEndQuery                             CmdEndQuery;
+   PFN_vkGetCalibratedTimestampsEXT              GetCalibratedTimestampsEXT;
+   PFN_vkGetQueryPoolResults                     GetQueryPoolResults;
 
    PFN_vkDestroySurfaceKHR                       DestroySurfaceKHR;
    PFN_vkGetPhysicalDeviceSurfaceSupportKHR      GetPhysicalDeviceSurfaceSupportKHR;
@@ -84,9 +126,20 @@ struct vk_api {
    PFN_vkAcquireNextImageKHR                     AcquireNextImageKHR;
    PFN_vkQueuePresentKHR                         QueuePresentKHR;
 
+   PFN_vkGetPhysicalDeviceDisplayPropertiesKHR   GetPhysicalDeviceDisplayPropertiesKHR;
+   PFN_vkGetPhysicalDeviceDisplayPlanePropertiesKHR GetPhysicalDeviceDisplayPlanePropertiesKHR;
+   PFN_vkGetDisplayPlaneSupportedDisplaysKHR     GetDisplayPlaneSupportedDisplaysKHR;
+   PFN_vkGetDisplayModePropertiesKHR             GetDisplayModePropertiesKHR;
+   PFN_vkGetDisplayPlaneCapabilitiesKHR          GetDisplayPlaneCapabilitiesKHR;
+   PFN_vkCreateDisplayPlaneSurfaceKHR            CreateDisplayPlaneSurfaceKHR;
+
 #ifdef VK_USE_PLATFORM_XCB_KHR
    PFN_vkCreateXcbSurfaceKHR                     CreateXcbSurfaceKHR;
 #endif
+
+#ifdef VK_USE_PLATFORM_WAYLAND_KHR
+   PFN_vkCreateWaylandSurfaceKHR                 CreateWaylandSurfaceKHR;
+#endif
 };
 
 void vk_api_load_from_icd      (struct vk_api* vk);
@@ -0,0 +1,134 @@
+/*
+ * Submit batching
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "vk-submit.h"
+
+static uint64_t
+get_time (void)
+{
+   struct timespec ts;
+
+   clock_gettime (CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void
+vk_submit_init (struct vk_submit* submit,
+                const struct vk_api* vk,
+                VkQueue queue,
+                uint32_t max_batch)
+{
+   memset (submit, 0, sizeof (struct vk_submit));
+   submit->vk = vk;
+   submit->queue = queue;
+   submit->max_batch = max_batch;
+}
+
+/* Starts a VkSubmitInfo where the arrays are at */
+static void
+open_info (struct vk_submit* submit)
+{
+   submit->infos[submit->infos_count++] = (VkSubmitInfo) {
+      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+      .waitSemaphoreCount = 0,
+      .pWaitSemaphores =
+         &submit->wait_semaphores[submit->wait_semaphores_count],
+      .pWaitDstStageMask = &submit->wait_stages[submit->wait_semaphores_count],
+      .commandBufferCount = 0,
+      .pCommandBuffers = &submit->cmd_buffers[submit->cmd_buffers_count],
+      .signalSemaphoreCount = 0,
+      .pSignalSemaphores =
+         &submit->signal_semaphores[submit->signal_semaphores_count]
+   };
+   submit->info_open = true;
+}
+
+bool
+vk_submit_add (struct vk_submit* submit,
+               VkCommandBuffer cmd_buffer,
+               VkSemaphore wait_semaphore,
+               VkPipelineStageFlags wait_stage,
+               VkSemaphore signal_semaphore)
+{
+   bool new_info = ! submit->info_open || wait_semaphore != VK_NULL_HANDLE;
+
+   /* make room */
+   if ((new_info && submit->infos_count == VK_SUBMIT_MAX_INFOS) ||
+       submit->cmd_buffers_count == VK_SUBMIT_MAX_CMD_BUFFERS ||
+       submit->wait_semaphores_count == VK_SUBMIT_MAX_SEMAPHORES ||
+       submit->signal_semaphores_count == VK_SUBMIT_MAX_SEMAPHORES) {
+      if (! vk_submit_flush (submit, VK_NULL_HANDLE))
+         return false;
+      new_info = true;
+   }
+
+   if (new_info)
+      open_info (submit);
+   VkSubmitInfo* info = &submit->infos[submit->infos_count - 1];
+
+   if (wait_semaphore != VK_NULL_HANDLE) {
+      submit->wait_semaphores[submit->wait_semaphores_count] = wait_semaphore;
+      submit->wait_stages[submit->wait_semaphores_count++] = wait_stage;
+      info->waitSemaphoreCount++;
+   }
+
+   submit->cmd_buffers[submit->cmd_buffers_count++] = cmd_buffer;
+   info->commandBufferCount++;
+
+   if (signal_semaphore != VK_NULL_HANDLE) {
+      submit->signal_semaphores[submit->signal_semaphores_count++] =
+         signal_semaphore;
+      info->signalSemaphoreCount++;
+      submit->info_open = false;
+   }
+
+   if (submit->max_batch > 0 &&
+       submit->cmd_buffers_count == submit->max_batch)
+      return vk_submit_flush (submit, VK_NULL_HANDLE);
+
+   return true;
+}
+
+bool
+vk_submit_flush (struct vk_submit* submit, VkFence fence)
+{
+   /* nothing to submit, nothing to signal */
+   if (submit->infos_count == 0 && fence == VK_NULL_HANDLE)
+      return true;
+
+   uint64_t start = get_time ();
+   VkResult result = submit->vk->QueueSubmit (submit->queue,
+                                              submit->infos_count,
+                                              submit->infos,
+                                              fence);
+   submit->submit_time += get_time () - start;
+   submit->submits++;
+   submit->cmd_buffers_submitted += submit->cmd_buffers_count;
+
+   submit->infos_count = 0;
+   submit->cmd_buffers_count = 0;
+   submit->wait_semaphores_count = 0;
+   submit->signal_semaphores_count = 0;
+   submit->info_open = false;
+
+   if (result != VK_SUCCESS) {
+      printf ("Error: Failed to submit queue\n");
+      return false;
+   }
+
+   return true;
+}
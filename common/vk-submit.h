@@ -0,0 +1,81 @@
+/*
+ * Submit batching: command buffers (and the semaphores they wait on and
+ * signal) come from several producers during a frame, e.g. a compute step,
+ * then every window drawn, and are only handed to the queue when flushed,
+ * in as few vkQueueSubmit() calls as possible: a single one, unless they
+ * don't fit, or a batch size is set.
+ *
+ * Within a call, command buffers are grouped in as few VkSubmitInfo as
+ * their semaphores allow. One that waits starts a new group, so that the
+ * earlier ones don't wait with it, and one that signals ends its group, so
+ * that the later ones don't delay the signal. Submission order is kept
+ * throughout.
+ *
+ * Calls to vkQueueSubmit() are counted and timed, to tell what batching
+ * saves.
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "vk-api.h"
+
+#define VK_SUBMIT_MAX_INFOS       32
+#define VK_SUBMIT_MAX_CMD_BUFFERS 256
+#define VK_SUBMIT_MAX_SEMAPHORES  32
+
+struct vk_submit {
+   const struct vk_api* vk;
+   VkQueue queue;
+
+   /* command buffers per vkQueueSubmit() at most, 0 for as many as fit */
+   uint32_t max_batch;
+
+   /* pending, the VkSubmitInfo point into the arrays below */
+   VkSubmitInfo infos[VK_SUBMIT_MAX_INFOS];
+   uint32_t infos_count;
+   VkCommandBuffer cmd_buffers[VK_SUBMIT_MAX_CMD_BUFFERS];
+   uint32_t cmd_buffers_count;
+   VkSemaphore wait_semaphores[VK_SUBMIT_MAX_SEMAPHORES];
+   VkPipelineStageFlags wait_stages[VK_SUBMIT_MAX_SEMAPHORES];
+   uint32_t wait_semaphores_count;
+   VkSemaphore signal_semaphores[VK_SUBMIT_MAX_SEMAPHORES];
+   uint32_t signal_semaphores_count;
+
+   /* the last VkSubmitInfo takes more command buffers */
+   bool info_open;
+
+   /* since the counters were last reset, in nanoseconds for the time */
+   uint64_t submits;
+   uint64_t cmd_buffers_submitted;
+   uint64_t submit_time;
+};
+
+void vk_submit_init  (struct vk_submit* submit,
+                      const struct vk_api* vk,
+                      VkQueue queue,
+                      uint32_t max_batch);
+
+/* Queues 'cmd_buffer', waiting on 'wait_semaphore' at 'wait_stage' and
+ * signaling 'signal_semaphore' once done, either being VK_NULL_HANDLE if
+ * not. It may flush what is pending first, to make room.
+ */
+bool vk_submit_add   (struct vk_submit* submit,
+                      VkCommandBuffer cmd_buffer,
+                      VkSemaphore wait_semaphore,
+                      VkPipelineStageFlags wait_stage,
+                      VkSemaphore signal_semaphore);
+
+/* Submits everything pending, and signals 'fence' (unless VK_NULL_HANDLE)
+ * once it is done, even if nothing was.
+ */
+bool vk_submit_flush (struct vk_submit* submit, VkFence fence);
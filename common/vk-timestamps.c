@@ -0,0 +1,509 @@
+/*
+ * GPU timestamps
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "vk-timestamps.h"
+
+#define MAX_QUEUE_FAMILIES 16
+
+static const char* statistics_names[VK_TIMESTAMPS_STATISTICS] = {
+   "vertex invocations",
+   "clipping primitives",
+   "fragment invocations",
+   "compute invocations"
+};
+
+bool
+vk_timestamps_init (struct vk_timestamps* ts,
+                    const struct vk_api* vk,
+                    VkPhysicalDevice physical_device,
+                    VkDevice device,
+                    uint32_t queue_family_index,
+                    VkCommandPool cmd_pool,
+                    bool statistics)
+{
+   memset (ts, 0, sizeof (struct vk_timestamps));
+   ts->vk = vk;
+   ts->device = device;
+   ts->cmd_pool = cmd_pool;
+
+   VkQueueFamilyProperties families[MAX_QUEUE_FAMILIES];
+   uint32_t families_count = MAX_QUEUE_FAMILIES;
+   vk->GetPhysicalDeviceQueueFamilyProperties (physical_device,
+                                               &families_count,
+                                               families);
+   if (queue_family_index >= families_count ||
+       families[queue_family_index].timestampValidBits == 0) {
+      printf ("Error: Queue family doesn't support timestamps\n");
+      return false;
+   }
+   ts->valid_bits = families[queue_family_index].timestampValidBits;
+
+   VkPhysicalDeviceProperties props;
+   vk->GetPhysicalDeviceProperties (physical_device, &props);
+   ts->period = props.limits.timestampPeriod;
+
+   VkQueryPoolCreateInfo query_pool_info = {
+      .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType = VK_QUERY_TYPE_TIMESTAMP,
+      .queryCount = VK_TIMESTAMPS_FRAMES * VK_TIMESTAMPS_MAX_QUERIES
+   };
+   if (vk->CreateQueryPool (device,
+                            &query_pool_info,
+                            NULL,
+                            &ts->query_pool) != VK_SUCCESS) {
+      printf ("Error: Failed to create a timestamp query pool\n");
+      return false;
+   }
+
+   VkQueryPoolCreateInfo statistics_pool_info = {
+      .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+      .queryCount = VK_TIMESTAMPS_FRAMES * VK_TIMESTAMPS_MAX_QUERIES / 2,
+      .pipelineStatistics = VK_TIMESTAMPS_STATISTICS_FLAGS
+   };
+   if (statistics &&
+       vk->CreateQueryPool (device,
+                            &statistics_pool_info,
+                            NULL,
+                            &ts->statistics_pool) != VK_SUCCESS) {
+      printf ("Error: Failed to create a pipeline statistics query pool\n");
+      return false;
+   }
+
+   /* the reset of each slot is the same every time */
+   VkCommandBuffer cmd_buffers[VK_TIMESTAMPS_FRAMES];
+   VkCommandBufferAllocateInfo cmd_buffer_alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+      .commandBufferCount = VK_TIMESTAMPS_FRAMES,
+      .commandPool = cmd_pool
+   };
+   if (vk->AllocateCommandBuffers (device,
+                                   &cmd_buffer_alloc_info,
+                                   cmd_buffers) != VK_SUCCESS) {
+      printf ("Error: Failed to allocate command buffers\n");
+      return false;
+   }
+
+   for (uint32_t i = 0; i < VK_TIMESTAMPS_FRAMES; i++) {
+      ts->frames[i].reset_cmd_buffer = cmd_buffers[i];
+
+      VkCommandBufferBeginInfo begin_info = {
+         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+         .flags = 0,
+         .pInheritanceInfo = NULL
+      };
+      if (vk->BeginCommandBuffer (cmd_buffers[i],
+                                  &begin_info) != VK_SUCCESS) {
+         printf ("Error: Failed to begin recording of command buffer\n");
+         return false;
+      }
+
+      vk->CmdResetQueryPool (cmd_buffers[i],
+                             ts->query_pool,
+                             i * VK_TIMESTAMPS_MAX_QUERIES,
+                             VK_TIMESTAMPS_MAX_QUERIES);
+      if (statistics)
+         vk->CmdResetQueryPool (cmd_buffers[i],
+                                ts->statistics_pool,
+                                i * VK_TIMESTAMPS_MAX_QUERIES / 2,
+                                VK_TIMESTAMPS_MAX_QUERIES / 2);
+
+      if (vk->EndCommandBuffer (cmd_buffers[i]) != VK_SUCCESS) {
+         printf ("Error: Failed to record command buffer\n");
+         return false;
+      }
+   }
+
+   /* the first frame goes in the first slot */
+   ts->frame = VK_TIMESTAMPS_FRAMES - 1;
+
+   ts->regions[0].label = "frame";
+   ts->regions_count = 1;
+
+   return true;
+}
+
+void
+vk_timestamps_destroy (struct vk_timestamps* ts)
+{
+   if (ts->query_pool == VK_NULL_HANDLE)
+      return;
+
+   for (uint32_t i = 0; i < VK_TIMESTAMPS_FRAMES; i++) {
+      if (ts->frames[i].reset_cmd_buffer != VK_NULL_HANDLE)
+         ts->vk->FreeCommandBuffers (ts->device,
+                                     ts->cmd_pool,
+                                     1,
+                                     &ts->frames[i].reset_cmd_buffer);
+   }
+   ts->vk->DestroyQueryPool (ts->device, ts->query_pool, NULL);
+   if (ts->statistics_pool != VK_NULL_HANDLE)
+      ts->vk->DestroyQueryPool (ts->device, ts->statistics_pool, NULL);
+
+   memset (ts, 0, sizeof (struct vk_timestamps));
+}
+
+/* Ticks from 'a' to 'b', which may wrap around the valid bits */
+static int64_t
+ticks_between (const struct vk_timestamps* ts, uint64_t a, uint64_t b)
+{
+   uint32_t shift = 64 - ts->valid_bits;
+
+   return (int64_t) ((b - a) << shift) >> shift;
+}
+
+bool
+vk_timestamps_calibrate (struct vk_timestamps* ts)
+{
+   if (ts->vk->GetCalibratedTimestampsEXT == NULL)
+      return false;
+
+   VkCalibratedTimestampInfoEXT infos[2] = {
+      {
+         .sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT,
+         .timeDomain = VK_TIME_DOMAIN_DEVICE_EXT
+      },
+      {
+         .sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT,
+         .timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT
+      }
+   };
+   uint64_t timestamps[2];
+   uint64_t max_deviation;
+   if (ts->vk->GetCalibratedTimestampsEXT (ts->device,
+                                           2,
+                                           infos,
+                                           timestamps,
+                                           &max_deviation) != VK_SUCCESS)
+      return false;
+
+   ts->calibration_gpu = timestamps[0];
+   ts->calibration_cpu = timestamps[1];
+   ts->calibrated = true;
+
+   return true;
+}
+
+void
+vk_timestamps_set_region_callback (struct vk_timestamps* ts,
+                                   VkTimestampsRegionEvent callback,
+                                   void* data)
+{
+   ts->region_event = callback;
+   ts->region_event_data = data;
+}
+
+/* GPU timestamp 'ticks' in nanoseconds of CLOCK_MONOTONIC */
+static uint64_t
+to_cpu_time (const struct vk_timestamps* ts, uint64_t ticks)
+{
+   return ts->calibration_cpu +
+      (int64_t) (ticks_between (ts, ts->calibration_gpu, ticks) * ts->period);
+}
+
+static void
+add_sample (struct vk_timestamps_region* region,
+            uint64_t time,
+            const uint64_t* statistics)
+{
+   uint32_t bucket = 0;
+   for (uint64_t us = time / 1000; us > 0; us >>= 1)
+      bucket++;
+   if (bucket >= VK_TIMESTAMPS_BUCKETS)
+      bucket = VK_TIMESTAMPS_BUCKETS - 1;
+   region->buckets[bucket]++;
+
+   if (region->frames == 0 || time < region->time_min)
+      region->time_min = time;
+   if (time > region->time_max)
+      region->time_max = time;
+
+   region->frames++;
+   region->time += time;
+   region->recent_frames++;
+   region->recent_time += time;
+
+   for (uint32_t s = 0; s < VK_TIMESTAMPS_STATISTICS; s++)
+      region->statistics[s] += statistics[s];
+}
+
+/* Adds the regions of frame slot 'slot' to their histograms, if its results
+ * are all available by now
+ */
+static void
+read_frame (struct vk_timestamps* ts, uint32_t slot)
+{
+   struct vk_timestamps_frame* frame = &ts->frames[slot];
+
+   if (! frame->pending)
+      return;
+   frame->pending = false;
+   if (frame->queries_count == 0)
+      return;
+
+   /* each value followed by its availability, never waiting for them */
+   uint64_t results[VK_TIMESTAMPS_MAX_QUERIES][2];
+   VkResult result =
+      ts->vk->GetQueryPoolResults (ts->device,
+                                   ts->query_pool,
+                                   slot * VK_TIMESTAMPS_MAX_QUERIES,
+                                   frame->queries_count,
+                                   sizeof (results),
+                                   results,
+                                   sizeof (results[0]),
+                                   VK_QUERY_RESULT_64_BIT |
+                                   VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+   if (result != VK_SUCCESS && result != VK_NOT_READY) {
+      ts->frames_dropped++;
+      return;
+   }
+
+   /* the counters of each region, followed by their availability */
+   uint64_t counters[VK_TIMESTAMPS_MAX_QUERIES / 2]
+                    [VK_TIMESTAMPS_STATISTICS + 1] = {{0}};
+   if (ts->statistics_pool != VK_NULL_HANDLE) {
+      result =
+         ts->vk->GetQueryPoolResults (ts->device,
+                                      ts->statistics_pool,
+                                      slot * VK_TIMESTAMPS_MAX_QUERIES / 2,
+                                      frame->queries_count / 2,
+                                      sizeof (counters),
+                                      counters,
+                                      sizeof (counters[0]),
+                                      VK_QUERY_RESULT_64_BIT |
+                                      VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+      if (result != VK_SUCCESS && result != VK_NOT_READY) {
+         ts->frames_dropped++;
+         return;
+      }
+   }
+
+   uint64_t times[VK_TIMESTAMPS_MAX_REGIONS] = {0};
+   uint64_t statistics[VK_TIMESTAMPS_MAX_REGIONS]
+                      [VK_TIMESTAMPS_STATISTICS] = {{0}};
+   bool found[VK_TIMESTAMPS_MAX_REGIONS] = {false};
+   int64_t first = 0, last = 0;
+
+   for (uint32_t q = 0; q < frame->queries_count; q += 2) {
+      if (results[q][1] == 0 || results[q + 1][1] == 0 ||
+          (ts->statistics_pool != VK_NULL_HANDLE &&
+           counters[q / 2][VK_TIMESTAMPS_STATISTICS] == 0)) {
+         ts->frames_dropped++;
+         return;
+      }
+
+      /* relative to the first query recorded, which may not run first */
+      int64_t start = ticks_between (ts, results[0][0], results[q][0]);
+      int64_t end = ticks_between (ts, results[0][0], results[q + 1][0]);
+      if (q == 0 || start < first)
+         first = start;
+      if (q == 0 || end > last)
+         last = end;
+
+      uint32_t region = frame->regions[q / 2];
+      if (end > start)
+         times[region] += (end - start) * ts->period;
+      found[region] = true;
+
+      /* the whole frame counts what all regions did */
+      for (uint32_t s = 0; s < VK_TIMESTAMPS_STATISTICS; s++) {
+         statistics[region][s] += counters[q / 2][s];
+         if (region != 0)
+            statistics[0][s] += counters[q / 2][s];
+      }
+   }
+
+   times[0] = last > first ? (last - first) * ts->period : 0;
+   found[0] = true;
+
+   for (uint32_t i = 0; i < ts->regions_count; i++) {
+      if (found[i])
+         add_sample (&ts->regions[i], times[i], statistics[i]);
+   }
+
+   if (ts->region_event == NULL || ! ts->calibrated)
+      return;
+
+   ts->region_event ("frame",
+                     frame->number,
+                     to_cpu_time (ts, results[0][0]) + first * ts->period,
+                     to_cpu_time (ts, results[0][0]) + last * ts->period,
+                     ts->region_event_data);
+   for (uint32_t q = 0; q < frame->queries_count; q += 2)
+      ts->region_event (ts->regions[frame->regions[q / 2]].label,
+                        frame->number,
+                        to_cpu_time (ts, results[q][0]),
+                        to_cpu_time (ts, results[q + 1][0]),
+                        ts->region_event_data);
+}
+
+VkCommandBuffer
+vk_timestamps_begin_frame (struct vk_timestamps* ts)
+{
+   ts->frame = (ts->frame + 1) % VK_TIMESTAMPS_FRAMES;
+
+   struct vk_timestamps_frame* frame = &ts->frames[ts->frame];
+   read_frame (ts, ts->frame);
+   frame->queries_count = 0;
+   frame->number = ts->frames_begun++;
+   frame->pending = true;
+
+   return frame->reset_cmd_buffer;
+}
+
+/* The region of 'label', added if new, VK_TIMESTAMPS_NONE if full */
+static uint32_t
+find_region (struct vk_timestamps* ts, const char* label)
+{
+   for (uint32_t i = 0; i < ts->regions_count; i++) {
+      if (strcmp (ts->regions[i].label, label) == 0)
+         return i;
+   }
+
+   if (ts->regions_count == VK_TIMESTAMPS_MAX_REGIONS)
+      return VK_TIMESTAMPS_NONE;
+
+   ts->regions[ts->regions_count].label = label;
+   return ts->regions_count++;
+}
+
+uint32_t
+vk_timestamps_begin (struct vk_timestamps* ts,
+                     VkCommandBuffer cmd_buffer,
+                     const char* label)
+{
+   struct vk_timestamps_frame* frame = &ts->frames[ts->frame];
+
+   uint32_t region = find_region (ts, label);
+   if (region == VK_TIMESTAMPS_NONE ||
+       frame->queries_count == VK_TIMESTAMPS_MAX_QUERIES) {
+      ts->regions_dropped++;
+      return VK_TIMESTAMPS_NONE;
+   }
+
+   uint32_t query = frame->queries_count;
+   frame->regions[query / 2] = region;
+   frame->queries_count += 2;
+
+   /* in the pools, the statistics query is at half the timestamps' index */
+   uint32_t index = ts->frame * VK_TIMESTAMPS_MAX_QUERIES + query;
+   ts->vk->CmdWriteTimestamp (cmd_buffer,
+                              VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                              ts->query_pool,
+                              index);
+
+   if (ts->statistics_pool != VK_NULL_HANDLE)
+      ts->vk->CmdBeginQuery (cmd_buffer, ts->statistics_pool, index / 2, 0);
+
+   return query;
+}
+
+void
+vk_timestamps_end (struct vk_timestamps* ts,
+                   VkCommandBuffer cmd_buffer,
+                   uint32_t query)
+{
+   if (query == VK_TIMESTAMPS_NONE)
+      return;
+
+   uint32_t index = ts->frame * VK_TIMESTAMPS_MAX_QUERIES + query;
+   if (ts->statistics_pool != VK_NULL_HANDLE)
+      ts->vk->CmdEndQuery (cmd_buffer, ts->statistics_pool, index / 2);
+
+   /* once everything before is done */
+   ts->vk->CmdWriteTimestamp (cmd_buffer,
+                              VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                              ts->query_pool,
+                              index + 1);
+}
+
+void
+vk_timestamps_collect (struct vk_timestamps* ts)
+{
+   /* oldest first */
+   for (uint32_t i = 1; i <= VK_TIMESTAMPS_FRAMES; i++)
+      read_frame (ts, (ts->frame + i) % VK_TIMESTAMPS_FRAMES);
+}
+
+void
+vk_timestamps_report (struct vk_timestamps* ts)
+{
+   if (ts->regions[0].recent_frames == 0)
+      return;
+
+   printf ("GPU: %lu frames",
+           (unsigned long) ts->regions[0].recent_frames);
+   for (uint32_t i = 0; i < ts->regions_count; i++) {
+      struct vk_timestamps_region* region = &ts->regions[i];
+
+      if (region->recent_frames == 0)
+         continue;
+
+      printf (", %s %.3f ms",
+              region->label,
+              region->recent_time / 1e6 / region->recent_frames);
+      region->recent_frames = 0;
+      region->recent_time = 0;
+   }
+   printf (" per frame\n");
+}
+
+void
+vk_timestamps_print (const struct vk_timestamps* ts)
+{
+   for (uint32_t i = 0; i < ts->regions_count; i++) {
+      const struct vk_timestamps_region* region = &ts->regions[i];
+
+      if (region->frames == 0)
+         continue;
+
+      printf ("GPU %s: %lu frames, %.3f ms on average, %.3f ms to %.3f ms\n",
+              region->label,
+              (unsigned long) region->frames,
+              region->time / 1e6 / region->frames,
+              region->time_min / 1e6,
+              region->time_max / 1e6);
+
+      for (uint32_t b = 0; b < VK_TIMESTAMPS_BUCKETS; b++) {
+         if (region->buckets[b] == 0)
+            continue;
+
+         if (b == 0)
+            printf ("   under 1 us: ");
+         else if (b == VK_TIMESTAMPS_BUCKETS - 1)
+            printf ("   %lu us and more: ", 1UL << (b - 1));
+         else
+            printf ("   %lu to %lu us: ", 1UL << (b - 1), 1UL << b);
+         printf ("%lu\n", (unsigned long) region->buckets[b]);
+      }
+
+      if (ts->statistics_pool == VK_NULL_HANDLE)
+         continue;
+
+      printf ("GPU %s statistics:", region->label);
+      for (uint32_t s = 0; s < VK_TIMESTAMPS_STATISTICS; s++)
+         printf ("%s %.1f %s",
+                 s > 0 ? "," : "",
+                 (double) region->statistics[s] / region->frames,
+                 statistics_names[s]);
+      printf (" per frame\n");
+   }
+
+   if (ts->frames_dropped > 0 || ts->regions_dropped > 0)
+      printf ("GPU: %lu frames not available in time, %lu regions beyond "
+              "the slots\n",
+              (unsigned long) ts->frames_dropped,
+              (unsigned long) ts->regions_dropped);
+}
@@ -0,0 +1,196 @@
+/*
+ * GPU timestamps: regions of a frame's command buffers (render passes,
+ * compute steps, copies) are labelled, and timed on the GPU by a timestamp
+ * written at their start (top of pipe) and one at their end (bottom of pipe).
+ *
+ * Every frame writes its own slot of the query pool, and a slot is only
+ * read back when its turn comes again, VK_TIMESTAMPS_FRAMES frames later, so
+ * that reading never waits for the GPU: a frame whose results still aren't
+ * available by then is dropped instead. Queries are thus recorded for a
+ * given frame, in command buffers recorded for that frame too.
+ *
+ * Times are converted to nanoseconds with the device's timestampPeriod, and
+ * summed per label for each frame (windows drawn in the same frame add up),
+ * along with the span of the whole frame ("frame"). These add to a
+ * histogram per label, with power-of-two buckets of microseconds, to tell
+ * what on the GPU a slower frame is spent on.
+ *
+ * Regions can also count what the pipeline did in them, with pipeline
+ * statistics queries (the pipelineStatisticsQuery feature must be enabled):
+ * vertex shader invocations, primitives out of clipping, fragment shader
+ * invocations and compute shader invocations. They add up per frame the same
+ * way, to tell e.g. overdraw from vertex load. Such a query can't span
+ * command buffers, so neither can a region then.
+ *
+ * With VK_EXT_calibrated_timestamps, GPU times are also converted to
+ * CLOCK_MONOTONIC, and every region read back can be passed on as such, to
+ * line it up with what the CPU did meanwhile (see common/trace.h).
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "vk-api.h"
+
+#define VK_TIMESTAMPS_FRAMES      3
+#define VK_TIMESTAMPS_MAX_QUERIES 64
+#define VK_TIMESTAMPS_MAX_REGIONS 16
+#define VK_TIMESTAMPS_BUCKETS     24
+
+/* the pipeline statistics counted, in the order of their bits */
+#define VK_TIMESTAMPS_STATISTICS  4
+#define VK_TIMESTAMPS_STATISTICS_FLAGS \
+   (VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT | \
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT | \
+    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT | \
+    VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT)
+
+/* returned for a region that doesn't fit in the frame's slot */
+#define VK_TIMESTAMPS_NONE UINT32_MAX
+
+/* A region read back, from 'start' to 'end' in nanoseconds of
+ * CLOCK_MONOTONIC, of frame 'frame' (counted from 0 by
+ * vk_timestamps_begin_frame())
+ */
+typedef void (* VkTimestampsRegionEvent) (const char* label,
+                                          uint64_t frame,
+                                          uint64_t start,
+                                          uint64_t end,
+                                          void* data);
+
+struct vk_timestamps_region {
+   const char* label;
+
+   /* over every frame it was in, in nanoseconds */
+   uint64_t frames;
+   uint64_t time;
+   uint64_t time_min;
+   uint64_t time_max;
+
+   /* bucket 0 counts frames under 1 us, bucket 'i' those from 2^(i-1) us
+    * up to 2^i us, and the last one all longer ones
+    */
+   uint64_t buckets[VK_TIMESTAMPS_BUCKETS];
+
+   /* over every frame it was in, if counted */
+   uint64_t statistics[VK_TIMESTAMPS_STATISTICS];
+
+   /* since the last report */
+   uint64_t recent_frames;
+   uint64_t recent_time;
+};
+
+struct vk_timestamps_frame {
+   /* resets the slot's queries, to be submitted ahead of any that writes
+    * them
+    */
+   VkCommandBuffer reset_cmd_buffer;
+
+   /* the region of each pair of queries (start and end) written */
+   uint32_t regions[VK_TIMESTAMPS_MAX_QUERIES / 2];
+   uint32_t queries_count;
+
+   /* the frame written, counted from 0 */
+   uint64_t number;
+
+   /* begun and not read back yet */
+   bool pending;
+};
+
+struct vk_timestamps {
+   const struct vk_api* vk;
+   VkDevice device;
+   VkCommandPool cmd_pool;
+
+   /* VK_TIMESTAMPS_MAX_QUERIES per frame slot, and one statistics query
+    * per region of a slot if counted
+    */
+   VkQueryPool query_pool;
+   VkQueryPool statistics_pool;
+
+   /* nanoseconds per tick, and how many bits of a timestamp count */
+   double period;
+   uint32_t valid_bits;
+
+   struct vk_timestamps_frame frames[VK_TIMESTAMPS_FRAMES];
+   uint32_t frame;
+   uint64_t frames_begun;
+
+   /* a GPU timestamp and the CLOCK_MONOTONIC time of the same moment */
+   bool calibrated;
+   uint64_t calibration_gpu;
+   uint64_t calibration_cpu;
+
+   /* called for every region read back, once calibrated */
+   VkTimestampsRegionEvent region_event;
+   void* region_event_data;
+
+   /* the first one is the whole frame */
+   struct vk_timestamps_region regions[VK_TIMESTAMPS_MAX_REGIONS];
+   uint32_t regions_count;
+
+   /* not available when read back, or beyond the slots */
+   uint64_t frames_dropped;
+   uint64_t regions_dropped;
+};
+
+/* Fails if the queue family of 'queue_family_index' has no timestamps.
+ * Pipeline statistics are counted too if 'statistics'.
+ */
+bool vk_timestamps_init         (struct vk_timestamps* ts,
+                                 const struct vk_api* vk,
+                                 VkPhysicalDevice physical_device,
+                                 VkDevice device,
+                                 uint32_t queue_family_index,
+                                 VkCommandPool cmd_pool,
+                                 bool statistics);
+
+void vk_timestamps_destroy      (struct vk_timestamps* ts);
+
+/* Takes a GPU timestamp and the CLOCK_MONOTONIC time together, to convert
+ * the GPU times read back from then on. VK_EXT_calibrated_timestamps must be
+ * enabled, and support both time domains.
+ */
+bool vk_timestamps_calibrate    (struct vk_timestamps* ts);
+
+void vk_timestamps_set_region_callback (struct vk_timestamps* ts,
+                                        VkTimestampsRegionEvent callback,
+                                        void* data);
+
+/* Moves to the next frame slot, reading back what it held first. Returns
+ * the command buffer resetting it, to submit before the frame's others.
+ */
+VkCommandBuffer
+     vk_timestamps_begin_frame  (struct vk_timestamps* ts);
+
+/* Writes the start of region 'label' into 'cmd_buffer', returning the query
+ * to pass to vk_timestamps_end() once its commands are recorded. Regions
+ * don't nest, and begin and end outside of render passes.
+ */
+uint32_t vk_timestamps_begin    (struct vk_timestamps* ts,
+                                 VkCommandBuffer cmd_buffer,
+                                 const char* label);
+
+void vk_timestamps_end          (struct vk_timestamps* ts,
+                                 VkCommandBuffer cmd_buffer,
+                                 uint32_t query);
+
+/* Reads back every frame still pending, once the device is idle */
+void vk_timestamps_collect      (struct vk_timestamps* ts);
+
+/* Prints the average time of each region since the last report */
+void vk_timestamps_report       (struct vk_timestamps* ts);
+
+/* Prints the histograms of all frames so far, and the statistics counted
+ * per frame on average
+ */
+void vk_timestamps_print        (const struct vk_timestamps* ts);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "wsi.h"
+
+/* The entry points of one window system, see wsi.h for what they do */
+struct wsi_backend {
+   const char* name;
+   enum wsi_platform platform;
+
+   /* whether a server seems to be running, to choose the default backend */
+   bool (* available)                 (void);
+
+   bool (* init)                      (const char* win_title,
+                                       uint32_t width,
+                                       uint32_t height,
+                                       WsiExposeEvent expose_event);
+   void (* get_connection_and_window) (uint32_t window,
+                                       const void** conn,
+                                       const void** win);
+   void (* get_size)                  (uint32_t window,
+                                       uint32_t* width,
+                                       uint32_t* height);
+   void (* toggle_fullscreen)         (uint32_t window);
+   bool (* wait_for_events)           (void);
+   bool (* poll_events)               (void);
+   int32_t (* get_fd)                 (void);
+   void (* window_show)               (void);
+   void (* finish)                    (void);
+
+   /* optional, NULL if there is only window 0 */
+   bool (* create_window)             (const char* win_title,
+                                       uint32_t width,
+                                       uint32_t height,
+                                       uint32_t window);
+
+   /* optional, NULL if the window system can't share images */
+   bool (* shm_image_create)          (uint32_t window,
+                                       uint32_t width,
+                                       uint32_t height,
+                                       struct wsi_shm_image* image);
+   bool (* shm_image_present)         (const struct wsi_shm_image* image,
+                                       const struct wsi_rect* rects,
+                                       uint32_t rects_count);
+   void (* shm_image_destroy)         (struct wsi_shm_image* image);
+};
+
+#ifdef VK_USE_PLATFORM_XCB_KHR
+extern const struct wsi_backend wsi_xcb_backend;
+#endif
+
+#ifdef VK_USE_PLATFORM_WAYLAND_KHR
+extern const struct wsi_backend wsi_wayland_backend;
+#endif
+
+extern const struct wsi_backend wsi_display_backend;
+extern const struct wsi_backend wsi_null_backend;
+
+/* Adds 'rect' of 'window' to the damage collected by wsi_get_damage() */
+void wsi_add_damage   (uint32_t window, const struct wsi_rect* rect);
+
+/* Stamps 'event' with an id and its receipt time, and passes it on to the
+ * input callback.
+ */
+void wsi_report_input (struct wsi_input_event* event);
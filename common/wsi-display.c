@@ -0,0 +1,253 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include "wsi-backend.h"
+
+/* signals that would leave the terminal raw, if they killed the process */
+static const int restore_signals[] = {
+   SIGINT, SIGTERM, SIGHUP, SIGQUIT, SIGABRT, SIGSEGV, SIGBUS
+};
+#define RESTORE_SIGNALS_COUNT \
+   (sizeof (restore_signals) / sizeof (restore_signals[0]))
+
+/* There is no window here: the Vulkan surface is made straight from a display
+ * plane (VK_KHR_display), and scanned out with no compositor in between. All
+ * that is left to the WSI is the keyboard, read from the controlling terminal
+ * if there is one.
+ */
+static struct {
+   WsiExposeEvent expose_event;
+
+   uint32_t width;
+   uint32_t height;
+
+   bool has_tty;
+   struct termios saved_termios;
+   bool has_handlers;
+   struct sigaction saved_actions[RESTORE_SIGNALS_COUNT];
+
+   bool quit;
+} display_data = { 0, };
+
+static void
+restore_terminal (void)
+{
+   if (display_data.has_tty)
+      tcsetattr (STDIN_FILENO, TCSANOW, &display_data.saved_termios);
+}
+
+/* Restores the terminal, then lets the signal do what it would have */
+static void
+restore_terminal_on_signal (int sig)
+{
+   restore_terminal ();
+   raise (sig);
+}
+
+static bool
+wsi_display_available (void)
+{
+   /* the last resort, whether it works is up to the driver */
+   return true;
+}
+
+static bool
+wsi_display_init (const char* win_title,
+                  uint32_t width,
+                  uint32_t height,
+                  WsiExposeEvent expose_event)
+{
+   display_data.width = width;
+   display_data.height = height;
+   display_data.expose_event = expose_event;
+
+   /* keys are read one by one and unechoed, as a window would get them */
+   if (isatty (STDIN_FILENO) &&
+       tcgetattr (STDIN_FILENO, &display_data.saved_termios) == 0) {
+      struct termios raw = display_data.saved_termios;
+
+      raw.c_lflag &= ~(ICANON | ECHO);
+      raw.c_cc[VMIN] = 1;
+      raw.c_cc[VTIME] = 0;
+      if (tcsetattr (STDIN_FILENO, TCSANOW, &raw) == 0)
+         display_data.has_tty = true;
+   }
+
+   /* however the process ends, the terminal must echo again */
+   if (display_data.has_tty) {
+      static bool exit_hook = false;
+      struct sigaction action = {
+         .sa_handler = restore_terminal_on_signal,
+         .sa_flags = SA_RESETHAND
+      };
+
+      if (! exit_hook)
+         exit_hook = atexit (restore_terminal) == 0;
+
+      sigemptyset (&action.sa_mask);
+      for (uint32_t i = 0; i < RESTORE_SIGNALS_COUNT; i++)
+         sigaction (restore_signals[i],
+                    &action,
+                    &display_data.saved_actions[i]);
+      display_data.has_handlers = true;
+   }
+
+   if (display_data.has_tty)
+      printf ("Display: Reading keys from the terminal\n");
+   else
+      printf ("Display: No terminal, quit with a signal\n");
+
+   return true;
+}
+
+static void
+wsi_display_get_connection_and_window (uint32_t window,
+                                       const void** conn,
+                                       const void** win)
+{
+   if (conn != NULL)
+      *conn = NULL;
+
+   if (win != NULL)
+      *win = NULL;
+}
+
+static void
+wsi_display_get_size (uint32_t window, uint32_t* width, uint32_t* height)
+{
+   /* the actual size is that of the display mode, the surface knows it */
+   *width = display_data.width;
+   *height = display_data.height;
+}
+
+static void
+wsi_display_toggle_fullscreen (uint32_t window)
+{
+   /* always fullscreen */
+}
+
+static bool
+process_input (int32_t timeout)
+{
+   if (! display_data.has_tty) {
+      /* nothing to wait for but a signal */
+      if (timeout != 0)
+         poll (NULL, 0, timeout);
+      return ! display_data.quit;
+   }
+
+   struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+   int32_t ready = poll (&pfd, 1, timeout);
+   if (ready < 0) {
+      if (errno == EINTR)
+         return ! display_data.quit;
+
+      printf ("Display: Error: Failed to poll the terminal\n");
+      return false;
+   }
+
+   if (ready == 0)
+      return ! display_data.quit;
+
+   unsigned char keys[16];
+   ssize_t count = read (STDIN_FILENO, keys, sizeof (keys));
+   if (count < 0 && (errno == EINTR || errno == EAGAIN))
+      return ! display_data.quit;
+   if (count <= 0) {
+      /* the terminal went away, keep running on signals alone (and no
+       * longer watch it, see wsi_get_fd())
+       */
+      restore_terminal ();
+      display_data.has_tty = false;
+      return ! display_data.quit;
+   }
+
+   /* a lone ESC, not the start of an escape sequence */
+   if (count == 1 && keys[0] == 0x1b) {
+      display_data.quit = true;
+      return false;
+   }
+
+   for (ssize_t i = 0; i < count; i++) {
+      struct wsi_input_event input = {
+         .type = WSI_INPUT_KEY_PRESS,
+         .code = keys[i],
+         .server_time = 0
+      };
+      wsi_report_input (&input);
+
+      switch (keys[i]) {
+      case 'q':
+         display_data.quit = true;
+         break;
+
+      case 'f':
+         wsi_display_toggle_fullscreen (0);
+         break;
+
+      default:
+         printf ("key pressed: %x\n", keys[i]);
+         break;
+      }
+   }
+
+   return ! display_data.quit;
+}
+
+static bool
+wsi_display_wait_for_events (void)
+{
+   return process_input (-1);
+}
+
+static bool
+wsi_display_poll_events (void)
+{
+   return process_input (0);
+}
+
+static int32_t
+wsi_display_get_fd (void)
+{
+   return display_data.has_tty ? STDIN_FILENO : -1;
+}
+
+static void
+wsi_display_window_show (void)
+{
+   /* the first present sets the mode */
+}
+
+static void
+wsi_display_finish (void)
+{
+   restore_terminal ();
+   if (display_data.has_handlers) {
+      for (uint32_t i = 0; i < RESTORE_SIGNALS_COUNT; i++)
+         sigaction (restore_signals[i], &display_data.saved_actions[i], NULL);
+   }
+
+   memset (&display_data, 0, sizeof (display_data));
+}
+
+const struct wsi_backend wsi_display_backend = {
+   .name = "display",
+   .platform = WSI_PLATFORM_DISPLAY,
+   .available = wsi_display_available,
+   .init = wsi_display_init,
+   .get_connection_and_window = wsi_display_get_connection_and_window,
+   .get_size = wsi_display_get_size,
+   .toggle_fullscreen = wsi_display_toggle_fullscreen,
+   .wait_for_events = wsi_display_wait_for_events,
+   .poll_events = wsi_display_poll_events,
+   .get_fd = wsi_display_get_fd,
+   .window_show = wsi_display_window_show,
+   .finish = wsi_display_finish
+};
@@ -0,0 +1,409 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "wsi-backend.h"
+
+/* No window system at all: events come from a script, and frames go to
+ * plain memory through the shared memory image entry points, so the whole
+ * render loop runs (and can be timed) anywhere.
+ *
+ * The script is $WSI_NULL_SCRIPT, or the file it names after a '@'. Commands
+ * are separated by ';' or new lines, and repeated if prefixed by 'N*':
+ *
+ *   expose          the whole window needs a redraw
+ *   damage X Y W H  a rectangle of it does
+ *   resize W H      it takes a new size, and needs a redraw
+ *   key CODE        a key is pressed
+ *   frames N        N frames are drawn, the whole window each
+ *   quit            the window is closed, as at the end of the script
+ *
+ * Each command after one of the first four waits for a frame to be
+ * presented, so that a script runs the same number of frames every time.
+ * 'frames' asks for each of its frames in turn, so that it doesn't wait on an
+ * example that only draws when exposed; one that animates draws them anyway,
+ * but no longer at a pace of its own.
+ */
+#define DEFAULT_SCRIPT \
+   "100*expose; resize 800 600; 100*damage 0 0 400 300; resize 640 480; " \
+   "100*expose; quit"
+
+#define MAX_COMMAND_SIZE 64
+
+static struct {
+   WsiExposeEvent expose_event;
+
+   uint32_t width;
+   uint32_t height;
+
+   char* script;
+   const char* next;
+
+   /* the current command, and how many more times to run it */
+   char command[MAX_COMMAND_SIZE];
+   uint32_t repeat;
+
+   /* frames to wait for before the next command, each asked for if
+    * 'redraw_pending'
+    */
+   uint32_t frames_pending;
+   bool redraw_pending;
+
+   /* readable while commands can run */
+   int32_t fd;
+
+   /* frames are timed from the first to the last, so that setup (instance,
+    * device, pipelines) doesn't count
+    */
+   uint32_t commands;
+   uint32_t frames;
+   uint64_t first_frame_time;
+   uint64_t last_frame_time;
+
+   bool quit;
+} null_data = { 0, };
+
+static bool
+wsi_null_available (void)
+{
+   /* only ever chosen by name */
+   return false;
+}
+
+static char*
+load_script (void)
+{
+   const char* env = getenv ("WSI_NULL_SCRIPT");
+
+   if (env == NULL)
+      return strdup (DEFAULT_SCRIPT);
+   if (env[0] != '@')
+      return strdup (env);
+
+   FILE* file = fopen (env + 1, "r");
+   if (file == NULL) {
+      printf ("Null: Error: Failed to open script '%s'\n", env + 1);
+      return NULL;
+   }
+
+   char* script = NULL;
+   size_t size = 0;
+   char buf[1024];
+   size_t read_size;
+   while ((read_size = fread (buf, 1, sizeof (buf), file)) > 0) {
+      script = realloc (script, size + read_size + 1);
+      memcpy (script + size, buf, read_size);
+      size += read_size;
+   }
+   fclose (file);
+
+   if (script == NULL)
+      return strdup ("");
+   script[size] = '\0';
+
+   return script;
+}
+
+/* Readable or not, as commands can run or wait for a frame */
+static void
+set_ready (bool ready)
+{
+   uint64_t value = 1;
+   ssize_t size;
+
+   if (ready)
+      size = write (null_data.fd, &value, sizeof (value));
+   else
+      size = read (null_data.fd, &value, sizeof (value));
+   (void) size;
+}
+
+static bool
+wsi_null_init (const char* win_title,
+               uint32_t width,
+               uint32_t height,
+               WsiExposeEvent expose_event)
+{
+   null_data.script = load_script ();
+   if (null_data.script == NULL)
+      return false;
+   null_data.next = null_data.script;
+
+   null_data.fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+   if (null_data.fd == -1) {
+      printf ("Null: Error: Failed to create an eventfd\n");
+      free (null_data.script);
+      return false;
+   }
+   set_ready (true);
+
+   null_data.width = width;
+   null_data.height = height;
+   null_data.expose_event = expose_event;
+
+   printf ("Null: Running script '%s'\n", null_data.script);
+
+   return true;
+}
+
+static void
+wsi_null_get_connection_and_window (uint32_t window,
+                                    const void** conn,
+                                    const void** win)
+{
+   if (conn != NULL)
+      *conn = NULL;
+
+   if (win != NULL)
+      *win = NULL;
+}
+
+static void
+wsi_null_get_size (uint32_t window, uint32_t* width, uint32_t* height)
+{
+   *width = null_data.width;
+   *height = null_data.height;
+}
+
+static void
+wsi_null_toggle_fullscreen (uint32_t window)
+{
+   /* nothing to show */
+}
+
+/* Moves to the next command of the script, false at its end */
+static bool
+next_command (void)
+{
+   const char* p = null_data.next;
+
+   while (*p == ';' || *p == '\n' || *p == ' ' || *p == '\t' || *p == '\r')
+      p++;
+   if (*p == '\0')
+      return false;
+
+   size_t length = strcspn (p, ";\n");
+   null_data.next = p + length;
+
+   /* the repeat prefix, within the command */
+   char* end;
+   unsigned long repeat = strtoul (p, &end, 10);
+   if (end != p && end < p + length && *end == '*') {
+      if (repeat < 1 || repeat > UINT32_MAX) {
+         printf ("Null: Error: Invalid repeat count %.*s\n",
+                 (int) (end - p), p);
+         return false;
+      }
+      length -= end + 1 - p;
+      p = end + 1;
+   } else {
+      repeat = 1;
+   }
+
+   /* trailing blanks are dropped */
+   while (length > 0 && (p[length - 1] == ' ' || p[length - 1] == '\t' ||
+                         p[length - 1] == '\r'))
+      length--;
+   if (length >= MAX_COMMAND_SIZE)
+      length = MAX_COMMAND_SIZE - 1;
+
+   memcpy (null_data.command, p, length);
+   null_data.command[length] = '\0';
+   null_data.repeat = repeat;
+
+   return true;
+}
+
+static void
+redraw (const struct wsi_rect* rect)
+{
+   wsi_add_damage (0, rect);
+   if (null_data.expose_event != NULL)
+      null_data.expose_event (0);
+}
+
+static void
+expose (const struct wsi_rect* rect)
+{
+   redraw (rect);
+   null_data.frames_pending = 1;
+}
+
+/* Runs the current command once, false if it quits */
+static bool
+run_command (void)
+{
+   const char* command = null_data.command;
+   struct wsi_rect rect = { 0, 0, null_data.width, null_data.height };
+   uint32_t a, b, c, d;
+
+   null_data.commands++;
+
+   if (strcmp (command, "expose") == 0) {
+      expose (&rect);
+   } else if (sscanf (command, "damage %u %u %u %u", &a, &b, &c, &d) == 4) {
+      rect = (struct wsi_rect) { a, b, c, d };
+      expose (&rect);
+   } else if (sscanf (command, "resize %u %u", &a, &b) == 2 &&
+              a > 0 && b > 0) {
+      null_data.width = a;
+      null_data.height = b;
+      rect = (struct wsi_rect) { 0, 0, a, b };
+      expose (&rect);
+   } else if (sscanf (command, "key %u", &a) == 1) {
+      struct wsi_input_event input = {
+         .type = WSI_INPUT_KEY_PRESS,
+         .code = a,
+         .server_time = 0
+      };
+      wsi_report_input (&input);
+      null_data.frames_pending = 1;
+   } else if (sscanf (command, "frames %u", &a) == 1) {
+      null_data.frames_pending = a;
+      null_data.redraw_pending = a > 0;
+      if (a > 0)
+         redraw (&rect);
+   } else if (strcmp (command, "quit") == 0) {
+      return false;
+   } else {
+      printf ("Null: Error: Unknown command '%s'\n", command);
+      return false;
+   }
+
+   return true;
+}
+
+static bool
+wsi_null_poll_events (void)
+{
+   if (null_data.quit)
+      return false;
+
+   /* the last command waits for its frame */
+   if (null_data.frames_pending > 0)
+      return true;
+
+   if (null_data.repeat == 0 && ! next_command ()) {
+      null_data.quit = true;
+      return false;
+   }
+
+   null_data.repeat--;
+   if (! run_command ()) {
+      null_data.quit = true;
+      return false;
+   }
+
+   if (null_data.frames_pending > 0)
+      set_ready (false);
+
+   return true;
+}
+
+static bool
+wsi_null_wait_for_events (void)
+{
+   /* there is nothing to wait for, but the next command */
+   return wsi_null_poll_events ();
+}
+
+static int32_t
+wsi_null_get_fd (void)
+{
+   return null_data.fd;
+}
+
+static void
+wsi_null_window_show (void)
+{
+}
+
+static bool
+wsi_null_shm_image_create (uint32_t window,
+                           uint32_t width,
+                           uint32_t height,
+                           struct wsi_shm_image* image)
+{
+   image->data = malloc ((size_t) width * height * 4);
+   if (image->data == NULL) {
+      printf ("Null: Error: Failed to allocate a %ux%u image\n",
+              width,
+              height);
+      return false;
+   }
+
+   image->width = width;
+   image->height = height;
+   image->stride = width * 4;
+   image->window = window;
+   image->id = 0;
+
+   return true;
+}
+
+static bool
+wsi_null_shm_image_present (const struct wsi_shm_image* image,
+                            const struct wsi_rect* rects,
+                            uint32_t rects_count)
+{
+   null_data.last_frame_time = wsi_get_time ();
+   if (null_data.frames++ == 0)
+      null_data.first_frame_time = null_data.last_frame_time;
+
+   if (null_data.frames_pending > 0 && --null_data.frames_pending == 0) {
+      null_data.redraw_pending = false;
+      set_ready (true);
+   } else if (null_data.redraw_pending) {
+      struct wsi_rect rect = { 0, 0, null_data.width, null_data.height };
+      redraw (&rect);
+   }
+
+   return true;
+}
+
+static void
+wsi_null_shm_image_destroy (struct wsi_shm_image* image)
+{
+   free (image->data);
+   memset (image, 0, sizeof (struct wsi_shm_image));
+}
+
+static void
+wsi_null_finish (void)
+{
+   if (null_data.script == NULL)
+      return;
+
+   double elapsed =
+      (null_data.last_frame_time - null_data.first_frame_time) / 1e9;
+   printf ("Null: %u commands, %u frames, %.3f s from the first to the "
+           "last\n",
+           null_data.commands,
+           null_data.frames,
+           elapsed);
+
+   close (null_data.fd);
+   free (null_data.script);
+   memset (&null_data, 0, sizeof (null_data));
+}
+
+const struct wsi_backend wsi_null_backend = {
+   .name = "null",
+   .platform = WSI_PLATFORM_NULL,
+   .available = wsi_null_available,
+   .init = wsi_null_init,
+   .get_connection_and_window = wsi_null_get_connection_and_window,
+   .get_size = wsi_null_get_size,
+   .toggle_fullscreen = wsi_null_toggle_fullscreen,
+   .wait_for_events = wsi_null_wait_for_events,
+   .poll_events = wsi_null_poll_events,
+   .get_fd = wsi_null_get_fd,
+   .window_show = wsi_null_window_show,
+   .finish = wsi_null_finish,
+   .shm_image_create = wsi_null_shm_image_create,
+   .shm_image_present = wsi_null_shm_image_present,
+   .shm_image_destroy = wsi_null_shm_image_destroy
+};
@@ -0,0 +1,522 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wayland-client.h>
+#include "xdg-shell-client-protocol.h"
+#include "wsi-backend.h"
+
+static struct {
+   struct wl_display* display;
+   struct wl_registry* registry;
+   struct wl_compositor* compositor;
+   struct xdg_wm_base* wm_base;
+   struct wl_seat* seat;
+   struct wl_keyboard* keyboard;
+   struct wl_pointer* pointer;
+
+   /* last pointer position, button events don't carry it */
+   int32_t pointer_x;
+   int32_t pointer_y;
+
+   struct wl_surface* surface;
+   struct xdg_surface* xdg_surface;
+   struct xdg_toplevel* toplevel;
+
+   WsiExposeEvent expose_event;
+
+   uint32_t width;
+   uint32_t height;
+
+   /* size requested by the last toplevel configure, 0 if left to us */
+   uint32_t pending_width;
+   uint32_t pending_height;
+
+   bool configured;
+   bool fullscreen;
+   bool quit;
+} wl_data = { 0, };
+
+static void wsi_wayland_toggle_fullscreen (uint32_t window);
+static void wsi_wayland_finish            (void);
+
+static void
+keyboard_keymap (void* data,
+                 struct wl_keyboard* keyboard,
+                 uint32_t format,
+                 int32_t fd,
+                 uint32_t size)
+{
+   /* raw evdev key codes are enough here */
+   close (fd);
+}
+
+static void
+keyboard_enter (void* data,
+                struct wl_keyboard* keyboard,
+                uint32_t serial,
+                struct wl_surface* surface,
+                struct wl_array* keys)
+{
+}
+
+static void
+keyboard_leave (void* data,
+                struct wl_keyboard* keyboard,
+                uint32_t serial,
+                struct wl_surface* surface)
+{
+}
+
+static void
+keyboard_key (void* data,
+              struct wl_keyboard* keyboard,
+              uint32_t serial,
+              uint32_t time,
+              uint32_t key,
+              uint32_t state)
+{
+   bool pressed = state == WL_KEYBOARD_KEY_STATE_PRESSED;
+   struct wsi_input_event input = {
+      .type = pressed ? WSI_INPUT_KEY_PRESS : WSI_INPUT_KEY_RELEASE,
+      .code = key + 8,
+      .x = wl_data.pointer_x,
+      .y = wl_data.pointer_y,
+      .server_time = time
+   };
+   wsi_report_input (&input);
+
+   if (pressed)
+      return;
+
+   /* evdev codes, X key codes minus 8 */
+   switch (key) {
+   case 0x1:
+      /* ESC key */
+      wl_data.quit = true;
+      break;
+
+   case 0x21:
+      /* F key */
+      wsi_wayland_toggle_fullscreen (0);
+      break;
+
+   default:
+      printf ("key pressed: %x\n", key);
+      break;
+   }
+}
+
+static void
+keyboard_modifiers (void* data,
+                    struct wl_keyboard* keyboard,
+                    uint32_t serial,
+                    uint32_t mods_depressed,
+                    uint32_t mods_latched,
+                    uint32_t mods_locked,
+                    uint32_t group)
+{
+}
+
+static const struct wl_keyboard_listener keyboard_listener = {
+   .keymap = keyboard_keymap,
+   .enter = keyboard_enter,
+   .leave = keyboard_leave,
+   .key = keyboard_key,
+   .modifiers = keyboard_modifiers
+};
+
+static void
+pointer_enter (void* data,
+               struct wl_pointer* pointer,
+               uint32_t serial,
+               struct wl_surface* surface,
+               wl_fixed_t x,
+               wl_fixed_t y)
+{
+   wl_data.pointer_x = wl_fixed_to_int (x);
+   wl_data.pointer_y = wl_fixed_to_int (y);
+}
+
+static void
+pointer_leave (void* data,
+               struct wl_pointer* pointer,
+               uint32_t serial,
+               struct wl_surface* surface)
+{
+}
+
+static void
+pointer_motion (void* data,
+                struct wl_pointer* pointer,
+                uint32_t time,
+                wl_fixed_t x,
+                wl_fixed_t y)
+{
+   wl_data.pointer_x = wl_fixed_to_int (x);
+   wl_data.pointer_y = wl_fixed_to_int (y);
+
+   struct wsi_input_event input = {
+      .type = WSI_INPUT_MOTION,
+      .code = 0,
+      .x = wl_data.pointer_x,
+      .y = wl_data.pointer_y,
+      .server_time = time
+   };
+   wsi_report_input (&input);
+}
+
+static void
+pointer_button (void* data,
+                struct wl_pointer* pointer,
+                uint32_t serial,
+                uint32_t time,
+                uint32_t button,
+                uint32_t state)
+{
+   /* evdev BTN_LEFT, BTN_RIGHT and BTN_MIDDLE, as X numbers them */
+   uint32_t code = button;
+   if (button == 0x110)
+      code = 1;
+   else if (button == 0x111)
+      code = 3;
+   else if (button == 0x112)
+      code = 2;
+
+   struct wsi_input_event input = {
+      .type = state == WL_POINTER_BUTTON_STATE_PRESSED ?
+         WSI_INPUT_BUTTON_PRESS : WSI_INPUT_BUTTON_RELEASE,
+      .code = code,
+      .x = wl_data.pointer_x,
+      .y = wl_data.pointer_y,
+      .server_time = time
+   };
+   wsi_report_input (&input);
+}
+
+static void
+pointer_axis (void* data,
+              struct wl_pointer* pointer,
+              uint32_t time,
+              uint32_t axis,
+              wl_fixed_t value)
+{
+}
+
+static const struct wl_pointer_listener pointer_listener = {
+   .enter = pointer_enter,
+   .leave = pointer_leave,
+   .motion = pointer_motion,
+   .button = pointer_button,
+   .axis = pointer_axis
+};
+
+static void
+seat_capabilities (void* data, struct wl_seat* seat, uint32_t capabilities)
+{
+   bool has_keyboard = capabilities & WL_SEAT_CAPABILITY_KEYBOARD;
+   bool has_pointer = capabilities & WL_SEAT_CAPABILITY_POINTER;
+
+   if (has_keyboard && wl_data.keyboard == NULL) {
+      wl_data.keyboard = wl_seat_get_keyboard (seat);
+      wl_keyboard_add_listener (wl_data.keyboard, &keyboard_listener, NULL);
+   } else if (! has_keyboard && wl_data.keyboard != NULL) {
+      wl_keyboard_destroy (wl_data.keyboard);
+      wl_data.keyboard = NULL;
+   }
+
+   if (has_pointer && wl_data.pointer == NULL) {
+      wl_data.pointer = wl_seat_get_pointer (seat);
+      wl_pointer_add_listener (wl_data.pointer, &pointer_listener, NULL);
+   } else if (! has_pointer && wl_data.pointer != NULL) {
+      wl_pointer_destroy (wl_data.pointer);
+      wl_data.pointer = NULL;
+   }
+}
+
+static const struct wl_seat_listener seat_listener = {
+   .capabilities = seat_capabilities
+};
+
+static void
+wm_base_ping (void* data, struct xdg_wm_base* wm_base, uint32_t serial)
+{
+   xdg_wm_base_pong (wm_base, serial);
+}
+
+static const struct xdg_wm_base_listener wm_base_listener = {
+   .ping = wm_base_ping
+};
+
+static void
+registry_global (void* data,
+                 struct wl_registry* registry,
+                 uint32_t name,
+                 const char* interface,
+                 uint32_t version)
+{
+   if (strcmp (interface, wl_compositor_interface.name) == 0) {
+      wl_data.compositor = wl_registry_bind (registry,
+                                             name,
+                                             &wl_compositor_interface,
+                                             1);
+   } else if (strcmp (interface, xdg_wm_base_interface.name) == 0) {
+      wl_data.wm_base = wl_registry_bind (registry,
+                                          name,
+                                          &xdg_wm_base_interface,
+                                          1);
+      xdg_wm_base_add_listener (wl_data.wm_base, &wm_base_listener, NULL);
+   } else if (strcmp (interface, wl_seat_interface.name) == 0 &&
+              wl_data.seat == NULL) {
+      wl_data.seat = wl_registry_bind (registry, name, &wl_seat_interface, 1);
+      wl_seat_add_listener (wl_data.seat, &seat_listener, NULL);
+   }
+}
+
+static void
+registry_global_remove (void* data, struct wl_registry* registry, uint32_t name)
+{
+}
+
+static const struct wl_registry_listener registry_listener = {
+   .global = registry_global,
+   .global_remove = registry_global_remove
+};
+
+static void
+toplevel_configure (void* data,
+                    struct xdg_toplevel* toplevel,
+                    int32_t width,
+                    int32_t height,
+                    struct wl_array* states)
+{
+   wl_data.pending_width = width > 0 ? width : 0;
+   wl_data.pending_height = height > 0 ? height : 0;
+}
+
+static void
+toplevel_close (void* data, struct xdg_toplevel* toplevel)
+{
+   wl_data.quit = true;
+}
+
+static const struct xdg_toplevel_listener toplevel_listener = {
+   .configure = toplevel_configure,
+   .close = toplevel_close
+};
+
+/* The end of a configure sequence: from here on, buffers have the new size */
+static void
+xdg_surface_configure (void* data,
+                       struct xdg_surface* xdg_surface,
+                       uint32_t serial)
+{
+   xdg_surface_ack_configure (xdg_surface, serial);
+
+   if (wl_data.pending_width > 0 && wl_data.pending_height > 0) {
+      wl_data.width = wl_data.pending_width;
+      wl_data.height = wl_data.pending_height;
+   }
+   wl_data.configured = true;
+
+   /* the compositor keeps the contents, only a configure needs a redraw */
+   struct wsi_rect rect = { 0, 0, wl_data.width, wl_data.height };
+   wsi_add_damage (0, &rect);
+   if (wl_data.expose_event != NULL)
+      wl_data.expose_event (0);
+}
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+   .configure = xdg_surface_configure
+};
+
+static void
+wsi_wayland_toggle_fullscreen (uint32_t window)
+{
+   wl_data.fullscreen = ! wl_data.fullscreen;
+
+   if (wl_data.fullscreen)
+      xdg_toplevel_set_fullscreen (wl_data.toplevel, NULL);
+   else
+      xdg_toplevel_unset_fullscreen (wl_data.toplevel);
+
+   wl_display_flush (wl_data.display);
+}
+
+static bool
+wsi_wayland_available (void)
+{
+   return getenv ("WAYLAND_DISPLAY") != NULL;
+}
+
+static bool
+wsi_wayland_init (const char* win_title,
+                  uint32_t width,
+                  uint32_t height,
+                  WsiExposeEvent expose_event)
+{
+   /* connection to the compositor */
+   wl_data.display = wl_display_connect (NULL);
+   if (wl_data.display == NULL) {
+      printf ("Wayland: Error: Failed to connect to the compositor\n");
+      return false;
+   }
+   printf ("Wayland: Connected to the compositor\n");
+
+   /* bind the globals, all announced by the first round-trip */
+   wl_data.registry = wl_display_get_registry (wl_data.display);
+   wl_registry_add_listener (wl_data.registry, &registry_listener, NULL);
+   wl_display_roundtrip (wl_data.display);
+
+   if (wl_data.compositor == NULL || wl_data.wm_base == NULL) {
+      printf ("Wayland: Error: No wl_compositor or xdg_wm_base global\n");
+      wsi_wayland_finish ();
+      return false;
+   }
+
+   /* create the window */
+   wl_data.width = width;
+   wl_data.height = height;
+   wl_data.expose_event = expose_event;
+
+   wl_data.surface = wl_compositor_create_surface (wl_data.compositor);
+   wl_data.xdg_surface = xdg_wm_base_get_xdg_surface (wl_data.wm_base,
+                                                      wl_data.surface);
+   xdg_surface_add_listener (wl_data.xdg_surface, &xdg_surface_listener, NULL);
+
+   wl_data.toplevel = xdg_surface_get_toplevel (wl_data.xdg_surface);
+   xdg_toplevel_add_listener (wl_data.toplevel, &toplevel_listener, NULL);
+   xdg_toplevel_set_title (wl_data.toplevel,
+                           win_title != NULL ? win_title : "WSI window");
+
+   /* No buffer may be attached before the first configure, wait for it.
+    * The window is only mapped by the first present.
+    */
+   wl_surface_commit (wl_data.surface);
+   while (! wl_data.configured) {
+      if (wl_display_dispatch (wl_data.display) == -1) {
+         printf ("Wayland: Error: Lost the connection to the compositor\n");
+         wsi_wayland_finish ();
+         return false;
+      }
+   }
+
+   return true;
+}
+
+static void
+wsi_wayland_get_connection_and_window (uint32_t window,
+                                       const void** conn,
+                                       const void** win)
+{
+   if (conn != NULL)
+      *conn = (const void*) wl_data.display;
+
+   if (win != NULL)
+      *win = (const void*) wl_data.surface;
+}
+
+static void
+wsi_wayland_get_size (uint32_t window, uint32_t* width, uint32_t* height)
+{
+   *width = wl_data.width;
+   *height = wl_data.height;
+}
+
+static bool
+wsi_wayland_wait_for_events (void)
+{
+   if (wl_display_dispatch (wl_data.display) == -1) {
+      printf ("Wayland: Error: Lost the connection to the compositor\n");
+      return false;
+   }
+
+   return ! wl_data.quit;
+}
+
+static bool
+wsi_wayland_poll_events (void)
+{
+   struct wl_display* display = wl_data.display;
+
+   /* the usual dance to read events without blocking */
+   while (wl_display_prepare_read (display) != 0)
+      wl_display_dispatch_pending (display);
+   wl_display_flush (display);
+
+   struct pollfd pfd = { wl_display_get_fd (display), POLLIN, 0 };
+   if (poll (&pfd, 1, 0) > 0) {
+      if (wl_display_read_events (display) == -1) {
+         printf ("Wayland: Error: Lost the connection to the compositor\n");
+         return false;
+      }
+   } else {
+      wl_display_cancel_read (display);
+   }
+
+   if (wl_display_dispatch_pending (display) == -1)
+      return false;
+
+   return ! wl_data.quit;
+}
+
+static int32_t
+wsi_wayland_get_fd (void)
+{
+   /* requests are flushed by wsi_wayland_poll_events(), before waiting */
+   return wl_display_get_fd (wl_data.display);
+}
+
+static void
+wsi_wayland_window_show (void)
+{
+   /* surfaces are mapped when they get a buffer */
+}
+
+static void
+wsi_wayland_finish (void)
+{
+   if (wl_data.display == NULL)
+      return;
+
+   if (wl_data.toplevel != NULL)
+      xdg_toplevel_destroy (wl_data.toplevel);
+   if (wl_data.xdg_surface != NULL)
+      xdg_surface_destroy (wl_data.xdg_surface);
+   if (wl_data.surface != NULL)
+      wl_surface_destroy (wl_data.surface);
+   if (wl_data.keyboard != NULL)
+      wl_keyboard_destroy (wl_data.keyboard);
+   if (wl_data.pointer != NULL)
+      wl_pointer_destroy (wl_data.pointer);
+   if (wl_data.seat != NULL)
+      wl_seat_destroy (wl_data.seat);
+   if (wl_data.wm_base != NULL)
+      xdg_wm_base_destroy (wl_data.wm_base);
+   if (wl_data.compositor != NULL)
+      wl_compositor_destroy (wl_data.compositor);
+   wl_registry_destroy (wl_data.registry);
+
+   /* disconnect from the compositor */
+   wl_display_disconnect (wl_data.display);
+
+   memset (&wl_data, 0, sizeof (wl_data));
+}
+
+const struct wsi_backend wsi_wayland_backend = {
+   .name = "wayland",
+   .platform = WSI_PLATFORM_WAYLAND,
+   .available = wsi_wayland_available,
+   .init = wsi_wayland_init,
+   .get_connection_and_window = wsi_wayland_get_connection_and_window,
+   .get_size = wsi_wayland_get_size,
+   .toggle_fullscreen = wsi_wayland_toggle_fullscreen,
+   .wait_for_events = wsi_wayland_wait_for_events,
+   .poll_events = wsi_wayland_poll_events,
+   .get_fd = wsi_wayland_get_fd,
+   .window_show = wsi_wayland_window_show,
+   .finish = wsi_wayland_finish
+};
@@ -1,17 +1,122 @@
+#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 #include <xcb/xcb.h>
-#include "wsi.h"
+#include <xcb/shm.h>
+#include "wsi-backend.h"
+
+/* Every atom the WSI uses, interned once at init */
+enum wsi_atom {
+   ATOM_WM_PROTOCOLS = 0,
+   ATOM_WM_DELETE_WINDOW,
+   ATOM_NET_WM_STATE,
+   ATOM_NET_WM_STATE_FULLSCREEN,
+   ATOM_NET_WM_BYPASS_COMPOSITOR,
+   ATOM_COUNT
+};
+
+static const char* atom_names[ATOM_COUNT] = {
+   [ATOM_WM_PROTOCOLS]            = "WM_PROTOCOLS",
+   [ATOM_WM_DELETE_WINDOW]        = "WM_DELETE_WINDOW",
+   [ATOM_NET_WM_STATE]            = "_NET_WM_STATE",
+   [ATOM_NET_WM_STATE_FULLSCREEN] = "_NET_WM_STATE_FULLSCREEN",
+   [ATOM_NET_WM_BYPASS_COMPOSITOR] = "_NET_WM_BYPASS_COMPOSITOR",
+};
+
+struct xcb_window {
+   xcb_window_t win;
+
+   uint32_t width;
+   uint32_t height;
+
+   bool fullscreen;
+};
 
 static struct {
    xcb_connection_t* conn;
    xcb_screen_t* screen;
-   xcb_window_t win;
-   xcb_intern_atom_reply_t* atom_wm_delete_window;
+   xcb_atom_t atoms[ATOM_COUNT];
    WsiExposeEvent expose_event;
+
+   /* created with the first shared memory image */
+   xcb_gcontext_t gc;
+
+   /* indexed by the WSI window numbers */
+   struct xcb_window windows[WSI_MAX_WINDOWS];
+   uint32_t windows_count;
 } xcb_data = { 0, };
 
+/* Sends all the intern requests before waiting for any reply, so that they
+ * cost a single round-trip.
+ */
+static bool
+intern_atoms (void)
+{
+   xcb_intern_atom_cookie_t cookies[ATOM_COUNT];
+   bool result = true;
+
+   for (uint32_t i = 0; i < ATOM_COUNT; i++) {
+      cookies[i] = xcb_intern_atom (xcb_data.conn,
+                                    0,
+                                    strlen (atom_names[i]),
+                                    atom_names[i]);
+   }
+
+   for (uint32_t i = 0; i < ATOM_COUNT; i++) {
+      xcb_intern_atom_reply_t* reply = xcb_intern_atom_reply (xcb_data.conn,
+                                                              cookies[i],
+                                                              NULL);
+      if (reply == NULL) {
+         printf ("XCB: Error: Failed to intern atom '%s'\n", atom_names[i]);
+         result = false;
+         continue;
+      }
+
+      xcb_data.atoms[i] = reply->atom;
+      free (reply);
+   }
+
+   return result;
+}
+
+static void wsi_xcb_toggle_fullscreen (uint32_t window);
+static void wsi_xcb_finish            (void);
+
+/* The WSI number of 'win', or UINT32_MAX if it isn't one of ours */
+static uint32_t
+find_window (xcb_window_t win)
+{
+   for (uint32_t i = 0; i < xcb_data.windows_count; i++) {
+      if (xcb_data.windows[i].win == win)
+         return i;
+   }
+
+   return UINT32_MAX;
+}
+
+/* Key, button and motion events share the layout of xcb_key_press_event_t */
+static void
+report_input_xcb (enum wsi_input_type type, const xcb_key_press_event_t* event)
+{
+   uint32_t window = find_window (event->event);
+   if (window == UINT32_MAX)
+      return;
+
+   struct wsi_input_event input = {
+      .window = window,
+      .type = type,
+      .code = event->detail,
+      .x = event->event_x,
+      .y = event->event_y,
+      .server_time = event->time
+   };
+
+   wsi_report_input (&input);
+}
+
 static bool
 wsi_handle_event_xcb (xcb_generic_event_t* event)
 {
@@ -19,31 +124,81 @@ wsi_handle_event_xcb (xcb_generic_event_t* event)
       uint8_t event_code = event->response_type & 0x7f;
 
       switch (event_code) {
-      case XCB_EXPOSE:
+      case XCB_EXPOSE: {
+         const xcb_expose_event_t* expose = (const xcb_expose_event_t*) event;
+         uint32_t window = find_window (expose->window);
+         struct wsi_rect rect = {
+            expose->x, expose->y, expose->width, expose->height
+         };
+
+         if (window == UINT32_MAX)
+            break;
+
+         wsi_add_damage (window, &rect);
          if (xcb_data.expose_event != NULL)
-            xcb_data.expose_event ();
+            xcb_data.expose_event (window);
+         break;
+      }
+
+      case XCB_CONFIGURE_NOTIFY: {
+         const xcb_configure_notify_event_t* configure =
+            (const xcb_configure_notify_event_t*) event;
+         uint32_t window = find_window (configure->window);
+
+         if (window == UINT32_MAX)
+            break;
+
+         xcb_data.windows[window].width = configure->width;
+         xcb_data.windows[window].height = configure->height;
          break;
+      }
 
       case XCB_CLIENT_MESSAGE:
+         /* closing any of the windows quits */
          if ((* (xcb_client_message_event_t*) event).data.data32[0] ==
-             (* xcb_data.atom_wm_delete_window).atom) {
+             xcb_data.atoms[ATOM_WM_DELETE_WINDOW]) {
             return false;
          }
          break;
 
+      case XCB_KEY_PRESS:
+         report_input_xcb (WSI_INPUT_KEY_PRESS,
+                           (const xcb_key_press_event_t*) event);
+         break;
+
+      case XCB_BUTTON_PRESS:
+         report_input_xcb (WSI_INPUT_BUTTON_PRESS,
+                           (const xcb_key_press_event_t*) event);
+         break;
+
+      case XCB_BUTTON_RELEASE:
+         report_input_xcb (WSI_INPUT_BUTTON_RELEASE,
+                           (const xcb_key_press_event_t*) event);
+         break;
+
+      case XCB_MOTION_NOTIFY:
+         report_input_xcb (WSI_INPUT_MOTION,
+                           (const xcb_key_press_event_t*) event);
+         break;
+
       case XCB_KEY_RELEASE: {
          const xcb_key_release_event_t* key =
             (const xcb_key_release_event_t*) event;
+
+         report_input_xcb (WSI_INPUT_KEY_RELEASE, key);
          switch (key->detail) {
          case 0x9:
             /* ESC key */
             return false;
             break;
 
-         case 0x29:
+         case 0x29: {
             /* F key */
-            wsi_toggle_fullscreen ();
+            uint32_t window = find_window (key->event);
+            if (window != UINT32_MAX)
+               wsi_xcb_toggle_fullscreen (window);
             break;
+         }
 
          default:
             printf ("key pressed: %x\n", key->detail);
@@ -63,74 +218,78 @@ wsi_handle_event_xcb (xcb_generic_event_t* event)
    return true;
 }
 
-void
-wsi_toggle_fullscreen (void)
+static void
+wsi_xcb_toggle_fullscreen (uint32_t window)
 {
-   static bool fullscreen_mode = false;
+   struct xcb_window* xcb_win = &xcb_data.windows[window];
 
-   fullscreen_mode = ! fullscreen_mode;
-
-   xcb_intern_atom_cookie_t cookie =
-      xcb_intern_atom (xcb_data.conn, 0, 13, "_NET_WM_STATE");
-   xcb_intern_atom_reply_t* reply = xcb_intern_atom_reply (xcb_data.conn,
-                                                           cookie,
-                                                           0);
-   xcb_atom_t atom1 = reply->atom;
-   free (reply);
-
-   cookie = xcb_intern_atom (xcb_data.conn, 0, 24, "_NET_WM_STATE_FULLSCREEN");
-   reply = xcb_intern_atom_reply (xcb_data.conn, cookie, 0);
-   xcb_atom_t atom2 = reply->atom;
-   free (reply);
+   xcb_win->fullscreen = ! xcb_win->fullscreen;
 
    xcb_client_message_event_t msg = {0};
    msg.response_type = XCB_CLIENT_MESSAGE;
-   msg.window = xcb_data.win;
+   msg.window = xcb_win->win;
    msg.format = 32;
-   msg.type = atom1;
+   msg.type = xcb_data.atoms[ATOM_NET_WM_STATE];
    memset (msg.data.data32, 0, 5 * sizeof (uint32_t));
-   msg.data.data32[0] = fullscreen_mode ? 1 : 0;
-   msg.data.data32[1] = atom2;
+   msg.data.data32[0] = xcb_win->fullscreen ? 1 : 0;
+   msg.data.data32[1] = xcb_data.atoms[ATOM_NET_WM_STATE_FULLSCREEN];
 
    xcb_send_event (xcb_data.conn,
                    true,
                    xcb_data.screen->root,
                    XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY,
                    (const char *) &msg);
+
+   /* While fullscreen, the compositing manager is asked to unredirect the
+    * window (1 requests it, no property means no preference), so that its
+    * frames go to the screen without being composited: a copy and a frame
+    * of latency less, and a flip if the swapchain images allow it.
+    */
+   if (xcb_win->fullscreen) {
+      uint32_t bypass = 1;
+
+      xcb_change_property (xcb_data.conn,
+                           XCB_PROP_MODE_REPLACE,
+                           xcb_win->win,
+                           xcb_data.atoms[ATOM_NET_WM_BYPASS_COMPOSITOR],
+                           XCB_ATOM_CARDINAL, 32, 1,
+                           &bypass);
+      printf ("XCB: Window %u fullscreen, bypassing the compositor\n", window);
+   } else {
+      xcb_delete_property (xcb_data.conn,
+                           xcb_win->win,
+                           xcb_data.atoms[ATOM_NET_WM_BYPASS_COMPOSITOR]);
+      printf ("XCB: Window %u back to composited\n", window);
+   }
+
    xcb_flush (xcb_data.conn);
 }
 
-bool
-wsi_init (const char* win_title,
-          uint32_t width,
-          uint32_t height,
-          WsiExposeEvent expose_event)
+static bool
+wsi_xcb_available (void)
 {
-   /* connection to the X server */
-   xcb_data.conn = xcb_connect (NULL, NULL);
-   if (xcb_data.conn == NULL) {
-      printf ("XCB: Error: Failed to connect to X server\n");
-      return false;
-   }
-   printf ("XCB: Connected to the X server\n");
+   return getenv ("DISPLAY") != NULL;
+}
 
-   /* Get the first screen */
-   const xcb_setup_t* xcb_setup  = xcb_get_setup (xcb_data.conn);
-   xcb_screen_iterator_t iter   = xcb_setup_roots_iterator (xcb_setup);
-   xcb_data.screen = iter.data;
+/* Only sends the requests, nothing waits for the server */
+static void
+create_xcb_window (uint32_t window, uint32_t width, uint32_t height)
+{
+   struct xcb_window* xcb_win = &xcb_data.windows[window];
 
-   /* Create the window */
-   xcb_data.win = xcb_generate_id (xcb_data.conn);
+   xcb_win->win = xcb_generate_id (xcb_data.conn);
 
    uint32_t value_mask, value_list[32];
    value_mask = XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK;
    value_list[0] = xcb_data.screen->black_pixel;
-   value_list[1] = XCB_EVENT_MASK_KEY_RELEASE | XCB_EVENT_MASK_EXPOSURE |
+   value_list[1] = XCB_EVENT_MASK_KEY_PRESS | XCB_EVENT_MASK_KEY_RELEASE |
+      XCB_EVENT_MASK_BUTTON_PRESS | XCB_EVENT_MASK_BUTTON_RELEASE |
+      XCB_EVENT_MASK_POINTER_MOTION | XCB_EVENT_MASK_EXPOSURE |
       XCB_EVENT_MASK_STRUCTURE_NOTIFY;
 
    xcb_create_window (xcb_data.conn,                 /* Connection          */
                       XCB_COPY_FROM_PARENT,          /* depth (same as root)*/
-                      xcb_data.win,                  /* window Id           */
+                      xcb_win->win,                  /* window Id           */
                       xcb_data.screen->root,         /* parent window       */
                       0, 0,                          /* x, y                */
                       width, height,                 /* width, height       */
@@ -139,26 +298,53 @@ wsi_init (const char* win_title,
                       xcb_data.screen->root_visual,  /* visual              */
                       value_mask, value_list);       /* masks, not used yet */
 
-   xcb_intern_atom_cookie_t cookie =
-      xcb_intern_atom (xcb_data.conn, 1, 12, "WM_PROTOCOLS");
-   xcb_intern_atom_reply_t* reply = xcb_intern_atom_reply (xcb_data.conn,
-                                                           cookie,
-                                                           0);
-
-   xcb_intern_atom_cookie_t cookie1 =
-      xcb_intern_atom (xcb_data.conn, 0, 16, "WM_DELETE_WINDOW");
-   xcb_data.atom_wm_delete_window = xcb_intern_atom_reply (xcb_data.conn,
-                                                           cookie1,
-                                                           0);
+   xcb_win->width = width;
+   xcb_win->height = height;
+   xcb_win->fullscreen = false;
+}
 
+/* Needs the atoms */
+static void
+set_wm_protocols (uint32_t window)
+{
    xcb_change_property (xcb_data.conn,
                         XCB_PROP_MODE_REPLACE,
-                        xcb_data.win,
-                        (*reply).atom,
-                        4, 32, 1,
-                        &(*xcb_data.atom_wm_delete_window).atom);
+                        xcb_data.windows[window].win,
+                        xcb_data.atoms[ATOM_WM_PROTOCOLS],
+                        XCB_ATOM_ATOM, 32, 1,
+                        &xcb_data.atoms[ATOM_WM_DELETE_WINDOW]);
+}
 
-   free (reply);
+static bool
+wsi_xcb_init (const char* win_title,
+              uint32_t width,
+              uint32_t height,
+              WsiExposeEvent expose_event)
+{
+   /* connection to the X server */
+   xcb_data.conn = xcb_connect (NULL, NULL);
+   if (xcb_data.conn == NULL) {
+      printf ("XCB: Error: Failed to connect to X server\n");
+      return false;
+   }
+   printf ("XCB: Connected to the X server\n");
+
+   /* Get the first screen */
+   const xcb_setup_t* xcb_setup  = xcb_get_setup (xcb_data.conn);
+   xcb_screen_iterator_t iter   = xcb_setup_roots_iterator (xcb_setup);
+   xcb_data.screen = iter.data;
+
+   /* Create the window */
+   create_xcb_window (0, width, height);
+   xcb_data.windows_count = 1;
+
+   /* the only replies init waits for, after the window requests above */
+   if (! intern_atoms ()) {
+      wsi_xcb_finish ();
+      return false;
+   }
+
+   set_wm_protocols (0);
 
    /* Make sure commands are sent before we pause so that the window gets
     * shown.
@@ -170,18 +356,44 @@ wsi_init (const char* win_title,
    return true;
 }
 
-void
-wsi_get_connection_and_window (const void** conn, const void** win)
+static bool
+wsi_xcb_create_window (const char* win_title,
+                       uint32_t width,
+                       uint32_t height,
+                       uint32_t window)
+{
+   assert (window == xcb_data.windows_count);
+
+   create_xcb_window (window, width, height);
+   set_wm_protocols (window);
+   xcb_flush (xcb_data.conn);
+
+   xcb_data.windows_count++;
+
+   return true;
+}
+
+static void
+wsi_xcb_get_connection_and_window (uint32_t window,
+                                   const void** conn,
+                                   const void** win)
 {
    if (conn != NULL)
       *conn = (const void*) xcb_data.conn;
 
    if (win != NULL)
-      *win = (const void*) &xcb_data.win;
+      *win = (const void*) &xcb_data.windows[window].win;
 }
 
-bool
-wsi_wait_for_events (void)
+static void
+wsi_xcb_get_size (uint32_t window, uint32_t* width, uint32_t* height)
+{
+   *width = xcb_data.windows[window].width;
+   *height = xcb_data.windows[window].height;
+}
+
+static bool
+wsi_xcb_wait_for_events (void)
 {
    xcb_generic_event_t* event;
 
@@ -189,23 +401,226 @@ wsi_wait_for_events (void)
    return wsi_handle_event_xcb (event);
 }
 
-void
-wsi_window_show (void)
+static bool
+wsi_xcb_poll_events (void)
+{
+   xcb_generic_event_t* event;
+
+   event = xcb_poll_for_event (xcb_data.conn);
+   return wsi_handle_event_xcb (event);
+}
+
+static int32_t
+wsi_xcb_get_fd (void)
+{
+   return xcb_get_file_descriptor (xcb_data.conn);
+}
+
+static void
+wsi_xcb_window_show (void)
+{
+   for (uint32_t i = 0; i < xcb_data.windows_count; i++)
+      xcb_map_window (xcb_data.conn, xcb_data.windows[i].win);
+}
+
+/* Shared memory images are put as is, so the window's pixels must be 32-bit
+ * and in the byte order of the client.
+ */
+static bool
+window_format_is_xrgb (void)
+{
+   const xcb_setup_t* setup = xcb_get_setup (xcb_data.conn);
+   uint8_t depth = xcb_data.screen->root_depth;
+
+   if (depth != 24 && depth != 32)
+      return false;
+
+   const uint16_t one = 1;
+   uint8_t byte_order = * (const uint8_t*) &one == 1 ?
+      XCB_IMAGE_ORDER_LSB_FIRST : XCB_IMAGE_ORDER_MSB_FIRST;
+   if (setup->image_byte_order != byte_order)
+      return false;
+
+   xcb_format_iterator_t iter = xcb_setup_pixmap_formats_iterator (setup);
+   for (; iter.rem > 0; xcb_format_next (&iter)) {
+      if (iter.data->depth == depth)
+         return iter.data->bits_per_pixel == 32;
+   }
+
+   return false;
+}
+
+static bool
+wsi_xcb_shm_image_create (uint32_t window,
+                          uint32_t width,
+                          uint32_t height,
+                          struct wsi_shm_image* image)
 {
-   xcb_map_window (xcb_data.conn, xcb_data.win);
+   const xcb_query_extension_reply_t* shm_ext =
+      xcb_get_extension_data (xcb_data.conn, &xcb_shm_id);
+   if (shm_ext == NULL || ! shm_ext->present) {
+      printf ("XCB: Error: The X server has no MIT-SHM extension\n");
+      return false;
+   }
+
+   if (! window_format_is_xrgb ()) {
+      printf ("XCB: Error: Windows of depth %u are not 32-bit XRGB\n",
+              xcb_data.screen->root_depth);
+      return false;
+   }
+
+   uint32_t stride = width * 4;
+   int32_t shmid = shmget (IPC_PRIVATE,
+                           (size_t) stride * height,
+                           IPC_CREAT | 0600);
+   if (shmid == -1) {
+      printf ("XCB: Error: Failed to create a shared memory segment\n");
+      return false;
+   }
+
+   void* data = shmat (shmid, NULL, 0);
+   if (data == (void*) -1) {
+      printf ("XCB: Error: Failed to attach a shared memory segment\n");
+      shmctl (shmid, IPC_RMID, NULL);
+      return false;
+   }
+
+   xcb_shm_seg_t seg = xcb_generate_id (xcb_data.conn);
+   xcb_void_cookie_t cookie = xcb_shm_attach_checked (xcb_data.conn,
+                                                      seg,
+                                                      shmid,
+                                                      true);
+   xcb_generic_error_t* error = xcb_request_check (xcb_data.conn, cookie);
+
+   /* attached on both ends, the segment now goes away with its last user */
+   shmctl (shmid, IPC_RMID, NULL);
+
+   if (error != NULL) {
+      printf ("XCB: Error: The X server failed to attach a shared memory "
+              "segment\n");
+      free (error);
+      shmdt (data);
+      return false;
+   }
+
+   if (xcb_data.gc == 0) {
+      xcb_data.gc = xcb_generate_id (xcb_data.conn);
+      xcb_create_gc (xcb_data.conn,
+                     xcb_data.gc,
+                     xcb_data.windows[window].win,
+                     0, NULL);
+   }
+
+   image->data = data;
+   image->width = width;
+   image->height = height;
+   image->stride = stride;
+   image->window = window;
+   image->id = seg;
+
+   return true;
 }
 
-void
-wsi_finish (void)
+static bool
+wsi_xcb_shm_image_present (const struct wsi_shm_image* image,
+                           const struct wsi_rect* rects,
+                           uint32_t rects_count)
+{
+   struct wsi_rect whole = { 0, 0, image->width, image->height };
+
+   if (rects_count == 0) {
+      rects = &whole;
+      rects_count = 1;
+   }
+
+   for (uint32_t i = 0; i < rects_count; i++) {
+      int32_t x0 = rects[i].x > 0 ? rects[i].x : 0;
+      int32_t y0 = rects[i].y > 0 ? rects[i].y : 0;
+      int32_t x1 = rects[i].x + (int32_t) rects[i].width;
+      int32_t y1 = rects[i].y + (int32_t) rects[i].height;
+
+      if (x1 > (int32_t) image->width)
+         x1 = image->width;
+      if (y1 > (int32_t) image->height)
+         y1 = image->height;
+      if (x1 <= x0 || y1 <= y0)
+         continue;
+
+      xcb_shm_put_image (xcb_data.conn,
+                         xcb_data.windows[image->window].win,
+                         xcb_data.gc,
+                         image->width, image->height,
+                         x0, y0,
+                         x1 - x0, y1 - y0,
+                         x0, y0,
+                         xcb_data.screen->root_depth,
+                         XCB_IMAGE_FORMAT_Z_PIXMAP,
+                         0,
+                         image->id,
+                         0);
+   }
+
+   /* The server reads the segment as it handles the puts: once it answers a
+    * later request, it is done with them.
+    */
+   xcb_get_input_focus_reply_t* reply =
+      xcb_get_input_focus_reply (xcb_data.conn,
+                                 xcb_get_input_focus (xcb_data.conn),
+                                 NULL);
+   if (reply == NULL) {
+      printf ("XCB: Error: Lost the connection to the X server\n");
+      return false;
+   }
+   free (reply);
+
+   return true;
+}
+
+static void
+wsi_xcb_shm_image_destroy (struct wsi_shm_image* image)
+{
+   xcb_shm_detach (xcb_data.conn, image->id);
+   xcb_flush (xcb_data.conn);
+
+   shmdt (image->data);
+   memset (image, 0, sizeof (struct wsi_shm_image));
+}
+
+static void
+wsi_xcb_finish (void)
 {
    if (xcb_data.conn == NULL)
       return;
 
-   /* Unmap the window from the screen */
-   xcb_unmap_window (xcb_data.conn, xcb_data.win);
+   if (xcb_data.gc != 0)
+      xcb_free_gc (xcb_data.conn, xcb_data.gc);
+   xcb_data.gc = 0;
 
-   free (xcb_data.atom_wm_delete_window);
+   /* Unmap the windows from the screen */
+   for (uint32_t i = 0; i < xcb_data.windows_count; i++)
+      xcb_unmap_window (xcb_data.conn, xcb_data.windows[i].win);
+   xcb_data.windows_count = 0;
 
    /* disconnect from the X server */
    xcb_disconnect (xcb_data.conn);
+   xcb_data.conn = NULL;
 }
+
+const struct wsi_backend wsi_xcb_backend = {
+   .name = "xcb",
+   .platform = WSI_PLATFORM_XCB,
+   .available = wsi_xcb_available,
+   .init = wsi_xcb_init,
+   .get_connection_and_window = wsi_xcb_get_connection_and_window,
+   .get_size = wsi_xcb_get_size,
+   .toggle_fullscreen = wsi_xcb_toggle_fullscreen,
+   .wait_for_events = wsi_xcb_wait_for_events,
+   .poll_events = wsi_xcb_poll_events,
+   .get_fd = wsi_xcb_get_fd,
+   .window_show = wsi_xcb_window_show,
+   .finish = wsi_xcb_finish,
+   .create_window = wsi_xcb_create_window,
+   .shm_image_create = wsi_xcb_shm_image_create,
+   .shm_image_present = wsi_xcb_shm_image_present,
+   .shm_image_destroy = wsi_xcb_shm_image_destroy
+};
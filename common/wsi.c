@@ -0,0 +1,267 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "wsi-backend.h"
+
+/* in order of preference, when the environment doesn't say */
+static const struct wsi_backend* backends[] = {
+#ifdef VK_USE_PLATFORM_WAYLAND_KHR
+   &wsi_wayland_backend,
+#endif
+#ifdef VK_USE_PLATFORM_XCB_KHR
+   &wsi_xcb_backend,
+#endif
+   &wsi_display_backend,
+   &wsi_null_backend,
+   NULL
+};
+
+static const struct wsi_backend* backend = NULL;
+
+static uint32_t windows_count = 0;
+
+static struct {
+   struct wsi_rect rects[WSI_MAX_DAMAGE_RECTS];
+   uint32_t count;
+} damage[WSI_MAX_WINDOWS] = { { { { 0, } }, 0 }, };
+
+static struct {
+   WsiInputEvent callback;
+   uint32_t last_id;
+} input = { NULL, 0 };
+
+bool
+wsi_select_backend (const char* name)
+{
+   for (uint32_t i = 0; backends[i] != NULL; i++) {
+      if (strcmp (backends[i]->name, name) == 0) {
+         backend = backends[i];
+         return true;
+      }
+   }
+
+   printf ("WSI: Error: Backend '%s' not supported, try:", name);
+   for (uint32_t i = 0; backends[i] != NULL; i++)
+      printf (" %s", backends[i]->name);
+   printf ("\n");
+
+   return false;
+}
+
+bool
+wsi_init (const char* win_title,
+          uint32_t width,
+          uint32_t height,
+          WsiExposeEvent expose_event)
+{
+   if (backend == NULL) {
+      const char* name = getenv ("WSI_BACKEND");
+
+      if (name != NULL) {
+         if (! wsi_select_backend (name))
+            return false;
+      } else {
+         for (uint32_t i = 0; backends[i] != NULL && backend == NULL; i++) {
+            if (backends[i]->available ())
+               backend = backends[i];
+         }
+      }
+   }
+
+   printf ("WSI: Using the %s backend\n", backend->name);
+
+   if (! backend->init (win_title, width, height, expose_event))
+      return false;
+
+   windows_count = 1;
+   return true;
+}
+
+bool
+wsi_create_window (const char* win_title,
+                   uint32_t width,
+                   uint32_t height,
+                   uint32_t* window)
+{
+   if (backend->create_window == NULL) {
+      printf ("WSI: Error: The %s backend has a single window\n",
+              backend->name);
+      return false;
+   }
+
+   if (windows_count == WSI_MAX_WINDOWS) {
+      printf ("WSI: Error: No more than %u windows\n", WSI_MAX_WINDOWS);
+      return false;
+   }
+
+   if (! backend->create_window (win_title, width, height, windows_count))
+      return false;
+
+   *window = windows_count++;
+   return true;
+}
+
+enum wsi_platform
+wsi_get_platform (void)
+{
+   assert (backend != NULL);
+   return backend->platform;
+}
+
+void
+wsi_get_connection_and_window (uint32_t window,
+                               const void** conn,
+                               const void** win)
+{
+   assert (window < windows_count);
+   backend->get_connection_and_window (window, conn, win);
+}
+
+void
+wsi_get_size (uint32_t window, uint32_t* width, uint32_t* height)
+{
+   assert (window < windows_count);
+   backend->get_size (window, width, height);
+}
+
+void
+wsi_toggle_fullscreen (uint32_t window)
+{
+   assert (window < windows_count);
+   backend->toggle_fullscreen (window);
+}
+
+bool
+wsi_wait_for_events (void)
+{
+   return backend->wait_for_events ();
+}
+
+bool
+wsi_poll_events (void)
+{
+   return backend->poll_events ();
+}
+
+int32_t
+wsi_get_fd (void)
+{
+   return backend->get_fd ();
+}
+
+void
+wsi_add_damage (uint32_t window, const struct wsi_rect* rect)
+{
+   assert (window < WSI_MAX_WINDOWS);
+   struct wsi_rect* rects = damage[window].rects;
+   uint32_t* count = &damage[window].count;
+
+   if (*count < WSI_MAX_DAMAGE_RECTS) {
+      rects[(*count)++] = *rect;
+      return;
+   }
+
+   /* out of rectangles, collapse everything into the bounding box */
+   int32_t x0 = rect->x, y0 = rect->y;
+   int32_t x1 = rect->x + rect->width, y1 = rect->y + rect->height;
+   for (uint32_t i = 0; i < *count; i++) {
+      const struct wsi_rect* r = &rects[i];
+
+      x0 = r->x < x0 ? r->x : x0;
+      y0 = r->y < y0 ? r->y : y0;
+      x1 = r->x + (int32_t) r->width > x1 ? r->x + (int32_t) r->width : x1;
+      y1 = r->y + (int32_t) r->height > y1 ? r->y + (int32_t) r->height : y1;
+   }
+
+   rects[0] = (struct wsi_rect) { x0, y0, x1 - x0, y1 - y0 };
+   *count = 1;
+}
+
+uint32_t
+wsi_get_damage (uint32_t window, struct wsi_rect* rects)
+{
+   assert (window < windows_count);
+   uint32_t count = damage[window].count;
+
+   memcpy (rects, damage[window].rects, count * sizeof (struct wsi_rect));
+   damage[window].count = 0;
+
+   return count;
+}
+
+void
+wsi_set_input_callback (WsiInputEvent input_event)
+{
+   input.callback = input_event;
+}
+
+uint64_t
+wsi_get_time (void)
+{
+   struct timespec now;
+
+   clock_gettime (CLOCK_MONOTONIC, &now);
+   return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void
+wsi_report_input (struct wsi_input_event* event)
+{
+   event->id = ++input.last_id;
+   event->receipt_time = wsi_get_time ();
+
+   if (input.callback != NULL)
+      input.callback (event);
+}
+
+void
+wsi_window_show (void)
+{
+   backend->window_show ();
+}
+
+bool
+wsi_shm_image_create (uint32_t window,
+                      uint32_t width,
+                      uint32_t height,
+                      struct wsi_shm_image* image)
+{
+   assert (window < windows_count);
+
+   if (backend->shm_image_create == NULL) {
+      printf ("WSI: Error: The %s backend has no shared memory images\n",
+              backend->name);
+      return false;
+   }
+
+   return backend->shm_image_create (window, width, height, image);
+}
+
+bool
+wsi_shm_image_present (const struct wsi_shm_image* image,
+                       const struct wsi_rect* rects,
+                       uint32_t rects_count)
+{
+   return backend->shm_image_present (image, rects, rects_count);
+}
+
+void
+wsi_shm_image_destroy (struct wsi_shm_image* image)
+{
+   if (image->data != NULL)
+      backend->shm_image_destroy (image);
+}
+
+void
+wsi_finish (void)
+{
+   if (backend != NULL)
+      backend->finish ();
+
+   memset (damage, 0, sizeof (damage));
+   windows_count = 0;
+}
@@ -3,20 +3,166 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-typedef void (* WsiExposeEvent) (void);
+/* Windows are numbered from 0, in the order they are created */
+typedef void (* WsiExposeEvent) (uint32_t window);
+
+enum wsi_input_type {
+   WSI_INPUT_KEY_PRESS = 0,
+   WSI_INPUT_KEY_RELEASE,
+   WSI_INPUT_BUTTON_PRESS,
+   WSI_INPUT_BUTTON_RELEASE,
+   WSI_INPUT_MOTION
+};
+
+/* A keyboard or pointer event, with the times to follow it to the screen */
+struct wsi_input_event {
+   /* increasing from 1, in the order events are received */
+   uint32_t id;
+
+   /* the window that had the focus */
+   uint32_t window;
+
+   enum wsi_input_type type;
+
+   /* X key codes (evdev + 8) and X buttons (1 left, 2 middle, 3 right), or
+    * bytes read from the terminal on display
+    */
+   uint32_t code;
+
+   /* pointer position in the window */
+   int32_t x;
+   int32_t y;
+
+   /* in milliseconds, when the server saw the event (0 on display) */
+   uint32_t server_time;
+
+   /* in nanoseconds of wsi_get_time(), when the client got the event */
+   uint64_t receipt_time;
+};
+
+typedef void (* WsiInputEvent) (const struct wsi_input_event* event);
+
+enum wsi_platform {
+   WSI_PLATFORM_XCB = 0,
+   WSI_PLATFORM_WAYLAND,
+   WSI_PLATFORM_DISPLAY,
+   WSI_PLATFORM_NULL
+};
+
+/* A rectangle of the window, in pixels from its top-left corner */
+struct wsi_rect {
+   int32_t x;
+   int32_t y;
+   uint32_t width;
+   uint32_t height;
+};
+
+#define WSI_MAX_DAMAGE_RECTS 16
+
+#define WSI_MAX_WINDOWS 16
+
+/* Picks a backend by name ("xcb", "wayland", "display", "null"), before
+ * wsi_init(). Otherwise, wsi_init() takes the one named by $WSI_BACKEND, or
+ * the first one that finds its server, Wayland first. Without any, it falls
+ * back to "display", which presents straight to a screen through
+ * VK_KHR_display. "null" is only used by name: it plays a script of events
+ * (see wsi-null.c) and shows nothing, frames go to shared memory images.
+ */
+bool wsi_select_backend            (const char* name);
 
 bool wsi_init                      (const char* win_title,
                                     uint32_t width,
                                     uint32_t height,
                                     WsiExposeEvent expose_event);
 
-void wsi_get_connection_and_window (const void** conn,
+/* Opens another window next to window 0, which wsi_init() opened, and stores
+ * its number in 'window'. Only XCB has more than one.
+ */
+bool wsi_create_window             (const char* win_title,
+                                    uint32_t width,
+                                    uint32_t height,
+                                    uint32_t* window);
+
+enum wsi_platform wsi_get_platform (void);
+
+/* The native handles to create a Vulkan surface from: xcb_connection_t* and
+ * xcb_window_t* on XCB, wl_display* and wl_surface* on Wayland. None on
+ * display, where the surface is made from a display plane instead, nor on
+ * null, which has no surface.
+ */
+void wsi_get_connection_and_window (uint32_t window,
+                                    const void** conn,
                                     const void** win);
 
-void wsi_toggle_fullscreen         (void);
+/* Current size of the window, as last configured */
+void wsi_get_size                  (uint32_t window,
+                                    uint32_t* width,
+                                    uint32_t* height);
+
+void wsi_toggle_fullscreen         (uint32_t window);
 
 bool wsi_wait_for_events           (void);
 
+/* Handles pending events, if any, without blocking */
+bool wsi_poll_events               (void);
+
+/* A file descriptor that gets readable as events arrive, to wait on along
+ * with others (see event-loop.h) before handling them with wsi_poll_events().
+ * Events may be queued already without it being readable: poll them before
+ * waiting. -1 if there is nothing to wait on, which it may become once events
+ * are handled (e.g. a terminal that hung up): stop waiting on it then.
+ */
+int32_t wsi_get_fd                 (void);
+
+/* Moves the rectangles of 'window' exposed since the last call into 'rects',
+ * which must hold WSI_MAX_DAMAGE_RECTS, and returns how many there are. Once
+ * that many are pending, further ones are merged into their bounding box.
+ */
+uint32_t wsi_get_damage            (uint32_t window,
+                                    struct wsi_rect* rects);
+
+/* Has 'input_event' called for every keyboard and pointer event, from within
+ * wsi_wait_for_events() and wsi_poll_events().
+ */
+void wsi_set_input_callback        (WsiInputEvent input_event);
+
+/* CLOCK_MONOTONIC, in nanoseconds */
+uint64_t wsi_get_time              (void);
+
+/* Maps every window */
 void wsi_window_show               (void);
 
+/* An image shared with the window system, to present frames written by the
+ * CPU (e.g, read back from a software Vulkan device) without a swapchain or
+ * any copy through the connection. XCB has them, over MIT-SHM, and null, in
+ * plain memory. Pixels are 32-bit, B, G, R, X in memory.
+ */
+struct wsi_shm_image {
+   void* data;
+   uint32_t width;
+   uint32_t height;
+   uint32_t stride;
+
+   /* the window it is presented to */
+   uint32_t window;
+
+   /* the backend's handle */
+   uint32_t id;
+};
+
+bool wsi_shm_image_create          (uint32_t window,
+                                    uint32_t width,
+                                    uint32_t height,
+                                    struct wsi_shm_image* image);
+
+/* Puts 'rects' of 'image' (all of it if 'rects_count' is 0) at the same place
+ * in its window. Returns once the server is done reading them, so the image
+ * can be written again.
+ */
+bool wsi_shm_image_present         (const struct wsi_shm_image* image,
+                                    const struct wsi_rect* rects,
+                                    uint32_t rects_count);
+
+void wsi_shm_image_destroy         (struct wsi_shm_image* image);
+
 void wsi_finish                    (void);
@@ -0,0 +1,476 @@
+/*
+ * Example:
+ *
+ * Compute client: Load generator for compute-daemon.
+ *
+ * Opens a number of connections to the daemon, and keeps up to 'window'
+ * requests in flight on each, until every connection got all its replies.
+ * Outputs are validated against a CPU implementation of the kernels.
+ * Reports jobs/s and the latency distribution over all jobs, then per
+ * connection, which shows whether the daemon treats clients fairly (see -g
+ * to make one connection greedy).
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "protocol.h"
+
+#define MAX_CONNECTIONS 64
+#define MAX_WINDOW      256
+
+#define DEFAULT_CONNECTIONS 4
+#define DEFAULT_JOBS        2000
+#define DEFAULT_ELEMENTS    1024
+#define DEFAULT_WINDOW      4
+#define DEFAULT_ROUNDS      16
+
+struct slot {
+   uint32_t id;
+   uint64_t sent_ns;
+
+   /* with -m: the memfd passed along the request */
+   int32_t memfd;
+   uint32_t* map;
+};
+
+struct connection {
+   int32_t fd;
+   uint32_t window;
+
+   struct slot slots[MAX_WINDOW];
+   uint32_t sent;
+   uint32_t received;
+   uint32_t errors;
+   uint32_t mismatches;
+
+   uint64_t* latencies;
+   uint64_t done_ns;
+};
+
+static struct {
+   uint32_t kernel;
+   uint32_t params[COMPUTE_MAX_PARAMS];
+   uint32_t count;
+   uint32_t jobs;
+   bool use_memfd;
+} config = {
+   .kernel = COMPUTE_KERNEL_SCALE,
+   .count = DEFAULT_ELEMENTS,
+   .jobs = DEFAULT_JOBS,
+};
+
+static uint64_t
+get_time_ns (void)
+{
+   struct timespec ts;
+
+   clock_gettime (CLOCK_MONOTONIC, &ts);
+   return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint32_t
+input_value (uint32_t id, uint32_t i)
+{
+   return id * 7919u + i;
+}
+
+/* CPU version of the kernels, to validate replies */
+static uint32_t
+expected_value (uint32_t x)
+{
+   switch (config.kernel) {
+   case COMPUTE_KERNEL_SCALE:
+      return x * config.params[0] + config.params[1];
+   case COMPUTE_KERNEL_HASH:
+      for (uint32_t i = 0; i < config.params[0]; i++) {
+         x ^= x >> 16;
+         x *= 0x7feb352du;
+         x ^= x >> 15;
+      }
+      return x;
+   default:
+      return 0;
+   }
+}
+
+static bool
+connect_daemon (struct connection* conn, const char* path)
+{
+   struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+   snprintf (addr.sun_path, sizeof (addr.sun_path), "%s", path);
+
+   conn->fd = socket (AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+   if (conn->fd < 0)
+      return false;
+
+   if (connect (conn->fd, (struct sockaddr*) &addr, sizeof (addr)) != 0) {
+      printf ("Error: Failed to connect to '%s': %s\n", path, strerror (errno));
+      close (conn->fd);
+      conn->fd = -1;
+      return false;
+   }
+
+   if (config.use_memfd) {
+      size_t size = config.count * sizeof (uint32_t);
+
+      for (uint32_t s = 0; s < conn->window; s++) {
+         struct slot* slot = &conn->slots[s];
+
+         /* sealed against shrinking, as the daemon requires */
+         slot->memfd = memfd_create ("compute-client",
+                                     MFD_CLOEXEC | MFD_ALLOW_SEALING);
+         if (slot->memfd < 0 || ftruncate (slot->memfd, size) != 0 ||
+             fcntl (slot->memfd, F_ADD_SEALS, F_SEAL_SHRINK) != 0)
+            return false;
+         slot->map = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                           slot->memfd, 0);
+         if (slot->map == MAP_FAILED)
+            return false;
+      }
+   }
+
+   return true;
+}
+
+static bool
+send_request (struct connection* conn)
+{
+   static uint32_t data[COMPUTE_MAX_INLINE / sizeof (uint32_t)];
+   struct slot* slot = &conn->slots[conn->sent % conn->window];
+   struct compute_request req = {
+      .id = conn->sent,
+      .kernel = config.kernel,
+      .count = config.count
+   };
+   union {
+      struct cmsghdr header;
+      uint8_t data[CMSG_SPACE (sizeof (int32_t))];
+   } control;
+   struct iovec iov[2] = {
+      { .iov_base = &req, .iov_len = sizeof (req) },
+      { .iov_base = data, .iov_len = config.count * sizeof (uint32_t) }
+   };
+   struct msghdr hdr = {
+      .msg_iov = iov,
+      .msg_iovlen = 2
+   };
+
+   memcpy (req.params, config.params, sizeof (req.params));
+
+   uint32_t* input = config.use_memfd ? slot->map : data;
+   for (uint32_t i = 0; i < config.count; i++)
+      input[i] = input_value (req.id, i);
+
+   if (config.use_memfd) {
+      req.flags |= COMPUTE_REQUEST_FD;
+      hdr.msg_iovlen = 1;
+      hdr.msg_control = control.data;
+      hdr.msg_controllen = sizeof (control.data);
+
+      struct cmsghdr* cmsg = CMSG_FIRSTHDR (&hdr);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN (sizeof (int32_t));
+      memcpy (CMSG_DATA (cmsg), &slot->memfd, sizeof (int32_t));
+   }
+
+   slot->id = req.id;
+   slot->sent_ns = get_time_ns ();
+
+   if (sendmsg (conn->fd, &hdr, MSG_NOSIGNAL) < 0) {
+      printf ("Error: Failed to send request: %s\n", strerror (errno));
+      return false;
+   }
+   conn->sent++;
+
+   return true;
+}
+
+static bool
+receive_reply (struct connection* conn)
+{
+   static uint8_t msg[sizeof (struct compute_reply) + COMPUTE_MAX_INLINE];
+
+   ssize_t size = recv (conn->fd, msg, sizeof (msg), 0);
+   if (size < (ssize_t) sizeof (struct compute_reply)) {
+      printf ("Error: Connection to the daemon lost\n");
+      return false;
+   }
+
+   uint64_t now = get_time_ns ();
+   const struct compute_reply* reply = (const struct compute_reply*) msg;
+   struct slot* slot = &conn->slots[conn->received % conn->window];
+
+   if (reply->id != slot->id) {
+      printf ("Error: Got reply %u, expected %u\n", reply->id, slot->id);
+      return false;
+   }
+
+   conn->latencies[conn->received] = now - slot->sent_ns;
+   conn->received++;
+   if (conn->received == config.jobs)
+      conn->done_ns = now;
+
+   if (reply->status != COMPUTE_STATUS_OK || reply->count != config.count) {
+      conn->errors++;
+      return true;
+   }
+
+   const uint32_t* output = config.use_memfd ?
+      slot->map : (const uint32_t*) (msg + sizeof (struct compute_reply));
+   for (uint32_t i = 0; i < config.count; i++) {
+      if (output[i] != expected_value (input_value (reply->id, i))) {
+         conn->mismatches++;
+         break;
+      }
+   }
+
+   return true;
+}
+
+static int
+compare_u64 (const void* a, const void* b)
+{
+   uint64_t x = *(const uint64_t*) a;
+   uint64_t y = *(const uint64_t*) b;
+
+   return x < y ? -1 : x > y;
+}
+
+/* sorts 'values' */
+static double
+percentile_us (uint64_t* values, uint32_t count, double p)
+{
+   qsort (values, count, sizeof (uint64_t), compare_u64);
+
+   uint32_t i = (uint32_t) (p / 100.0 * (count - 1) + 0.5);
+   return values[i] / 1000.0;
+}
+
+static void
+print_usage (const char* name)
+{
+   printf ("Usage: %s [options]\n"
+           "  -S <path>   socket path (default: $XDG_RUNTIME_DIR/%s)\n"
+           "  -c <n>      connections (default: %u, max: %u)\n"
+           "  -n <n>      jobs per connection (default: %u)\n"
+           "  -s <n>      elements per job (default: %u)\n"
+           "  -w <n>      requests in flight per connection (default: %u)\n"
+           "  -g <n>      requests in flight on the first connection\n"
+           "  -k <name>   kernel: 'scale' or 'hash' (default: scale)\n"
+           "  -r <n>      hash rounds (default: %u)\n"
+           "  -m          pass input and output in a memfd\n",
+           name,
+           COMPUTE_SOCKET_NAME,
+           DEFAULT_CONNECTIONS,
+           MAX_CONNECTIONS,
+           DEFAULT_JOBS,
+           DEFAULT_ELEMENTS,
+           DEFAULT_WINDOW,
+           DEFAULT_ROUNDS);
+}
+
+int32_t
+main (int32_t argc, char* argv[])
+{
+   char socket_path[108];
+   uint32_t num_conns = DEFAULT_CONNECTIONS;
+   uint32_t window = DEFAULT_WINDOW;
+   uint32_t greedy_window = 0;
+   uint32_t rounds = DEFAULT_ROUNDS;
+   int opt;
+
+   compute_get_socket_path (socket_path, sizeof (socket_path));
+
+   while ((opt = getopt (argc, argv, "S:c:n:s:w:g:k:r:mh")) != -1) {
+      switch (opt) {
+      case 'S':
+         snprintf (socket_path, sizeof (socket_path), "%s", optarg);
+         break;
+      case 'c':
+         num_conns = atoi (optarg);
+         break;
+      case 'n':
+         config.jobs = atoi (optarg);
+         break;
+      case 's':
+         config.count = atoi (optarg);
+         break;
+      case 'w':
+         window = atoi (optarg);
+         break;
+      case 'g':
+         greedy_window = atoi (optarg);
+         break;
+      case 'k':
+         if (strcmp (optarg, "scale") == 0) {
+            config.kernel = COMPUTE_KERNEL_SCALE;
+         } else if (strcmp (optarg, "hash") == 0) {
+            config.kernel = COMPUTE_KERNEL_HASH;
+         } else {
+            print_usage (argv[0]);
+            return -1;
+         }
+         break;
+      case 'r':
+         rounds = atoi (optarg);
+         break;
+      case 'm':
+         config.use_memfd = true;
+         break;
+      default:
+         print_usage (argv[0]);
+         return opt == 'h' ? 0 : -1;
+      }
+   }
+   if (num_conns == 0 || num_conns > MAX_CONNECTIONS ||
+       config.jobs == 0 || config.count == 0 ||
+       window == 0 || window > MAX_WINDOW || greedy_window > MAX_WINDOW) {
+      print_usage (argv[0]);
+      return -1;
+   }
+   if (! config.use_memfd &&
+       config.count * sizeof (uint32_t) > COMPUTE_MAX_INLINE) {
+      printf ("Error: Inline jobs are limited to %zu elements, use -m\n",
+              COMPUTE_MAX_INLINE / sizeof (uint32_t));
+      return -1;
+   }
+
+   if (config.kernel == COMPUTE_KERNEL_SCALE) {
+      config.params[0] = 3;
+      config.params[1] = 1;
+   } else {
+      config.params[0] = rounds;
+   }
+
+   struct connection* conns = calloc (num_conns, sizeof (struct connection));
+   bool ok = true;
+
+   for (uint32_t c = 0; c < num_conns && ok; c++) {
+      conns[c].window = c == 0 && greedy_window > 0 ? greedy_window : window;
+      conns[c].latencies = calloc (config.jobs, sizeof (uint64_t));
+      ok = connect_daemon (&conns[c], socket_path);
+   }
+
+   uint64_t start = get_time_ns ();
+   uint32_t active = num_conns;
+
+   while (ok && active > 0) {
+      struct pollfd fds[MAX_CONNECTIONS];
+
+      for (uint32_t c = 0; c < num_conns && ok; c++) {
+         struct connection* conn = &conns[c];
+
+         while (ok &&
+                conn->sent < config.jobs &&
+                conn->sent - conn->received < conn->window)
+            ok = send_request (conn);
+
+         fds[c].fd = conn->received < config.jobs ? conn->fd : -1;
+         fds[c].events = POLLIN;
+      }
+
+      if (! ok || poll (fds, num_conns, -1) < 0)
+         break;
+
+      for (uint32_t c = 0; c < num_conns && ok; c++) {
+         if (fds[c].revents == 0)
+            continue;
+         ok = receive_reply (&conns[c]);
+         if (ok && conns[c].received == config.jobs)
+            active--;
+      }
+   }
+
+   uint64_t elapsed = get_time_ns () - start;
+
+   if (ok) {
+      uint32_t total = num_conns * config.jobs;
+      uint64_t* all = malloc (total * sizeof (uint64_t));
+      uint32_t errors = 0, mismatches = 0;
+
+      for (uint32_t c = 0; c < num_conns; c++) {
+         memcpy (all + c * config.jobs,
+                 conns[c].latencies,
+                 config.jobs * sizeof (uint64_t));
+         errors += conns[c].errors;
+         mismatches += conns[c].mismatches;
+      }
+
+      printf ("%u connections x %u jobs of %u elements, %s%s\n\n",
+              num_conns,
+              config.jobs,
+              config.count,
+              config.kernel == COMPUTE_KERNEL_SCALE ? "scale" : "hash",
+              config.use_memfd ? ", memfd" : ", inline");
+      printf ("jobs/s:  %.1f\n", total * 1e9 / elapsed);
+      printf ("MB/s:    %.1f\n",
+              (double) total * config.count * sizeof (uint32_t) * 1e3 / elapsed);
+      printf ("latency: p50 %.1f us, p90 %.1f us, p99 %.1f us, "
+              "p99.9 %.1f us, max %.1f us\n",
+              percentile_us (all, total, 50.0),
+              percentile_us (all, total, 90.0),
+              percentile_us (all, total, 99.0),
+              percentile_us (all, total, 99.9),
+              percentile_us (all, total, 100.0));
+      printf ("result:  %s (%u errors, %u mismatches)\n\n",
+              errors == 0 && mismatches == 0 ? "ok" : "FAILED",
+              errors,
+              mismatches);
+
+      printf ("%-6s %6s %10s %12s %12s\n",
+              "conn", "window", "jobs/s", "p50 (us)", "p99 (us)");
+      for (uint32_t c = 0; c < num_conns; c++) {
+         struct connection* conn = &conns[c];
+
+         printf ("%-6u %6u %10.1f %12.1f %12.1f\n",
+                 c,
+                 conn->window,
+                 config.jobs * 1e9 / (conn->done_ns - start),
+                 percentile_us (conn->latencies, config.jobs, 50.0),
+                 percentile_us (conn->latencies, config.jobs, 99.0));
+      }
+
+      free (all);
+      ok = errors == 0 && mismatches == 0;
+   }
+
+   /* free stuff */
+   for (uint32_t c = 0; c < num_conns; c++) {
+      for (uint32_t s = 0; s < conns[c].window; s++) {
+         if (conns[c].slots[s].map != NULL && conns[c].slots[s].map != MAP_FAILED)
+            munmap (conns[c].slots[s].map, config.count * sizeof (uint32_t));
+         if (conns[c].slots[s].memfd > 0)
+            close (conns[c].slots[s].memfd);
+      }
+      if (conns[c].fd > 0)
+         close (conns[c].fd);
+      free (conns[c].latencies);
+   }
+   free (conns);
+
+   return ok ? 0 : -1;
+}
@@ -0,0 +1,628 @@
+/*
+ * Example:
+ *
+ * Compute daemon: A long-lived process that sets up GBM, EGL, a GLES 3.1
+ *                 context and all its compute programs once, then serves
+ *                 compute jobs to any number of clients over a Unix socket.
+ *
+ * A one-shot tool like render-nodes-minimal pays for device, context and
+ * shader setup on every run, which dwarfs the cost of a small job. Here that
+ * cost is paid once at startup.
+ *
+ * Requests (see protocol.h) carry a kernel ID, parameters, and the input
+ * either inline or in a passed memfd. They are queued per client, and the
+ * scheduler takes one job from each client with pending work in turn, so a
+ * client flooding the daemon cannot starve the others. A client whose queue
+ * is full is not read from until it drains (back pressure), and one that
+ * doesn't read its replies is skipped until it does: replies never block.
+ *
+ * Use compute-client as load generator.
+ *
+ * Tested on Mesa 22.3, llvmpipe.
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "common/gles-compute.h"
+#include "protocol.h"
+
+#define LOCAL_SIZE_X    64
+
+#define MAX_CLIENTS     64
+#define MAX_CLIENT_JOBS 32
+
+#define MAX_MESSAGE_SIZE (sizeof (struct compute_request) + COMPUTE_MAX_INLINE)
+
+static const struct {
+   const char* filename;
+   uint32_t num_params;
+} kernels[COMPUTE_KERNEL_COUNT] = {
+   [COMPUTE_KERNEL_SCALE] = { CURRENT_DIR "/scale.comp", 2 },
+   [COMPUTE_KERNEL_HASH]  = { CURRENT_DIR "/hash.comp",  1 },
+};
+
+struct job {
+   struct compute_request req;
+   enum compute_status status;
+
+   uint32_t* data;      /* inline copy, or mapping of 'fd' */
+   int32_t fd;
+   size_t map_size;
+};
+
+struct client {
+   int32_t fd;
+   uint32_t serial;
+
+   struct job jobs[MAX_CLIENT_JOBS];
+   uint32_t head;
+   uint32_t queued;
+
+   /* the last reply, and its inline output, if the socket was full */
+   bool reply_pending;
+   struct compute_reply reply;
+   uint32_t reply_data[COMPUTE_MAX_INLINE / sizeof (uint32_t)];
+   size_t reply_size;
+
+   uint64_t served;
+};
+
+static struct {
+   struct gles_compute gc;
+   GLuint programs[COMPUTE_KERNEL_COUNT];
+
+   /* grown on demand, shared by all jobs */
+   GLuint input;
+   GLuint output;
+   GLsizeiptr buffer_size;
+
+   int32_t listen_fd;
+   struct client clients[MAX_CLIENTS];
+   uint32_t num_clients;
+   uint32_t next_serial;
+   uint32_t next_client;   /* round-robin cursor */
+
+   uint64_t jobs;
+   uint64_t busy_ns;
+} server;
+
+static volatile sig_atomic_t quit = 0;
+
+static void
+on_signal (int sig)
+{
+   quit = 1;
+}
+
+static void
+free_job (struct job* job)
+{
+   if (job->map_size > 0)
+      munmap (job->data, job->map_size);
+   else
+      free (job->data);
+   if (job->fd >= 0)
+      close (job->fd);
+   memset (job, 0, sizeof (struct job));
+   job->fd = -1;
+}
+
+static void
+close_client (struct client* client)
+{
+   printf ("Client %u: disconnected, %lu jobs served\n",
+           client->serial,
+           (unsigned long) client->served);
+
+   while (client->queued > 0) {
+      free_job (&client->jobs[client->head]);
+      client->head = (client->head + 1) % MAX_CLIENT_JOBS;
+      client->queued--;
+   }
+
+   close (client->fd);
+   client->fd = -1;
+   server.num_clients--;
+}
+
+static void
+accept_client (void)
+{
+   int32_t fd = accept4 (server.listen_fd,
+                         NULL,
+                         NULL,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+   if (fd < 0)
+      return;
+
+   for (uint32_t i = 0; i < MAX_CLIENTS; i++) {
+      struct client* client = &server.clients[i];
+
+      if (client->fd < 0) {
+         memset (client, 0, sizeof (struct client));
+         client->fd = fd;
+         client->serial = server.next_serial++;
+         server.num_clients++;
+         printf ("Client %u: connected\n", client->serial);
+         return;
+      }
+   }
+
+   printf ("Error: Too many clients, connection refused\n");
+   close (fd);
+}
+
+/* Fills 'job' from a received message. Malformed requests are still queued,
+ * with an error status, so that replies keep the order of requests.
+ */
+static void
+parse_request (struct job* job,
+               const uint8_t* msg,
+               size_t size,
+               int32_t fd,
+               bool truncated)
+{
+   const struct compute_request* req = (const struct compute_request*) msg;
+
+   job->status = COMPUTE_STATUS_INVALID;
+
+   /* only keep an fd passed along with a request for one */
+   job->fd = -1;
+   if (size < sizeof (struct compute_request) || truncated ||
+       ! (req->flags & COMPUTE_REQUEST_FD)) {
+      if (fd >= 0)
+         close (fd);
+   } else {
+      job->fd = fd;
+   }
+
+   if (size < sizeof (struct compute_request) || truncated)
+      return;
+
+   job->req = *req;
+
+   if (req->kernel >= COMPUTE_KERNEL_COUNT ||
+       req->count == 0 ||
+       req->count > COMPUTE_MAX_ELEMENTS)
+      return;
+
+   size_t data_size = (size_t) req->count * sizeof (uint32_t);
+
+   if (req->flags & COMPUTE_REQUEST_FD) {
+      struct stat st;
+
+      /* it can't shrink under the mapping, which would fault */
+      int32_t seals = fd >= 0 ? fcntl (fd, F_GET_SEALS) : -1;
+      if (seals < 0 || ! (seals & F_SEAL_SHRINK))
+         return;
+
+      if (fstat (fd, &st) != 0 || (size_t) st.st_size < data_size)
+         return;
+
+      job->data = mmap (NULL, data_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        fd, 0);
+      if (job->data == MAP_FAILED) {
+         job->data = NULL;
+         return;
+      }
+      job->map_size = data_size;
+   } else {
+      if (size != sizeof (struct compute_request) + data_size)
+         return;
+
+      job->data = malloc (data_size);
+      if (job->data == NULL)
+         return;
+      memcpy (job->data, msg + sizeof (struct compute_request), data_size);
+   }
+
+   job->status = COMPUTE_STATUS_OK;
+}
+
+/* Queues all requests available on 'client', up to a full queue. Returns
+ * false if the client went away.
+ */
+static bool
+receive_requests (struct client* client)
+{
+   static uint8_t msg[MAX_MESSAGE_SIZE];
+
+   while (client->queued < MAX_CLIENT_JOBS) {
+      union {
+         struct cmsghdr header;
+         uint8_t data[CMSG_SPACE (sizeof (int32_t))];
+      } control;
+      struct iovec iov = {
+         .iov_base = msg,
+         .iov_len = sizeof (msg)
+      };
+      struct msghdr hdr = {
+         .msg_iov = &iov,
+         .msg_iovlen = 1,
+         .msg_control = control.data,
+         .msg_controllen = sizeof (control.data)
+      };
+
+      ssize_t size = recvmsg (client->fd, &hdr, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+      if (size < 0)
+         return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+      if (size == 0)
+         return false;
+
+      int32_t fd = -1;
+      struct cmsghdr* cmsg = CMSG_FIRSTHDR (&hdr);
+      if (cmsg != NULL &&
+          cmsg->cmsg_level == SOL_SOCKET &&
+          cmsg->cmsg_type == SCM_RIGHTS)
+         memcpy (&fd, CMSG_DATA (cmsg), sizeof (int32_t));
+
+      uint32_t tail = (client->head + client->queued) % MAX_CLIENT_JOBS;
+      parse_request (&client->jobs[tail],
+                     msg,
+                     size,
+                     fd,
+                     hdr.msg_flags & (MSG_TRUNC | MSG_CTRUNC));
+      client->queued++;
+   }
+
+   return true;
+}
+
+static bool
+ensure_buffers (GLsizeiptr size)
+{
+   if (size <= server.buffer_size)
+      return true;
+
+   GLsizeiptr new_size = server.buffer_size > 0 ? server.buffer_size : 4096;
+   while (new_size < size)
+      new_size *= 2;
+
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, server.input);
+   glBufferData (GL_SHADER_STORAGE_BUFFER, new_size, NULL, GL_STREAM_DRAW);
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, server.output);
+   glBufferData (GL_SHADER_STORAGE_BUFFER, new_size, NULL, GL_STREAM_READ);
+
+   if (glGetError () != GL_NO_ERROR) {
+      printf ("Error: Failed to allocate %ld bytes buffers\n", (long) new_size);
+      server.buffer_size = 0;
+      return false;
+   }
+   server.buffer_size = new_size;
+
+   return true;
+}
+
+static enum compute_status
+run_job (const struct job* job, uint32_t* output)
+{
+   const struct compute_request* req = &job->req;
+   GLsizeiptr size = (GLsizeiptr) req->count * sizeof (uint32_t);
+
+   if (! ensure_buffers (size))
+      return COMPUTE_STATUS_FAILED;
+
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, server.input);
+   glBufferSubData (GL_SHADER_STORAGE_BUFFER, 0, size, job->data);
+
+   glUseProgram (server.programs[req->kernel]);
+   glUniform1ui (0, req->count);
+   for (uint32_t i = 0; i < kernels[req->kernel].num_params; i++)
+      glUniform1ui (1 + i, req->params[i]);
+
+   glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 0, server.input);
+   glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 1, server.output);
+   gles_compute_dispatch_1d (&server.gc,
+                             (req->count + LOCAL_SIZE_X - 1) / LOCAL_SIZE_X);
+
+   glMemoryBarrier (GL_BUFFER_UPDATE_BARRIER_BIT);
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, server.output);
+   const void* result = glMapBufferRange (GL_SHADER_STORAGE_BUFFER,
+                                          0,
+                                          size,
+                                          GL_MAP_READ_BIT);
+   if (result == NULL)
+      return COMPUTE_STATUS_FAILED;
+
+   memcpy (output, result, size);
+   glUnmapBuffer (GL_SHADER_STORAGE_BUFFER);
+
+   return COMPUTE_STATUS_OK;
+}
+
+/* Sends the pending reply of 'client', if any. It stays pending while the
+ * socket is full. Returns false if the client went away.
+ */
+static bool
+send_reply (struct client* client)
+{
+   if (! client->reply_pending)
+      return true;
+
+   struct iovec iov[2] = {
+      {
+         .iov_base = &client->reply,
+         .iov_len = sizeof (struct compute_reply)
+      },
+      { .iov_base = client->reply_data, .iov_len = client->reply_size }
+   };
+   struct msghdr hdr = {
+      .msg_iov = iov,
+      .msg_iovlen = client->reply_size > 0 ? 2 : 1
+   };
+
+   /* packets go whole or not at all */
+   if (sendmsg (client->fd, &hdr, MSG_NOSIGNAL | MSG_DONTWAIT) < 0)
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+   client->reply_pending = false;
+   return true;
+}
+
+/* A client with jobs to run, and room for their reply */
+static bool
+is_ready (const struct client* client)
+{
+   return client->fd >= 0 && client->queued > 0 && ! client->reply_pending;
+}
+
+/* Runs the oldest job of the next ready client, round-robin */
+static void
+dispatch_next (void)
+{
+   for (uint32_t n = 0; n < MAX_CLIENTS; n++) {
+      uint32_t c = (server.next_client + n) % MAX_CLIENTS;
+      struct client* client = &server.clients[c];
+      uint32_t* output = client->reply_data;
+
+      if (! is_ready (client))
+         continue;
+
+      struct job* job = &client->jobs[client->head];
+      struct compute_reply reply = {
+         .id = job->req.id,
+         .status = job->status,
+         .count = 0
+      };
+      bool inline_output = ! (job->req.flags & COMPUTE_REQUEST_FD);
+
+      if (reply.status == COMPUTE_STATUS_OK) {
+         uint64_t start = gles_compute_get_time_ns ();
+         reply.status = run_job (job, inline_output ? output : job->data);
+         uint64_t elapsed = gles_compute_get_time_ns () - start;
+
+         reply.gpu_time_us = elapsed / 1000;
+         server.busy_ns += elapsed;
+         server.jobs++;
+         client->served++;
+      }
+      if (reply.status == COMPUTE_STATUS_OK)
+         reply.count = job->req.count;
+
+      size_t data_size = 0;
+      if (reply.status == COMPUTE_STATUS_OK && inline_output)
+         data_size = reply.count * sizeof (uint32_t);
+
+      free_job (job);
+      client->head = (client->head + 1) % MAX_CLIENT_JOBS;
+      client->queued--;
+
+      client->reply = reply;
+      client->reply_size = data_size;
+      client->reply_pending = true;
+      if (! send_reply (client))
+         close_client (client);
+
+      server.next_client = (c + 1) % MAX_CLIENTS;
+      return;
+   }
+}
+
+static bool
+init_gles (const char* render_node)
+{
+   if (! gles_compute_init (&server.gc, render_node)) {
+      printf ("Error: Failed to setup a GLES compute context\n");
+      return false;
+   }
+   printf ("Renderer: %s\n", server.gc.renderer);
+
+   char defines[64];
+   snprintf (defines, sizeof (defines), "#define LOCAL_SIZE_X %u\n",
+             LOCAL_SIZE_X);
+
+   for (uint32_t k = 0; k < COMPUTE_KERNEL_COUNT; k++) {
+      server.programs[k] = gles_compute_load_program (kernels[k].filename,
+                                                      defines);
+      if (server.programs[k] == 0)
+         return false;
+   }
+
+   glGenBuffers (1, &server.input);
+   glGenBuffers (1, &server.output);
+
+   return true;
+}
+
+static bool
+init_socket (const char* path)
+{
+   struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+   if (strlen (path) >= sizeof (addr.sun_path)) {
+      printf ("Error: Socket path too long: '%s'\n", path);
+      return false;
+   }
+   strcpy (addr.sun_path, path);
+
+   server.listen_fd = socket (AF_UNIX,
+                              SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                              0);
+   if (server.listen_fd < 0) {
+      printf ("Error: Failed to create socket: %s\n", strerror (errno));
+      return false;
+   }
+
+   /* a previous instance may have left its socket behind */
+   unlink (path);
+
+   if (bind (server.listen_fd, (struct sockaddr*) &addr, sizeof (addr)) != 0 ||
+       listen (server.listen_fd, 16) != 0) {
+      printf ("Error: Failed to listen on '%s': %s\n", path, strerror (errno));
+      return false;
+   }
+
+   return true;
+}
+
+static void
+print_usage (const char* name)
+{
+   printf ("Usage: %s [options]\n"
+           "  -d <path>  DRM render node (default: %s)\n"
+           "  -S <path>  socket path (default: $XDG_RUNTIME_DIR/%s)\n",
+           name,
+           GLES_COMPUTE_DEFAULT_RENDER_NODE,
+           COMPUTE_SOCKET_NAME);
+}
+
+int32_t
+main (int32_t argc, char* argv[])
+{
+   const char* render_node = NULL;
+   char socket_path[108];
+   int opt;
+
+   compute_get_socket_path (socket_path, sizeof (socket_path));
+
+   while ((opt = getopt (argc, argv, "d:S:h")) != -1) {
+      switch (opt) {
+      case 'd':
+         render_node = optarg;
+         break;
+      case 'S':
+         snprintf (socket_path, sizeof (socket_path), "%s", optarg);
+         break;
+      default:
+         print_usage (argv[0]);
+         return opt == 'h' ? 0 : -1;
+      }
+   }
+
+   server.listen_fd = -1;
+   for (uint32_t i = 0; i < MAX_CLIENTS; i++)
+      server.clients[i].fd = -1;
+
+   uint64_t start = gles_compute_get_time_ns ();
+   if (! init_gles (render_node) || ! init_socket (socket_path))
+      goto out;
+   printf ("Ready in %.1f ms, listening on %s\n",
+           (gles_compute_get_time_ns () - start) / 1e6,
+           socket_path);
+
+   struct sigaction sa = { .sa_handler = on_signal };
+   sigaction (SIGINT, &sa, NULL);
+   sigaction (SIGTERM, &sa, NULL);
+
+   start = gles_compute_get_time_ns ();
+
+   while (! quit) {
+      struct pollfd fds[1 + MAX_CLIENTS];
+      struct client* polled[1 + MAX_CLIENTS];
+      uint32_t num_fds = 0;
+      bool pending = false;
+
+      fds[num_fds].fd = server.listen_fd;
+      fds[num_fds].events = POLLIN;
+      polled[num_fds++] = NULL;
+
+      for (uint32_t i = 0; i < MAX_CLIENTS; i++) {
+         struct client* client = &server.clients[i];
+
+         if (client->fd < 0)
+            continue;
+         pending |= is_ready (client);
+
+         /* back pressure: stop reading a client with a full queue, and wait
+          * for room for a reply it doesn't read yet
+          */
+         fds[num_fds].fd = client->fd;
+         fds[num_fds].events =
+            (client->queued < MAX_CLIENT_JOBS ? POLLIN : 0) |
+            (client->reply_pending ? POLLOUT : 0);
+         polled[num_fds++] = client;
+      }
+
+      /* with jobs pending, only pick up new requests, don't block */
+      if (poll (fds, num_fds, pending ? 0 : -1) < 0) {
+         if (errno == EINTR)
+            continue;
+         printf ("Error: poll() failed: %s\n", strerror (errno));
+         break;
+      }
+
+      if (fds[0].revents & POLLIN)
+         accept_client ();
+
+      for (uint32_t i = 1; i < num_fds; i++) {
+         if (fds[i].revents == 0)
+            continue;
+         if (! send_reply (polled[i]) ||
+             ! receive_requests (polled[i]) ||
+             (fds[i].revents & (POLLHUP | POLLERR) && polled[i]->queued == 0))
+            close_client (polled[i]);
+      }
+
+      dispatch_next ();
+   }
+
+   uint64_t elapsed = gles_compute_get_time_ns () - start;
+   printf ("\n%lu jobs served, GPU path busy %.1f%% of the time\n",
+           (unsigned long) server.jobs,
+           elapsed > 0 ? server.busy_ns * 100.0 / elapsed : 0.0);
+
+ out:
+   /* free stuff */
+   for (uint32_t i = 0; i < MAX_CLIENTS; i++) {
+      if (server.clients[i].fd >= 0)
+         close_client (&server.clients[i]);
+   }
+
+   if (server.listen_fd >= 0) {
+      close (server.listen_fd);
+      unlink (socket_path);
+   }
+
+   if (server.gc.display != EGL_NO_DISPLAY) {
+      glDeleteBuffers (1, &server.output);
+      glDeleteBuffers (1, &server.input);
+      for (uint32_t k = 0; k < COMPUTE_KERNEL_COUNT; k++)
+         glDeleteProgram (server.programs[k]);
+   }
+   gles_compute_finish (&server.gc);
+
+   return quit ? 0 : -1;
+}
@@ -0,0 +1,80 @@
+/*
+ * Compute daemon protocol
+ *
+ * Clients connect to a SOCK_SEQPACKET Unix socket, so every message is one
+ * datagram-like packet. A request is a 'struct compute_request', followed by
+ * 'count' 32-bit input elements, unless COMPUTE_REQUEST_FD is set: then a
+ * file descriptor (e.g, a memfd) of at least 'count' elements is passed
+ * along (SCM_RIGHTS), holding the input, and the output is written back to
+ * it in place. It must be sealed with F_SEAL_SHRINK (a memfd created with
+ * MFD_ALLOW_SEALING), so that it can't be truncated under the daemon's
+ * mapping of it; requests with one that isn't are invalid.
+ *
+ * Each request gets one 'struct compute_reply' with the same 'id', followed
+ * by the output elements when they were sent inline. Replies to a client
+ * come in the order of its requests.
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define COMPUTE_SOCKET_NAME  "compute-daemon.sock"
+
+/* inline payloads must fit a single packet */
+#define COMPUTE_MAX_INLINE   (32 << 10)
+#define COMPUTE_MAX_ELEMENTS (16 << 20)
+#define COMPUTE_MAX_PARAMS   4
+
+enum compute_kernel {
+   COMPUTE_KERNEL_SCALE = 0,   /* dst = src * params[0] + params[1] */
+   COMPUTE_KERNEL_HASH,        /* dst = hash (src), params[0] rounds */
+   COMPUTE_KERNEL_COUNT
+};
+
+enum compute_request_flags {
+   COMPUTE_REQUEST_FD = 1 << 0
+};
+
+enum compute_status {
+   COMPUTE_STATUS_OK = 0,
+   COMPUTE_STATUS_INVALID,     /* bad kernel, size or payload */
+   COMPUTE_STATUS_FAILED
+};
+
+struct compute_request {
+   uint32_t id;
+   uint32_t kernel;
+   uint32_t flags;
+   uint32_t count;
+   uint32_t params[COMPUTE_MAX_PARAMS];
+};
+
+struct compute_reply {
+   uint32_t id;
+   uint32_t status;
+   uint32_t count;
+   uint32_t gpu_time_us;       /* upload + dispatch + readback */
+};
+
+/* $XDG_RUNTIME_DIR/compute-daemon.sock, or under /tmp */
+static inline void
+compute_get_socket_path (char* path, size_t len)
+{
+   const char* dir = getenv ("XDG_RUNTIME_DIR");
+
+   if (dir == NULL || dir[0] == '\0')
+      dir = "/tmp";
+
+   snprintf (path, len, "%s/%s", dir, COMPUTE_SOCKET_NAME);
+}
@@ -0,0 +1,250 @@
+/*
+ * Batched complex FFTs on GLES 3.1 compute shaders.
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gpu-fft.h"
+
+#define MAX_LOCAL_SIZE_X 128
+
+#define PI 3.14159265358979323846
+
+/* uniform locations, fixed in fft.comp */
+#define UNIFORM_NUM_GROUPS          0
+#define UNIFORM_BATCHES             1
+#define UNIFORM_STRIDES             2
+#define UNIFORM_TRANSFORM_SIZE      3
+#define UNIFORM_TWIDDLE_STRIDE      4
+#define UNIFORM_POST_TWIDDLE_STRIDE 5
+
+/* How one pass addresses its transforms, see fft.comp */
+struct fft_pass {
+   uint32_t size;
+   uint32_t outer;
+   uint32_t batches;
+   uint32_t strides[4];
+   uint32_t transform_size;
+   uint32_t post_twiddle_stride;
+};
+
+static uint32_t
+log2_uint (uint32_t value)
+{
+   uint32_t log = 0;
+
+   while (value >>= 1)
+      log++;
+
+   return log;
+}
+
+static bool
+is_pow2 (uint32_t value)
+{
+   return value != 0 && (value & (value - 1)) == 0;
+}
+
+bool
+gpu_fft_init (struct gpu_fft* fft,
+              const struct gles_compute* gc,
+              enum gpu_fft_radix radix)
+{
+   memset (fft, 0, sizeof (struct gpu_fft));
+   fft->gc = gc;
+   fft->radix = radix;
+
+   /* two halves of 'size' vec2 for the Stockham stages */
+   uint32_t max_pass = (uint32_t) gc->max_shared_memory_size /
+      (2 * 2 * sizeof (float));
+   fft->max_pass_size = 1u << log2_uint (max_pass);
+   if (fft->max_pass_size > GPU_FFT_MAX_SIZE)
+      fft->max_pass_size = GPU_FFT_MAX_SIZE;
+
+   /* any size must split into two passes */
+   if ((uint64_t) fft->max_pass_size * fft->max_pass_size < GPU_FFT_MAX_SIZE) {
+      printf ("Error: Not enough shared memory for %u-point FFTs\n",
+              GPU_FFT_MAX_SIZE);
+      return false;
+   }
+
+   float* table = malloc (GPU_FFT_MAX_SIZE * 2 * sizeof (float));
+   if (table == NULL) {
+      printf ("Error: Failed to allocate the twiddle factors\n");
+      return false;
+   }
+   for (uint32_t i = 0; i < GPU_FFT_MAX_SIZE; i++) {
+      double angle = -2.0 * PI * i / GPU_FFT_MAX_SIZE;
+
+      table[i * 2 + 0] = cos (angle);
+      table[i * 2 + 1] = sin (angle);
+   }
+
+   glGenBuffers (1, &fft->twiddles);
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, fft->twiddles);
+   glBufferData (GL_SHADER_STORAGE_BUFFER,
+                 GPU_FFT_MAX_SIZE * 2 * sizeof (float),
+                 table,
+                 GL_STATIC_DRAW);
+   free (table);
+
+   glGenBuffers (1, &fft->scratch);
+
+   return true;
+}
+
+void
+gpu_fft_finish (struct gpu_fft* fft)
+{
+   for (uint32_t i = 0; i <= GPU_FFT_MAX_LOG2; i++)
+      glDeleteProgram (fft->programs[i]);
+
+   glDeleteBuffers (1, &fft->twiddles);
+   glDeleteBuffers (1, &fft->scratch);
+
+   memset (fft, 0, sizeof (struct gpu_fft));
+}
+
+static GLuint
+get_program (struct gpu_fft* fft, uint32_t size)
+{
+   uint32_t log = log2_uint (size);
+
+   if (fft->programs[log] != 0)
+      return fft->programs[log];
+
+   uint32_t radix = fft->radix == GPU_FFT_RADIX_4 && size >= 4 ? 4 : 2;
+   uint32_t local_size_x = size / radix;
+   if (local_size_x > MAX_LOCAL_SIZE_X)
+      local_size_x = MAX_LOCAL_SIZE_X;
+
+   char defines[128];
+   snprintf (defines, sizeof (defines),
+             "#define N %u\n#define RADIX %u\n#define LOCAL_SIZE_X %u\n",
+             size, radix, local_size_x);
+
+   fft->programs[log] = gles_compute_load_program (CURRENT_DIR "/fft.comp",
+                                                   defines);
+   return fft->programs[log];
+}
+
+/* returns the scratch buffer, grown to at least 'size' bytes if needed */
+static GLuint
+get_scratch (struct gpu_fft* fft, GLsizeiptr size)
+{
+   if (fft->scratch_size < size) {
+      glBindBuffer (GL_SHADER_STORAGE_BUFFER, fft->scratch);
+      glBufferData (GL_SHADER_STORAGE_BUFFER, size, NULL, GL_DYNAMIC_COPY);
+      fft->scratch_size = size;
+   }
+
+   return fft->scratch;
+}
+
+static bool
+dispatch (struct gpu_fft* fft,
+          const struct fft_pass* pass,
+          GLuint src,
+          GLuint dst)
+{
+   GLuint program = get_program (fft, pass->size);
+   if (program == 0)
+      return false;
+
+   uint32_t groups = pass->outer * pass->batches;
+
+   glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 0, src);
+   glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 1, dst);
+   glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 2, fft->twiddles);
+
+   glUseProgram (program);
+   glUniform1ui (UNIFORM_NUM_GROUPS, groups);
+   glUniform1ui (UNIFORM_BATCHES, pass->batches);
+   glUniform4uiv (UNIFORM_STRIDES, 1, pass->strides);
+   glUniform1ui (UNIFORM_TRANSFORM_SIZE, pass->transform_size);
+   glUniform1ui (UNIFORM_TWIDDLE_STRIDE, GPU_FFT_MAX_SIZE / pass->size);
+   glUniform1ui (UNIFORM_POST_TWIDDLE_STRIDE, pass->post_twiddle_stride);
+
+   gles_compute_dispatch_1d (fft->gc, groups);
+   glMemoryBarrier (GL_SHADER_STORAGE_BARRIER_BIT);
+
+   return true;
+}
+
+bool
+gpu_fft_1d (struct gpu_fft* fft,
+            GLuint src,
+            GLuint dst,
+            uint32_t size,
+            uint32_t batches)
+{
+   assert (is_pow2 (size) && size >= 2 && size <= GPU_FFT_MAX_SIZE);
+   assert (src != dst);
+
+   if (size <= fft->max_pass_size) {
+      const struct fft_pass pass = {
+         size, batches, 1, { 0, 1, 0, 1 }, size, 0
+      };
+      return dispatch (fft, &pass, src, dst);
+   }
+
+   /* Four-step FFT of size = n1 * n2, as n1 x n2 matrices: n2 transforms of
+    * size n1 down the columns, multiplied by exp(-2 pi i n2 k1 / size) and
+    * transposed on the way out, then n1 transforms of size n2 along the
+    * rows, transposed back on the way out.
+    */
+   uint32_t n1 = 1u << ((log2_uint (size) + 1) / 2);
+   uint32_t n2 = size / n1;
+   GLuint scratch = get_scratch (fft,
+                                 (GLsizeiptr) size * batches * 2 *
+                                 sizeof (float));
+
+   const struct fft_pass columns = {
+      n1, batches, n2, { 1, n2, 1, n2 }, size, GPU_FFT_MAX_SIZE / size
+   };
+   const struct fft_pass rows = {
+      n2, batches, n1, { n2, 1, 1, n1 }, size, 0
+   };
+
+   return dispatch (fft, &columns, src, scratch) &&
+      dispatch (fft, &rows, scratch, dst);
+}
+
+bool
+gpu_fft_2d (struct gpu_fft* fft,
+            GLuint src,
+            GLuint dst,
+            uint32_t width,
+            uint32_t height,
+            uint32_t batches)
+{
+   assert (is_pow2 (width) && width >= 2 && width <= fft->max_pass_size);
+   assert (is_pow2 (height) && height >= 2 && height <= fft->max_pass_size);
+   assert (src != dst);
+
+   uint32_t size = width * height;
+   GLuint scratch = get_scratch (fft,
+                                 (GLsizeiptr) size * batches * 2 *
+                                 sizeof (float));
+
+   const struct fft_pass rows = {
+      width, batches * height, 1, { 0, 1, 0, 1 }, width, 0
+   };
+   const struct fft_pass columns = {
+      height, batches, width, { 1, width, 1, width }, size, 0
+   };
+
+   return dispatch (fft, &rows, src, scratch) &&
+      dispatch (fft, &columns, scratch, dst);
+}
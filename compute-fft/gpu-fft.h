@@ -0,0 +1,75 @@
+/*
+ * Batched complex FFTs on GLES 3.1 compute shaders.
+ *
+ * Transforms are forward and unnormalized, on shader storage buffers of
+ * complex values stored as pairs of floats (real, imaginary). All functions
+ * expect the context of 'gc' to be current.
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "common/gles-compute.h"
+
+/* largest transform, also the size of the twiddle table */
+#define GPU_FFT_MAX_LOG2 16
+#define GPU_FFT_MAX_SIZE (1 << GPU_FFT_MAX_LOG2)
+
+enum gpu_fft_radix {
+   GPU_FFT_RADIX_2 = 0,
+   GPU_FFT_RADIX_4,
+   GPU_FFT_RADIX_COUNT
+};
+
+struct gpu_fft {
+   const struct gles_compute* gc;
+   enum gpu_fft_radix radix;
+
+   /* largest size transformed in shared memory, in a single pass */
+   uint32_t max_pass_size;
+
+   /* one kernel per size, compiled on first use */
+   GLuint programs[GPU_FFT_MAX_LOG2 + 1];
+
+   /* exp(-2 pi i k / GPU_FFT_MAX_SIZE), precomputed in double precision */
+   GLuint twiddles;
+
+   GLuint scratch;
+   GLsizeiptr scratch_size;
+};
+
+bool gpu_fft_init   (struct gpu_fft* fft,
+                    const struct gles_compute* gc,
+                    enum gpu_fft_radix radix);
+
+void gpu_fft_finish (struct gpu_fft* fft);
+
+/* 'batches' transforms of 'size' consecutive values of 'src', into 'dst'.
+ * 'size' must be a power of two, from 2 to GPU_FFT_MAX_SIZE. Sizes above
+ * 'max_pass_size' take two passes (the "four-step" FFT).
+ */
+bool gpu_fft_1d     (struct gpu_fft* fft,
+                    GLuint src,
+                    GLuint dst,
+                    uint32_t size,
+                    uint32_t batches);
+
+/* 'batches' transforms of row-major 'width' x 'height' images of 'src', into
+ * 'dst': rows first, then columns. Both dimensions must be powers of two,
+ * from 2 to 'max_pass_size'.
+ */
+bool gpu_fft_2d     (struct gpu_fft* fft,
+                    GLuint src,
+                    GLuint dst,
+                    uint32_t width,
+                    uint32_t height,
+                    uint32_t batches);
@@ -0,0 +1,344 @@
+/*
+ * Example:
+ *
+ * Compute FFT: Batched complex FFTs on GLES 3.1 compute shaders, as used by
+ *              signal and image processing jobs.
+ *
+ * 1D transforms of 256 to 64K points, and square 2D transforms, are run in
+ * batches filling a fixed number of values, with radix-2 and radix-4
+ * kernels (see fft.comp). Each transform is done by one work group in shared
+ * memory, with twiddle factors read from a table precomputed in double
+ * precision. Sizes too large for shared memory take two passes (four-step
+ * FFT), as does every 2D transform (rows, then columns).
+ *
+ * Results are reported in GFLOP/s, counting the usual 5 N log2 (N) flops per
+ * transform, and validated against a double precision CPU FFT on the first,
+ * middle and last transforms of each batch.
+ *
+ * Tested on Mesa 22.3, llvmpipe.
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "common/gles-compute.h"
+#include "gpu-fft.h"
+
+#define PI 3.14159265358979323846
+
+#define DEFAULT_MIN_SIZE   256
+#define DEFAULT_MAX_SIZE   65536
+#define DEFAULT_VALUES_LOG 20
+#define DEFAULT_ITERATIONS 3
+
+/* relative RMS error allowed against the CPU, a few times the fp32 epsilon
+ * times log2 (N)
+ */
+#define MAX_ERROR 1e-5
+
+static const char* radix_names[GPU_FFT_RADIX_COUNT] = {
+   "radix-2",
+   "radix-4"
+};
+
+/* In-place radix-2 FFT of 'size' complex values, 'stride' values apart */
+static void
+cpu_fft (double* data, uint32_t size, uint32_t stride)
+{
+   for (uint32_t i = 1, j = 0; i < size; i++) {
+      uint32_t bit = size >> 1;
+
+      for (; j & bit; bit >>= 1)
+         j ^= bit;
+      j ^= bit;
+
+      if (i < j) {
+         for (uint32_t c = 0; c < 2; c++) {
+            double tmp = data[i * stride * 2 + c];
+            data[i * stride * 2 + c] = data[j * stride * 2 + c];
+            data[j * stride * 2 + c] = tmp;
+         }
+      }
+   }
+
+   for (uint32_t len = 2; len <= size; len *= 2) {
+      for (uint32_t k = 0; k < len / 2; k++) {
+         double wr = cos (-2.0 * PI * k / len);
+         double wi = sin (-2.0 * PI * k / len);
+
+         for (uint32_t i = k; i < size; i += len) {
+            double* a = data + i * stride * 2;
+            double* b = data + (i + len / 2) * stride * 2;
+            double br = b[0] * wr - b[1] * wi;
+            double bi = b[0] * wi + b[1] * wr;
+
+            b[0] = a[0] - br;
+            b[1] = a[1] - bi;
+            a[0] += br;
+            a[1] += bi;
+         }
+      }
+   }
+}
+
+/* Relative RMS error of transform 'index' of 'data' (a 'width' x 'height'
+ * image, height 1 in 1D) against the CPU.
+ */
+static double
+transform_error (const float* input,
+                 const float* data,
+                 uint32_t width,
+                 uint32_t height,
+                 uint32_t index)
+{
+   uint32_t size = width * height;
+   double* expected = malloc (size * 2 * sizeof (double));
+   double error = 0.0, norm = 0.0;
+
+   if (expected == NULL)
+      return INFINITY;
+
+   for (uint32_t i = 0; i < size * 2; i++)
+      expected[i] = input[(size_t) index * size * 2 + i];
+
+   for (uint32_t y = 0; y < height; y++)
+      cpu_fft (expected + y * width * 2, width, 1);
+   if (height > 1) {
+      for (uint32_t x = 0; x < width; x++)
+         cpu_fft (expected + x * 2, height, width);
+   }
+
+   for (uint32_t i = 0; i < size * 2; i++) {
+      double delta = data[(size_t) index * size * 2 + i] - expected[i];
+
+      error += delta * delta;
+      norm += expected[i] * expected[i];
+   }
+
+   free (expected);
+
+   return sqrt (error / norm);
+}
+
+/* Largest error over the first, middle and last transforms */
+static double
+check_output (GLuint buffer,
+              const float* input,
+              uint32_t width,
+              uint32_t height,
+              uint32_t batches)
+{
+   const uint32_t checked[] = { 0, batches / 2, batches - 1 };
+   size_t values = (size_t) width * height * batches;
+   double error = 0.0;
+
+   glMemoryBarrier (GL_BUFFER_UPDATE_BARRIER_BIT);
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, buffer);
+   const float* data = glMapBufferRange (GL_SHADER_STORAGE_BUFFER,
+                                         0,
+                                         values * 2 * sizeof (float),
+                                         GL_MAP_READ_BIT);
+   if (data == NULL)
+      return INFINITY;
+
+   for (uint32_t i = 0; i < 3; i++) {
+      double e = transform_error (input, data, width, height, checked[i]);
+
+      /* NaN must fail too */
+      if (! (e <= error))
+         error = e;
+   }
+
+   glUnmapBuffer (GL_SHADER_STORAGE_BUFFER);
+
+   return error;
+}
+
+static bool
+run (struct gpu_fft* fft,
+     GLuint src,
+     GLuint dst,
+     uint32_t width,
+     uint32_t height,
+     uint32_t batches)
+{
+   if (height == 1)
+      return gpu_fft_1d (fft, src, dst, width, batches);
+
+   return gpu_fft_2d (fft, src, dst, width, height, batches);
+}
+
+static void
+print_usage (const char* name)
+{
+   printf ("Usage: %s [options]\n"
+           "  -d <path>  DRM render node (default: %s)\n"
+           "  -s <n>     smallest transform size (default: %u)\n"
+           "  -S <n>     largest transform size (default: %u)\n"
+           "  -v <n>     log2 of the values per batch (default: %u)\n"
+           "  -i <n>     timed iterations per run (default: %u)\n",
+           name,
+           GLES_COMPUTE_DEFAULT_RENDER_NODE,
+           DEFAULT_MIN_SIZE,
+           DEFAULT_MAX_SIZE,
+           DEFAULT_VALUES_LOG,
+           DEFAULT_ITERATIONS);
+}
+
+int32_t
+main (int32_t argc, char* argv[])
+{
+   const char* render_node = NULL;
+   uint32_t min_size = DEFAULT_MIN_SIZE;
+   uint32_t max_size = DEFAULT_MAX_SIZE;
+   uint32_t values_log = DEFAULT_VALUES_LOG;
+   uint32_t iterations = DEFAULT_ITERATIONS;
+   int32_t result = 0;
+   int opt;
+
+   while ((opt = getopt (argc, argv, "d:s:S:v:i:h")) != -1) {
+      switch (opt) {
+      case 'd':
+         render_node = optarg;
+         break;
+      case 's':
+         min_size = atoi (optarg);
+         break;
+      case 'S':
+         max_size = atoi (optarg);
+         break;
+      case 'v':
+         values_log = atoi (optarg);
+         break;
+      case 'i':
+         iterations = atoi (optarg);
+         break;
+      default:
+         print_usage (argv[0]);
+         return opt == 'h' ? 0 : -1;
+      }
+   }
+   uint32_t values = 1u << values_log;
+   if (min_size < 4 || (min_size & (min_size - 1)) != 0 ||
+       min_size > max_size || max_size > GPU_FFT_MAX_SIZE ||
+       values_log > 26 || max_size > values || iterations == 0) {
+      print_usage (argv[0]);
+      return -1;
+   }
+
+   struct gles_compute gc;
+   if (! gles_compute_init (&gc, render_node)) {
+      printf ("Error: Failed to setup a GLES compute context\n");
+      return -1;
+   }
+   printf ("Renderer: %s\n", gc.renderer);
+
+   struct gpu_fft ffts[GPU_FFT_RADIX_COUNT];
+   uint32_t inited = 0;
+   for (; inited < GPU_FFT_RADIX_COUNT; inited++) {
+      if (! gpu_fft_init (&ffts[inited], &gc, inited)) {
+         result = -1;
+         goto out;
+      }
+   }
+   printf ("Single pass up to %u points\n", ffts[0].max_pass_size);
+
+   /* random values in [-1, 1], the same for every run */
+   float* input = malloc ((size_t) values * 2 * sizeof (float));
+   if (input == NULL) {
+      printf ("Error: Failed to allocate %u values\n", values);
+      result = -1;
+      goto out;
+   }
+   srand (values);
+   for (size_t i = 0; i < (size_t) values * 2; i++)
+      input[i] = 2.0f * rand () / RAND_MAX - 1.0f;
+
+   GLuint buffers[2];
+   glGenBuffers (2, buffers);
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, buffers[0]);
+   glBufferData (GL_SHADER_STORAGE_BUFFER, (size_t) values * 2 * sizeof (float),
+                 input, GL_STATIC_DRAW);
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, buffers[1]);
+   glBufferData (GL_SHADER_STORAGE_BUFFER, (size_t) values * 2 * sizeof (float),
+                 NULL, GL_DYNAMIC_COPY);
+
+   printf ("\n%-4s %-12s %8s %-8s %10s %10s %10s   %s\n",
+           "dims", "size", "batches", "radix", "ms", "GFLOP/s", "error",
+           "result");
+
+   for (uint32_t size = min_size; size <= max_size; size *= 2) {
+      /* 1D, then 2D when 'size' is a square of single pass sizes */
+      uint32_t side = 1u << (__builtin_ctz (size) / 2);
+      bool square = side * side == size && side <= ffts[0].max_pass_size;
+
+      for (uint32_t dims = 1; dims <= (square ? 2 : 1); dims++) {
+         uint32_t width = dims == 1 ? size : side;
+         uint32_t height = dims == 1 ? 1 : side;
+         uint32_t batches = values / size;
+         double flop = 5.0 * size * log2 (size) * batches;
+         char name[32];
+
+         snprintf (name, sizeof (name), dims == 1 ? "%u" : "%ux%u",
+                   width, height);
+
+         for (uint32_t r = 0; r < GPU_FFT_RADIX_COUNT; r++) {
+            /* warm up (compiling the kernels), and the run that gets
+             * validated
+             */
+            if (! run (&ffts[r], buffers[0], buffers[1], width, height,
+                       batches)) {
+               result = -1;
+               goto done;
+            }
+            double error = check_output (buffers[1], input, width, height,
+                                         batches);
+            bool valid = error <= MAX_ERROR;
+
+            uint64_t start = gles_compute_get_time_ns ();
+            for (uint32_t i = 0; i < iterations; i++)
+               run (&ffts[r], buffers[0], buffers[1], width, height, batches);
+            gles_compute_wait ();
+            uint64_t ns = (gles_compute_get_time_ns () - start) / iterations;
+
+            printf ("%-4s %-12s %8u %-8s %10.2f %10.2f %10.2e   %s\n",
+                    dims == 1 ? "1d" : "2d",
+                    name,
+                    batches,
+                    radix_names[r],
+                    ns / 1e6,
+                    flop / ns,
+                    error,
+                    valid ? "ok" : "MISMATCH");
+            if (! valid)
+               result = -1;
+         }
+      }
+   }
+
+ done:
+   glDeleteBuffers (2, buffers);
+   free (input);
+
+ out:
+   /* free stuff */
+   for (uint32_t r = 0; r < inited; r++)
+      gpu_fft_finish (&ffts[r]);
+   gles_compute_finish (&gc);
+
+   return result;
+}
@@ -0,0 +1,143 @@
+/*
+ * Blocked, multi-threaded CPU SGEMM
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include "cpu-gemm.h"
+
+#if defined (__AVX2__) && defined (__FMA__)
+#include <immintrin.h>
+#elif defined (__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/* A panel of KC rows of B by NC columns (256KB) stays in L2 while all rows
+ * of a thread's share of C go through it.
+ */
+#define KC 256
+#define NC 256
+
+/* rows of C per thread, at least */
+#define MIN_ROWS_PER_THREAD 16
+
+static uint32_t num_threads = 0;
+
+struct job {
+   const float* a;
+   const float* b;
+   float* c;
+   uint32_t n;
+   uint32_t k;
+   uint32_t row_begin;
+   uint32_t row_end;
+};
+
+void
+cpu_gemm_set_threads (uint32_t threads)
+{
+   num_threads = threads;
+}
+
+/* c[0, count) += alpha * b[0, count) */
+static void
+axpy (float* restrict c, const float* restrict b, float alpha, uint32_t count)
+{
+   uint32_t j = 0;
+
+#if defined (__AVX2__) && defined (__FMA__)
+   __m256 va = _mm256_set1_ps (alpha);
+   for (; j + 8 <= count; j += 8) {
+      __m256 vc = _mm256_loadu_ps (c + j);
+      vc = _mm256_fmadd_ps (va, _mm256_loadu_ps (b + j), vc);
+      _mm256_storeu_ps (c + j, vc);
+   }
+#elif defined (__ARM_NEON)
+   float32x4_t va = vdupq_n_f32 (alpha);
+   for (; j + 4 <= count; j += 4)
+      vst1q_f32 (c + j, vfmaq_f32 (vld1q_f32 (c + j), va, vld1q_f32 (b + j)));
+#endif
+
+   for (; j < count; j++)
+      c[j] += alpha * b[j];
+}
+
+static void*
+run_job (void* data)
+{
+   const struct job* job = data;
+   uint32_t n = job->n;
+   uint32_t k = job->k;
+
+   for (uint32_t i = job->row_begin; i < job->row_end; i++)
+      memset (job->c + (size_t) i * n, 0, n * sizeof (float));
+
+   for (uint32_t kk = 0; kk < k; kk += KC) {
+      uint32_t k_end = kk + KC < k ? kk + KC : k;
+
+      for (uint32_t jj = 0; jj < n; jj += NC) {
+         uint32_t width = jj + NC < n ? NC : n - jj;
+
+         for (uint32_t i = job->row_begin; i < job->row_end; i++) {
+            const float* a_row = job->a + (size_t) i * k;
+            float* c_row = job->c + (size_t) i * n + jj;
+
+            for (uint32_t p = kk; p < k_end; p++)
+               axpy (c_row, job->b + (size_t) p * n + jj, a_row[p], width);
+         }
+      }
+   }
+
+   return NULL;
+}
+
+void
+cpu_sgemm (const float* a,
+           const float* b,
+           float* c,
+           uint32_t m,
+           uint32_t n,
+           uint32_t k)
+{
+   pthread_t tids[CPU_GEMM_MAX_THREADS];
+   struct job jobs[CPU_GEMM_MAX_THREADS];
+   uint32_t threads = num_threads;
+
+   if (threads == 0)
+      threads = sysconf (_SC_NPROCESSORS_ONLN);
+   if (threads > CPU_GEMM_MAX_THREADS)
+      threads = CPU_GEMM_MAX_THREADS;
+   if (threads > m / MIN_ROWS_PER_THREAD)
+      threads = m / MIN_ROWS_PER_THREAD;
+   if (threads == 0)
+      threads = 1;
+
+   for (uint32_t t = 0; t < threads; t++) {
+      jobs[t].a = a;
+      jobs[t].b = b;
+      jobs[t].c = c;
+      jobs[t].n = n;
+      jobs[t].k = k;
+      jobs[t].row_begin = (uint64_t) m * t / threads;
+      jobs[t].row_end = (uint64_t) m * (t + 1) / threads;
+   }
+
+   for (uint32_t t = 1; t < threads; t++)
+      pthread_create (&tids[t], NULL, run_job, &jobs[t]);
+
+   run_job (&jobs[0]);
+
+   for (uint32_t t = 1; t < threads; t++)
+      pthread_join (tids[t], NULL);
+}
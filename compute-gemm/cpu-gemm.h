@@ -0,0 +1,28 @@
+/*
+ * Blocked, multi-threaded CPU SGEMM, the reference for the GPU kernels.
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define CPU_GEMM_MAX_THREADS 64
+
+/* Sets the number of worker threads, 0 for one per online CPU */
+void cpu_gemm_set_threads (uint32_t num_threads);
+
+/* C = A * B, all row-major: A is M x K, B is K x N and C is M x N */
+void cpu_sgemm            (const float* a,
+                           const float* b,
+                           float* c,
+                           uint32_t m,
+                           uint32_t n,
+                           uint32_t k);
@@ -0,0 +1,297 @@
+/*
+ * Example:
+ *
+ * Compute GEMM: Matrix multiplication on GLES 3.1 compute shaders, as a
+ *               compute throughput (rather than bandwidth) baseline.
+ *
+ * Three variants of C = A * B are benchmarked over a sweep of square matrix
+ * sizes (see gemm.comp): naive, shared-memory tiled, and register-blocked.
+ * Each runs with fp32 inputs, and with fp16 inputs packed two per uint,
+ * accumulating in fp32 in both cases.
+ *
+ * Results are reported in GFLOP/s and validated against a blocked,
+ * multi-threaded CPU SGEMM. Inputs are multiples of 1/8 in [-2, 2], exact in
+ * fp16, so that every product and partial sum is exact in fp32 and the GPU
+ * must match the CPU bit for bit, whatever the summation order.
+ *
+ * Tested on Mesa 22.3, llvmpipe.
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/gles-compute.h"
+#include "cpu-gemm.h"
+
+#define TILE  16
+#define WPT   4
+
+#define DEFAULT_MIN_SIZE   128
+#define DEFAULT_MAX_SIZE   1024
+#define DEFAULT_ITERATIONS 3
+
+enum gemm_variant {
+   GEMM_NAIVE = 0,
+   GEMM_TILED,
+   GEMM_BLOCKED,
+   GEMM_VARIANT_COUNT
+};
+
+static const char* variant_names[GEMM_VARIANT_COUNT] = {
+   "naive",
+   "tiled",
+   "blocked"
+};
+
+enum gemm_precision {
+   GEMM_FP32 = 0,
+   GEMM_FP16,
+   GEMM_PRECISION_COUNT
+};
+
+static const char* precision_names[GEMM_PRECISION_COUNT] = {
+   "fp32",
+   "fp16"
+};
+
+/* Only handles zero and normal values, without rounding: enough for the
+ * inputs used here, which are exact in fp16.
+ */
+static uint16_t
+float_to_half (float value)
+{
+   uint32_t bits;
+   memcpy (&bits, &value, sizeof (bits));
+
+   uint16_t sign = (bits >> 16) & 0x8000;
+   int32_t exponent = (int32_t) ((bits >> 23) & 0xff) - 127 + 15;
+   uint16_t mantissa = (bits >> 13) & 0x3ff;
+
+   if ((bits & 0x7fffffff) == 0 || exponent <= 0)
+      return sign;
+
+   return sign | (exponent << 10) | mantissa;
+}
+
+static void
+upload (GLuint buffer, const float* data, size_t count, bool half)
+{
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, buffer);
+
+   if (! half) {
+      glBufferData (GL_SHADER_STORAGE_BUFFER, count * sizeof (float), data,
+                    GL_STATIC_DRAW);
+      return;
+   }
+
+   /* two per uint, rounded up to whole uints */
+   size_t size = (count + 1) / 2 * sizeof (uint32_t);
+   uint16_t* packed = calloc (1, size);
+   for (size_t i = 0; i < count; i++)
+      packed[i] = float_to_half (data[i]);
+
+   glBufferData (GL_SHADER_STORAGE_BUFFER, size, packed, GL_STATIC_DRAW);
+   free (packed);
+}
+
+static void
+dispatch (GLuint program, enum gemm_variant variant, uint32_t size)
+{
+   uint32_t block = variant == GEMM_BLOCKED ? TILE * WPT : TILE;
+   uint32_t groups = (size + block - 1) / block;
+
+   glUseProgram (program);
+   glUniform3i (0, size, size, size);
+   glDispatchCompute (groups, groups, 1);
+}
+
+static bool
+check_output (GLuint buffer, const float* expected, size_t count)
+{
+   bool valid;
+
+   glMemoryBarrier (GL_BUFFER_UPDATE_BARRIER_BIT);
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, buffer);
+   const float* data = glMapBufferRange (GL_SHADER_STORAGE_BUFFER,
+                                         0,
+                                         count * sizeof (float),
+                                         GL_MAP_READ_BIT);
+   if (data == NULL)
+      return false;
+
+   valid = memcmp (data, expected, count * sizeof (float)) == 0;
+   glUnmapBuffer (GL_SHADER_STORAGE_BUFFER);
+
+   return valid;
+}
+
+static void
+print_usage (const char* name)
+{
+   printf ("Usage: %s [options]\n"
+           "  -d <path>  DRM render node (default: %s)\n"
+           "  -s <n>     smallest matrix size (default: %u)\n"
+           "  -S <n>     largest matrix size (default: %u)\n"
+           "  -i <n>     timed iterations per run (default: %u)\n"
+           "  -t <n>     CPU threads, 0 for all CPUs (default: 0)\n",
+           name,
+           GLES_COMPUTE_DEFAULT_RENDER_NODE,
+           DEFAULT_MIN_SIZE,
+           DEFAULT_MAX_SIZE,
+           DEFAULT_ITERATIONS);
+}
+
+int32_t
+main (int32_t argc, char* argv[])
+{
+   const char* render_node = NULL;
+   uint32_t min_size = DEFAULT_MIN_SIZE;
+   uint32_t max_size = DEFAULT_MAX_SIZE;
+   uint32_t iterations = DEFAULT_ITERATIONS;
+   int32_t result = 0;
+   int opt;
+
+   while ((opt = getopt (argc, argv, "d:s:S:i:t:h")) != -1) {
+      switch (opt) {
+      case 'd':
+         render_node = optarg;
+         break;
+      case 's':
+         min_size = atoi (optarg);
+         break;
+      case 'S':
+         max_size = atoi (optarg);
+         break;
+      case 'i':
+         iterations = atoi (optarg);
+         break;
+      case 't':
+         cpu_gemm_set_threads (atoi (optarg));
+         break;
+      default:
+         print_usage (argv[0]);
+         return opt == 'h' ? 0 : -1;
+      }
+   }
+   /* partial sums stay exact in fp32 up to K = 65536 */
+   if (min_size == 0 || min_size > max_size || max_size > 65536 ||
+       iterations == 0) {
+      print_usage (argv[0]);
+      return -1;
+   }
+
+   struct gles_compute gc;
+   if (! gles_compute_init (&gc, render_node)) {
+      printf ("Error: Failed to setup a GLES compute context\n");
+      return -1;
+   }
+   printf ("Renderer: %s\n", gc.renderer);
+
+   GLuint programs[GEMM_PRECISION_COUNT][GEMM_VARIANT_COUNT] = { { 0 } };
+   for (uint32_t p = 0; p < GEMM_PRECISION_COUNT; p++) {
+      for (uint32_t v = 0; v < GEMM_VARIANT_COUNT; v++) {
+         char defines[128];
+
+         snprintf (defines, sizeof (defines),
+                   "#define TILE %u\n#define WPT %u\n#define VARIANT %u\n%s",
+                   TILE, WPT, v,
+                   p == GEMM_FP16 ? "#define HALF\n" : "");
+         programs[p][v] = gles_compute_load_program (CURRENT_DIR "/gemm.comp",
+                                                     defines);
+         if (programs[p][v] == 0) {
+            result = -1;
+            goto out;
+         }
+      }
+   }
+
+   GLuint buffers[3];
+   glGenBuffers (3, buffers);
+
+   printf ("\n%-6s %-8s %-5s %10s %10s   %s\n",
+           "size", "variant", "prec", "ms", "GFLOP/s", "result");
+
+   for (uint32_t size = min_size; size <= max_size; size *= 2) {
+      size_t count = (size_t) size * size;
+      double flop = 2.0 * size * size * size;
+      float* a = malloc (count * sizeof (float));
+      float* b = malloc (count * sizeof (float));
+      float* expected = malloc (count * sizeof (float));
+
+      srand (size);
+      for (size_t i = 0; i < count; i++) {
+         a[i] = (rand () % 33 - 16) / 8.0f;
+         b[i] = (rand () % 33 - 16) / 8.0f;
+      }
+
+      uint64_t start = gles_compute_get_time_ns ();
+      cpu_sgemm (a, b, expected, size, size, size);
+      uint64_t cpu_ns = gles_compute_get_time_ns () - start;
+
+      printf ("%-6u %-8s %-5s %10.2f %10.2f\n",
+              size, "cpu", "fp32", cpu_ns / 1e6, flop / cpu_ns);
+
+      glBindBuffer (GL_SHADER_STORAGE_BUFFER, buffers[2]);
+      glBufferData (GL_SHADER_STORAGE_BUFFER, count * sizeof (float), NULL,
+                    GL_DYNAMIC_COPY);
+
+      for (uint32_t p = 0; p < GEMM_PRECISION_COUNT; p++) {
+         upload (buffers[0], a, count, p == GEMM_FP16);
+         upload (buffers[1], b, count, p == GEMM_FP16);
+         for (uint32_t i = 0; i < 3; i++)
+            glBindBufferBase (GL_SHADER_STORAGE_BUFFER, i, buffers[i]);
+
+         for (uint32_t v = 0; v < GEMM_VARIANT_COUNT; v++) {
+            /* warm up, and the run that gets validated */
+            dispatch (programs[p][v], v, size);
+            bool valid = check_output (buffers[2], expected, count);
+
+            start = gles_compute_get_time_ns ();
+            for (uint32_t i = 0; i < iterations; i++)
+               dispatch (programs[p][v], v, size);
+            gles_compute_wait ();
+            uint64_t ns = (gles_compute_get_time_ns () - start) / iterations;
+
+            printf ("%-6u %-8s %-5s %10.2f %10.2f   %s\n",
+                    size,
+                    variant_names[v],
+                    precision_names[p],
+                    ns / 1e6,
+                    flop / ns,
+                    valid ? "ok" : "MISMATCH");
+            if (! valid)
+               result = -1;
+         }
+      }
+
+      free (expected);
+      free (b);
+      free (a);
+   }
+
+   glDeleteBuffers (3, buffers);
+
+ out:
+   /* free stuff */
+   for (uint32_t p = 0; p < GEMM_PRECISION_COUNT; p++) {
+      for (uint32_t v = 0; v < GEMM_VARIANT_COUNT; v++)
+         glDeleteProgram (programs[p][v]);
+   }
+   gles_compute_finish (&gc);
+
+   return result;
+}
@@ -0,0 +1,200 @@
+/*
+ * PPM/PAM image streams
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include "image-io.h"
+
+#define MAX_ROW_SIZE (65536 * 4)
+
+/* Reads a whitespace separated token, skipping '#' comments */
+static bool
+read_token (FILE* f, char* token, size_t len)
+{
+   size_t n = 0;
+   int c;
+
+   while ((c = fgetc (f)) != EOF) {
+      if (c == '#') {
+         while ((c = fgetc (f)) != EOF && c != '\n');
+      } else if (! isspace (c)) {
+         break;
+      }
+   }
+
+   while (c != EOF && ! isspace (c) && n < len - 1) {
+      token[n++] = c;
+      c = fgetc (f);
+   }
+   token[n] = '\0';
+
+   /* the single whitespace after the last header token is consumed here */
+   return n > 0;
+}
+
+static bool
+read_uint (FILE* f, uint32_t* value)
+{
+   char token[16];
+
+   if (! read_token (f, token, sizeof (token)))
+      return false;
+
+   char* end;
+   unsigned long v = strtoul (token, &end, 10);
+   if (*end != '\0' || v == 0 || v > 65535)
+      return false;
+   *value = v;
+
+   return true;
+}
+
+static bool
+read_pam_header (FILE* f, struct image_header* hdr)
+{
+   char token[32];
+   uint32_t maxval = 0;
+
+   hdr->width = hdr->height = hdr->depth = 0;
+
+   while (read_token (f, token, sizeof (token))) {
+      if (strcmp (token, "ENDHDR") == 0) {
+         return hdr->width > 0 && hdr->height > 0 && maxval == 255 &&
+            (hdr->depth == 3 || hdr->depth == 4);
+      } else if (strcmp (token, "WIDTH") == 0) {
+         if (! read_uint (f, &hdr->width))
+            return false;
+      } else if (strcmp (token, "HEIGHT") == 0) {
+         if (! read_uint (f, &hdr->height))
+            return false;
+      } else if (strcmp (token, "DEPTH") == 0) {
+         if (! read_uint (f, &hdr->depth))
+            return false;
+      } else if (strcmp (token, "MAXVAL") == 0) {
+         if (! read_uint (f, &maxval))
+            return false;
+      } else if (strcmp (token, "TUPLTYPE") == 0) {
+         /* implied by DEPTH */
+         if (! read_token (f, token, sizeof (token)))
+            return false;
+      } else {
+         return false;
+      }
+   }
+
+   return false;
+}
+
+enum image_read_result
+image_read_header (FILE* f, struct image_header* hdr)
+{
+   char magic[4];
+   int c;
+
+   /* tolerate whitespace between concatenated frames */
+   while ((c = fgetc (f)) != EOF && isspace (c));
+   if (c == EOF)
+      return IMAGE_READ_EOF;
+   ungetc (c, f);
+
+   if (! read_token (f, magic, sizeof (magic)))
+      return IMAGE_READ_ERROR;
+
+   if (strcmp (magic, "P6") == 0) {
+      uint32_t maxval;
+
+      hdr->format = IMAGE_FORMAT_PPM;
+      hdr->depth = 3;
+      if (! read_uint (f, &hdr->width) ||
+          ! read_uint (f, &hdr->height) ||
+          ! read_uint (f, &maxval) ||
+          maxval != 255) {
+         printf ("Image: Error: Unsupported PPM header\n");
+         return IMAGE_READ_ERROR;
+      }
+   } else if (strcmp (magic, "P7") == 0) {
+      hdr->format = IMAGE_FORMAT_PAM;
+      if (! read_pam_header (f, hdr)) {
+         printf ("Image: Error: Unsupported PAM header\n");
+         return IMAGE_READ_ERROR;
+      }
+   } else {
+      printf ("Image: Error: Not a PPM (P6) or PAM (P7) image\n");
+      return IMAGE_READ_ERROR;
+   }
+
+   if (hdr->width * hdr->depth > MAX_ROW_SIZE)
+      return IMAGE_READ_ERROR;
+
+   return IMAGE_READ_OK;
+}
+
+bool
+image_read_pixels (FILE* f, const struct image_header* hdr, uint8_t* rgba)
+{
+   uint8_t row[MAX_ROW_SIZE];
+   size_t row_size = hdr->width * hdr->depth;
+
+   if (hdr->depth == 4)
+      return fread (rgba, row_size, hdr->height, f) == hdr->height;
+
+   for (uint32_t y = 0; y < hdr->height; y++) {
+      if (fread (row, 1, row_size, f) != row_size)
+         return false;
+
+      uint8_t* dst = rgba + (size_t) y * hdr->width * 4;
+      for (uint32_t x = 0; x < hdr->width; x++) {
+         dst[x * 4 + 0] = row[x * 3 + 0];
+         dst[x * 4 + 1] = row[x * 3 + 1];
+         dst[x * 4 + 2] = row[x * 3 + 2];
+         dst[x * 4 + 3] = 255;
+      }
+   }
+
+   return true;
+}
+
+bool
+image_write (FILE* f, const struct image_header* hdr, const uint8_t* rgba)
+{
+   uint8_t row[MAX_ROW_SIZE];
+   size_t row_size = hdr->width * hdr->depth;
+
+   if (hdr->format == IMAGE_FORMAT_PPM) {
+      fprintf (f, "P6\n%u %u\n255\n", hdr->width, hdr->height);
+   } else {
+      fprintf (f, "P7\nWIDTH %u\nHEIGHT %u\nDEPTH %u\nMAXVAL 255\n"
+               "TUPLTYPE %s\nENDHDR\n",
+               hdr->width,
+               hdr->height,
+               hdr->depth,
+               hdr->depth == 4 ? "RGB_ALPHA" : "RGB");
+   }
+
+   if (hdr->depth == 4)
+      return fwrite (rgba, row_size, hdr->height, f) == hdr->height;
+
+   for (uint32_t y = 0; y < hdr->height; y++) {
+      const uint8_t* src = rgba + (size_t) y * hdr->width * 4;
+
+      for (uint32_t x = 0; x < hdr->width; x++) {
+         row[x * 3 + 0] = src[x * 4 + 0];
+         row[x * 3 + 1] = src[x * 4 + 1];
+         row[x * 3 + 2] = src[x * 4 + 2];
+      }
+      if (fwrite (row, 1, row_size, f) != row_size)
+         return false;
+   }
+
+   return true;
+}
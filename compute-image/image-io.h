@@ -0,0 +1,47 @@
+/*
+ * Minimal streaming reader/writer of binary PPM (P6) and PAM (P7) images,
+ * 8 bits per channel. Pixels are exchanged as tightly packed RGBA.
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum image_format {
+   IMAGE_FORMAT_PPM = 0,
+   IMAGE_FORMAT_PAM
+};
+
+struct image_header {
+   enum image_format format;
+   uint32_t width;
+   uint32_t height;
+   uint32_t depth;      /* channels in the file: 3, or 4 for PAM RGB_ALPHA */
+};
+
+enum image_read_result {
+   IMAGE_READ_OK = 0,
+   IMAGE_READ_EOF,      /* clean end of stream, between frames */
+   IMAGE_READ_ERROR
+};
+
+enum image_read_result image_read_header (FILE* f, struct image_header* hdr);
+
+/* Reads the pixels following a header, expanding them to RGBA */
+bool                   image_read_pixels (FILE* f,
+                                          const struct image_header* hdr,
+                                          uint8_t* rgba);
+
+bool                   image_write       (FILE* f,
+                                          const struct image_header* hdr,
+                                          const uint8_t* rgba);
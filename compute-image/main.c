@@ -0,0 +1,620 @@
+/*
+ * Example:
+ *
+ * Compute image: A streaming image-processing pipeline of GLES 3.1 compute
+ *                passes over GL_RGBA8 images bound as image units.
+ *
+ * Frames are read as a stream of PPM (P6) or PAM (P7) images from stdin, go
+ * through a chain of passes, and are written in the same format to stdout,
+ * e.g:
+ *
+ *    ffmpeg -i in.mp4 -f image2pipe -c:v ppm - | \
+ *       ./compute-image -p blur,sobel | \
+ *       ffmpeg -f image2pipe -c:v ppm -i - out.mp4
+ *
+ * Passes:
+ *    blur   Separable Gaussian blur (two passes), tiled in shared memory
+ *    sobel  Sobel edge magnitude, tiled in shared memory
+ *    sepia  Colour transform
+ *    gray   Colour transform
+ *
+ * Decode, upload, compute and readback are overlapped: each of the
+ * PIPELINE_DEPTH frames in flight has its own textures and pixel buffers.
+ * Frame N is decoded straight into a mapped pixel unpack buffer, uploaded
+ * and processed asynchronously, and read back into a pixel pack buffer,
+ * while the CPU moves on to decode frame N + 1. Frame N is only mapped and
+ * written out PIPELINE_DEPTH frames later, when its fence has long passed.
+ *
+ * Megapixels/s of each pass (from GL_EXT_disjoint_timer_query, when
+ * available), of the whole chain on the GPU, and end-to-end are reported on
+ * stderr.
+ *
+ * Tested on Mesa 22.3, llvmpipe.
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/gles-compute.h"
+#include <GLES2/gl2ext.h>
+#include "image-io.h"
+
+#define TILE              16
+#define MAX_RADIUS        16
+#define DEFAULT_RADIUS    4
+#define DEFAULT_PASSES    "blur,sobel"
+#define DEFAULT_FRAMES    100
+#define MAX_PASSES        16
+#define PIPELINE_DEPTH    3
+
+enum pass_kernel {
+   KERNEL_BLUR_H = 0,
+   KERNEL_BLUR_V,
+   KERNEL_SOBEL,
+   KERNEL_COLOR,
+   KERNEL_COUNT
+};
+
+/* column-major, as glUniformMatrix4fv() expects */
+static const float sepia_matrix[16] = {
+   0.393f, 0.349f, 0.272f, 0.0f,
+   0.769f, 0.686f, 0.534f, 0.0f,
+   0.189f, 0.168f, 0.131f, 0.0f,
+   0.0f,   0.0f,   0.0f,   1.0f
+};
+
+static const float gray_matrix[16] = {
+   0.2126f, 0.2126f, 0.2126f, 0.0f,
+   0.7152f, 0.7152f, 0.7152f, 0.0f,
+   0.0722f, 0.0722f, 0.0722f, 0.0f,
+   0.0f,    0.0f,    0.0f,    1.0f
+};
+
+struct pass {
+   const char* name;
+   enum pass_kernel kernel;
+   const float* matrix;
+
+   uint64_t gpu_ns;
+};
+
+struct frame {
+   struct image_header hdr;
+   bool busy;
+
+   GLuint upload;             /* pixel unpack buffer */
+   GLuint download;           /* pixel pack buffer */
+   GLuint textures[2];        /* ping-pong between passes */
+   GLuint fbos[2];            /* for glReadPixels() */
+   GLuint queries[MAX_PASSES + 1];   /* timestamps around each pass */
+   GLsync fence;
+};
+
+static struct {
+   struct gles_compute gc;
+   GLuint programs[KERNEL_COUNT];
+
+   struct pass passes[MAX_PASSES];
+   uint32_t num_passes;
+
+   struct frame frames[PIPELINE_DEPTH];
+   uint32_t width;
+   uint32_t height;
+
+   bool has_timer_query;
+   PFNGLQUERYCOUNTEREXTPROC QueryCounterEXT;
+   PFNGLGETQUERYOBJECTUI64VEXTPROC GetQueryObjectui64vEXT;
+
+   FILE* out;
+   uint64_t frames_done;
+   uint64_t pixels_done;
+} app;
+
+static bool
+parse_passes (const char* list)
+{
+   char copy[256];
+   snprintf (copy, sizeof (copy), "%s", list);
+
+   for (char* name = strtok (copy, ","); name != NULL; name = strtok (NULL, ",")) {
+      if (app.num_passes + 2 > MAX_PASSES) {
+         printf ("Error: Too many passes\n");
+         return false;
+      }
+
+      struct pass* pass = &app.passes[app.num_passes];
+      if (strcmp (name, "blur") == 0) {
+         pass[0].name = "blur-h";
+         pass[0].kernel = KERNEL_BLUR_H;
+         pass[1].name = "blur-v";
+         pass[1].kernel = KERNEL_BLUR_V;
+         app.num_passes += 2;
+      } else if (strcmp (name, "sobel") == 0) {
+         pass->name = "sobel";
+         pass->kernel = KERNEL_SOBEL;
+         app.num_passes++;
+      } else if (strcmp (name, "sepia") == 0) {
+         pass->name = "sepia";
+         pass->kernel = KERNEL_COLOR;
+         pass->matrix = sepia_matrix;
+         app.num_passes++;
+      } else if (strcmp (name, "gray") == 0) {
+         pass->name = "gray";
+         pass->kernel = KERNEL_COLOR;
+         pass->matrix = gray_matrix;
+         app.num_passes++;
+      } else {
+         printf ("Error: Unknown pass '%s'\n", name);
+         return false;
+      }
+   }
+
+   return app.num_passes > 0;
+}
+
+static bool
+create_programs (uint32_t radius)
+{
+   char defines[128];
+   float weights[MAX_RADIUS + 1];
+   float sigma = radius / 2.0f;
+   float sum = 0.0f;
+
+   snprintf (defines, sizeof (defines),
+             "#define TILE %u\n#define RADIUS %u\n#define HORIZONTAL\n",
+             TILE, radius);
+   app.programs[KERNEL_BLUR_H] =
+      gles_compute_load_program (CURRENT_DIR "/blur.comp", defines);
+
+   snprintf (defines, sizeof (defines),
+             "#define TILE %u\n#define RADIUS %u\n",
+             TILE, radius);
+   app.programs[KERNEL_BLUR_V] =
+      gles_compute_load_program (CURRENT_DIR "/blur.comp", defines);
+
+   snprintf (defines, sizeof (defines), "#define TILE %u\n", TILE);
+   app.programs[KERNEL_SOBEL] =
+      gles_compute_load_program (CURRENT_DIR "/sobel.comp", defines);
+   app.programs[KERNEL_COLOR] =
+      gles_compute_load_program (CURRENT_DIR "/color.comp", defines);
+
+   for (uint32_t k = 0; k < KERNEL_COUNT; k++) {
+      if (app.programs[k] == 0)
+         return false;
+   }
+
+   /* normalized Gaussian weights, center first */
+   for (uint32_t r = 0; r <= radius; r++) {
+      weights[r] = expf (-(float) (r * r) / (2.0f * sigma * sigma));
+      sum += r == 0 ? weights[r] : 2.0f * weights[r];
+   }
+   for (uint32_t r = 0; r <= radius; r++)
+      weights[r] /= sum;
+
+   for (uint32_t k = KERNEL_BLUR_H; k <= KERNEL_BLUR_V; k++) {
+      glUseProgram (app.programs[k]);
+      glUniform1fv (1, radius + 1, weights);
+   }
+
+   return true;
+}
+
+static void
+destroy_frames (void)
+{
+   for (uint32_t i = 0; i < PIPELINE_DEPTH; i++) {
+      struct frame* frame = &app.frames[i];
+
+      if (frame->fence != NULL)
+         glDeleteSync (frame->fence);
+      glDeleteQueries (MAX_PASSES + 1, frame->queries);
+      glDeleteFramebuffers (2, frame->fbos);
+      glDeleteTextures (2, frame->textures);
+      glDeleteBuffers (1, &frame->download);
+      glDeleteBuffers (1, &frame->upload);
+      memset (frame, 0, sizeof (struct frame));
+   }
+}
+
+static bool
+create_frames (uint32_t width, uint32_t height)
+{
+   GLsizeiptr size = (GLsizeiptr) width * height * 4;
+
+   destroy_frames ();
+   app.width = width;
+   app.height = height;
+
+   for (uint32_t i = 0; i < PIPELINE_DEPTH; i++) {
+      struct frame* frame = &app.frames[i];
+
+      glGenBuffers (1, &frame->upload);
+      glBindBuffer (GL_PIXEL_UNPACK_BUFFER, frame->upload);
+      glBufferData (GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+
+      glGenBuffers (1, &frame->download);
+      glBindBuffer (GL_PIXEL_PACK_BUFFER, frame->download);
+      glBufferData (GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+
+      glGenTextures (2, frame->textures);
+      glGenFramebuffers (2, frame->fbos);
+      for (uint32_t t = 0; t < 2; t++) {
+         glBindTexture (GL_TEXTURE_2D, frame->textures[t]);
+         glTexStorage2D (GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+
+         glBindFramebuffer (GL_FRAMEBUFFER, frame->fbos[t]);
+         glFramebufferTexture2D (GL_FRAMEBUFFER,
+                                 GL_COLOR_ATTACHMENT0,
+                                 GL_TEXTURE_2D,
+                                 frame->textures[t],
+                                 0);
+      }
+
+      if (app.has_timer_query)
+         glGenQueries (MAX_PASSES + 1, frame->queries);
+   }
+
+   glBindBuffer (GL_PIXEL_UNPACK_BUFFER, 0);
+   glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+   glBindFramebuffer (GL_FRAMEBUFFER, 0);
+
+   for (uint32_t k = 0; k < KERNEL_COUNT; k++) {
+      glUseProgram (app.programs[k]);
+      glUniform2i (0, width, height);
+   }
+
+   if (glGetError () != GL_NO_ERROR) {
+      printf ("Error: Failed to allocate %ux%u frames\n", width, height);
+      return false;
+   }
+
+   return true;
+}
+
+/* Synthetic frames for benchmarking: moving gradients and a checkerboard */
+static void
+generate_pixels (uint8_t* rgba, uint32_t width, uint32_t height, uint32_t n)
+{
+   for (uint32_t y = 0; y < height; y++) {
+      for (uint32_t x = 0; x < width; x++) {
+         uint8_t* p = rgba + ((size_t) y * width + x) * 4;
+
+         p[0] = x + n;
+         p[1] = y + n;
+         p[2] = ((x >> 4) ^ (y >> 4)) & 1 ? 224 : 32;
+         p[3] = 255;
+      }
+   }
+}
+
+static void
+process_frame (struct frame* frame)
+{
+   uint32_t src = 0;
+
+   glBindBuffer (GL_PIXEL_UNPACK_BUFFER, frame->upload);
+   glBindTexture (GL_TEXTURE_2D, frame->textures[0]);
+   glTexSubImage2D (GL_TEXTURE_2D, 0, 0, 0, app.width, app.height,
+                    GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+   glBindBuffer (GL_PIXEL_UNPACK_BUFFER, 0);
+
+   /* timestamps rather than GL_TIME_ELAPSED_EXT, which some drivers only
+    * implement for draws
+    */
+   if (app.has_timer_query)
+      app.QueryCounterEXT (frame->queries[0], GL_TIMESTAMP_EXT);
+
+   for (uint32_t i = 0; i < app.num_passes; i++) {
+      const struct pass* pass = &app.passes[i];
+
+      glUseProgram (app.programs[pass->kernel]);
+      if (pass->matrix != NULL)
+         glUniformMatrix4fv (1, 1, GL_FALSE, pass->matrix);
+
+      glBindImageTexture (0, frame->textures[src], 0, GL_FALSE, 0,
+                          GL_READ_ONLY, GL_RGBA8);
+      glBindImageTexture (1, frame->textures[1 - src], 0, GL_FALSE, 0,
+                          GL_WRITE_ONLY, GL_RGBA8);
+
+      glDispatchCompute ((app.width + TILE - 1) / TILE,
+                         (app.height + TILE - 1) / TILE,
+                         1);
+
+      glMemoryBarrier (GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+      if (app.has_timer_query)
+         app.QueryCounterEXT (frame->queries[i + 1], GL_TIMESTAMP_EXT);
+
+      src = 1 - src;
+   }
+
+   /* asynchronous readback into the pixel pack buffer */
+   glMemoryBarrier (GL_FRAMEBUFFER_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+   glBindFramebuffer (GL_READ_FRAMEBUFFER, frame->fbos[src]);
+   glBindBuffer (GL_PIXEL_PACK_BUFFER, frame->download);
+   glReadPixels (0, 0, app.width, app.height,
+                 GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+   glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+
+   frame->fence = glFenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+   frame->busy = true;
+
+   /* get the GPU started while the CPU decodes the next frame */
+   glFlush ();
+}
+
+/* Waits for a frame in flight, then writes it out */
+static bool
+retire_frame (struct frame* frame)
+{
+   bool ok = true;
+
+   if (! frame->busy)
+      return true;
+
+   glClientWaitSync (frame->fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                     GL_TIMEOUT_IGNORED);
+   glDeleteSync (frame->fence);
+   frame->fence = NULL;
+   frame->busy = false;
+
+   if (app.has_timer_query) {
+      GLuint64 ts[MAX_PASSES + 1];
+
+      for (uint32_t i = 0; i <= app.num_passes; i++)
+         app.GetQueryObjectui64vEXT (frame->queries[i], GL_QUERY_RESULT, &ts[i]);
+      for (uint32_t i = 0; i < app.num_passes; i++)
+         app.passes[i].gpu_ns += ts[i + 1] - ts[i];
+   }
+
+   if (app.out != NULL) {
+      glBindBuffer (GL_PIXEL_PACK_BUFFER, frame->download);
+      const uint8_t* rgba = glMapBufferRange (GL_PIXEL_PACK_BUFFER,
+                                              0,
+                                              app.width * app.height * 4,
+                                              GL_MAP_READ_BIT);
+      ok = rgba != NULL && image_write (app.out, &frame->hdr, rgba);
+      glUnmapBuffer (GL_PIXEL_PACK_BUFFER);
+      glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+
+      if (! ok)
+         printf ("Error: Failed to write frame %lu\n",
+                 (unsigned long) app.frames_done);
+   }
+   app.frames_done++;
+   app.pixels_done += frame->hdr.width * frame->hdr.height;
+
+   return ok;
+}
+
+/* Retires all frames in flight, oldest first */
+static bool
+drain_pipeline (uint32_t next)
+{
+   bool ok = true;
+
+   for (uint32_t i = 0; i < PIPELINE_DEPTH; i++)
+      ok &= retire_frame (&app.frames[(next + i) % PIPELINE_DEPTH]);
+
+   return ok;
+}
+
+static void
+print_stats (uint64_t elapsed_ns)
+{
+   double mpixels = app.pixels_done / 1e6;
+   uint64_t chain_ns = 0;
+
+   printf ("\n%lu frames, %.1f megapixels\n\n",
+           (unsigned long) app.frames_done, mpixels);
+
+   if (app.has_timer_query) {
+      printf ("%-10s %12s %10s\n", "pass", "GPU ms", "MP/s");
+      for (uint32_t i = 0; i < app.num_passes; i++) {
+         const struct pass* pass = &app.passes[i];
+
+         printf ("%-10s %12.2f %10.1f\n",
+                 pass->name,
+                 pass->gpu_ns / 1e6,
+                 mpixels * 1e9 / pass->gpu_ns);
+         chain_ns += pass->gpu_ns;
+      }
+      printf ("%-10s %12.2f %10.1f\n",
+              "chain",
+              chain_ns / 1e6,
+              mpixels * 1e9 / chain_ns);
+   } else {
+      printf ("GL_EXT_disjoint_timer_query not supported, "
+              "no per-pass timings\n");
+   }
+
+   printf ("%-10s %12.2f %10.1f\n",
+           "end-to-end",
+           elapsed_ns / 1e6,
+           mpixels * 1e9 / elapsed_ns);
+}
+
+static void
+print_usage (const char* name)
+{
+   fprintf (stderr,
+            "Usage: %s [options] < in > out\n"
+            "  -d <path>     DRM render node (default: %s)\n"
+            "  -p <list>     comma separated passes: blur, sobel, sepia, gray\n"
+            "                (default: %s)\n"
+            "  -r <n>        blur radius, up to %u (default: %u)\n"
+            "  -g <w>x<h>    generate frames instead of reading stdin,\n"
+            "                and discard the output\n"
+            "  -n <n>        number of frames generated (default: %u)\n",
+            name,
+            GLES_COMPUTE_DEFAULT_RENDER_NODE,
+            DEFAULT_PASSES,
+            MAX_RADIUS,
+            DEFAULT_RADIUS,
+            DEFAULT_FRAMES);
+}
+
+int32_t
+main (int32_t argc, char* argv[])
+{
+   const char* render_node = NULL;
+   const char* pass_list = DEFAULT_PASSES;
+   uint32_t radius = DEFAULT_RADIUS;
+   uint32_t gen_width = 0, gen_height = 0;
+   uint32_t num_frames = DEFAULT_FRAMES;
+   int32_t result = -1;
+   int opt;
+
+   while ((opt = getopt (argc, argv, "d:p:r:g:n:h")) != -1) {
+      switch (opt) {
+      case 'd':
+         render_node = optarg;
+         break;
+      case 'p':
+         pass_list = optarg;
+         break;
+      case 'r':
+         radius = atoi (optarg);
+         break;
+      case 'g':
+         if (sscanf (optarg, "%ux%u", &gen_width, &gen_height) != 2) {
+            print_usage (argv[0]);
+            return -1;
+         }
+         break;
+      case 'n':
+         num_frames = atoi (optarg);
+         break;
+      default:
+         print_usage (argv[0]);
+         return opt == 'h' ? 0 : -1;
+      }
+   }
+   if (radius == 0 || radius > MAX_RADIUS) {
+      print_usage (argv[0]);
+      return -1;
+   }
+
+   /* stdout carries the images: everything else, including the messages of
+    * the common code, goes to stderr
+    */
+   if (gen_width == 0) {
+      app.out = fdopen (dup (STDOUT_FILENO), "wb");
+      if (app.out == NULL)
+         return -1;
+   }
+   dup2 (STDERR_FILENO, STDOUT_FILENO);
+
+   if (! parse_passes (pass_list))
+      return -1;
+
+   if (! gles_compute_init (&app.gc, render_node)) {
+      printf ("Error: Failed to setup a GLES compute context\n");
+      return -1;
+   }
+   printf ("Renderer: %s\n", app.gc.renderer);
+
+   app.has_timer_query = gles_compute_has_extension ("GL_EXT_disjoint_timer_query");
+   if (app.has_timer_query) {
+      app.QueryCounterEXT = (PFNGLQUERYCOUNTEREXTPROC)
+         eglGetProcAddress ("glQueryCounterEXT");
+      app.GetQueryObjectui64vEXT = (PFNGLGETQUERYOBJECTUI64VEXTPROC)
+         eglGetProcAddress ("glGetQueryObjectui64vEXT");
+      app.has_timer_query = app.QueryCounterEXT != NULL &&
+         app.GetQueryObjectui64vEXT != NULL;
+   }
+
+   if (! create_programs (radius))
+      goto out;
+
+   uint64_t start = gles_compute_get_time_ns ();
+   uint32_t n;
+
+   for (n = 0; gen_width == 0 || n < num_frames; n++) {
+      struct frame* frame = &app.frames[n % PIPELINE_DEPTH];
+      struct image_header hdr = {
+         .format = IMAGE_FORMAT_PAM,
+         .width = gen_width,
+         .height = gen_height,
+         .depth = 4
+      };
+
+      if (gen_width == 0) {
+         enum image_read_result res = image_read_header (stdin, &hdr);
+         if (res == IMAGE_READ_EOF)
+            break;
+         if (res == IMAGE_READ_ERROR)
+            goto out;
+      }
+
+      /* frees the slot: frames are retired in order */
+      if (! retire_frame (frame))
+         goto out;
+
+      if (hdr.width != app.width || hdr.height != app.height) {
+         if (! drain_pipeline (n % PIPELINE_DEPTH) ||
+             ! create_frames (hdr.width, hdr.height))
+            goto out;
+      }
+      frame->hdr = hdr;
+
+      /* decode straight into the upload buffer */
+      glBindBuffer (GL_PIXEL_UNPACK_BUFFER, frame->upload);
+      uint8_t* rgba = glMapBufferRange (GL_PIXEL_UNPACK_BUFFER,
+                                        0,
+                                        hdr.width * hdr.height * 4,
+                                        GL_MAP_WRITE_BIT |
+                                        GL_MAP_INVALIDATE_BUFFER_BIT);
+      bool ok = rgba != NULL;
+      if (ok && gen_width == 0)
+         ok = image_read_pixels (stdin, &hdr, rgba);
+      else if (ok)
+         generate_pixels (rgba, hdr.width, hdr.height, n);
+      glUnmapBuffer (GL_PIXEL_UNPACK_BUFFER);
+      glBindBuffer (GL_PIXEL_UNPACK_BUFFER, 0);
+
+      if (! ok) {
+         printf ("Error: Failed to read frame %u\n", n);
+         goto out;
+      }
+
+      process_frame (frame);
+   }
+
+   if (! drain_pipeline (n % PIPELINE_DEPTH))
+      goto out;
+   if (app.out != NULL)
+      fflush (app.out);
+
+   if (app.frames_done > 0)
+      print_stats (gles_compute_get_time_ns () - start);
+
+   result = 0;
+
+ out:
+   /* free stuff */
+   destroy_frames ();
+   for (uint32_t k = 0; k < KERNEL_COUNT; k++)
+      glDeleteProgram (app.programs[k]);
+   gles_compute_finish (&app.gc);
+
+   if (app.out != NULL)
+      fclose (app.out);
+
+   return result;
+}
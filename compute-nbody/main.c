@@ -0,0 +1,274 @@
+/*
+ * Example:
+ *
+ * Compute N-body: All-pairs gravitational N-body simulation on GLES 3.1
+ *                 compute shaders, as a compute-bound regression test.
+ *
+ * Two variants of the simulation step are benchmarked over a sweep of body
+ * counts (see nbody.comp): naive, reading every position from memory, and
+ * tiled, sharing positions through shared memory within a work group.
+ *
+ * Positions and velocities live in separate SSBOs, in two sets that steps
+ * ping-pong between without any CPU readback. Results are reported in body
+ * interactions per second (N^2 per step), and in GFLOP/s counting the usual
+ * 20 flops per interaction. The first step of each run is validated against
+ * a double precision CPU reference, on a sample of the bodies.
+ *
+ * Tested on Mesa 22.3, llvmpipe.
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "common/gles-compute.h"
+#include "common/nbody.h"
+
+#define LOCAL_SIZE_X 128
+#define SOFTENING    1e-4f
+#define TIME_STEP    1e-3f
+
+#define FLOPS_PER_INTERACTION 20
+
+#define DEFAULT_MIN_BODIES 1024
+#define DEFAULT_MAX_BODIES 32768
+#define DEFAULT_STEPS      10
+
+/* bodies checked against the CPU, spread over the whole range */
+#define VALIDATE_BODIES 256
+
+enum nbody_variant {
+   NBODY_NAIVE = 0,
+   NBODY_TILED,
+   NBODY_VARIANT_COUNT
+};
+
+static const char* variant_names[NBODY_VARIANT_COUNT] = {
+   "naive",
+   "tiled"
+};
+
+static void
+upload (GLuint buffer, const float* data, uint32_t count)
+{
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, buffer);
+   glBufferData (GL_SHADER_STORAGE_BUFFER, count * 4 * sizeof (float), data,
+                 GL_DYNAMIC_COPY);
+}
+
+/* Runs one step, from set 'src' to set 'src ^ 1' */
+static void
+step (const struct gles_compute* gc,
+      const GLuint pos[2],
+      const GLuint vel[2],
+      uint32_t src,
+      uint32_t count)
+{
+   glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 0, pos[src]);
+   glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 1, vel[src]);
+   glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 2, pos[src ^ 1]);
+   glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 3, vel[src ^ 1]);
+
+   gles_compute_dispatch_1d (gc, (count + LOCAL_SIZE_X - 1) / LOCAL_SIZE_X);
+
+   /* the next step reads what this one wrote */
+   glMemoryBarrier (GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+/* Checks the velocity change over one step against a double precision sum.
+ * The tolerance is relative to the sum of the magnitudes of all terms, so
+ * that it holds whatever the summation order, even where they cancel out.
+ */
+static bool
+check_step (GLuint buffer, const float* pos, const float* vel, uint32_t count)
+{
+   bool valid = true;
+
+   glMemoryBarrier (GL_BUFFER_UPDATE_BARRIER_BIT);
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, buffer);
+   const float* data = glMapBufferRange (GL_SHADER_STORAGE_BUFFER,
+                                         0,
+                                         count * 4 * sizeof (float),
+                                         GL_MAP_READ_BIT);
+   if (data == NULL)
+      return false;
+
+   uint32_t stride = count > VALIDATE_BODIES ? count / VALIDATE_BODIES : 1;
+   for (uint32_t i = 0; i < count && valid; i += stride) {
+      const float* p = pos + i * 4;
+      double acc[3] = { 0.0 };
+      double magnitude = 0.0;
+
+      for (uint32_t j = 0; j < count; j++) {
+         const float* q = pos + j * 4;
+         double r[3] = { q[0] - p[0], q[1] - p[1], q[2] - p[2] };
+         double dist2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2] + SOFTENING;
+         double s = q[3] / (dist2 * sqrt (dist2));
+
+         for (uint32_t c = 0; c < 3; c++)
+            acc[c] += r[c] * s;
+         magnitude += sqrt (dist2 - SOFTENING) * s;
+      }
+
+      for (uint32_t c = 0; c < 3; c++) {
+         double delta = data[i * 4 + c] - vel[i * 4 + c];
+
+         if (fabs (delta - acc[c] * TIME_STEP) >
+             1e-4 * magnitude * TIME_STEP + 1e-6 * fabs (vel[i * 4 + c]))
+            valid = false;
+      }
+   }
+
+   glUnmapBuffer (GL_SHADER_STORAGE_BUFFER);
+
+   return valid;
+}
+
+static void
+print_usage (const char* name)
+{
+   printf ("Usage: %s [options]\n"
+           "  -d <path>  DRM render node (default: %s)\n"
+           "  -s <n>     fewest bodies (default: %u)\n"
+           "  -S <n>     most bodies (default: %u)\n"
+           "  -n <n>     timed steps per run (default: %u)\n",
+           name,
+           GLES_COMPUTE_DEFAULT_RENDER_NODE,
+           DEFAULT_MIN_BODIES,
+           DEFAULT_MAX_BODIES,
+           DEFAULT_STEPS);
+}
+
+int32_t
+main (int32_t argc, char* argv[])
+{
+   const char* render_node = NULL;
+   uint32_t min_bodies = DEFAULT_MIN_BODIES;
+   uint32_t max_bodies = DEFAULT_MAX_BODIES;
+   uint32_t steps = DEFAULT_STEPS;
+   int32_t result = 0;
+   int opt;
+
+   while ((opt = getopt (argc, argv, "d:s:S:n:h")) != -1) {
+      switch (opt) {
+      case 'd':
+         render_node = optarg;
+         break;
+      case 's':
+         min_bodies = atoi (optarg);
+         break;
+      case 'S':
+         max_bodies = atoi (optarg);
+         break;
+      case 'n':
+         steps = atoi (optarg);
+         break;
+      default:
+         print_usage (argv[0]);
+         return opt == 'h' ? 0 : -1;
+      }
+   }
+   if (min_bodies == 0 || min_bodies > max_bodies || max_bodies > (1 << 24) ||
+       steps == 0) {
+      print_usage (argv[0]);
+      return -1;
+   }
+
+   struct gles_compute gc;
+   if (! gles_compute_init (&gc, render_node)) {
+      printf ("Error: Failed to setup a GLES compute context\n");
+      return -1;
+   }
+   printf ("Renderer: %s\n", gc.renderer);
+
+   GLuint programs[NBODY_VARIANT_COUNT] = { 0 };
+   for (uint32_t v = 0; v < NBODY_VARIANT_COUNT; v++) {
+      char defines[128];
+
+      snprintf (defines, sizeof (defines),
+                "#define LOCAL_SIZE_X %u\n#define SOFTENING %.9g\n"
+                "#define VARIANT %u\n",
+                LOCAL_SIZE_X, SOFTENING, v);
+      programs[v] = gles_compute_load_program (CURRENT_DIR "/nbody.comp",
+                                               defines);
+      if (programs[v] == 0) {
+         result = -1;
+         goto out;
+      }
+   }
+
+   /* two sets of (positions, velocities), ping-ponged */
+   GLuint pos[2], vel[2];
+   glGenBuffers (2, pos);
+   glGenBuffers (2, vel);
+
+   printf ("\n%-8s %-8s %10s %12s %10s   %s\n",
+           "bodies", "variant", "ms/step", "Ginter/s", "GFLOP/s", "result");
+
+   for (uint32_t count = min_bodies; count <= max_bodies; count *= 2) {
+      double interactions = (double) count * count;
+      float* init_pos = malloc (count * 4 * sizeof (float));
+      float* init_vel = malloc (count * 4 * sizeof (float));
+
+      nbody_init_bodies (init_pos, init_vel, count);
+
+      for (uint32_t v = 0; v < NBODY_VARIANT_COUNT; v++) {
+         /* uniforms are program state, set once per run */
+         glUseProgram (programs[v]);
+         glUniform1ui (0, count);
+         glUniform1f (1, TIME_STEP);
+
+         upload (pos[0], init_pos, count);
+         upload (vel[0], init_vel, count);
+         upload (pos[1], NULL, count);
+         upload (vel[1], NULL, count);
+
+         /* warm up, and the step that gets validated */
+         step (&gc, pos, vel, 0, count);
+         bool valid = check_step (vel[1], init_pos, init_vel, count);
+
+         uint64_t start = gles_compute_get_time_ns ();
+         for (uint32_t i = 0; i < steps; i++)
+            step (&gc, pos, vel, (i + 1) & 1, count);
+         gles_compute_wait ();
+         uint64_t ns = (gles_compute_get_time_ns () - start) / steps;
+
+         printf ("%-8u %-8s %10.2f %12.3f %10.2f   %s\n",
+                 count,
+                 variant_names[v],
+                 ns / 1e6,
+                 interactions / ns,
+                 interactions * FLOPS_PER_INTERACTION / ns,
+                 valid ? "ok" : "MISMATCH");
+         if (! valid)
+            result = -1;
+      }
+
+      free (init_vel);
+      free (init_pos);
+   }
+
+   glDeleteBuffers (2, vel);
+   glDeleteBuffers (2, pos);
+
+ out:
+   /* free stuff */
+   for (uint32_t v = 0; v < NBODY_VARIANT_COUNT; v++)
+      glDeleteProgram (programs[v]);
+   gles_compute_finish (&gc);
+
+   return result;
+}
@@ -0,0 +1,366 @@
+/*
+ * Example:
+ *
+ * Compute pool: Many small, independent compute jobs dispatched from a pool
+ *               of CPU threads, each owning an EGL context that shares
+ *               programs and buffers with the main one.
+ *
+ * Every job binds its own slice of an input and an output buffer, dispatches
+ * a small kernel and waits on its own fence. The same batch of jobs is run
+ * from the main thread alone (one context, a fence wait per job, as
+ * render-nodes-minimal does), then from pools of 1, 2, 4... threads. Whether
+ * the throughput scales tells if the driver overlaps submissions coming from
+ * multiple contexts, or serializes them.
+ *
+ * Tested on Mesa 22.3, llvmpipe.
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/gles-compute.h"
+#include "common/gles-pool.h"
+
+#define LOCAL_SIZE_X     64
+
+#define DEFAULT_THREADS  4
+#define DEFAULT_JOBS     2048
+#define DEFAULT_SIZE     4096
+#define DEFAULT_ROUNDS   64
+
+struct job {
+   const struct gles_compute* gc;
+   GLuint program;
+   GLuint input;
+   GLuint output;
+   GLintptr offset;
+   GLsizeiptr size;
+   uint32_t groups;
+};
+
+struct result {
+   double jobs_per_sec;
+   double wait_ratio;
+   bool valid;
+};
+
+static void
+run_job (uint32_t thread, void* data)
+{
+   const struct job* job = data;
+
+   glUseProgram (job->program);
+   glBindBufferRange (GL_SHADER_STORAGE_BUFFER, 0,
+                      job->input, job->offset, job->size);
+   glBindBufferRange (GL_SHADER_STORAGE_BUFFER, 1,
+                      job->output, job->offset, job->size);
+   gles_compute_dispatch_1d (job->gc, job->groups);
+}
+
+static uint32_t
+hash (uint32_t h, uint32_t rounds)
+{
+   for (uint32_t i = 0; i < rounds; i++) {
+      h ^= h >> 16;
+      h *= 0x7feb352du;
+      h ^= h >> 15;
+   }
+
+   return h;
+}
+
+static bool
+check_output (const struct job* jobs,
+              uint32_t num_jobs,
+              uint32_t count,
+              uint32_t rounds)
+{
+   bool valid = true;
+
+   glMemoryBarrier (GL_BUFFER_UPDATE_BARRIER_BIT);
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, jobs[0].output);
+
+   for (uint32_t j = 0; j < num_jobs && valid; j++) {
+      const uint32_t* data = glMapBufferRange (GL_SHADER_STORAGE_BUFFER,
+                                               jobs[j].offset,
+                                               jobs[j].size,
+                                               GL_MAP_READ_BIT);
+      if (data == NULL)
+         return false;
+
+      uint32_t first = jobs[j].offset / sizeof (uint32_t);
+      for (uint32_t i = 0; i < count && valid; i++)
+         valid = data[i] == hash (first + i, rounds);
+      glUnmapBuffer (GL_SHADER_STORAGE_BUFFER);
+   }
+
+   return valid;
+}
+
+static bool
+clear_output (GLuint output, GLsizeiptr size)
+{
+   void* zeros = calloc (1, size);
+   if (zeros == NULL) {
+      printf ("Error: Failed to allocate the cleared output\n");
+      return false;
+   }
+
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, output);
+   glBufferData (GL_SHADER_STORAGE_BUFFER, size, zeros, GL_DYNAMIC_COPY);
+   free (zeros);
+
+   /* the workers must see the new storage */
+   gles_compute_wait ();
+
+   return true;
+}
+
+/* the baseline: all jobs from the main thread, waiting on each one */
+static void
+run_serial (const struct job* jobs, uint32_t num_jobs, struct result* result)
+{
+   uint64_t wait_ns = 0;
+   uint64_t start = gles_compute_get_time_ns ();
+
+   for (uint32_t j = 0; j < num_jobs; j++) {
+      run_job (0, (void*) &jobs[j]);
+
+      uint64_t wait_start = gles_compute_get_time_ns ();
+      gles_compute_wait ();
+      wait_ns += gles_compute_get_time_ns () - wait_start;
+   }
+
+   uint64_t elapsed = gles_compute_get_time_ns () - start;
+
+   result->jobs_per_sec = num_jobs * 1e9 / elapsed;
+   result->wait_ratio = (double) wait_ns / elapsed;
+}
+
+static bool
+run_pool (struct gles_compute* gc,
+          uint32_t threads,
+          struct job* jobs,
+          uint32_t num_jobs,
+          struct result* result)
+{
+   struct gles_pool pool;
+
+   if (! gles_pool_init (&pool, gc, threads))
+      return false;
+
+   uint64_t start = gles_compute_get_time_ns ();
+
+   for (uint32_t j = 0; j < num_jobs; j++)
+      gles_pool_submit (&pool, run_job, &jobs[j]);
+   gles_pool_wait (&pool);
+
+   uint64_t elapsed = gles_compute_get_time_ns () - start;
+
+   /* share of the workers' time spent blocked on their own fences */
+   uint64_t wait_ns = 0;
+   for (uint32_t t = 0; t < pool.num_workers; t++)
+      wait_ns += pool.workers[t].wait_ns;
+
+   result->jobs_per_sec = num_jobs * 1e9 / elapsed;
+   result->wait_ratio = (double) wait_ns / (elapsed * threads);
+
+   gles_pool_finish (&pool);
+
+   return true;
+}
+
+static void
+print_usage (const char* name)
+{
+   printf ("Usage: %s [options]\n"
+           "  -d <path>  DRM render node (default: %s)\n"
+           "  -t <n>     max number of threads (default: %u, max: %u)\n"
+           "  -n <n>     number of jobs (default: %u)\n"
+           "  -s <n>     elements per job (default: %u)\n"
+           "  -r <n>     hash rounds per element (default: %u)\n",
+           name,
+           GLES_COMPUTE_DEFAULT_RENDER_NODE,
+           DEFAULT_THREADS,
+           GLES_POOL_MAX_THREADS,
+           DEFAULT_JOBS,
+           DEFAULT_SIZE,
+           DEFAULT_ROUNDS);
+}
+
+int32_t
+main (int32_t argc, char* argv[])
+{
+   const char* render_node = NULL;
+   uint32_t max_threads = DEFAULT_THREADS;
+   uint32_t num_jobs = DEFAULT_JOBS;
+   uint32_t count = DEFAULT_SIZE;
+   uint32_t rounds = DEFAULT_ROUNDS;
+   int opt;
+
+   while ((opt = getopt (argc, argv, "d:t:n:s:r:h")) != -1) {
+      switch (opt) {
+      case 'd':
+         render_node = optarg;
+         break;
+      case 't':
+         max_threads = atoi (optarg);
+         break;
+      case 'n':
+         num_jobs = atoi (optarg);
+         break;
+      case 's':
+         count = atoi (optarg);
+         break;
+      case 'r':
+         rounds = atoi (optarg);
+         break;
+      default:
+         print_usage (argv[0]);
+         return opt == 'h' ? 0 : -1;
+      }
+   }
+   if (max_threads == 0 || max_threads > GLES_POOL_MAX_THREADS ||
+       num_jobs == 0 || count == 0) {
+      print_usage (argv[0]);
+      return -1;
+   }
+
+   struct gles_compute gc;
+   if (! gles_compute_init (&gc, render_node)) {
+      printf ("Error: Failed to setup a GLES compute context\n");
+      return -1;
+   }
+   printf ("Renderer: %s\n", gc.renderer);
+
+   char defines[128];
+   snprintf (defines, sizeof (defines),
+             "#define LOCAL_SIZE_X %u\n#define ROUNDS %u\n",
+             LOCAL_SIZE_X, rounds);
+   GLuint program = gles_compute_load_program (CURRENT_DIR "/job.comp",
+                                               defines);
+   if (program == 0) {
+      gles_compute_finish (&gc);
+      return -1;
+   }
+
+   /* slices start at offsets bindable with glBindBufferRange() */
+   GLint alignment = 1;
+   glGetIntegerv (GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+   GLsizeiptr job_size = count * sizeof (uint32_t);
+   GLsizeiptr stride = (job_size + alignment - 1) / alignment * alignment;
+   GLsizeiptr total = stride * num_jobs;
+
+   if (total > gc.max_ssbo_size) {
+      printf ("Error: %u jobs of %u elements exceed the max SSBO size\n",
+              num_jobs, count);
+      glDeleteProgram (program);
+      gles_compute_finish (&gc);
+      return -1;
+   }
+
+   uint32_t* data = malloc (total);
+   if (data == NULL) {
+      printf ("Error: Failed to allocate %u jobs of %u elements\n",
+              num_jobs, count);
+      glDeleteProgram (program);
+      gles_compute_finish (&gc);
+      return -1;
+   }
+   for (uint32_t i = 0; i < total / sizeof (uint32_t); i++)
+      data[i] = i;
+
+   GLuint input, output;
+   glGenBuffers (1, &input);
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, input);
+   glBufferData (GL_SHADER_STORAGE_BUFFER, total, data, GL_STATIC_DRAW);
+   glGenBuffers (1, &output);
+   free (data);
+
+   struct job* jobs = calloc (num_jobs, sizeof (struct job));
+   if (jobs == NULL) {
+      printf ("Error: Failed to allocate %u jobs\n", num_jobs);
+      glDeleteBuffers (1, &output);
+      glDeleteBuffers (1, &input);
+      glDeleteProgram (program);
+      gles_compute_finish (&gc);
+      return -1;
+   }
+   for (uint32_t j = 0; j < num_jobs; j++) {
+      jobs[j].gc = &gc;
+      jobs[j].program = program;
+      jobs[j].input = input;
+      jobs[j].output = output;
+      jobs[j].offset = j * stride;
+      jobs[j].size = job_size;
+      jobs[j].groups = (count + LOCAL_SIZE_X - 1) / LOCAL_SIZE_X;
+   }
+
+   /* the uniform is program state, shared by all contexts: set it once */
+   glUseProgram (program);
+   glUniform1ui (0, count);
+
+   printf ("%u jobs of %u elements, %u rounds\n\n", num_jobs, count, rounds);
+   printf ("%-8s %12s %9s %8s   %s\n",
+           "threads", "jobs/s", "speedup", "wait", "result");
+
+   struct result serial;
+   if (! clear_output (output, total))
+      goto free_stuff;
+   run_serial (jobs, num_jobs, &serial);
+   serial.valid = check_output (jobs, num_jobs, count, rounds);
+   printf ("%-8s %12.1f %8.2fx %7.1f%%   %s\n",
+           "main",
+           serial.jobs_per_sec,
+           1.0,
+           serial.wait_ratio * 100.0,
+           serial.valid ? "ok" : "MISMATCH");
+
+   for (uint32_t threads = 1; threads <= max_threads; ) {
+      struct result result;
+
+      if (! clear_output (output, total))
+         break;
+      if (! run_pool (&gc, threads, jobs, num_jobs, &result)) {
+         printf ("Error: Failed to run a pool of %u threads\n", threads);
+         break;
+      }
+      result.valid = check_output (jobs, num_jobs, count, rounds);
+
+      printf ("%-8u %12.1f %8.2fx %7.1f%%   %s\n",
+              threads,
+              result.jobs_per_sec,
+              result.jobs_per_sec / serial.jobs_per_sec,
+              result.wait_ratio * 100.0,
+              result.valid ? "ok" : "MISMATCH");
+
+      if (threads < max_threads && threads * 2 > max_threads)
+         threads = max_threads;
+      else
+         threads *= 2;
+   }
+
+   /* free stuff */
+ free_stuff:
+   free (jobs);
+   glDeleteBuffers (1, &output);
+   glDeleteBuffers (1, &input);
+   glDeleteProgram (program);
+   gles_compute_finish (&gc);
+
+   return 0;
+}
@@ -0,0 +1,616 @@
+/*
+ * Multi-threaded CPU reference implementations of the GPU primitives.
+ *
+ * Work is split in one contiguous chunk per thread. Every primitive follows
+ * the same pattern as its GPU counterpart: a parallel pass over the chunks,
+ * a tiny sequential step over the per-chunk results, and (if needed) a second
+ * parallel pass.
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cpu-reference.h"
+
+#if defined (__AVX2__)
+#include <immintrin.h>
+#elif defined (__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/* below this, spawning threads costs more than it saves */
+#define MIN_ITEMS_PER_THREAD (64 * 1024)
+
+#define HISTOGRAM_BINS 256
+
+static uint32_t num_threads = 0;
+
+typedef void (* ChunkFunc) (void* data,
+                            uint32_t thread,
+                            size_t begin,
+                            size_t end);
+
+struct chunk {
+   ChunkFunc func;
+   void* data;
+   uint32_t thread;
+   size_t begin;
+   size_t end;
+};
+
+void
+cpu_reference_set_threads (uint32_t threads)
+{
+   num_threads = threads < CPU_MAX_THREADS ? threads : CPU_MAX_THREADS;
+}
+
+const char*
+cpu_reference_simd (void)
+{
+#if defined (__AVX2__)
+   return "avx2";
+#elif defined (__ARM_NEON)
+   return "neon";
+#else
+   return "scalar";
+#endif
+}
+
+static uint32_t
+get_threads (size_t count)
+{
+   uint32_t threads = num_threads;
+
+   if (threads == 0) {
+      long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+      threads = cpus > 0 ? (uint32_t) cpus : 1;
+   }
+   if (threads > CPU_MAX_THREADS)
+      threads = CPU_MAX_THREADS;
+   if (threads > count / MIN_ITEMS_PER_THREAD)
+      threads = count / MIN_ITEMS_PER_THREAD;
+
+   return threads > 0 ? threads : 1;
+}
+
+static void*
+run_chunk (void* data)
+{
+   struct chunk* chunk = data;
+
+   chunk->func (chunk->data, chunk->thread, chunk->begin, chunk->end);
+   return NULL;
+}
+
+/* runs 'func' over 'threads' contiguous chunks of [0, count) */
+static void
+parallel_for (size_t count, uint32_t threads, ChunkFunc func, void* data)
+{
+   pthread_t tids[CPU_MAX_THREADS];
+   struct chunk chunks[CPU_MAX_THREADS];
+
+   for (uint32_t t = 0; t < threads; t++) {
+      chunks[t].func = func;
+      chunks[t].data = data;
+      chunks[t].thread = t;
+      chunks[t].begin = count * t / threads;
+      chunks[t].end = count * (t + 1) / threads;
+   }
+
+   for (uint32_t t = 1; t < threads; t++)
+      pthread_create (&tids[t], NULL, run_chunk, &chunks[t]);
+
+   run_chunk (&chunks[0]);
+
+   for (uint32_t t = 1; t < threads; t++)
+      pthread_join (tids[t], NULL);
+}
+
+/* Reduction */
+/* ========================================================================= */
+
+static uint32_t
+reduce_range (const uint32_t* src, size_t count)
+{
+   uint32_t sum = 0;
+   size_t i = 0;
+
+#if defined (__AVX2__)
+   /* four independent accumulators to hide the latency of the adds */
+   __m256i acc0 = _mm256_setzero_si256 ();
+   __m256i acc1 = _mm256_setzero_si256 ();
+   __m256i acc2 = _mm256_setzero_si256 ();
+   __m256i acc3 = _mm256_setzero_si256 ();
+
+   for (; i + 32 <= count; i += 32) {
+      const __m256i* p = (const __m256i*) (src + i);
+      acc0 = _mm256_add_epi32 (acc0, _mm256_loadu_si256 (p));
+      acc1 = _mm256_add_epi32 (acc1, _mm256_loadu_si256 (p + 1));
+      acc2 = _mm256_add_epi32 (acc2, _mm256_loadu_si256 (p + 2));
+      acc3 = _mm256_add_epi32 (acc3, _mm256_loadu_si256 (p + 3));
+   }
+   acc0 = _mm256_add_epi32 (_mm256_add_epi32 (acc0, acc1),
+                            _mm256_add_epi32 (acc2, acc3));
+
+   uint32_t lanes[8];
+   _mm256_storeu_si256 ((__m256i*) lanes, acc0);
+   for (unsigned l = 0; l < 8; l++)
+      sum += lanes[l];
+#elif defined (__ARM_NEON)
+   uint32x4_t acc0 = vdupq_n_u32 (0);
+   uint32x4_t acc1 = vdupq_n_u32 (0);
+
+   for (; i + 8 <= count; i += 8) {
+      acc0 = vaddq_u32 (acc0, vld1q_u32 (src + i));
+      acc1 = vaddq_u32 (acc1, vld1q_u32 (src + i + 4));
+   }
+   acc0 = vaddq_u32 (acc0, acc1);
+
+   uint32_t lanes[4];
+   vst1q_u32 (lanes, acc0);
+   sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+   for (; i < count; i++)
+      sum += src[i];
+
+   return sum;
+}
+
+struct reduce_data {
+   const uint32_t* src;
+   uint32_t sums[CPU_MAX_THREADS];
+};
+
+static void
+reduce_chunk (void* data, uint32_t thread, size_t begin, size_t end)
+{
+   struct reduce_data* rd = data;
+
+   rd->sums[thread] = reduce_range (rd->src + begin, end - begin);
+}
+
+uint32_t
+cpu_reduce (const uint32_t* src, size_t count)
+{
+   struct reduce_data rd = { src, {0, } };
+   uint32_t threads = get_threads (count);
+
+   parallel_for (count, threads, reduce_chunk, &rd);
+
+   uint32_t sum = 0;
+   for (uint32_t t = 0; t < threads; t++)
+      sum += rd.sums[t];
+
+   return sum;
+}
+
+/* Scan */
+/* ========================================================================= */
+
+/* scans 'count' elements starting from 'carry', returns the new carry */
+static uint32_t
+scan_range (const uint32_t* src,
+            uint32_t* dst,
+            size_t count,
+            uint32_t carry,
+            bool exclusive)
+{
+   size_t i = 0;
+
+#if defined (__AVX2__)
+   __m256i carry_v = _mm256_set1_epi32 (carry);
+   const __m256i last = _mm256_set1_epi32 (7);
+
+   for (; i + 8 <= count; i += 8) {
+      __m256i v = _mm256_loadu_si256 ((const __m256i*) (src + i));
+
+      /* in-register scan of each 128-bit half... */
+      __m256i x = _mm256_add_epi32 (v, _mm256_slli_si256 (v, 4));
+      x = _mm256_add_epi32 (x, _mm256_slli_si256 (x, 8));
+
+      /* ...then carry the low half's total into the high half */
+      __m256i t = _mm256_shuffle_epi32 (x, _MM_SHUFFLE (3, 3, 3, 3));
+      x = _mm256_add_epi32 (x, _mm256_permute2x128_si256 (t, t, 0x08));
+
+      x = _mm256_add_epi32 (x, carry_v);
+      carry_v = _mm256_permutevar8x32_epi32 (x, last);
+
+      if (exclusive)
+         x = _mm256_sub_epi32 (x, v);
+      _mm256_storeu_si256 ((__m256i*) (dst + i), x);
+   }
+   carry = (uint32_t) _mm256_extract_epi32 (carry_v, 0);
+#elif defined (__ARM_NEON)
+   const uint32x4_t zero = vdupq_n_u32 (0);
+
+   for (; i + 4 <= count; i += 4) {
+      uint32x4_t v = vld1q_u32 (src + i);
+
+      uint32x4_t x = vaddq_u32 (v, vextq_u32 (zero, v, 3));
+      x = vaddq_u32 (x, vextq_u32 (zero, x, 2));
+      x = vaddq_u32 (x, vdupq_n_u32 (carry));
+      carry = vgetq_lane_u32 (x, 3);
+
+      if (exclusive)
+         x = vsubq_u32 (x, v);
+      vst1q_u32 (dst + i, x);
+   }
+#endif
+
+   for (; i < count; i++) {
+      uint32_t value = src[i];
+      dst[i] = exclusive ? carry : carry + value;
+      carry += value;
+   }
+
+   return carry;
+}
+
+struct scan_data {
+   const uint32_t* src;
+   uint32_t* dst;
+   bool exclusive;
+   uint32_t offsets[CPU_MAX_THREADS];
+};
+
+static void
+scan_sum_chunk (void* data, uint32_t thread, size_t begin, size_t end)
+{
+   struct scan_data* sd = data;
+
+   sd->offsets[thread] = reduce_range (sd->src + begin, end - begin);
+}
+
+static void
+scan_chunk (void* data, uint32_t thread, size_t begin, size_t end)
+{
+   struct scan_data* sd = data;
+
+   scan_range (sd->src + begin,
+               sd->dst + begin,
+               end - begin,
+               sd->offsets[thread],
+               sd->exclusive);
+}
+
+void
+cpu_scan (const uint32_t* src, uint32_t* dst, size_t count, bool exclusive)
+{
+   struct scan_data sd = { src, dst, exclusive, {0, } };
+   uint32_t threads = get_threads (count);
+
+   if (threads > 1) {
+      parallel_for (count, threads, scan_sum_chunk, &sd);
+
+      /* exclusive scan of the chunk sums */
+      uint32_t carry = 0;
+      for (uint32_t t = 0; t < threads; t++) {
+         uint32_t sum = sd.offsets[t];
+         sd.offsets[t] = carry;
+         carry += sum;
+      }
+   }
+
+   parallel_for (count, threads, scan_chunk, &sd);
+}
+
+/* Stream compaction */
+/* ========================================================================= */
+
+#if defined (__AVX2__)
+/* for each 8-bit mask, the lane indices of its set bits, packed at the front */
+static uint32_t compact_lut[256][8];
+static pthread_once_t compact_lut_once = PTHREAD_ONCE_INIT;
+
+static void
+init_compact_lut (void)
+{
+   for (uint32_t mask = 0; mask < 256; mask++) {
+      uint32_t n = 0;
+      for (uint32_t lane = 0; lane < 8; lane++) {
+         if (mask & (1 << lane))
+            compact_lut[mask][n++] = lane;
+      }
+   }
+}
+
+/* unsigned 'a < b', AVX2 only has signed compares */
+static inline __m256i
+cmplt_epu32 (__m256i a, __m256i b)
+{
+   const __m256i bias = _mm256_set1_epi32 (0x80000000);
+
+   return _mm256_cmpgt_epi32 (_mm256_xor_si256 (b, bias),
+                              _mm256_xor_si256 (a, bias));
+}
+#endif
+
+static size_t
+compact_count_range (const uint32_t* src, size_t count, uint32_t threshold)
+{
+   size_t kept = 0;
+   size_t i = 0;
+
+#if defined (__AVX2__)
+   const __m256i t = _mm256_set1_epi32 (threshold);
+
+   for (; i + 8 <= count; i += 8) {
+      __m256i v = _mm256_loadu_si256 ((const __m256i*) (src + i));
+      __m256i lt = cmplt_epu32 (v, t);
+      kept += __builtin_popcount (_mm256_movemask_ps (_mm256_castsi256_ps (lt)));
+   }
+#elif defined (__ARM_NEON)
+   const uint32x4_t t = vdupq_n_u32 (threshold);
+   uint32x4_t acc = vdupq_n_u32 (0);
+
+   /* lanes of a true compare are all ones, i.e, -1 */
+   for (; i + 4 <= count; i += 4)
+      acc = vsubq_u32 (acc, vcltq_u32 (vld1q_u32 (src + i), t));
+
+   uint32_t lanes[4];
+   vst1q_u32 (lanes, acc);
+   kept = (size_t) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+   for (; i < count; i++)
+      kept += src[i] < threshold;
+
+   return kept;
+}
+
+static size_t
+compact_range (const uint32_t* src,
+               uint32_t* dst,
+               size_t count,
+               uint32_t threshold)
+{
+   size_t kept = 0;
+   size_t i = 0;
+
+#if defined (__AVX2__)
+   const __m256i t = _mm256_set1_epi32 (threshold);
+   const __m256i lanes = _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7);
+
+   for (; i + 8 <= count; i += 8) {
+      __m256i v = _mm256_loadu_si256 ((const __m256i*) (src + i));
+      uint32_t mask =
+         _mm256_movemask_ps (_mm256_castsi256_ps (cmplt_epu32 (v, t)));
+      uint32_t n = __builtin_popcount (mask);
+
+      /* pack the kept lanes to the front, and store only those (the tail
+       * of this chunk belongs to another thread)
+       */
+      __m256i perm =
+         _mm256_loadu_si256 ((const __m256i*) compact_lut[mask]);
+      __m256i store_mask = _mm256_cmpgt_epi32 (_mm256_set1_epi32 (n), lanes);
+      _mm256_maskstore_epi32 ((int*) (dst + kept),
+                              store_mask,
+                              _mm256_permutevar8x32_epi32 (v, perm));
+      kept += n;
+   }
+#endif
+
+   for (; i < count; i++) {
+      if (src[i] < threshold)
+         dst[kept++] = src[i];
+   }
+
+   return kept;
+}
+
+struct compact_data {
+   const uint32_t* src;
+   uint32_t* dst;
+   uint32_t threshold;
+   size_t offsets[CPU_MAX_THREADS];
+};
+
+static void
+compact_count_chunk (void* data, uint32_t thread, size_t begin, size_t end)
+{
+   struct compact_data* cd = data;
+
+   cd->offsets[thread] = compact_count_range (cd->src + begin,
+                                              end - begin,
+                                              cd->threshold);
+}
+
+static void
+compact_chunk (void* data, uint32_t thread, size_t begin, size_t end)
+{
+   struct compact_data* cd = data;
+
+   compact_range (cd->src + begin,
+                  cd->dst + cd->offsets[thread],
+                  end - begin,
+                  cd->threshold);
+}
+
+size_t
+cpu_compact (const uint32_t* src,
+             uint32_t* dst,
+             size_t count,
+             uint32_t threshold)
+{
+   struct compact_data cd = { src, dst, threshold, {0, } };
+   uint32_t threads = get_threads (count);
+
+#if defined (__AVX2__)
+   pthread_once (&compact_lut_once, init_compact_lut);
+#endif
+
+   if (threads == 1)
+      return compact_range (src, dst, count, threshold);
+
+   parallel_for (count, threads, compact_count_chunk, &cd);
+
+   size_t kept = 0;
+   for (uint32_t t = 0; t < threads; t++) {
+      size_t n = cd.offsets[t];
+      cd.offsets[t] = kept;
+      kept += n;
+   }
+
+   parallel_for (count, threads, compact_chunk, &cd);
+
+   return kept;
+}
+
+/* Histogram */
+/* ========================================================================= */
+
+struct histogram_data {
+   const uint32_t* src;
+   uint32_t shift;
+   uint32_t (* hists)[HISTOGRAM_BINS];
+};
+
+static void
+histogram_chunk (void* data, uint32_t thread, size_t begin, size_t end)
+{
+   struct histogram_data* hd = data;
+   const uint32_t* src = hd->src;
+   const uint32_t shift = hd->shift;
+
+   /* Scattered increments don't vectorize, but four sub-histograms break
+    * the store-to-load dependency between equal consecutive bins.
+    */
+   uint32_t sub[4][HISTOGRAM_BINS];
+   memset (sub, 0, sizeof (sub));
+
+   size_t i = begin;
+   for (; i + 4 <= end; i += 4) {
+      sub[0][(src[i] >> shift) & (HISTOGRAM_BINS - 1)]++;
+      sub[1][(src[i + 1] >> shift) & (HISTOGRAM_BINS - 1)]++;
+      sub[2][(src[i + 2] >> shift) & (HISTOGRAM_BINS - 1)]++;
+      sub[3][(src[i + 3] >> shift) & (HISTOGRAM_BINS - 1)]++;
+   }
+   for (; i < end; i++)
+      sub[0][(src[i] >> shift) & (HISTOGRAM_BINS - 1)]++;
+
+   for (uint32_t b = 0; b < HISTOGRAM_BINS; b++)
+      hd->hists[thread][b] = sub[0][b] + sub[1][b] + sub[2][b] + sub[3][b];
+}
+
+void
+cpu_histogram (const uint32_t* src,
+               size_t count,
+               uint32_t shift,
+               uint32_t* hist)
+{
+   uint32_t threads = get_threads (count);
+   uint32_t (* hists)[HISTOGRAM_BINS] =
+      malloc (threads * sizeof (uint32_t[HISTOGRAM_BINS]));
+   struct histogram_data hd = { src, shift, hists };
+
+   parallel_for (count, threads, histogram_chunk, &hd);
+
+   memcpy (hist, hists[0], sizeof (uint32_t[HISTOGRAM_BINS]));
+   for (uint32_t t = 1; t < threads; t++) {
+      for (uint32_t b = 0; b < HISTOGRAM_BINS; b++)
+         hist[b] += hists[t][b];
+   }
+
+   free (hists);
+}
+
+/* Radix sort */
+/* ========================================================================= */
+
+#define CPU_RADIX_BITS 8
+#define CPU_RADIX      (1 << CPU_RADIX_BITS)
+
+struct radix_data {
+   const uint32_t* keys_in;
+   const uint32_t* values_in;
+   uint32_t* keys_out;
+   uint32_t* values_out;
+   uint32_t shift;
+   size_t (* offsets)[CPU_RADIX];
+};
+
+static void
+radix_count_chunk (void* data, uint32_t thread, size_t begin, size_t end)
+{
+   struct radix_data* rd = data;
+   size_t* counts = rd->offsets[thread];
+
+   memset (counts, 0, sizeof (size_t[CPU_RADIX]));
+   for (size_t i = begin; i < end; i++)
+      counts[(rd->keys_in[i] >> rd->shift) & (CPU_RADIX - 1)]++;
+}
+
+static void
+radix_scatter_chunk (void* data, uint32_t thread, size_t begin, size_t end)
+{
+   struct radix_data* rd = data;
+   size_t* offsets = rd->offsets[thread];
+
+   for (size_t i = begin; i < end; i++) {
+      uint32_t key = rd->keys_in[i];
+      size_t position = offsets[(key >> rd->shift) & (CPU_RADIX - 1)]++;
+
+      rd->keys_out[position] = key;
+      rd->values_out[position] = rd->values_in[i];
+   }
+}
+
+void
+cpu_radix_sort (uint32_t* keys,
+                uint32_t* values,
+                uint32_t* tmp_keys,
+                uint32_t* tmp_values,
+                size_t count)
+{
+   uint32_t threads = get_threads (count);
+   size_t (* offsets)[CPU_RADIX] = malloc (threads * sizeof (size_t[CPU_RADIX]));
+   uint32_t* buffers[2][2] = {
+      { keys, values },
+      { tmp_keys, tmp_values }
+   };
+
+   /* an even number of passes leaves the result in place */
+   assert ((32 / CPU_RADIX_BITS) % 2 == 0);
+
+   for (uint32_t shift = 0, pass = 0;
+        shift < 32;
+        shift += CPU_RADIX_BITS, pass++) {
+      struct radix_data rd = {
+         .keys_in = buffers[pass & 1][0],
+         .values_in = buffers[pass & 1][1],
+         .keys_out = buffers[(pass + 1) & 1][0],
+         .values_out = buffers[(pass + 1) & 1][1],
+         .shift = shift,
+         .offsets = offsets
+      };
+
+      parallel_for (count, threads, radix_count_chunk, &rd);
+
+      /* digit-major exclusive scan of the per-thread counts */
+      size_t position = 0;
+      for (uint32_t d = 0; d < CPU_RADIX; d++) {
+         for (uint32_t t = 0; t < threads; t++) {
+            size_t n = offsets[t][d];
+            offsets[t][d] = position;
+            position += n;
+         }
+      }
+
+      parallel_for (count, threads, radix_scatter_chunk, &rd);
+   }
+
+   free (offsets);
+}
@@ -0,0 +1,52 @@
+/*
+ * Multi-threaded CPU reference implementations of the GPU primitives, using
+ * AVX2 or NEON where it pays off (and plain C elsewhere).
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CPU_MAX_THREADS 64
+
+/* Sets the number of worker threads, 0 for one per online CPU */
+void        cpu_reference_set_threads (uint32_t num_threads);
+
+/* Name of the SIMD flavour compiled in: "avx2", "neon" or "scalar" */
+const char* cpu_reference_simd        (void);
+
+uint32_t    cpu_reduce                (const uint32_t* src, size_t count);
+
+void        cpu_scan                  (const uint32_t* src,
+                                       uint32_t* dst,
+                                       size_t count,
+                                       bool exclusive);
+
+size_t      cpu_compact               (const uint32_t* src,
+                                       uint32_t* dst,
+                                       size_t count,
+                                       uint32_t threshold);
+
+void        cpu_histogram             (const uint32_t* src,
+                                       size_t count,
+                                       uint32_t shift,
+                                       uint32_t* hist); /* 256 bins */
+
+/* Stable sort of 'keys' and 'values', using 'tmp_keys' and 'tmp_values'
+ * (of 'count' elements each) as scratch.
+ */
+void        cpu_radix_sort            (uint32_t* keys,
+                                       uint32_t* values,
+                                       uint32_t* tmp_keys,
+                                       uint32_t* tmp_values,
+                                       size_t count);
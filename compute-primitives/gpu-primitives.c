@@ -0,0 +1,553 @@
+/*
+ * GPU parallel primitives on GLES 3.1 compute shaders.
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common/gles-autotune.h"
+#include "gpu-primitives.h"
+
+#define DIV_ROUND_UP(a, b) (((a) + (b) - 1) / (b))
+
+#define RADIX (1 << RADIX_BITS)
+
+/* the number of passes must be even, for the result to end up in place */
+#if (32 / RADIX_BITS) % 2 != 0
+#error "RADIX_BITS must give an even number of radix sort passes"
+#endif
+
+/* uniform locations, fixed in the shaders */
+#define UNIFORM_COUNT      0
+#define UNIFORM_NUM_GROUPS 1
+#define UNIFORM_PARAM      2
+
+static const struct gpu_primitive_config default_configs[] = {
+   [GPU_PRIMITIVE_REDUCE]     = { 256, 8 },
+   [GPU_PRIMITIVE_SCAN]       = { 256, 4 },
+   [GPU_PRIMITIVE_COMPACT]    = { 256, 4 },
+   [GPU_PRIMITIVE_HISTOGRAM]  = { 256, 8 },
+   [GPU_PRIMITIVE_RADIX_SORT] = { 64, 16 },
+};
+
+static const char* primitive_names[] = {
+   [GPU_PRIMITIVE_REDUCE]     = "reduce",
+   [GPU_PRIMITIVE_SCAN]       = "scan",
+   [GPU_PRIMITIVE_COMPACT]    = "compact",
+   [GPU_PRIMITIVE_HISTOGRAM]  = "histogram",
+   [GPU_PRIMITIVE_RADIX_SORT] = "radix-sort",
+};
+
+/* names of the tuned configurations, see common/gles-autotune.h */
+static const char* tune_keys[] = {
+   [GPU_PRIMITIVE_REDUCE]     = "primitives-reduce",
+   [GPU_PRIMITIVE_SCAN]       = "primitives-scan",
+   [GPU_PRIMITIVE_COMPACT]    = "primitives-compact",
+   [GPU_PRIMITIVE_HISTOGRAM]  = "primitives-histogram",
+   [GPU_PRIMITIVE_RADIX_SORT] = "primitives-radix-sort",
+};
+
+const char*
+gpu_primitive_name (enum gpu_primitive primitive)
+{
+   assert (primitive < GPU_PRIMITIVE_COUNT);
+   return primitive_names[primitive];
+}
+
+uint32_t
+gpu_primitive_shared_size (enum gpu_primitive primitive,
+                           const struct gpu_primitive_config* cfg)
+{
+   uint32_t tile = cfg->local_size_x * cfg->items_per_thread;
+
+   switch (primitive) {
+   case GPU_PRIMITIVE_REDUCE:
+      return cfg->local_size_x * sizeof (uint32_t);
+   case GPU_PRIMITIVE_SCAN:
+   case GPU_PRIMITIVE_COMPACT:
+      return (tile + cfg->local_size_x) * sizeof (uint32_t);
+   case GPU_PRIMITIVE_HISTOGRAM:
+      return HISTOGRAM_BINS * sizeof (uint32_t);
+   case GPU_PRIMITIVE_RADIX_SORT:
+      return cfg->local_size_x * RADIX * sizeof (uint32_t);
+   default:
+      assert (false);
+      return 0;
+   }
+}
+
+static GLuint
+load_kernel (const char* filename,
+             const struct gpu_primitive_config* cfg,
+             const char* extra_defines)
+{
+   char defines[512];
+
+   snprintf (defines, sizeof (defines),
+             "#define LOCAL_SIZE_X %u\n"
+             "#define ITEMS_PER_THREAD %u\n"
+             "#define NUM_BINS %u\n"
+             "#define RADIX_BITS %u\n"
+             "%s",
+             cfg->local_size_x,
+             cfg->items_per_thread,
+             HISTOGRAM_BINS,
+             RADIX_BITS,
+             extra_defines != NULL ? extra_defines : "");
+
+   return gles_compute_load_program (filename, defines);
+}
+
+/* (re)builds the kernels of a primitive with its current configuration */
+static bool
+build_primitive (struct gpu_primitives* prims, enum gpu_primitive primitive)
+{
+   const struct gpu_primitive_config* cfg = &prims->configs[primitive];
+   GLuint* programs[2] = { NULL, NULL };
+   GLuint built[2] = { 0, 0 };
+
+   switch (primitive) {
+   case GPU_PRIMITIVE_REDUCE:
+      programs[0] = &prims->reduce;
+      built[0] = load_kernel (CURRENT_DIR "/reduce.comp", cfg, NULL);
+      break;
+   case GPU_PRIMITIVE_SCAN:
+      programs[0] = &prims->scan;
+      programs[1] = &prims->scan_add;
+      built[0] = load_kernel (CURRENT_DIR "/scan.comp", cfg, NULL);
+      built[1] = load_kernel (CURRENT_DIR "/scan-add.comp", cfg, NULL);
+      break;
+   case GPU_PRIMITIVE_COMPACT:
+      programs[0] = &prims->compact_count;
+      programs[1] = &prims->compact_scatter;
+      built[0] = load_kernel (CURRENT_DIR "/compact.comp",
+                              cfg,
+                              "#define COMPACT_COUNT\n");
+      built[1] = load_kernel (CURRENT_DIR "/compact.comp", cfg, NULL);
+      break;
+   case GPU_PRIMITIVE_HISTOGRAM:
+      programs[0] = &prims->histogram;
+      built[0] = load_kernel (CURRENT_DIR "/histogram.comp", cfg, NULL);
+      break;
+   case GPU_PRIMITIVE_RADIX_SORT:
+      programs[0] = &prims->radix_count;
+      programs[1] = &prims->radix_scatter;
+      built[0] = load_kernel (CURRENT_DIR "/radix-sort.comp",
+                              cfg,
+                              "#define RADIX_COUNT\n");
+      built[1] = load_kernel (CURRENT_DIR "/radix-sort.comp", cfg, NULL);
+      break;
+   default:
+      assert (false);
+      return false;
+   }
+
+   if (built[0] == 0 || (programs[1] != NULL && built[1] == 0)) {
+      glDeleteProgram (built[0]);
+      glDeleteProgram (built[1]);
+      return false;
+   }
+
+   for (unsigned i = 0; i < 2; i++) {
+      if (programs[i] != NULL) {
+         glDeleteProgram (*programs[i]);
+         *programs[i] = built[i];
+      }
+   }
+
+   return true;
+}
+
+static bool
+is_legal_config (const struct gles_compute* gc,
+                 enum gpu_primitive primitive,
+                 const struct gpu_primitive_config* cfg)
+{
+   uint32_t x = cfg->local_size_x;
+
+   /* the work group reductions and scans need a power of two */
+   return x >= RADIX && (x & (x - 1)) == 0 &&
+      x <= (uint32_t) gc->max_work_group_size[0] &&
+      x <= (uint32_t) gc->max_invocations &&
+      cfg->items_per_thread > 0 &&
+      gpu_primitive_shared_size (primitive, cfg) <=
+      (uint32_t) gc->max_shared_memory_size;
+}
+
+bool
+gpu_primitives_init (struct gpu_primitives* prims,
+                     const struct gles_compute* gc,
+                     const struct gpu_primitive_config* configs)
+{
+   memset (prims, 0, sizeof (struct gpu_primitives));
+   prims->gc = gc;
+
+   if (configs != NULL) {
+      memcpy (prims->configs, configs, sizeof (prims->configs));
+   } else {
+      /* defaults, overridden by the configurations tuned for this device */
+      memcpy (prims->configs, default_configs, sizeof (prims->configs));
+
+      for (uint32_t p = 0; p < GPU_PRIMITIVE_COUNT; p++) {
+         struct gles_autotune_config tuned;
+         if (! gles_autotune_load (gc, tune_keys[p], &tuned))
+            continue;
+
+         struct gpu_primitive_config cfg = {
+            tuned.local_size[0],
+            tuned.tile_size
+         };
+         if (is_legal_config (gc, p, &cfg))
+            prims->configs[p] = cfg;
+      }
+   }
+
+   for (uint32_t p = 0; p < GPU_PRIMITIVE_COUNT; p++) {
+      if (! build_primitive (prims, p)) {
+         printf ("Error: Failed to build the GPU primitives\n");
+         gpu_primitives_finish (prims);
+         return false;
+      }
+   }
+
+   glGenBuffers (GPU_SCRATCH_COUNT, prims->scratch);
+
+   return true;
+}
+
+bool
+gpu_primitives_set_config (struct gpu_primitives* prims,
+                           enum gpu_primitive primitive,
+                           const struct gpu_primitive_config* cfg)
+{
+   struct gpu_primitive_config previous = prims->configs[primitive];
+
+   if (! is_legal_config (prims->gc, primitive, cfg))
+      return false;
+
+   prims->configs[primitive] = *cfg;
+   if (! build_primitive (prims, primitive)) {
+      prims->configs[primitive] = previous;
+      return false;
+   }
+
+   return true;
+}
+
+struct tune_data {
+   struct gpu_primitives* prims;
+   enum gpu_primitive primitive;
+   GpuPrimitiveRun run;
+   void* data;
+};
+
+static uint32_t
+tune_shared_size (const struct gles_autotune_config* tuned, void* data)
+{
+   struct tune_data* td = data;
+   struct gpu_primitive_config cfg = {
+      tuned->local_size[0],
+      tuned->tile_size
+   };
+
+   return gpu_primitive_shared_size (td->primitive, &cfg);
+}
+
+static uint64_t
+tune_run (const struct gles_autotune_config* tuned, void* data)
+{
+   struct tune_data* td = data;
+   struct gpu_primitive_config cfg = {
+      tuned->local_size[0],
+      tuned->tile_size
+   };
+
+   if (! gpu_primitives_set_config (td->prims, td->primitive, &cfg))
+      return 0;
+
+   return td->run (td->prims, td->primitive, td->data);
+}
+
+bool
+gpu_primitives_autotune (struct gpu_primitives* prims,
+                         enum gpu_primitive primitive,
+                         GpuPrimitiveRun run,
+                         void* data)
+{
+   /* 1D kernels: only 'local_size_x' and the elements per thread vary */
+   const struct gles_autotune_space space = {
+      .min_local_size = { RADIX < 32 ? 32 : RADIX, 1, 1 },
+      .max_local_size = { 1024, 1, 1 },
+      .tile_sizes = { 1, 2, 4, 8, 16, 32 },
+      .num_tile_sizes = 6,
+      .shared_size = tune_shared_size
+   };
+   struct tune_data td = { prims, primitive, run, data };
+   struct gpu_primitive_config previous = prims->configs[primitive];
+   struct gles_autotune_config best;
+
+   if (! gles_autotune_run (prims->gc,
+                            tune_keys[primitive],
+                            &space,
+                            tune_run,
+                            &td,
+                            &best)) {
+      gpu_primitives_set_config (prims, primitive, &previous);
+      return false;
+   }
+
+   struct gpu_primitive_config cfg = { best.local_size[0], best.tile_size };
+   return gpu_primitives_set_config (prims, primitive, &cfg);
+}
+
+void
+gpu_primitives_finish (struct gpu_primitives* prims)
+{
+   glDeleteProgram (prims->reduce);
+   glDeleteProgram (prims->scan);
+   glDeleteProgram (prims->scan_add);
+   glDeleteProgram (prims->compact_count);
+   glDeleteProgram (prims->compact_scatter);
+   glDeleteProgram (prims->histogram);
+   glDeleteProgram (prims->radix_count);
+   glDeleteProgram (prims->radix_scatter);
+
+   glDeleteBuffers (GPU_SCRATCH_COUNT, prims->scratch);
+
+   memset (prims, 0, sizeof (struct gpu_primitives));
+}
+
+/* returns a scratch buffer of at least 'size' bytes, growing it if needed */
+static GLuint
+get_scratch (struct gpu_primitives* prims, enum gpu_scratch slot, size_t size)
+{
+   if (size == 0)
+      size = sizeof (uint32_t);
+
+   if (prims->scratch_size[slot] < (GLsizeiptr) size) {
+      glBindBuffer (GL_SHADER_STORAGE_BUFFER, prims->scratch[slot]);
+      glBufferData (GL_SHADER_STORAGE_BUFFER, size, NULL, GL_DYNAMIC_COPY);
+      prims->scratch_size[slot] = size;
+   }
+
+   return prims->scratch[slot];
+}
+
+static uint32_t
+read_uint (GLuint buffer, uint32_t index)
+{
+   uint32_t value;
+
+   glMemoryBarrier (GL_BUFFER_UPDATE_BARRIER_BIT);
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, buffer);
+   const uint32_t* data = glMapBufferRange (GL_SHADER_STORAGE_BUFFER,
+                                            index * sizeof (uint32_t),
+                                            sizeof (uint32_t),
+                                            GL_MAP_READ_BIT);
+   assert (data != NULL);
+   value = *data;
+   glUnmapBuffer (GL_SHADER_STORAGE_BUFFER);
+
+   return value;
+}
+
+static uint32_t
+num_groups (const struct gpu_primitives* prims,
+            enum gpu_primitive primitive,
+            uint32_t count)
+{
+   const struct gpu_primitive_config* cfg = &prims->configs[primitive];
+
+   return DIV_ROUND_UP (count, cfg->local_size_x * cfg->items_per_thread);
+}
+
+/* 'param' is the kernel-specific uniform, NULL for kernels without one */
+static void
+dispatch (const struct gpu_primitives* prims,
+          GLuint program,
+          uint32_t count,
+          uint32_t groups,
+          const uint32_t* param)
+{
+   glUseProgram (program);
+   glUniform1ui (UNIFORM_COUNT, count);
+   glUniform1ui (UNIFORM_NUM_GROUPS, groups);
+   if (param != NULL)
+      glUniform1ui (UNIFORM_PARAM, *param);
+
+   gles_compute_dispatch_1d (prims->gc, groups);
+   glMemoryBarrier (GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+uint32_t
+gpu_reduce (struct gpu_primitives* prims, GLuint src, uint32_t count)
+{
+   if (count == 0)
+      return 0;
+
+   /* reduce to one partial sum per group, until one group is left */
+   GLuint input = src;
+   for (uint32_t pass = 0; ; pass++) {
+      uint32_t groups = num_groups (prims, GPU_PRIMITIVE_REDUCE, count);
+      GLuint output = get_scratch (prims,
+                                   GPU_SCRATCH_TMP0 + (pass & 1),
+                                   groups * sizeof (uint32_t));
+
+      glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 0, input);
+      glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 1, output);
+      dispatch (prims, prims->reduce, count, groups, NULL);
+
+      input = output;
+      count = groups;
+      if (count == 1)
+         break;
+   }
+
+   return read_uint (input, 0);
+}
+
+static void
+scan_level (struct gpu_primitives* prims,
+            GLuint src,
+            GLuint dst,
+            uint32_t count,
+            bool exclusive,
+            uint32_t level)
+{
+   assert (level < MAX_SCAN_LEVELS);
+
+   uint32_t groups = num_groups (prims, GPU_PRIMITIVE_SCAN, count);
+   GLuint sums = get_scratch (prims,
+                              GPU_SCRATCH_SCAN_LEVEL0 + level,
+                              groups * sizeof (uint32_t));
+
+   glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 0, src);
+   glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 1, dst);
+   glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 2, sums);
+   uint32_t exclusive_param = exclusive;
+   dispatch (prims, prims->scan, count, groups, &exclusive_param);
+
+   if (groups == 1)
+      return;
+
+   /* scan the tile sums, and add them back to each tile */
+   scan_level (prims, sums, sums, groups, true, level + 1);
+
+   glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 1, dst);
+   glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 2, sums);
+   dispatch (prims, prims->scan_add, count, groups, NULL);
+}
+
+void
+gpu_scan (struct gpu_primitives* prims,
+          GLuint src,
+          GLuint dst,
+          uint32_t count,
+          bool exclusive)
+{
+   if (count == 0)
+      return;
+
+   scan_level (prims, src, dst, count, exclusive, 0);
+}
+
+uint32_t
+gpu_compact (struct gpu_primitives* prims,
+             GLuint src,
+             GLuint dst,
+             uint32_t count,
+             uint32_t threshold)
+{
+   if (count == 0)
+      return 0;
+
+   uint32_t groups = num_groups (prims, GPU_PRIMITIVE_COMPACT, count);
+   GLuint counts = get_scratch (prims,
+                                GPU_SCRATCH_TMP0,
+                                groups * sizeof (uint32_t));
+
+   /* count kept elements per tile */
+   glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 0, src);
+   glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 2, counts);
+   dispatch (prims, prims->compact_count, count, groups, &threshold);
+
+   /* the inclusive scan of the counts gives each tile's end offset */
+   gpu_scan (prims, counts, counts, groups, false);
+
+   glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 0, src);
+   glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 1, dst);
+   glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 2, counts);
+   dispatch (prims, prims->compact_scatter, count, groups, &threshold);
+
+   return read_uint (counts, groups - 1);
+}
+
+void
+gpu_histogram (struct gpu_primitives* prims,
+               GLuint src,
+               GLuint hist,
+               uint32_t count,
+               uint32_t shift)
+{
+   static const uint32_t zeros[HISTOGRAM_BINS] = {0, };
+
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, hist);
+   glBufferSubData (GL_SHADER_STORAGE_BUFFER, 0, sizeof (zeros), zeros);
+
+   if (count == 0)
+      return;
+
+   uint32_t groups = num_groups (prims, GPU_PRIMITIVE_HISTOGRAM, count);
+
+   glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 0, src);
+   glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 1, hist);
+   dispatch (prims, prims->histogram, count, groups, &shift);
+}
+
+void
+gpu_radix_sort (struct gpu_primitives* prims,
+                GLuint keys,
+                GLuint values,
+                uint32_t count)
+{
+   if (count == 0)
+      return;
+
+   uint32_t groups = num_groups (prims, GPU_PRIMITIVE_RADIX_SORT, count);
+   GLuint offsets = get_scratch (prims,
+                                 GPU_SCRATCH_TMP0,
+                                 RADIX * groups * sizeof (uint32_t));
+   GLuint buffers[2][2] = {
+      { keys, values },
+      { get_scratch (prims, GPU_SCRATCH_TMP1, count * sizeof (uint32_t)),
+        get_scratch (prims, GPU_SCRATCH_TMP2, count * sizeof (uint32_t)) }
+   };
+
+   for (uint32_t shift = 0, pass = 0; shift < 32; shift += RADIX_BITS, pass++) {
+      GLuint* in = buffers[pass & 1];
+      GLuint* out = buffers[(pass + 1) & 1];
+
+      /* digit counts per tile, and their global offsets */
+      glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 0, in[0]);
+      glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 4, offsets);
+      dispatch (prims, prims->radix_count, count, groups, &shift);
+
+      gpu_scan (prims, offsets, offsets, RADIX * groups, true);
+
+      glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 0, in[0]);
+      glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 1, in[1]);
+      glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 2, out[0]);
+      glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 3, out[1]);
+      glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 4, offsets);
+      dispatch (prims, prims->radix_scatter, count, groups, &shift);
+   }
+}
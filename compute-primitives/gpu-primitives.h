@@ -0,0 +1,137 @@
+/*
+ * GPU parallel primitives on GLES 3.1 compute shaders.
+ *
+ * All functions operate on shader storage buffers of 32-bit unsigned
+ * integers, and expect the context of 'gc' to be current.
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "common/gles-compute.h"
+
+#define HISTOGRAM_BINS 256
+#define RADIX_BITS     4
+
+enum gpu_primitive {
+   GPU_PRIMITIVE_REDUCE = 0,
+   GPU_PRIMITIVE_SCAN,
+   GPU_PRIMITIVE_COMPACT,
+   GPU_PRIMITIVE_HISTOGRAM,
+   GPU_PRIMITIVE_RADIX_SORT,
+   GPU_PRIMITIVE_COUNT
+};
+
+/* work group size and number of elements per invocation of a primitive */
+struct gpu_primitive_config {
+   uint32_t local_size_x;
+   uint32_t items_per_thread;
+};
+
+#define MAX_SCAN_LEVELS 8
+
+enum gpu_scratch {
+   GPU_SCRATCH_SCAN_LEVEL0 = 0,
+   GPU_SCRATCH_TMP0 = MAX_SCAN_LEVELS,
+   GPU_SCRATCH_TMP1,
+   GPU_SCRATCH_TMP2,
+   GPU_SCRATCH_COUNT
+};
+
+struct gpu_primitives {
+   const struct gles_compute* gc;
+
+   struct gpu_primitive_config configs[GPU_PRIMITIVE_COUNT];
+
+   GLuint reduce;
+   GLuint scan;
+   GLuint scan_add;
+   GLuint compact_count;
+   GLuint compact_scatter;
+   GLuint histogram;
+   GLuint radix_count;
+   GLuint radix_scatter;
+
+   GLuint scratch[GPU_SCRATCH_COUNT];
+   GLsizeiptr scratch_size[GPU_SCRATCH_COUNT];
+};
+
+const char* gpu_primitive_name        (enum gpu_primitive primitive);
+
+/* Shared memory (in bytes) a primitive needs with a given configuration */
+uint32_t    gpu_primitive_shared_size (enum gpu_primitive primitive,
+                                       const struct gpu_primitive_config* cfg);
+
+/* Times one run of 'primitive' with its current configuration, returning
+ * nanoseconds, or 0 if the result was wrong.
+ */
+typedef uint64_t (* GpuPrimitiveRun) (struct gpu_primitives* prims,
+                                      enum gpu_primitive primitive,
+                                      void* data);
+
+/* Compiles all kernels. If 'configs' is NULL, the configurations tuned for
+ * this device are used, or the defaults for primitives never tuned.
+ */
+bool        gpu_primitives_init       (struct gpu_primitives* prims,
+                                       const struct gles_compute* gc,
+                                       const struct gpu_primitive_config* configs);
+
+void        gpu_primitives_finish     (struct gpu_primitives* prims);
+
+/* Rebuilds the kernels of a primitive. Fails, keeping the previous config,
+ * if 'cfg' is not legal on the device.
+ */
+bool        gpu_primitives_set_config (struct gpu_primitives* prims,
+                                       enum gpu_primitive primitive,
+                                       const struct gpu_primitive_config* cfg);
+
+/* Times all legal configurations of a primitive with 'run', then persists
+ * and applies the fastest one.
+ */
+bool        gpu_primitives_autotune   (struct gpu_primitives* prims,
+                                       enum gpu_primitive primitive,
+                                       GpuPrimitiveRun run,
+                                       void* data);
+
+/* Returns the sum of 'count' elements of 'src' (wrapping on overflow) */
+uint32_t    gpu_reduce                (struct gpu_primitives* prims,
+                                       GLuint src,
+                                       uint32_t count);
+
+/* Prefix sum of 'src' into 'dst', which may be the same buffer */
+void        gpu_scan                  (struct gpu_primitives* prims,
+                                       GLuint src,
+                                       GLuint dst,
+                                       uint32_t count,
+                                       bool exclusive);
+
+/* Copies the elements of 'src' smaller than 'threshold' to 'dst', in order.
+ * Returns how many were copied.
+ */
+uint32_t    gpu_compact               (struct gpu_primitives* prims,
+                                       GLuint src,
+                                       GLuint dst,
+                                       uint32_t count,
+                                       uint32_t threshold);
+
+/* HISTOGRAM_BINS-bins histogram of '(src[i] >> shift) % HISTOGRAM_BINS' */
+void        gpu_histogram             (struct gpu_primitives* prims,
+                                       GLuint src,
+                                       GLuint hist,
+                                       uint32_t count,
+                                       uint32_t shift);
+
+/* Stable in-place sort of 'keys', carrying 'values' along */
+void        gpu_radix_sort            (struct gpu_primitives* prims,
+                                       GLuint keys,
+                                       GLuint values,
+                                       uint32_t count);
@@ -0,0 +1,563 @@
+/*
+ * Example:
+ *
+ * Compute primitives: A library of parallel primitives (reduction, scan,
+ *                     stream compaction, histogram and key/value radix sort)
+ *                     on GLES 3.1 compute shaders, benchmarked against
+ *                     multi-threaded SIMD CPU implementations.
+ *
+ * For each primitive and input size, this runs the GPU and the CPU versions
+ * over the same random input, validates the GPU result against the CPU one,
+ * and reports the throughput of both in millions of elements per second.
+ * Scans are run both inclusive ("scan") and exclusive ("scan-excl").
+ *
+ * Sizes sweep from 1K to 256M elements in steps of 4x by default. Sizes that
+ * don't fit in memory (or in a single shader storage block) are skipped.
+ *
+ * With '-T', the work group size and elements per thread of each primitive
+ * are autotuned first, and persisted for this device (see
+ * common/gles-autotune.h). Later runs pick up the tuned configurations.
+ *
+ * Tested on Mesa 22.3, llvmpipe.
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/gles-compute.h"
+#include "cpu-reference.h"
+#include "gpu-primitives.h"
+
+#define DEFAULT_MIN_SIZE   (1 << 10)
+#define DEFAULT_MAX_SIZE   (1 << 28)
+#define DEFAULT_ITERATIONS 5
+
+#define TUNE_SIZE          (1 << 22)
+#define TUNE_ITERATIONS    3
+
+#define COMPACT_THRESHOLD  0x80000000u
+#define HISTOGRAM_SHIFT    0
+
+struct buffers {
+   size_t count;
+
+   /* host side */
+   uint32_t* input;
+   uint32_t* values;
+   uint32_t* cpu_out;
+   uint32_t* cpu_values;
+   uint32_t* cpu_tmp[2];
+
+   /* device side */
+   GLuint gpu_input;
+   GLuint gpu_values;
+   GLuint gpu_out;
+   GLuint gpu_out_values;
+};
+
+static uint32_t
+xorshift32 (uint32_t* state)
+{
+   uint32_t x = *state;
+
+   x ^= x << 13;
+   x ^= x >> 17;
+   x ^= x << 5;
+   *state = x;
+
+   return x;
+}
+
+static size_t
+parse_size (const char* str)
+{
+   char* end;
+   size_t size = strtoull (str, &end, 10);
+
+   if (*end == 'K' || *end == 'k')
+      size <<= 10;
+   else if (*end == 'M' || *end == 'm')
+      size <<= 20;
+
+   return size;
+}
+
+static void
+print_size (size_t size, char* str, size_t len)
+{
+   if (size >= (1 << 20) && size % (1 << 20) == 0)
+      snprintf (str, len, "%zuM", size >> 20);
+   else if (size >= (1 << 10) && size % (1 << 10) == 0)
+      snprintf (str, len, "%zuK", size >> 10);
+   else
+      snprintf (str, len, "%zu", size);
+}
+
+static GLuint
+create_buffer (size_t size, const void* data)
+{
+   GLuint buffer;
+
+   glGenBuffers (1, &buffer);
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, buffer);
+   glBufferData (GL_SHADER_STORAGE_BUFFER, size, data, GL_DYNAMIC_COPY);
+   if (glGetError () != GL_NO_ERROR) {
+      glDeleteBuffers (1, &buffer);
+      return 0;
+   }
+
+   return buffer;
+}
+
+static void
+free_buffers (struct buffers* bufs)
+{
+   free (bufs->input);
+   free (bufs->values);
+   free (bufs->cpu_out);
+   free (bufs->cpu_values);
+   free (bufs->cpu_tmp[0]);
+   free (bufs->cpu_tmp[1]);
+
+   glDeleteBuffers (1, &bufs->gpu_input);
+   glDeleteBuffers (1, &bufs->gpu_values);
+   glDeleteBuffers (1, &bufs->gpu_out);
+   glDeleteBuffers (1, &bufs->gpu_out_values);
+
+   memset (bufs, 0, sizeof (struct buffers));
+}
+
+static bool
+alloc_buffers (struct buffers* bufs, size_t count)
+{
+   /* outputs also hold histograms, make room for those on tiny inputs */
+   size_t size = (count > HISTOGRAM_BINS ? count : HISTOGRAM_BINS) *
+      sizeof (uint32_t);
+
+   memset (bufs, 0, sizeof (struct buffers));
+   bufs->count = count;
+
+   bufs->input = malloc (size);
+   bufs->values = malloc (size);
+   bufs->cpu_out = malloc (size);
+   bufs->cpu_values = malloc (size);
+   bufs->cpu_tmp[0] = malloc (size);
+   bufs->cpu_tmp[1] = malloc (size);
+   if (bufs->input == NULL || bufs->values == NULL ||
+       bufs->cpu_out == NULL || bufs->cpu_values == NULL ||
+       bufs->cpu_tmp[0] == NULL || bufs->cpu_tmp[1] == NULL) {
+      free_buffers (bufs);
+      return false;
+   }
+
+   uint32_t seed = 0x12345678;
+   for (size_t i = 0; i < count; i++) {
+      bufs->input[i] = xorshift32 (&seed);
+      bufs->values[i] = (uint32_t) i;
+   }
+
+   bufs->gpu_input = create_buffer (size, bufs->input);
+   bufs->gpu_values = create_buffer (size, bufs->values);
+   bufs->gpu_out = create_buffer (size, NULL);
+   bufs->gpu_out_values = create_buffer (size, NULL);
+   if (bufs->gpu_input == 0 || bufs->gpu_values == 0 ||
+       bufs->gpu_out == 0 || bufs->gpu_out_values == 0) {
+      free_buffers (bufs);
+      return false;
+   }
+
+   return true;
+}
+
+/* compares the first 'count' elements of a buffer with 'expected' */
+static bool
+check_buffer (GLuint buffer, const uint32_t* expected, size_t count)
+{
+   if (count == 0)
+      return true;
+
+   glMemoryBarrier (GL_BUFFER_UPDATE_BARRIER_BIT);
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, buffer);
+   const uint32_t* data = glMapBufferRange (GL_SHADER_STORAGE_BUFFER,
+                                            0,
+                                            count * sizeof (uint32_t),
+                                            GL_MAP_READ_BIT);
+   if (data == NULL)
+      return false;
+
+   bool equal = memcmp (data, expected, count * sizeof (uint32_t)) == 0;
+   glUnmapBuffer (GL_SHADER_STORAGE_BUFFER);
+
+   return equal;
+}
+
+static void
+copy_buffer (GLuint src, GLuint dst, size_t count)
+{
+   glBindBuffer (GL_COPY_READ_BUFFER, src);
+   glBindBuffer (GL_COPY_WRITE_BUFFER, dst);
+   glCopyBufferSubData (GL_COPY_READ_BUFFER,
+                        GL_COPY_WRITE_BUFFER,
+                        0,
+                        0,
+                        count * sizeof (uint32_t));
+}
+
+/* Runs one iteration of a primitive on the GPU, returns the elapsed time in
+ * nanoseconds. Only the primitive itself is timed, not the input setup.
+ * Scans are exclusive if 'exclusive', inclusive otherwise.
+ */
+static uint64_t
+run_gpu (struct gpu_primitives* prims,
+         enum gpu_primitive primitive,
+         bool exclusive,
+         struct buffers* bufs,
+         uint32_t* result)
+{
+   uint32_t count = (uint32_t) bufs->count;
+   uint64_t start;
+
+   if (primitive == GPU_PRIMITIVE_RADIX_SORT) {
+      copy_buffer (bufs->gpu_input, bufs->gpu_out, count);
+      copy_buffer (bufs->gpu_values, bufs->gpu_out_values, count);
+      glMemoryBarrier (GL_SHADER_STORAGE_BARRIER_BIT);
+   }
+   gles_compute_wait ();
+
+   start = gles_compute_get_time_ns ();
+
+   switch (primitive) {
+   case GPU_PRIMITIVE_REDUCE:
+      *result = gpu_reduce (prims, bufs->gpu_input, count);
+      break;
+   case GPU_PRIMITIVE_SCAN:
+      gpu_scan (prims, bufs->gpu_input, bufs->gpu_out, count, exclusive);
+      break;
+   case GPU_PRIMITIVE_COMPACT:
+      *result = gpu_compact (prims,
+                             bufs->gpu_input,
+                             bufs->gpu_out,
+                             count,
+                             COMPACT_THRESHOLD);
+      break;
+   case GPU_PRIMITIVE_HISTOGRAM:
+      gpu_histogram (prims,
+                     bufs->gpu_input,
+                     bufs->gpu_out,
+                     count,
+                     HISTOGRAM_SHIFT);
+      break;
+   case GPU_PRIMITIVE_RADIX_SORT:
+      gpu_radix_sort (prims, bufs->gpu_out, bufs->gpu_out_values, count);
+      break;
+   default:
+      assert (false);
+   }
+   gles_compute_wait ();
+
+   return gles_compute_get_time_ns () - start;
+}
+
+/* same as run_gpu(), on the CPU */
+static uint64_t
+run_cpu (enum gpu_primitive primitive,
+         bool exclusive,
+         struct buffers* bufs,
+         size_t* result)
+{
+   size_t count = bufs->count;
+   uint64_t start;
+
+   if (primitive == GPU_PRIMITIVE_RADIX_SORT) {
+      memcpy (bufs->cpu_out, bufs->input, count * sizeof (uint32_t));
+      memcpy (bufs->cpu_values, bufs->values, count * sizeof (uint32_t));
+   }
+
+   start = gles_compute_get_time_ns ();
+
+   switch (primitive) {
+   case GPU_PRIMITIVE_REDUCE:
+      *result = cpu_reduce (bufs->input, count);
+      break;
+   case GPU_PRIMITIVE_SCAN:
+      cpu_scan (bufs->input, bufs->cpu_out, count, exclusive);
+      break;
+   case GPU_PRIMITIVE_COMPACT:
+      *result = cpu_compact (bufs->input,
+                             bufs->cpu_out,
+                             count,
+                             COMPACT_THRESHOLD);
+      break;
+   case GPU_PRIMITIVE_HISTOGRAM:
+      cpu_histogram (bufs->input, count, HISTOGRAM_SHIFT, bufs->cpu_out);
+      break;
+   case GPU_PRIMITIVE_RADIX_SORT:
+      cpu_radix_sort (bufs->cpu_out,
+                      bufs->cpu_values,
+                      bufs->cpu_tmp[0],
+                      bufs->cpu_tmp[1],
+                      count);
+      break;
+   default:
+      assert (false);
+   }
+
+   return gles_compute_get_time_ns () - start;
+}
+
+static bool
+validate (enum gpu_primitive primitive,
+          struct buffers* bufs,
+          uint32_t gpu_result,
+          size_t cpu_result)
+{
+   switch (primitive) {
+   case GPU_PRIMITIVE_REDUCE:
+      return gpu_result == cpu_result;
+   case GPU_PRIMITIVE_SCAN:
+      return check_buffer (bufs->gpu_out, bufs->cpu_out, bufs->count);
+   case GPU_PRIMITIVE_COMPACT:
+      return gpu_result == cpu_result &&
+         check_buffer (bufs->gpu_out, bufs->cpu_out, cpu_result);
+   case GPU_PRIMITIVE_HISTOGRAM:
+      return check_buffer (bufs->gpu_out, bufs->cpu_out, HISTOGRAM_BINS);
+   case GPU_PRIMITIVE_RADIX_SORT:
+      return check_buffer (bufs->gpu_out, bufs->cpu_out, bufs->count) &&
+         check_buffer (bufs->gpu_out_values, bufs->cpu_values, bufs->count);
+   default:
+      return false;
+   }
+}
+
+static void
+run_benchmark (struct gpu_primitives* prims,
+               enum gpu_primitive primitive,
+               bool exclusive,
+               struct buffers* bufs,
+               uint32_t iterations)
+{
+   uint64_t gpu_ns = 0;
+   uint64_t cpu_ns = 0;
+   uint32_t gpu_result = 0;
+   size_t cpu_result = 0;
+   char size_str[24];
+
+   /* warm up (program upload, scratch allocation, page faults) */
+   run_gpu (prims, primitive, exclusive, bufs, &gpu_result);
+   run_cpu (primitive, exclusive, bufs, &cpu_result);
+
+   for (uint32_t i = 0; i < iterations; i++) {
+      gpu_ns += run_gpu (prims, primitive, exclusive, bufs, &gpu_result);
+      cpu_ns += run_cpu (primitive, exclusive, bufs, &cpu_result);
+   }
+
+   bool valid = validate (primitive, bufs, gpu_result, cpu_result);
+
+   double elements = (double) bufs->count * iterations;
+   print_size (bufs->count, size_str, sizeof (size_str));
+   printf ("%-12s %10s %16.2f %16.2f   %s\n",
+           exclusive ? "scan-excl" : gpu_primitive_name (primitive),
+           size_str,
+           elements * 1e3 / gpu_ns,
+           elements * 1e3 / cpu_ns,
+           valid ? "ok" : "MISMATCH");
+}
+
+struct tune_data {
+   struct buffers* bufs;
+   size_t cpu_result;
+};
+
+static uint64_t
+tune_run (struct gpu_primitives* prims,
+          enum gpu_primitive primitive,
+          void* data)
+{
+   struct tune_data* td = data;
+   uint32_t gpu_result = 0;
+   uint64_t best_ns = UINT64_MAX;
+
+   run_gpu (prims, primitive, false, td->bufs, &gpu_result);
+   for (uint32_t i = 0; i < TUNE_ITERATIONS; i++) {
+      uint64_t ns = run_gpu (prims, primitive, false, td->bufs,
+                             &gpu_result);
+      if (ns < best_ns)
+         best_ns = ns;
+   }
+
+   /* a variant giving wrong results is no variant */
+   if (! validate (primitive, td->bufs, gpu_result, td->cpu_result))
+      return 0;
+
+   return best_ns;
+}
+
+static void
+autotune (struct gpu_primitives* prims, const char* only, size_t size)
+{
+   struct buffers bufs;
+
+   if (! alloc_buffers (&bufs, size)) {
+      printf ("Error: Not enough memory to autotune\n");
+      return;
+   }
+
+   for (uint32_t p = 0; p < GPU_PRIMITIVE_COUNT; p++) {
+      struct tune_data td = { &bufs, 0 };
+
+      if (only != NULL && strcmp (only, gpu_primitive_name (p)) != 0)
+         continue;
+
+      /* the reference result, that each variant is validated against */
+      run_cpu (p, false, &bufs, &td.cpu_result);
+
+      if (! gpu_primitives_autotune (prims, p, tune_run, &td))
+         printf ("Error: Failed to autotune '%s'\n", gpu_primitive_name (p));
+   }
+
+   free_buffers (&bufs);
+}
+
+static void
+print_usage (const char* name)
+{
+   printf ("Usage: %s [options]\n"
+           "  -d <path>  DRM render node (default: %s)\n"
+           "  -k <name>  only run this primitive (reduce, scan, compact,\n"
+           "             histogram, radix-sort)\n"
+           "  -s <size>  smallest input, in elements (default: 1K)\n"
+           "  -S <size>  largest input, in elements (default: 256M)\n"
+           "  -i <n>     timed iterations per size (default: %u)\n"
+           "  -t <n>     CPU threads (default: one per CPU)\n"
+           "  -T         autotune the GPU kernels before benchmarking\n",
+           name,
+           GLES_COMPUTE_DEFAULT_RENDER_NODE,
+           DEFAULT_ITERATIONS);
+}
+
+int32_t
+main (int32_t argc, char* argv[])
+{
+   const char* render_node = NULL;
+   const char* only = NULL;
+   size_t min_size = DEFAULT_MIN_SIZE;
+   size_t max_size = DEFAULT_MAX_SIZE;
+   uint32_t iterations = DEFAULT_ITERATIONS;
+   bool tune = false;
+   int opt;
+
+   while ((opt = getopt (argc, argv, "d:k:s:S:i:t:Th")) != -1) {
+      switch (opt) {
+      case 'd':
+         render_node = optarg;
+         break;
+      case 'k':
+         only = optarg;
+         break;
+      case 's':
+         min_size = parse_size (optarg);
+         break;
+      case 'S':
+         max_size = parse_size (optarg);
+         break;
+      case 'i':
+         iterations = atoi (optarg);
+         break;
+      case 't':
+         cpu_reference_set_threads (atoi (optarg));
+         break;
+      case 'T':
+         tune = true;
+         break;
+      default:
+         print_usage (argv[0]);
+         return opt == 'h' ? 0 : -1;
+      }
+   }
+   if (min_size == 0 || iterations == 0) {
+      print_usage (argv[0]);
+      return -1;
+   }
+
+   struct gles_compute gc;
+   if (! gles_compute_init (&gc, render_node)) {
+      printf ("Error: Failed to setup a GLES compute context\n");
+      return -1;
+   }
+   printf ("Renderer: %s\n", gc.renderer);
+   printf ("CPU reference: %s, %ld CPU(s)\n",
+           cpu_reference_simd (),
+           sysconf (_SC_NPROCESSORS_ONLN));
+
+   struct gpu_primitives prims;
+   if (! gpu_primitives_init (&prims, &gc, NULL)) {
+      gles_compute_finish (&gc);
+      return -1;
+   }
+
+   if (tune)
+      autotune (&prims, only, max_size < TUNE_SIZE ? max_size : TUNE_SIZE);
+
+   for (uint32_t p = 0; p < GPU_PRIMITIVE_COUNT; p++) {
+      printf ("%s: local size %u, %u elements per thread\n",
+              gpu_primitive_name (p),
+              prims.configs[p].local_size_x,
+              prims.configs[p].items_per_thread);
+   }
+
+   printf ("\n%-12s %10s %16s %16s   %s\n",
+           "primitive", "elements", "GPU (Melem/s)", "CPU (Melem/s)", "result");
+
+   for (size_t size = min_size; size <= max_size; size *= 4) {
+      struct buffers bufs;
+      char size_str[24];
+
+      print_size (size, size_str, sizeof (size_str));
+
+      if ((GLint64) (size * sizeof (uint32_t)) > gc.max_ssbo_size ||
+          size > UINT32_MAX) {
+         printf ("%-12s %10s   skipped, above GL_MAX_SHADER_STORAGE_BLOCK_SIZE\n",
+                 "*", size_str);
+         continue;
+      }
+
+      if (! alloc_buffers (&bufs, size)) {
+         printf ("%-12s %10s   skipped, out of memory\n", "*", size_str);
+         continue;
+      }
+
+      for (uint32_t p = 0; p < GPU_PRIMITIVE_COUNT; p++) {
+         if (only != NULL && strcmp (only, gpu_primitive_name (p)) != 0)
+            continue;
+
+         run_benchmark (&prims, p, false, &bufs, iterations);
+
+         /* exclusive scans too, as radix sort uses them */
+         if (p == GPU_PRIMITIVE_SCAN)
+            run_benchmark (&prims, p, true, &bufs, iterations);
+      }
+
+      free_buffers (&bufs);
+   }
+
+   /* free stuff */
+   gpu_primitives_finish (&prims);
+   gles_compute_finish (&gc);
+
+   return 0;
+}
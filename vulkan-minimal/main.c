@@ -5,7 +5,8 @@
  *
  * This example renders a triangle using the Vulkan API on an X11 window.
  * It does the minimum required to put pixels on the screen, and not much
- * more (e.g, doesn't support resizing the window).
+ * more (e.g, doesn't support resizing the window). It draws when the window
+ * is exposed, and sleeps on the X connection otherwise. ESC quits.
  *
  * Tested on Linux 4.7, Mesa 12.0, Intel GPU (gen7+).
  *
@@ -29,6 +30,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <xcb/xcb.h>
+#include "common/event-loop.h"
 
 #define VK_USE_PLATFORM_XCB_KHR
 #include <vulkan/vulkan.h>
@@ -139,6 +141,39 @@ load_file (const char* filename, size_t* file_size)
    }
 }
 
+/* set on expose, the main loop sleeps until then */
+static bool redraw = true;
+
+/* Handles the events queued, returns false to quit */
+static bool
+handle_xcb_events (void* data)
+{
+   xcb_connection_t* xcb_conn = data;
+   xcb_generic_event_t* event;
+   bool quit = false;
+
+   while ((event = xcb_poll_for_event (xcb_conn)) != NULL) {
+      switch (event->response_type & 0x7f) {
+      case XCB_EXPOSE:
+         redraw = true;
+         break;
+
+      case XCB_KEY_RELEASE:
+         /* ESC key */
+         if (((xcb_key_release_event_t*) event)->detail == 0x9)
+            quit = true;
+         break;
+
+      default:
+         break;
+      }
+
+      free (event);
+   }
+
+   return ! quit && ! xcb_connection_has_error (xcb_conn);
+}
+
 int32_t
 main (int32_t argc, char* argv[])
 {
@@ -850,14 +885,29 @@ main (int32_t argc, char* argv[])
    }
 
 
-   /* start the show (mainloop) */
+   /* start the show (mainloop): draw when exposed, sleep in between */
+   struct event_loop loop;
+   bool loop_ready = event_loop_init (&loop) &&
+      event_loop_add_fd (&loop,
+                         xcb_get_file_descriptor (xcb_conn),
+                         handle_xcb_events,
+                         xcb_conn);
+   assert (loop_ready);
+
+   /* events queued already don't make the connection readable */
+   while (handle_xcb_events (xcb_conn)) {
+      if (! redraw) {
+         if (! event_loop_dispatch (&loop, -1))
+            break;
+         continue;
+      }
+      redraw = false;
 
-   while (VK_TRUE) {
       /* acquire next image */
       uint32_t image_index;
       result = vk.AcquireNextImageKHR (device,
                                        swapchain,
-                                       1000,
+                                       UINT64_MAX,
                                        image_available_semaphore,
                                        VK_NULL_HANDLE,
                                        &image_index);
@@ -914,6 +964,8 @@ main (int32_t argc, char* argv[])
       assert (result == VK_SUCCESS);
    }
 
+   event_loop_finish (&loop);
+
    /* free all allocated objects */
 
    /* wait for all async ops on device */
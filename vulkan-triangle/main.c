@@ -3,8 +3,23 @@
  *
  * Vulkan triangle: (yet another) Vulkan triangle demo.
  *
- * This example shows a triangle rendered by Vulkan API on an X11 window. It
- * supports resizing the window, and toggling fullscreen mode (F-key).
+ * This example shows a triangle rendered by Vulkan API on an X11 or Wayland
+ * window, straight on a display (VK_KHR_display), or offscreen driven by a
+ * script (common/wsi-null.c). It supports resizing the window, and toggling
+ * fullscreen mode (F-key). Exposed areas alone are redrawn, and frames are
+ * reported with their rate, CPU time and input latency.
+ *
+ * Options (see '-h'):
+ *   -b  window system backend
+ *   -s  present through MIT-SHM instead of a swapchain
+ *   -w  number of windows
+ *   -n  animate an N-body simulation instead
+ *   -d  animate many draws, pipeline binds and render passes
+ *   -c  animate, submitting more command buffers per frame
+ *   -r  pace the animation
+ *   -t  time the passes of every frame on the GPU
+ *   -p  count pipeline statistics too
+ *   -T  trace a window of frames, CPU and GPU
  *
  * Tested on Linux 4.7, Mesa 12.0, Intel Haswell (gen7+).
  *
@@ -20,7 +35,10 @@
  * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <assert.h>
+#include "common/event-loop.h"
 #include "common/wsi.h"
 #include <fcntl.h>
 #include <signal.h>
@@ -29,11 +47,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 /* 'VK_USE_PLATFORM_X_KHR' currently defined as flag in Makefile */
 #include <vulkan/vulkan.h>
 #include "common/vk-api.h"
+#include "common/vk-submit.h"
+#include "common/vk-timestamps.h"
+#include "common/trace.h"
+#include "common/nbody.h"
 
 #define WIDTH  640
 #define HEIGHT 480
@@ -45,87 +68,1070 @@ struct vk_objects {
    VkPhysicalDevice physical_device;
    VkDevice device;
 
-   VkSurfaceKHR surface;
    VkQueue graphics_queue;
    VkCommandPool cmd_pool;
    VkPipelineShaderStageCreateInfo shader_stages[2];
 
-   VkSemaphore image_available_semaphore;
-   VkSemaphore render_finished_semaphore;
+   /* shared by all windows, which are drawn in the same submit */
+   VkFence frame_fence;
+
+   /* what every frame submits goes through it, batched */
+   struct vk_submit submit;
 };
 
 struct vk_config {
    VkSurfaceCapabilitiesKHR surface_caps;
    VkSurfaceFormatKHR surface_format;
    VkPresentModeKHR present_mode;
+
+   /* VK_KHR_incremental_present is enabled */
+   bool incremental_present;
+
+   /* VK_EXT_calibrated_timestamps is enabled, for GPU times to be traced
+    * along with CPU ones
+    */
+   bool calibrated_timestamps;
+
+   /* frames are read back and put in the window through MIT-SHM, instead of
+    * being presented from a swapchain
+    */
+   bool shm_present;
 };
 
 #define MAX_SWAPCHAIN_IMAGES 8
+#define MAX_EXTENSIONS       256
+#define MAX_SURFACE_FORMATS  64
+#define MAX_PRESENT_MODES    16
+#define MAX_DISPLAYS         8
+#define MAX_DISPLAY_MODES    64
+#define MAX_DISPLAY_PLANES   16
+#define MAX_TIME_DOMAINS     8
+
+/* Everything drawn to one window */
+struct vk_state {
+   /* the WSI window number */
+   uint32_t window;
+   VkSurfaceKHR surface;
+
+   VkSemaphore image_available_semaphore;
+   VkSemaphore render_finished_semaphore;
+
+   /* re-recorded for every partial redraw */
+   VkCommandBuffer damage_cmd_buffer;
+
+   /* the window needs a frame, and maybe a new swapchain first */
+   bool damaged;
+   bool expose;
+
+   /* what was exposed, if the frame is only a redraw */
+   struct wsi_rect damage[WSI_MAX_DAMAGE_RECTS];
+   uint32_t damage_count;
+
+   VkExtent2D surface_extent;
+
+   VkSwapchainKHR swapchain;
+   VkSwapchainKHR previous_swapchain;
+   uint32_t swapchain_images_count;
+   VkImageView image_views[MAX_SWAPCHAIN_IMAGES];
+   VkFramebuffer framebuffers[MAX_SWAPCHAIN_IMAGES];
+
+   VkRenderPass renderpass;
+   VkPipelineLayout pipeline_layout;
+   VkPipeline pipeline;
+
+   /* with '-d' switching pipelines, one that only differs in culling, for
+    * draws to alternate between both
+    */
+   VkPipeline switch_pipeline;
+
+   /* one per swapchain image, times two N-body parities if enabled */
+   uint32_t cmd_buffers_count;
+   VkCommandBuffer cmd_buffers[2 * MAX_SWAPCHAIN_IMAGES];
+
+   /* Partial redraws load the previous contents of the image, which is only
+    * possible once it holds a whole frame.
+    */
+   VkRenderPass damage_renderpass;
+   bool image_drawn[MAX_SWAPCHAIN_IMAGES];
+
+   /* MIT-SHM presents render to a single image, in place of the swapchain,
+    * which is then read back to a mapped buffer
+    */
+   VkImage offscreen_image;
+   VkDeviceMemory offscreen_memory;
+   VkBuffer readback_buffer;
+   VkDeviceMemory readback_memory;
+   uint8_t* readback_data;
+   struct wsi_shm_image shm_image;
+};
+
+#define NBODY_MAX_BODIES (1 << 20)
+#define NBODY_LOCAL_SIZE 128
+#define NBODY_TIME_STEP  2e-3f
+
+struct vk_nbody {
+   /* 0 if disabled */
+   uint32_t count;
+
+   /* [set][0] are positions (xyz and mass), [set][1] velocities */
+   VkBuffer buffers[2][2];
+   VkDeviceMemory memory;
+
+   /* set 'i' reads buffers[i] and writes buffers[i ^ 1] */
+   VkDescriptorSetLayout set_layout;
+   VkDescriptorPool descriptor_pool;
+   VkDescriptorSet sets[2];
+
+   VkShaderModule shader_module;
+   VkPipelineLayout pipeline_layout;
+   VkPipeline pipeline;
+
+   /* a step per parity, submitted once per frame ahead of all windows' draws,
+    * which read the positions it writes
+    */
+   VkCommandBuffer step_cmd_buffers[2];
+
+   /* the set read by the next step */
+   uint32_t parity;
+};
+
+/* With '-d', command buffers are recorded with many draws, again for every
+ * frame, to measure the CPU cost of recording and submitting them
+ */
+struct vk_draw_bench {
+   /* draws per command buffer, 0 if disabled */
+   uint32_t draws;
+
+   /* draws between pipeline binds and between render passes, 0 for a
+    * single one
+    */
+   uint32_t pipeline_period;
+   uint32_t renderpass_period;
+
+   /* since the last report, in nanoseconds for times */
+   uint32_t frames;
+   uint64_t commands;
+   uint64_t record_time;
+   uint64_t submit_time;
+};
+
+/* With '-c', every frame also submits that many more command buffers (that
+ * only record a barrier), as if from other producers, to measure what
+ * submitting costs, batched or one by one
+ */
+struct vk_submit_bench {
+   /* command buffers, 0 if disabled */
+   uint32_t count;
+
+   /* at most per vkQueueSubmit(), 0 for as many as fit */
+   uint32_t batch;
+
+   VkCommandBuffer* cmd_buffers;
+
+   /* since the last report */
+   uint32_t frames;
+};
+
+static struct vk_objects objs = {VK_NULL_HANDLE,};
+static struct vk_config config = {0,};
+static struct vk_nbody nbody = {0,};
+static struct vk_draw_bench draw_bench = {0,};
+static struct vk_submit_bench submit_bench = {0,};
+
+/* with '-t', the passes of every frame are timed on the GPU, and with '-p'
+ * their pipeline statistics counted too
+ */
+static bool gpu_timing = false;
+static bool gpu_statistics = false;
+static struct vk_timestamps timestamps = {0,};
+
+/* with '-T', a window of frames is traced, on the CPU and on the GPU */
+#define TRACE_FRAMES 100
+
+static char trace_path[256] = "";
+static unsigned long trace_first_frame = 0;
+static unsigned long trace_frames = TRACE_FRAMES;
+static struct trace trace = {0,};
+
+/* indexed by the WSI window numbers */
+static struct vk_state windows[WSI_MAX_WINDOWS] = {{0,},};
+static uint32_t windows_count = 1;
+
+static const VkClearValue clear_color = {{{0.01f, 0.01f, 0.01f, 1.0f}}};
+
+static bool running = false;
+
+static struct event_loop loop;
+
+/* the window system's fd the loop watches, if any */
+static int32_t wsi_fd = -1;
+
+/* between animation frames, in nanoseconds, 0 if not paced */
+static uint64_t frame_interval = 0;
+static uint64_t frames_missed = 0;
+
+/* The latest input not drawn yet, which tags the next frame */
+static struct wsi_input_event pending_input = {0,};
+
+/* from the receipt of tagged inputs, in nanoseconds, since the last report */
+static struct {
+   uint32_t count;
+   uint64_t to_submit;
+   uint64_t to_present;
+   uint64_t to_present_max;
+} input_latency = {0,};
+
+/* Adds what the CPU did for frame 'frame' since 'start' to the trace */
+static void
+trace_cpu (const char* name, uint64_t frame, uint64_t start)
+{
+   if (trace.file != NULL)
+      trace_event (&trace, TRACE_CPU, name, frame, start, wsi_get_time ());
+}
+
+/* Adds a region of a frame read back from the GPU to the trace */
+static void
+trace_gpu (const char* label,
+           uint64_t frame,
+           uint64_t start,
+           uint64_t end,
+           void* data)
+{
+   trace_event (&trace, TRACE_GPU, label, frame, start, end);
+}
+
+/* Frames follow one another (or frame deadlines), rather than exposes */
+static bool
+animated (void)
+{
+   return nbody.count > 0 || draw_bench.draws > 0 || submit_bench.count > 0;
+}
+
+static bool
+recreate_swapchain (struct vk_objects* objs,
+                    struct vk_config* config,
+                    struct vk_state* state);
+
+static uint32_t*
+load_file (const char* filename, size_t* file_size)
+{
+   char *data = NULL;
+   size_t size = 0;
+   size_t read_size = 0;
+   size_t alloc_size = 0;
+   int fd = open (filename, O_RDONLY);
+   uint8_t buf[1024];
+
+   while ((read_size = read (fd, buf, 1024)) > 0) {
+      if (size + read_size > alloc_size) {
+         alloc_size = read_size + size;
+         data = realloc (data, alloc_size);
+      }
+
+      memcpy (data + size, buf, read_size);
+      size += read_size;
+   }
+
+   if (read_size == 0) {
+      if (file_size)
+         *file_size = size;
+
+      return (uint32_t*) data;
+   }
+   else {
+      return NULL;
+   }
+}
+
+static void
+ctrl_c_handler (int32_t dummy)
+{
+   running = false;
+   signal (SIGINT, NULL);
+
+   /* in case the signal came just before the loop went to sleep */
+   event_loop_wake (&loop);
+}
+
+static bool
+find_memory_type (struct vk_objects* objs,
+                  uint32_t type_bits,
+                  VkMemoryPropertyFlags flags,
+                  uint32_t* type_index)
+{
+   VkPhysicalDeviceMemoryProperties props;
+   vk.GetPhysicalDeviceMemoryProperties (objs->physical_device, &props);
+
+   for (uint32_t i = 0; i < props.memoryTypeCount; i++) {
+      if ((type_bits & (1 << i)) &&
+          (props.memoryTypes[i].propertyFlags & flags) == flags) {
+         *type_index = i;
+         return true;
+      }
+   }
+
+   return false;
+}
+
+static bool
+create_nbody_buffers (struct vk_objects* objs, struct vk_nbody* nbody)
+{
+   VkDeviceSize size = (VkDeviceSize) nbody->count * 4 * sizeof (float);
+
+   /* positions are also read as vertices; velocities share the usage so
+    * that all four buffers have the same requirements
+    */
+   VkBufferCreateInfo buffer_info = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      .size = size,
+      .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+         VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+   };
+   for (uint32_t i = 0; i < 4; i++) {
+      if (vk.CreateBuffer (objs->device,
+                           &buffer_info,
+                           allocator,
+                           &nbody->buffers[i / 2][i % 2]) != VK_SUCCESS) {
+         printf ("Error: Failed to create N-body buffers\n");
+         return false;
+      }
+   }
+
+   /* all four share one allocation */
+   VkMemoryRequirements reqs;
+   vk.GetBufferMemoryRequirements (objs->device, nbody->buffers[0][0], &reqs);
+   VkDeviceSize stride = (reqs.size + reqs.alignment - 1) /
+      reqs.alignment * reqs.alignment;
+
+   /* bodies are uploaded once through a mapping: device local memory is
+    * preferred, but not all devices can map it
+    */
+   uint32_t type_index;
+   if (! find_memory_type (objs,
+                           reqs.memoryTypeBits,
+                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                           VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                           &type_index) &&
+       ! find_memory_type (objs,
+                           reqs.memoryTypeBits,
+                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                           VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                           &type_index)) {
+      printf ("Error: No host visible memory for the N-body buffers\n");
+      return false;
+   }
+
+   VkMemoryAllocateInfo alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+      .allocationSize = 4 * stride,
+      .memoryTypeIndex = type_index
+   };
+   if (vk.AllocateMemory (objs->device,
+                          &alloc_info,
+                          allocator,
+                          &nbody->memory) != VK_SUCCESS) {
+      printf ("Error: Failed to allocate N-body memory\n");
+      return false;
+   }
+
+   for (uint32_t i = 0; i < 4; i++) {
+      if (vk.BindBufferMemory (objs->device,
+                               nbody->buffers[i / 2][i % 2],
+                               nbody->memory,
+                               i * stride) != VK_SUCCESS) {
+         printf ("Error: Failed to bind N-body buffer memory\n");
+         return false;
+      }
+   }
+
+   /* initial state goes to set 0 */
+   void* data;
+   if (vk.MapMemory (objs->device,
+                     nbody->memory,
+                     0,
+                     2 * stride,
+                     0,
+                     &data) != VK_SUCCESS) {
+      printf ("Error: Failed to map N-body memory\n");
+      return false;
+   }
+   nbody_init_bodies (data, (float*) ((uint8_t*) data + stride), nbody->count);
+   vk.UnmapMemory (objs->device, nbody->memory);
+   printf ("N-body buffers created, %u bodies\n", nbody->count);
+
+   return true;
+}
+
+static bool
+create_nbody_pipeline (struct vk_objects* objs, struct vk_nbody* nbody)
+{
+   /* (positions, velocities) in, then out */
+   VkDescriptorSetLayoutBinding bindings[4];
+   for (uint32_t i = 0; i < 4; i++) {
+      bindings[i] = (VkDescriptorSetLayoutBinding) {
+         .binding = i,
+         .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+         .descriptorCount = 1,
+         .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+      };
+   }
+
+   VkDescriptorSetLayoutCreateInfo set_layout_info = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+      .bindingCount = 4,
+      .pBindings = bindings
+   };
+   if (vk.CreateDescriptorSetLayout (objs->device,
+                                     &set_layout_info,
+                                     allocator,
+                                     &nbody->set_layout) != VK_SUCCESS) {
+      printf ("Error: Failed to create the N-body descriptor set layout\n");
+      return false;
+   }
+
+   VkDescriptorPoolSize pool_size = {
+      .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      .descriptorCount = 8
+   };
+   VkDescriptorPoolCreateInfo pool_info = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+      .maxSets = 2,
+      .poolSizeCount = 1,
+      .pPoolSizes = &pool_size
+   };
+   if (vk.CreateDescriptorPool (objs->device,
+                                &pool_info,
+                                allocator,
+                                &nbody->descriptor_pool) != VK_SUCCESS) {
+      printf ("Error: Failed to create the N-body descriptor pool\n");
+      return false;
+   }
+
+   VkDescriptorSetLayout set_layouts[2] = {
+      nbody->set_layout,
+      nbody->set_layout
+   };
+   VkDescriptorSetAllocateInfo set_alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+      .descriptorPool = nbody->descriptor_pool,
+      .descriptorSetCount = 2,
+      .pSetLayouts = set_layouts
+   };
+   if (vk.AllocateDescriptorSets (objs->device,
+                                  &set_alloc_info,
+                                  nbody->sets) != VK_SUCCESS) {
+      printf ("Error: Failed to allocate the N-body descriptor sets\n");
+      return false;
+   }
+
+   VkDescriptorBufferInfo buffer_infos[2][4];
+   VkWriteDescriptorSet writes[2][4];
+   for (uint32_t s = 0; s < 2; s++) {
+      for (uint32_t b = 0; b < 4; b++) {
+         buffer_infos[s][b] = (VkDescriptorBufferInfo) {
+            .buffer = nbody->buffers[b < 2 ? s : s ^ 1][b % 2],
+            .offset = 0,
+            .range = VK_WHOLE_SIZE
+         };
+         writes[s][b] = (VkWriteDescriptorSet) {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = nbody->sets[s],
+            .dstBinding = b,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo = &buffer_infos[s][b]
+         };
+      }
+   }
+   vk.UpdateDescriptorSets (objs->device, 8, writes[0], 0, NULL);
+
+   /* the compute shader */
+   size_t shader_code_size;
+   uint32_t* shader_code = load_file (CURRENT_DIR "/nbody.spv",
+                                      &shader_code_size);
+   if (shader_code == NULL) {
+      printf ("Error: Failed to load compute shader code from 'nbody.spv'\n");
+      return false;
+   }
+
+   VkShaderModuleCreateInfo shader_info = {
+      .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+      .codeSize = shader_code_size,
+      .pCode = shader_code,
+   };
+   VkResult result = vk.CreateShaderModule (objs->device,
+                                            &shader_info,
+                                            allocator,
+                                            &nbody->shader_module);
+   free (shader_code);
+   if (result != VK_SUCCESS) {
+      printf ("Error: Failed to create compute shader module\n");
+      return false;
+   }
+
+   /* (count, time step) */
+   VkPushConstantRange push_constant_range = {
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+      .offset = 0,
+      .size = 2 * sizeof (uint32_t)
+   };
+   VkPipelineLayoutCreateInfo pipeline_layout_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+      .setLayoutCount = 1,
+      .pSetLayouts = &nbody->set_layout,
+      .pushConstantRangeCount = 1,
+      .pPushConstantRanges = &push_constant_range
+   };
+   if (vk.CreatePipelineLayout (objs->device,
+                                &pipeline_layout_info,
+                                allocator,
+                                &nbody->pipeline_layout) != VK_SUCCESS) {
+      printf ("Error: Failed to create the N-body pipeline layout\n");
+      return false;
+   }
+
+   VkComputePipelineCreateInfo pipeline_info = {
+      .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+      .stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+      .stage.module = nbody->shader_module,
+      .stage.pName = "main",
+      .layout = nbody->pipeline_layout,
+      .basePipelineHandle = VK_NULL_HANDLE,
+      .basePipelineIndex = -1
+   };
+   if (vk.CreateComputePipelines (objs->device,
+                                  VK_NULL_HANDLE,
+                                  1,
+                                  &pipeline_info,
+                                  allocator,
+                                  &nbody->pipeline) != VK_SUCCESS) {
+      printf ("Error: Failed to create the N-body compute pipeline\n");
+      return false;
+   }
+   printf ("N-body compute pipeline created\n");
+
+   return true;
+}
+
+static void
+destroy_nbody (VkDevice device, struct vk_nbody* nbody)
+{
+   vk.DestroyPipeline (device, nbody->pipeline, allocator);
+   vk.DestroyPipelineLayout (device, nbody->pipeline_layout, allocator);
+   vk.DestroyShaderModule (device, nbody->shader_module, allocator);
+
+   /* descriptor sets are implicitly freed with their pool */
+   vk.DestroyDescriptorPool (device, nbody->descriptor_pool, allocator);
+   vk.DestroyDescriptorSetLayout (device, nbody->set_layout, allocator);
+
+   for (uint32_t i = 0; i < 4; i++)
+      vk.DestroyBuffer (device, nbody->buffers[i / 2][i % 2], allocator);
+   vk.FreeMemory (device, nbody->memory, allocator);
+}
+
+/* Records a simulation step reading set 'parity', and the barriers around it */
+static void
+record_nbody_step (VkCommandBuffer cmd_buffer,
+                   const struct vk_nbody* nbody,
+                   uint32_t parity)
+{
+   /* the previous frame's step wrote what this one reads, and its step and
+    * draw read what this one overwrites
+    */
+   VkMemoryBarrier step_barrier = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+   };
+   vk.CmdPipelineBarrier (cmd_buffer,
+                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+                          VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                          0,
+                          1, &step_barrier,
+                          0, NULL,
+                          0, NULL);
+
+   vk.CmdBindPipeline (cmd_buffer,
+                       VK_PIPELINE_BIND_POINT_COMPUTE,
+                       nbody->pipeline);
+   vk.CmdBindDescriptorSets (cmd_buffer,
+                             VK_PIPELINE_BIND_POINT_COMPUTE,
+                             nbody->pipeline_layout,
+                             0,
+                             1, &nbody->sets[parity],
+                             0, NULL);
+
+   struct {
+      uint32_t count;
+      float dt;
+   } params = { nbody->count, NBODY_TIME_STEP };
+   vk.CmdPushConstants (cmd_buffer,
+                        nbody->pipeline_layout,
+                        VK_SHADER_STAGE_COMPUTE_BIT,
+                        0,
+                        sizeof (params),
+                        &params);
+
+   vk.CmdDispatch (cmd_buffer,
+                   (nbody->count + NBODY_LOCAL_SIZE - 1) / NBODY_LOCAL_SIZE,
+                   1,
+                   1);
+
+   /* new positions are then read as vertices */
+   VkMemoryBarrier draw_barrier = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT
+   };
+   vk.CmdPipelineBarrier (cmd_buffer,
+                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                          VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                          0,
+                          1, &draw_barrier,
+                          0, NULL,
+                          0, NULL);
+}
+
+/* Records the step reading set 'parity' in its own command buffer, timed if
+ * 'ts' isn't NULL
+ */
+static bool
+record_nbody_step_cmd_buffer (struct vk_nbody* nbody,
+                              uint32_t parity,
+                              struct vk_timestamps* ts)
+{
+   VkCommandBuffer cmd_buffer = nbody->step_cmd_buffers[parity];
+
+   VkCommandBufferBeginInfo begin_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .flags = 0,
+      .pInheritanceInfo = NULL
+   };
+   if (vk.BeginCommandBuffer (cmd_buffer, &begin_info) != VK_SUCCESS) {
+      printf ("Error: Failed to begin recording of command buffer\n");
+      return false;
+   }
+
+   uint32_t query = VK_TIMESTAMPS_NONE;
+   if (ts != NULL)
+      query = vk_timestamps_begin (ts, cmd_buffer, "nbody step");
+
+   record_nbody_step (cmd_buffer, nbody, parity);
+
+   if (ts != NULL)
+      vk_timestamps_end (ts, cmd_buffer, query);
+
+   if (vk.EndCommandBuffer (cmd_buffer) != VK_SUCCESS) {
+      printf ("Error: Failed to record command buffer\n");
+      return false;
+   }
+
+   return true;
+}
+
+/* Records the step of each parity in its own command buffer */
+static bool
+create_nbody_step_cmd_buffers (struct vk_objects* objs, struct vk_nbody* nbody)
+{
+   VkCommandBufferAllocateInfo cmd_buffer_alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+      .commandBufferCount = 2,
+      .commandPool = objs->cmd_pool
+   };
+   if (vk.AllocateCommandBuffers (objs->device,
+                                  &cmd_buffer_alloc_info,
+                                  nbody->step_cmd_buffers) != VK_SUCCESS) {
+      printf ("Error: Failed to allocate command buffers\n");
+      return false;
+   }
+
+   for (uint32_t parity = 0; parity < 2; parity++) {
+      if (! record_nbody_step_cmd_buffer (nbody, parity, NULL))
+         return false;
+   }
+   printf ("N-body steps recorded\n");
+
+   return true;
+}
+
+/* Records the command buffers of '-c', each with a mere barrier */
+static bool
+create_submit_bench_cmd_buffers (struct vk_objects* objs,
+                                 struct vk_submit_bench* bench)
+{
+   bench->cmd_buffers = calloc (bench->count, sizeof (VkCommandBuffer));
+
+   VkCommandBufferAllocateInfo cmd_buffer_alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+      .commandBufferCount = bench->count,
+      .commandPool = objs->cmd_pool
+   };
+   if (vk.AllocateCommandBuffers (objs->device,
+                                  &cmd_buffer_alloc_info,
+                                  bench->cmd_buffers) != VK_SUCCESS) {
+      printf ("Error: Failed to allocate command buffers\n");
+      return false;
+   }
+
+   for (uint32_t i = 0; i < bench->count; i++) {
+      VkCommandBuffer cmd_buffer = bench->cmd_buffers[i];
+
+      VkCommandBufferBeginInfo begin_info = {
+         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+         .flags = 0,
+         .pInheritanceInfo = NULL
+      };
+      if (vk.BeginCommandBuffer (cmd_buffer, &begin_info) != VK_SUCCESS) {
+         printf ("Error: Failed to begin recording of command buffer\n");
+         return false;
+      }
+
+      /* not empty, so that drivers can't skip it */
+      vk.CmdPipelineBarrier (cmd_buffer,
+                             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                             0,
+                             0, NULL,
+                             0, NULL,
+                             0, NULL);
+
+      if (vk.EndCommandBuffer (cmd_buffer) != VK_SUCCESS) {
+         printf ("Error: Failed to record command buffer\n");
+         return false;
+      }
+   }
+   printf ("%u more command buffers per frame recorded\n", bench->count);
+
+   return true;
+}
+
+/* The size of the surface, which is up to the swapchain on some platforms
+ * (e.g, Wayland): the window size then.
+ */
+static VkExtent2D
+get_surface_extent (uint32_t window,
+                    const VkSurfaceCapabilitiesKHR* surface_caps)
+{
+   VkExtent2D extent = surface_caps->currentExtent;
+
+   if (extent.width != UINT32_MAX)
+      return extent;
+
+   wsi_get_size (window, &extent.width, &extent.height);
+
+   if (extent.width < surface_caps->minImageExtent.width)
+      extent.width = surface_caps->minImageExtent.width;
+   if (extent.width > surface_caps->maxImageExtent.width)
+      extent.width = surface_caps->maxImageExtent.width;
+   if (extent.height < surface_caps->minImageExtent.height)
+      extent.height = surface_caps->minImageExtent.height;
+   if (extent.height > surface_caps->maxImageExtent.height)
+      extent.height = surface_caps->maxImageExtent.height;
+
+   return extent;
+}
+
+/* Scans out straight to the first display, in its native resolution at the
+ * highest refresh rate, on the first plane that can show it.
+ */
+static bool
+create_display_surface (VkInstance instance,
+                        VkPhysicalDevice physical_device,
+                        VkSurfaceKHR* surface)
+{
+   VkResult result;
+
+   /* choose a display */
+   VkDisplayPropertiesKHR displays[MAX_DISPLAYS];
+   uint32_t display_count = MAX_DISPLAYS;
+   result = vk.GetPhysicalDeviceDisplayPropertiesKHR (physical_device,
+                                                      &display_count,
+                                                      displays);
+   if ((result != VK_SUCCESS && result != VK_INCOMPLETE) ||
+       display_count == 0) {
+      printf ("Error: No display connected to the physical device\n");
+      return false;
+   }
+   for (uint32_t i = 0; i < display_count; i++) {
+      printf ("Display %u: %s (%ux%u)\n",
+              i,
+              displays[i].displayName != NULL ?
+                 displays[i].displayName : "unnamed",
+              displays[i].physicalResolution.width,
+              displays[i].physicalResolution.height);
+   }
+   const VkDisplayPropertiesKHR* display = &displays[0];
+
+   /* choose a mode */
+   VkDisplayModePropertiesKHR modes[MAX_DISPLAY_MODES];
+   uint32_t mode_count = MAX_DISPLAY_MODES;
+   result = vk.GetDisplayModePropertiesKHR (physical_device,
+                                            display->display,
+                                            &mode_count,
+                                            modes);
+   if ((result != VK_SUCCESS && result != VK_INCOMPLETE) || mode_count == 0) {
+      printf ("Error: No mode found for the display\n");
+      return false;
+   }
+
+   const VkDisplayModePropertiesKHR* mode = NULL;
+   bool mode_native = false;
+   for (uint32_t i = 0; i < mode_count; i++) {
+      const VkDisplayModeParametersKHR* params = &modes[i].parameters;
+      bool native =
+         params->visibleRegion.width == display->physicalResolution.width &&
+         params->visibleRegion.height == display->physicalResolution.height;
+
+      printf ("   mode %u: %ux%u @ %u.%03u Hz\n",
+              i,
+              params->visibleRegion.width,
+              params->visibleRegion.height,
+              params->refreshRate / 1000,
+              params->refreshRate % 1000);
+
+      if (mode == NULL ||
+          (native && ! mode_native) ||
+          (native == mode_native &&
+           params->refreshRate > mode->parameters.refreshRate)) {
+         mode = &modes[i];
+         mode_native = native;
+      }
+   }
+
+   /* choose a plane that can be shown on the display, and isn't elsewhere */
+   VkDisplayPlanePropertiesKHR planes[MAX_DISPLAY_PLANES];
+   uint32_t plane_count = MAX_DISPLAY_PLANES;
+   result = vk.GetPhysicalDeviceDisplayPlanePropertiesKHR (physical_device,
+                                                           &plane_count,
+                                                           planes);
+   if (result != VK_SUCCESS && result != VK_INCOMPLETE)
+      plane_count = 0;
+
+   uint32_t plane_index = UINT32_MAX;
+   for (uint32_t i = 0; i < plane_count && plane_index == UINT32_MAX; i++) {
+      if (planes[i].currentDisplay != VK_NULL_HANDLE &&
+          planes[i].currentDisplay != display->display)
+         continue;
+
+      VkDisplayKHR supported[MAX_DISPLAYS];
+      uint32_t supported_count = MAX_DISPLAYS;
+      result = vk.GetDisplayPlaneSupportedDisplaysKHR (physical_device,
+                                                       i,
+                                                       &supported_count,
+                                                       supported);
+      if (result != VK_SUCCESS && result != VK_INCOMPLETE)
+         continue;
+
+      for (uint32_t j = 0; j < supported_count; j++) {
+         if (supported[j] == display->display) {
+            plane_index = i;
+            break;
+         }
+      }
+   }
+   if (plane_index == UINT32_MAX) {
+      printf ("Error: No plane can show the display\n");
+      return false;
+   }
+
+   /* the plane has nothing under it to blend with, if it can be helped */
+   VkDisplayPlaneCapabilitiesKHR plane_caps;
+   vk.GetDisplayPlaneCapabilitiesKHR (physical_device,
+                                      mode->displayMode,
+                                      plane_index,
+                                      &plane_caps);
+   VkDisplayPlaneAlphaFlagBitsKHR alpha_mode =
+      VK_DISPLAY_PLANE_ALPHA_OPAQUE_BIT_KHR;
+   if (! (plane_caps.supportedAlpha & alpha_mode))
+      alpha_mode = plane_caps.supportedAlpha & -plane_caps.supportedAlpha;
+
+   printf ("Presenting %ux%u @ %u.%03u Hz on plane %u\n",
+           mode->parameters.visibleRegion.width,
+           mode->parameters.visibleRegion.height,
+           mode->parameters.refreshRate / 1000,
+           mode->parameters.refreshRate % 1000,
+           plane_index);
+
+   VkDisplaySurfaceCreateInfoKHR surface_info = {
+      .sType = VK_STRUCTURE_TYPE_DISPLAY_SURFACE_CREATE_INFO_KHR,
+      .displayMode = mode->displayMode,
+      .planeIndex = plane_index,
+      .planeStackIndex = planes[plane_index].currentStackIndex,
+      .transform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR,
+      .globalAlpha = 1.0,
+      .alphaMode = alpha_mode,
+      .imageExtent = mode->parameters.visibleRegion
+   };
 
-struct vk_state {
-   VkExtent2D surface_extent;
+   return vk.CreateDisplayPlaneSurfaceKHR (instance,
+                                           &surface_info,
+                                           allocator,
+                                           surface) == VK_SUCCESS;
+}
 
-   VkSwapchainKHR swapchain;
-   VkSwapchainKHR previous_swapchain;
-   uint32_t swapchain_images_count;
-   VkImageView image_views[MAX_SWAPCHAIN_IMAGES];
-   VkFramebuffer framebuffers[MAX_SWAPCHAIN_IMAGES];
+/* Creates a surface from 'window' of whichever WSI backend is in use */
+static bool
+create_surface (VkInstance instance,
+                VkPhysicalDevice physical_device,
+                uint32_t window,
+                VkSurfaceKHR* surface)
+{
+   const void* conn = NULL;
+   const void* win = NULL;
+   VkResult result = VK_ERROR_EXTENSION_NOT_PRESENT;
+
+   wsi_get_connection_and_window (window, &conn, &win);
+
+   switch (wsi_get_platform ()) {
+#ifdef VK_USE_PLATFORM_XCB_KHR
+   case WSI_PLATFORM_XCB: {
+      VkXcbSurfaceCreateInfoKHR surface_info = {
+         .sType = VK_STRUCTURE_TYPE_XCB_SURFACE_CREATE_INFO_KHR,
+         .connection = (xcb_connection_t*) conn,
+         .window = * (const xcb_window_t*) win,
+      };
+      result = vk.CreateXcbSurfaceKHR (instance,
+                                       &surface_info,
+                                       allocator,
+                                       surface);
+      break;
+   }
+#endif
+
+#ifdef VK_USE_PLATFORM_WAYLAND_KHR
+   case WSI_PLATFORM_WAYLAND: {
+      VkWaylandSurfaceCreateInfoKHR surface_info = {
+         .sType = VK_STRUCTURE_TYPE_WAYLAND_SURFACE_CREATE_INFO_KHR,
+         .display = (struct wl_display*) conn,
+         .surface = (struct wl_surface*) win,
+      };
+      result = vk.CreateWaylandSurfaceKHR (instance,
+                                           &surface_info,
+                                           allocator,
+                                           surface);
+      break;
+   }
+#endif
 
-   VkRenderPass renderpass;
-   VkPipelineLayout pipeline_layout;
-   VkPipeline pipeline;
-   VkCommandBuffer cmd_buffers[MAX_SWAPCHAIN_IMAGES];
-};
+   case WSI_PLATFORM_DISPLAY:
+      return create_display_surface (instance, physical_device, surface);
 
-static struct vk_objects objs = {VK_NULL_HANDLE,};
-static struct vk_config config = {0,};
-static struct vk_state state = {0,};
+   default:
+      break;
+   }
 
-static bool running = false;
-static bool damaged = false;
-static bool expose = false;
+   return result == VK_SUCCESS;
+}
 
+/* True if GPU timestamps can be taken along with CLOCK_MONOTONIC, which
+ * VK_EXT_calibrated_timestamps doesn't promise for every device
+ */
 static bool
-recreate_swapchain (struct vk_objects* objs,
-                    struct vk_config* config,
-                    struct vk_state* state);
-
-static uint32_t*
-load_file (const char* filename, size_t* file_size)
+supports_calibration (VkPhysicalDevice physical_device)
 {
-   char *data = NULL;
-   size_t size = 0;
-   size_t read_size = 0;
-   size_t alloc_size = 0;
-   int fd = open (filename, O_RDONLY);
-   uint8_t buf[1024];
+   VkTimeDomainEXT domains[MAX_TIME_DOMAINS];
+   uint32_t domains_count = MAX_TIME_DOMAINS;
+   bool device = false, monotonic = false;
 
-   while ((read_size = read (fd, buf, 1024)) > 0) {
-      if (size + read_size > alloc_size) {
-         alloc_size = read_size + size;
-         data = realloc (data, alloc_size);
-      }
+   if (vk.GetPhysicalDeviceCalibrateableTimeDomainsEXT == NULL)
+      return false;
 
-      memcpy (data + size, buf, read_size);
-      size += read_size;
+   VkResult result =
+      vk.GetPhysicalDeviceCalibrateableTimeDomainsEXT (physical_device,
+                                                       &domains_count,
+                                                       domains);
+   if (result != VK_SUCCESS && result != VK_INCOMPLETE)
+      return false;
+
+   for (uint32_t i = 0; i < domains_count; i++) {
+      device = device || domains[i] == VK_TIME_DOMAIN_DEVICE_EXT;
+      monotonic = monotonic ||
+         domains[i] == VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
    }
 
-   if (read_size == 0) {
-      if (file_size)
-         *file_size = size;
+   return device && monotonic;
+}
 
-      return (uint32_t*) data;
+/* Prefers 8-bit BGRA, the layout of 24 and 32-bit X visuals and of most
+ * scanout buffers, so that a fullscreen window can be flipped to the screen
+ * as is rather than converted by the compositor, then 8-bit RGBA. Either must
+ * be UNORM: shaders write non-linear colours already, which an SRGB format
+ * would encode again.
+ */
+static bool
+choose_surface_format (VkPhysicalDevice physical_device,
+                       VkSurfaceKHR surface,
+                       VkSurfaceFormatKHR* surface_format)
+{
+   VkSurfaceFormatKHR formats[MAX_SURFACE_FORMATS];
+   uint32_t formats_count = MAX_SURFACE_FORMATS;
+   VkResult result;
+
+   result = vk.GetPhysicalDeviceSurfaceFormatsKHR (physical_device,
+                                                   surface,
+                                                   &formats_count,
+                                                   formats);
+   if ((result != VK_SUCCESS && result != VK_INCOMPLETE) ||
+       formats_count == 0) {
+      printf ("Error: No suitable surface format found\n");
+      return false;
    }
-   else {
-      return NULL;
+
+   *surface_format = formats[0];
+   for (uint32_t i = 0; i < formats_count; i++) {
+      if (formats[i].format == VK_FORMAT_B8G8R8A8_UNORM) {
+         *surface_format = formats[i];
+         break;
+      }
+      if (formats[i].format == VK_FORMAT_R8G8B8A8_UNORM)
+         *surface_format = formats[i];
    }
+   printf ("Found %u surface format(s). Choosing format %u.\n",
+           formats_count,
+           surface_format->format);
+
+   return true;
 }
 
-static void
-ctrl_c_handler (int32_t dummy)
+/* Prefers mailbox, then FIFO: both flip whole images without tearing, which
+ * is what lets the compositor (or the X server, once bypassed) scan them out
+ * directly. Mailbox adds no queueing latency on top.
+ */
+static bool
+choose_present_mode (VkPhysicalDevice physical_device,
+                     VkSurfaceKHR surface,
+                     VkPresentModeKHR* present_mode)
 {
-   running = false;
-   signal (SIGINT, NULL);
+   VkPresentModeKHR modes[MAX_PRESENT_MODES];
+   uint32_t modes_count = MAX_PRESENT_MODES;
+   VkResult result;
+
+   result = vk.GetPhysicalDeviceSurfacePresentModesKHR (physical_device,
+                                                        surface,
+                                                        &modes_count,
+                                                        modes);
+   if ((result != VK_SUCCESS && result != VK_INCOMPLETE) || modes_count == 0) {
+      printf ("Error: No suitable present modes found\n");
+      return false;
+   }
+
+   /* always supported */
+   *present_mode = VK_PRESENT_MODE_FIFO_KHR;
+   for (uint32_t i = 0; i < modes_count; i++) {
+      if (modes[i] == VK_PRESENT_MODE_MAILBOX_KHR)
+         *present_mode = modes[i];
+   }
+   printf ("Found %u present mode(s). Choosing %s.\n",
+           modes_count,
+           *present_mode == VK_PRESENT_MODE_MAILBOX_KHR ? "mailbox" : "FIFO");
+
+   return true;
 }
 
 static bool
@@ -136,6 +1142,7 @@ create_renderpass (struct vk_objects* objs,
    assert (objs->device != VK_NULL_HANDLE);
 
    state->renderpass = VK_NULL_HANDLE;
+   state->damage_renderpass = VK_NULL_HANDLE;
 
    /* config a color attachment */
    VkAttachmentDescription color_attachment = {
@@ -146,7 +1153,8 @@ create_renderpass (struct vk_objects* objs,
       .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
       .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
       .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-      .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+      .finalLayout = config->shm_present ?
+         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
    };
 
    /* an attachment reference */
@@ -162,14 +1170,25 @@ create_renderpass (struct vk_objects* objs,
       .pColorAttachments = &color_attachment_ref,
    };
 
-   VkSubpassDependency dependency = {
-      .srcSubpass = VK_SUBPASS_EXTERNAL,
-      .dstSubpass = 0,
-      .srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-      .srcAccessMask = VK_ACCESS_MEMORY_READ_BIT,
-      .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-      .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
-         VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+   VkSubpassDependency dependencies[] = {
+      {
+         .srcSubpass = VK_SUBPASS_EXTERNAL,
+         .dstSubpass = 0,
+         .srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+         .srcAccessMask = VK_ACCESS_MEMORY_READ_BIT,
+         .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+         .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+      },
+      /* MIT-SHM presents read the image back right after */
+      {
+         .srcSubpass = 0,
+         .dstSubpass = VK_SUBPASS_EXTERNAL,
+         .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+         .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+         .dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT,
+         .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT
+      }
    };
 
    /* create a render pass */
@@ -179,8 +1198,8 @@ create_renderpass (struct vk_objects* objs,
       .pAttachments = &color_attachment,
       .subpassCount = 1,
       .pSubpasses = &render_subpass,
-      .dependencyCount = 1,
-      .pDependencies = &dependency
+      .dependencyCount = config->shm_present ? 2 : 1,
+      .pDependencies = dependencies
    };
 
    if (vk.CreateRenderPass (objs->device,
@@ -190,6 +1209,19 @@ create_renderpass (struct vk_objects* objs,
       printf ("Error: Failed to create render pass\n");
       return false;
    }
+
+   /* a compatible one for partial redraws, keeping what is outside the
+    * damage
+    */
+   color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+   color_attachment.initialLayout = color_attachment.finalLayout;
+   if (vk.CreateRenderPass (objs->device,
+                            &render_pass_info,
+                            allocator,
+                            &state->damage_renderpass) != VK_SUCCESS) {
+      printf ("Error: Failed to create render pass\n");
+      return false;
+   }
    printf ("Render pass created\n");
 
    return true;
@@ -203,19 +1235,33 @@ create_pipeline (struct vk_objects* objs,
    assert (objs->device != VK_NULL_HANDLE);
    assert (state->renderpass != VK_NULL_HANDLE);
 
-   /* specify the vertex input */
+   /* specify the vertex input: none for the triangle, N-body positions
+    * (xyz and mass) otherwise
+    */
+   VkVertexInputBindingDescription binding_desc = {
+      .binding = 0,
+      .stride = 4 * sizeof (float),
+      .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+   };
+   VkVertexInputAttributeDescription attribute_desc = {
+      .location = 0,
+      .binding = 0,
+      .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+      .offset = 0
+   };
    VkPipelineVertexInputStateCreateInfo vertex_input_info = {
       .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-      .vertexBindingDescriptionCount = 0,
-      .pVertexBindingDescriptions = NULL,
-      .vertexAttributeDescriptionCount = 0,
-      .pVertexAttributeDescriptions = NULL
+      .vertexBindingDescriptionCount = nbody.count > 0 ? 1 : 0,
+      .pVertexBindingDescriptions = &binding_desc,
+      .vertexAttributeDescriptionCount = nbody.count > 0 ? 1 : 0,
+      .pVertexAttributeDescriptions = &attribute_desc
    };
 
    /* specify the input assembly (type of primitives) */
    VkPipelineInputAssemblyStateCreateInfo input_assembly_info = {
       .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-      .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+      .topology = nbody.count > 0 ?
+         VK_PRIMITIVE_TOPOLOGY_POINT_LIST : VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
       .primitiveRestartEnable = VK_FALSE,
    };
 
@@ -243,6 +1289,14 @@ create_pipeline (struct vk_objects* objs,
       .pScissors = &scissor
    };
 
+   /* the scissor is set at record time, to redraw damaged areas only */
+   VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_SCISSOR};
+   VkPipelineDynamicStateCreateInfo dynamic_state_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+      .dynamicStateCount = 1,
+      .pDynamicStates = dynamic_states
+   };
+
    /* configure rasterizer */
    VkPipelineRasterizationStateCreateInfo rasterizer = {
       .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
@@ -271,14 +1325,14 @@ create_pipeline (struct vk_objects* objs,
       .alphaToOneEnable = VK_FALSE
    };
 
-   /* color blending */
+   /* color blending, additive for N-body points so dense areas glow */
    VkPipelineColorBlendAttachmentState color_blend_attachment = {
       .colorWriteMask =
          VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT
          | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
-      .blendEnable = VK_FALSE,
+      .blendEnable = nbody.count > 0 ? VK_TRUE : VK_FALSE,
       .srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
-      .dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
+      .dstColorBlendFactor = VK_BLEND_FACTOR_ONE,
       .colorBlendOp = VK_BLEND_OP_ADD,
       .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
       .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
@@ -301,14 +1355,19 @@ create_pipeline (struct vk_objects* objs,
                              state->pipeline_layout,
                              allocator);
 
-   /* pipeline layout */
+   /* pipeline layout, N-body points get a scale as push constant */
+   VkPushConstantRange push_constant_range = {
+      .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+      .offset = 0,
+      .size = 2 * sizeof (float)
+   };
    VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
    VkPipelineLayoutCreateInfo pipeline_layout_info = {
       .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
       .setLayoutCount = 0,
       .pSetLayouts = NULL,
-      .pushConstantRangeCount = 0,
-      .pPushConstantRanges = 0
+      .pushConstantRangeCount = nbody.count > 0 ? 1 : 0,
+      .pPushConstantRanges = &push_constant_range
    };
    if (vk.CreatePipelineLayout (objs->device,
                                 &pipeline_layout_info,
@@ -333,7 +1392,7 @@ create_pipeline (struct vk_objects* objs,
       .pMultisampleState = &multisampling,
       .pDepthStencilState = NULL,
       .pColorBlendState = &color_blending_info,
-      .pDynamicState = NULL,
+      .pDynamicState = &dynamic_state_info,
       .layout = pipeline_layout,
       .renderPass = state->renderpass,
       .subpass = 0,
@@ -352,6 +1411,381 @@ create_pipeline (struct vk_objects* objs,
    state->pipeline = pipeline;
    printf ("Graphics pipeline created\n");
 
+   /* the triangle faces the viewer, it draws the same without culling */
+   if (draw_bench.pipeline_period > 0) {
+      rasterizer.cullMode = VK_CULL_MODE_NONE;
+      if (vk.CreateGraphicsPipelines (objs->device,
+                                      VK_NULL_HANDLE,
+                                      1,
+                                      &pipeline_info,
+                                      allocator,
+                                      &state->switch_pipeline) != VK_SUCCESS) {
+         printf ("Error: Failed to create the graphics pipeline\n");
+         return false;
+      }
+   }
+
+   return true;
+}
+
+static void
+destroy_offscreen_image (VkDevice device, struct vk_state* state)
+{
+   wsi_shm_image_destroy (&state->shm_image);
+
+   vk.DestroyBuffer (device, state->readback_buffer, allocator);
+   vk.FreeMemory (device, state->readback_memory, allocator);
+   vk.DestroyImage (device, state->offscreen_image, allocator);
+   vk.FreeMemory (device, state->offscreen_memory, allocator);
+
+   state->readback_buffer = VK_NULL_HANDLE;
+   state->readback_memory = VK_NULL_HANDLE;
+   state->readback_data = NULL;
+   state->offscreen_image = VK_NULL_HANDLE;
+   state->offscreen_memory = VK_NULL_HANDLE;
+}
+
+/* For MIT-SHM presents: the image rendered to, the buffer it is read back to,
+ * and the image shared with the X server, all of the size of the window.
+ */
+static bool
+create_offscreen_image (struct vk_objects* objs,
+                        struct vk_config* config,
+                        struct vk_state* state)
+{
+   VkExtent2D extent = state->surface_extent;
+
+   destroy_offscreen_image (objs->device, state);
+
+   VkImageCreateInfo image_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+      .imageType = VK_IMAGE_TYPE_2D,
+      .format = config->surface_format.format,
+      .extent = {extent.width, extent.height, 1},
+      .mipLevels = 1,
+      .arrayLayers = 1,
+      .samples = VK_SAMPLE_COUNT_1_BIT,
+      .tiling = VK_IMAGE_TILING_OPTIMAL,
+      .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+         VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+   };
+   if (vk.CreateImage (objs->device,
+                       &image_info,
+                       allocator,
+                       &state->offscreen_image) != VK_SUCCESS) {
+      printf ("Error: Failed to create the offscreen image\n");
+      return false;
+   }
+
+   VkMemoryRequirements reqs;
+   vk.GetImageMemoryRequirements (objs->device, state->offscreen_image, &reqs);
+
+   VkMemoryAllocateInfo alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+      .allocationSize = reqs.size
+   };
+   if (! find_memory_type (objs,
+                           reqs.memoryTypeBits,
+                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                           &alloc_info.memoryTypeIndex) ||
+       vk.AllocateMemory (objs->device,
+                          &alloc_info,
+                          allocator,
+                          &state->offscreen_memory) != VK_SUCCESS ||
+       vk.BindImageMemory (objs->device,
+                           state->offscreen_image,
+                           state->offscreen_memory,
+                           0) != VK_SUCCESS) {
+      printf ("Error: Failed to allocate the offscreen image memory\n");
+      return false;
+   }
+
+   /* tightly packed, as the image shared with the X server */
+   VkBufferCreateInfo buffer_info = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      .size = (VkDeviceSize) extent.width * extent.height * 4,
+      .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+   };
+   if (vk.CreateBuffer (objs->device,
+                        &buffer_info,
+                        allocator,
+                        &state->readback_buffer) != VK_SUCCESS) {
+      printf ("Error: Failed to create the readback buffer\n");
+      return false;
+   }
+
+   /* the CPU reads it all, cached memory is preferred */
+   vk.GetBufferMemoryRequirements (objs->device,
+                                   state->readback_buffer,
+                                   &reqs);
+   alloc_info.allocationSize = reqs.size;
+   if (! find_memory_type (objs,
+                           reqs.memoryTypeBits,
+                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                           VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
+                           VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+                           &alloc_info.memoryTypeIndex) &&
+       ! find_memory_type (objs,
+                           reqs.memoryTypeBits,
+                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                           VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                           &alloc_info.memoryTypeIndex)) {
+      printf ("Error: No host visible memory for the readback buffer\n");
+      return false;
+   }
+
+   /* mapped for good */
+   if (vk.AllocateMemory (objs->device,
+                          &alloc_info,
+                          allocator,
+                          &state->readback_memory) != VK_SUCCESS ||
+       vk.BindBufferMemory (objs->device,
+                            state->readback_buffer,
+                            state->readback_memory,
+                            0) != VK_SUCCESS ||
+       vk.MapMemory (objs->device,
+                     state->readback_memory,
+                     0,
+                     VK_WHOLE_SIZE,
+                     0,
+                     (void**) &state->readback_data) != VK_SUCCESS) {
+      printf ("Error: Failed to allocate the readback buffer memory\n");
+      return false;
+   }
+
+   if (! wsi_shm_image_create (state->window,
+                               extent.width,
+                               extent.height,
+                               &state->shm_image))
+      return false;
+   printf ("Offscreen image created, presented through MIT-SHM\n");
+
+   return true;
+}
+
+/* Copies 'rects' of the offscreen image, just rendered, to the same place in
+ * the readback buffer, for the CPU to read once the frame fence is signaled.
+ */
+static void
+record_readback (VkCommandBuffer cmd_buffer,
+                 struct vk_state* state,
+                 const VkRect2D* rects,
+                 uint32_t rects_count)
+{
+   VkBufferImageCopy regions[WSI_MAX_DAMAGE_RECTS];
+
+   for (uint32_t i = 0; i < rects_count; i++) {
+      VkDeviceSize offset = (VkDeviceSize) rects[i].offset.y *
+         state->surface_extent.width + rects[i].offset.x;
+
+      regions[i] = (VkBufferImageCopy) {
+         .bufferOffset = offset * 4,
+         .bufferRowLength = state->surface_extent.width,
+         .bufferImageHeight = state->surface_extent.height,
+         .imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+         .imageSubresource.mipLevel = 0,
+         .imageSubresource.baseArrayLayer = 0,
+         .imageSubresource.layerCount = 1,
+         .imageOffset = {rects[i].offset.x, rects[i].offset.y, 0},
+         .imageExtent = {rects[i].extent.width, rects[i].extent.height, 1}
+      };
+   }
+   vk.CmdCopyImageToBuffer (cmd_buffer,
+                            state->offscreen_image,
+                            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                            state->readback_buffer,
+                            rects_count,
+                            regions);
+
+   VkBufferMemoryBarrier barrier = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .buffer = state->readback_buffer,
+      .offset = 0,
+      .size = VK_WHOLE_SIZE
+   };
+   vk.CmdPipelineBarrier (cmd_buffer,
+                          VK_PIPELINE_STAGE_TRANSFER_BIT,
+                          VK_PIPELINE_STAGE_HOST_BIT,
+                          0,
+                          0, NULL,
+                          1, &barrier,
+                          0, NULL);
+}
+
+/* Records the draws of '-d' into the render pass begun with 'begin_info',
+ * once the pipeline is bound and the first draw recorded, switching
+ * pipelines and render passes every so many draws. Returns the number of
+ * commands recorded.
+ */
+static uint32_t
+record_bench_draws (VkCommandBuffer cmd_buffer,
+                    const struct vk_state* state,
+                    VkRenderPassBeginInfo* begin_info)
+{
+   uint32_t commands = 0;
+
+   /* draws after the first one only cover a pixel, for the GPU to keep up */
+   VkRect2D pixel = {{0, 0}, {1, 1}};
+   vk.CmdSetScissor (cmd_buffer, 0, 1, &pixel);
+   commands++;
+
+   for (uint32_t d = 1; d < draw_bench.draws; d++) {
+      if (draw_bench.renderpass_period > 0 &&
+          d % draw_bench.renderpass_period == 0) {
+         vk.CmdEndRenderPass (cmd_buffer);
+
+         /* the next passes keep what the previous ones drew */
+         begin_info->renderPass = state->damage_renderpass;
+         begin_info->clearValueCount = 0;
+         vk.CmdBeginRenderPass (cmd_buffer,
+                                begin_info,
+                                VK_SUBPASS_CONTENTS_INLINE);
+         commands += 2;
+      }
+
+      if (draw_bench.pipeline_period > 0 &&
+          d % draw_bench.pipeline_period == 0) {
+         bool odd = (d / draw_bench.pipeline_period) % 2 == 1;
+
+         vk.CmdBindPipeline (cmd_buffer,
+                             VK_PIPELINE_BIND_POINT_GRAPHICS,
+                             odd ? state->switch_pipeline : state->pipeline);
+         commands++;
+      }
+
+      vk.CmdDraw (cmd_buffer, 3, 1, 0, 0);
+      commands++;
+   }
+
+   return commands;
+}
+
+/* Records the whole frame into command buffer 'j', [parity * images +
+ * image], returning in 'commands_count' how many commands that took. Its
+ * passes are timed if 'ts' isn't NULL, for the frame being drawn only.
+ */
+static bool
+record_command_buffer (struct vk_config* config,
+                       struct vk_state* state,
+                       uint32_t j,
+                       struct vk_timestamps* ts,
+                       uint32_t* commands_count)
+{
+   uint32_t i = j % state->swapchain_images_count;
+   uint32_t parity = j / state->swapchain_images_count;
+   VkCommandBuffer cmd_buffer = state->cmd_buffers[j];
+   uint32_t commands = 0;
+
+   assert (state->framebuffers[i] != VK_NULL_HANDLE);
+
+   VkCommandBufferBeginInfo begin_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
+      .pInheritanceInfo = NULL
+   };
+
+   if (vk.BeginCommandBuffer (cmd_buffer,
+                              &begin_info) != VK_SUCCESS) {
+      printf ("Error: Failed to begin recording of command buffer\n");
+      return false;
+   }
+
+   /* start a render pass */
+   VkOffset2D swapchain_offset = {0, 0};
+   VkRenderPassBeginInfo renderpass_begin_info = {
+      .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+      .renderPass = state->renderpass,
+      .framebuffer = state->framebuffers[i],
+      .renderArea.offset = swapchain_offset,
+      .renderArea.extent = state->surface_extent,
+      .clearValueCount = 1,
+      .pClearValues = &clear_color
+   };
+   uint32_t query = VK_TIMESTAMPS_NONE;
+   if (ts != NULL)
+      query = vk_timestamps_begin (ts, cmd_buffer, "draw");
+
+   vk.CmdBeginRenderPass (cmd_buffer,
+                          &renderpass_begin_info,
+                          VK_SUBPASS_CONTENTS_INLINE);
+
+   vk.CmdBindPipeline (cmd_buffer,
+                       VK_PIPELINE_BIND_POINT_GRAPHICS,
+                       state->pipeline);
+
+   VkRect2D scissor = {
+      .offset = swapchain_offset,
+      .extent = state->surface_extent
+   };
+   vk.CmdSetScissor (cmd_buffer, 0, 1, &scissor);
+   commands += 3;
+
+   if (nbody.count > 0) {
+      /* fit the unit sphere in the window, keeping the aspect ratio */
+      float extent = state->surface_extent.width <
+         state->surface_extent.height ?
+         state->surface_extent.width : state->surface_extent.height;
+      float scale[2] = {
+         0.8f * extent / state->surface_extent.width,
+         0.8f * extent / state->surface_extent.height
+      };
+      vk.CmdPushConstants (cmd_buffer,
+                           state->pipeline_layout,
+                           VK_SHADER_STAGE_VERTEX_BIT,
+                           0,
+                           sizeof (scale),
+                           scale);
+
+      /* the positions just written by the step */
+      VkDeviceSize offset = 0;
+      vk.CmdBindVertexBuffers (cmd_buffer,
+                               0,
+                               1,
+                               &nbody.buffers[parity ^ 1][0],
+                               &offset);
+
+      vk.CmdDraw (cmd_buffer, nbody.count, 1, 0, 0);
+      commands += 3;
+   } else {
+      vk.CmdDraw (cmd_buffer, 3, 1, 0, 0);
+      commands++;
+
+      if (draw_bench.draws > 1)
+         commands += record_bench_draws (cmd_buffer,
+                                         state,
+                                         &renderpass_begin_info);
+   }
+
+   vk.CmdEndRenderPass (cmd_buffer);
+   commands++;
+
+   if (ts != NULL)
+      vk_timestamps_end (ts, cmd_buffer, query);
+
+   if (config->shm_present) {
+      if (ts != NULL)
+         query = vk_timestamps_begin (ts, cmd_buffer, "readback");
+
+      record_readback (cmd_buffer, state, &scissor, 1);
+
+      if (ts != NULL)
+         vk_timestamps_end (ts, cmd_buffer, query);
+   }
+
+   if (vk.EndCommandBuffer (cmd_buffer) != VK_SUCCESS) {
+      printf ("Error: Failed to record command buffer\n");
+      return false;
+   }
+
+   *commands_count = commands;
+
    return true;
 }
 
@@ -364,11 +1798,14 @@ create_command_buffers (struct vk_objects* objs,
    assert (objs->cmd_pool != VK_NULL_HANDLE);
    assert (state->renderpass != VK_NULL_HANDLE);
 
-   /* create command buffers */
+   /* create command buffers, N-body ones for each parity */
+   uint32_t parities = nbody.count > 0 ? 2 : 1;
+   state->cmd_buffers_count = state->swapchain_images_count * parities;
+
    VkCommandBufferAllocateInfo cmd_buffer_alloc_info = {
       .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
       .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-      .commandBufferCount = state->swapchain_images_count,
+      .commandBufferCount = state->cmd_buffers_count,
       .commandPool = objs->cmd_pool
    };
    if (vk.AllocateCommandBuffers (objs->device,
@@ -380,70 +1817,35 @@ create_command_buffers (struct vk_objects* objs,
    printf ("Command buffers allocated\n");
 
    /* start recording to command buffers */
-   for (uint32_t i = 0; i < state->swapchain_images_count; i++) {
-      assert (state->framebuffers[i] != VK_NULL_HANDLE);
-
-      VkCommandBufferBeginInfo begin_info = {
-         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-         .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
-         .pInheritanceInfo = NULL
-      };
+   for (uint32_t j = 0; j < state->cmd_buffers_count; j++) {
+      uint32_t commands;
 
-      if (vk.BeginCommandBuffer (state->cmd_buffers[i],
-                                 &begin_info) != VK_SUCCESS) {
-         printf ("Error: Failed to begin recording of command buffer\n");
+      if (! record_command_buffer (config, state, j, NULL, &commands))
          return false;
-      }
-
-      /* start a render pass */
-      VkClearValue clear_color = {{{0.01f, 0.01f, 0.01f, 1.0f}}};
-      VkOffset2D swapchain_offset = {0, 0};
-      VkRenderPassBeginInfo renderpass_begin_info = {
-         .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-         .renderPass = state->renderpass,
-         .framebuffer = state->framebuffers[i],
-         .renderArea.offset = swapchain_offset,
-         .renderArea.extent = state->surface_extent,
-         .clearValueCount = 1,
-         .pClearValues = &clear_color
-      };
-      vk.CmdBeginRenderPass (state->cmd_buffers[i],
-                             &renderpass_begin_info,
-                             VK_SUBPASS_CONTENTS_INLINE);
-
-      vk.CmdBindPipeline (state->cmd_buffers[i],
-                          VK_PIPELINE_BIND_POINT_GRAPHICS,
-                          state->pipeline);
-
-      vk.CmdDraw (state->cmd_buffers[i], 3, 1, 0, 0);
-
-      vk.CmdEndRenderPass (state->cmd_buffers[i]);
-
-      vk.EndCommandBuffer (state->cmd_buffers[i]);
    }
    printf ("Render pass commands recorded in buffer\n");
 
    return true;
 }
 
+/* Creates a swapchain of the surface's size in place of the current one,
+ * returning its images.
+ */
 static bool
-recreate_swapchain (struct vk_objects* objs,
-                    struct vk_config* config,
-                    struct vk_state* state)
+create_swapchain (struct vk_objects* objs,
+                  struct vk_config* config,
+                  struct vk_state* state,
+                  VkImage* swapchain_images,
+                  uint32_t* swapchain_images_count)
 {
    uint32_t width, height;
 
-   assert (objs->physical_device != VK_NULL_HANDLE);
-   assert (objs->device != VK_NULL_HANDLE);
-   assert (objs->surface != VK_NULL_HANDLE);
-
-   /* wait for all async ops on device */
-   vk.DeviceWaitIdle (objs->device);
+   assert (state->surface != VK_NULL_HANDLE);
 
    /* resolve swap image size */
    VkSurfaceCapabilitiesKHR surface_caps;
    vk.GetPhysicalDeviceSurfaceCapabilitiesKHR (objs->physical_device,
-                                               objs->surface,
+                                               state->surface,
                                                &surface_caps);
    config->surface_caps = surface_caps;
    printf ("Surface's image count (min, max): (%u, %u)\n",
@@ -453,8 +1855,9 @@ recreate_swapchain (struct vk_objects* objs,
            surface_caps.currentExtent.width,
            surface_caps.currentExtent.height);
 
-   width = surface_caps.currentExtent.width;
-   height = surface_caps.currentExtent.height;
+   VkExtent2D extent = get_surface_extent (state->window, &surface_caps);
+   width = extent.width;
+   height = extent.height;
 
    state->surface_extent.width = width;
    state->surface_extent.height = height;
@@ -477,7 +1880,7 @@ recreate_swapchain (struct vk_objects* objs,
 
    VkSwapchainCreateInfoKHR swapchain_info = {
       .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
-      .surface = objs->surface,
+      .surface = state->surface,
       .minImageCount = config->surface_caps.minImageCount,
       .imageFormat = config->surface_format.format,
       .imageColorSpace = config->surface_format.colorSpace,
@@ -494,39 +1897,77 @@ recreate_swapchain (struct vk_objects* objs,
       .oldSwapchain = state->previous_swapchain
    };
 
-   if (vk.CreateSwapchainKHR (objs->device,
-                              &swapchain_info,
-                              allocator,
-                              &swapchain) != VK_SUCCESS) {
-      printf ("Error: Failed to create a swap chain\n");
-      return false;
-   }
-   state->swapchain = swapchain;
-   printf ("Swap chain created\n");
+   if (vk.CreateSwapchainKHR (objs->device,
+                              &swapchain_info,
+                              allocator,
+                              &swapchain) != VK_SUCCESS) {
+      printf ("Error: Failed to create a swap chain\n");
+      return false;
+   }
+   state->swapchain = swapchain;
+   printf ("Swap chain created\n");
+
+   /* get the images from the swap chain */
+   if (vk.GetSwapchainImagesKHR (objs->device,
+                                 state->swapchain,
+                                 swapchain_images_count,
+                                 NULL) != VK_SUCCESS) {
+      printf ("Error: Failed to get the images from the swap chain\n");
+      return false;
+   }
+   if (*swapchain_images_count > MAX_SWAPCHAIN_IMAGES) {
+      printf ("Too many images in the swapchain. I can handle only %u\n",
+              *swapchain_images_count);
+      return false;
+   }
+   printf ("%u images in the swap chain\n", *swapchain_images_count);
+
+   vk.GetSwapchainImagesKHR (objs->device,
+                             state->swapchain,
+                             swapchain_images_count,
+                             swapchain_images);
+
+   return true;
+}
+
+static bool
+recreate_swapchain (struct vk_objects* objs,
+                    struct vk_config* config,
+                    struct vk_state* state)
+{
+   VkImage swapchain_images[MAX_SWAPCHAIN_IMAGES] = {VK_NULL_HANDLE,};
+   uint32_t swapchain_images_count = 0;
+
+   assert (objs->physical_device != VK_NULL_HANDLE);
+   assert (objs->device != VK_NULL_HANDLE);
+
+   /* wait for all async ops on device */
+   vk.DeviceWaitIdle (objs->device);
 
-   /* get the images from the swap chain */
-   uint32_t swapchain_images_count = 0;
-   if (vk.GetSwapchainImagesKHR (objs->device,
-                                 state->swapchain,
-                                 &swapchain_images_count,
-                                 NULL) != VK_SUCCESS) {
-      printf ("Error: Failed to get the images from the swap chain\n");
-      return false;
-   }
-   if (swapchain_images_count > MAX_SWAPCHAIN_IMAGES) {
-      printf ("Too many images in the swapchain. I can handle only %u\n",
-              swapchain_images_count);
+   /* MIT-SHM presents render to a single image of the window's size */
+   if (config->shm_present) {
+      wsi_get_size (state->window,
+                    &state->surface_extent.width,
+                    &state->surface_extent.height);
+      if (! create_offscreen_image (objs, config, state))
+         return false;
+
+      swapchain_images[0] = state->offscreen_image;
+      swapchain_images_count = 1;
+   } else if (! create_swapchain (objs,
+                                  config,
+                                  state,
+                                  swapchain_images,
+                                  &swapchain_images_count)) {
       return false;
    }
+   VkExtent2D swapchain_extent = state->surface_extent;
+
    uint32_t old_swapchain_images_count = state->swapchain_images_count;
    state->swapchain_images_count = swapchain_images_count;
-   printf ("%u images in the swap chain\n", swapchain_images_count);
 
-   VkImage swapchain_images[MAX_SWAPCHAIN_IMAGES] = {VK_NULL_HANDLE,};
-   vk.GetSwapchainImagesKHR (objs->device,
-                             state->swapchain,
-                             &swapchain_images_count,
-                             swapchain_images);
+   /* new images hold nothing yet, they can't be partially redrawn */
+   memset (state->image_drawn, 0, sizeof (state->image_drawn));
 
    /* destroy previous image views */
    for (uint32_t i = 0; i < old_swapchain_images_count; i++) {
@@ -569,9 +2010,11 @@ recreate_swapchain (struct vk_objects* objs,
    }
    printf ("Image views created\n");
 
-   /* create a new renderpass */
+   /* create new renderpasses */
    if (state->renderpass != VK_NULL_HANDLE)
       vk.DestroyRenderPass (objs->device, state->renderpass, allocator);
+   if (state->damage_renderpass != VK_NULL_HANDLE)
+      vk.DestroyRenderPass (objs->device, state->damage_renderpass, allocator);
    if (! create_renderpass (objs, config, state))
       return false;
 
@@ -614,19 +2057,22 @@ recreate_swapchain (struct vk_objects* objs,
    }
    printf ("Framebuffers created\n");
 
-   /* destroy any previous pipeline */
+   /* destroy any previous pipelines */
    if (state->pipeline != VK_NULL_HANDLE)
       vk.DestroyPipeline (objs->device, state->pipeline, allocator);
+   if (state->switch_pipeline != VK_NULL_HANDLE)
+      vk.DestroyPipeline (objs->device, state->switch_pipeline, allocator);
 
    /* create a new pipeline */
    if (! create_pipeline (objs, config, state))
       return false;
 
    /* free any previous command buffers */
-   vk.FreeCommandBuffers (objs->device,
-                          objs->cmd_pool,
-                          old_swapchain_images_count,
-                          state->cmd_buffers);
+   if (state->cmd_buffers_count > 0)
+      vk.FreeCommandBuffers (objs->device,
+                             objs->cmd_pool,
+                             state->cmd_buffers_count,
+                             state->cmd_buffers);
 
    /* create new command buffers */
    if (! create_command_buffers (objs, config, state))
@@ -635,92 +2081,771 @@ recreate_swapchain (struct vk_objects* objs,
    return true;
 }
 
+/* Records into the damage command buffer a redraw of only 'rects' (within
+ * the surface) of swapchain image 'image', timed if 'ts' isn't NULL.
+ */
 static bool
-draw_frame (struct vk_objects* objs, struct vk_state* state)
+record_damage (struct vk_objects* objs,
+               struct vk_state* state,
+               uint32_t image,
+               const VkRect2D* rects,
+               uint32_t rects_count,
+               struct vk_timestamps* ts)
 {
-   VkResult result;
+   VkCommandBuffer cmd_buffer = state->damage_cmd_buffer;
 
-   /* acquire swapchain's next image */
-   uint32_t image_index;
-   result = vk.AcquireNextImageKHR (objs->device,
-                                    state->swapchain,
-                                    1000000,
-                                    objs->image_available_semaphore,
-                                    VK_NULL_HANDLE,
-                                    &image_index);
-   if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
-      expose = true;
-      return true;
-   } else if (result != VK_SUCCESS) {
-      printf ("Error: Failed to acquire next image from swap chain\n");
+   VkCommandBufferBeginInfo begin_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+      .pInheritanceInfo = NULL
+   };
+   if (vk.BeginCommandBuffer (cmd_buffer, &begin_info) != VK_SUCCESS) {
+      printf ("Error: Failed to begin recording of command buffer\n");
       return false;
    }
 
-   /* submit graphics queue */
-   VkSemaphore wait_semaphores[] = {objs->image_available_semaphore};
-   VkSemaphore signal_semaphores[] = {objs->render_finished_semaphore};
-
-   VkPipelineStageFlags wait_stages[] =
-      {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+   /* the render area bounds all rectangles */
+   int32_t x0 = rects[0].offset.x, y0 = rects[0].offset.y;
+   int32_t x1 = x0 + rects[0].extent.width, y1 = y0 + rects[0].extent.height;
+   for (uint32_t i = 1; i < rects_count; i++) {
+      const VkRect2D* r = &rects[i];
+
+      x0 = r->offset.x < x0 ? r->offset.x : x0;
+      y0 = r->offset.y < y0 ? r->offset.y : y0;
+      if (r->offset.x + (int32_t) r->extent.width > x1)
+         x1 = r->offset.x + r->extent.width;
+      if (r->offset.y + (int32_t) r->extent.height > y1)
+         y1 = r->offset.y + r->extent.height;
+   }
 
-   VkSubmitInfo submit_info = {
-      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-      .waitSemaphoreCount = 1,
-      .pWaitSemaphores = wait_semaphores,
-      .pWaitDstStageMask = wait_stages,
-      .commandBufferCount = 1,
-      .pCommandBuffers = &state->cmd_buffers[image_index],
-      .signalSemaphoreCount = 1,
-      .pSignalSemaphores = signal_semaphores
+   VkRenderPassBeginInfo renderpass_begin_info = {
+      .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+      .renderPass = state->damage_renderpass,
+      .framebuffer = state->framebuffers[image],
+      .renderArea.offset = {x0, y0},
+      .renderArea.extent = {x1 - x0, y1 - y0},
+      .clearValueCount = 0,
+      .pClearValues = NULL
+   };
+   uint32_t query = VK_TIMESTAMPS_NONE;
+   if (ts != NULL)
+      query = vk_timestamps_begin (ts, cmd_buffer, "redraw");
+
+   vk.CmdBeginRenderPass (cmd_buffer,
+                          &renderpass_begin_info,
+                          VK_SUBPASS_CONTENTS_INLINE);
+
+   vk.CmdBindPipeline (cmd_buffer,
+                       VK_PIPELINE_BIND_POINT_GRAPHICS,
+                       state->pipeline);
+
+   /* clear and redraw each rectangle, leaving the rest of the area alone */
+   VkClearAttachment clear = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .colorAttachment = 0,
+      .clearValue = clear_color
    };
+   for (uint32_t i = 0; i < rects_count; i++) {
+      VkClearRect clear_rect = {
+         .rect = rects[i],
+         .baseArrayLayer = 0,
+         .layerCount = 1
+      };
+      vk.CmdClearAttachments (cmd_buffer, 1, &clear, 1, &clear_rect);
+
+      vk.CmdSetScissor (cmd_buffer, 0, 1, &rects[i]);
+      vk.CmdDraw (cmd_buffer, 3, 1, 0, 0);
+   }
+
+   vk.CmdEndRenderPass (cmd_buffer);
+
+   if (ts != NULL)
+      vk_timestamps_end (ts, cmd_buffer, query);
+
+   if (config.shm_present) {
+      if (ts != NULL)
+         query = vk_timestamps_begin (ts, cmd_buffer, "readback");
 
-   if (vk.QueueSubmit (objs->graphics_queue,
-                       1,
-                       &submit_info,
-                       VK_NULL_HANDLE) != VK_SUCCESS) {
-      printf ("Error: Failed to submit queue\n");
+      record_readback (cmd_buffer, state, rects, rects_count);
+
+      if (ts != NULL)
+         vk_timestamps_end (ts, cmd_buffer, query);
+   }
+
+   if (vk.EndCommandBuffer (cmd_buffer) != VK_SUCCESS) {
+      printf ("Error: Failed to record command buffer\n");
       return false;
    }
 
-   /* present the frame */
-   VkSwapchainKHR swapchains[] = {state->swapchain};
-   VkPresentInfoKHR present_info = {
-      .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-      .waitSemaphoreCount = 1,
-      .pWaitSemaphores = signal_semaphores,
-      .swapchainCount = 1,
-      .pSwapchains = swapchains,
-      .pImageIndices = &image_index,
-      .pResults = NULL
-   };
+   return true;
+}
+
+/* Puts the frame just rendered in the window through the image shared with
+ * the X server: only 'rects' of it, or all of it if 'rects_count' is 0. The
+ * frame fence must be signaled already.
+ */
+static bool
+present_shm (struct vk_state* state,
+             const VkRect2D* rects,
+             uint32_t rects_count)
+{
+   struct wsi_shm_image* image = &state->shm_image;
+   uint32_t src_stride = state->surface_extent.width * 4;
+   VkRect2D whole = {{0, 0}, state->surface_extent};
+   struct wsi_rect shm_rects[WSI_MAX_DAMAGE_RECTS];
+
+   if (rects_count == 0) {
+      rects = &whole;
+      rects_count = 1;
+   }
+
+   for (uint32_t i = 0; i < rects_count; i++) {
+      const VkRect2D* r = &rects[i];
+      const uint8_t* src = state->readback_data +
+         (size_t) r->offset.y * src_stride + r->offset.x * 4;
+      uint8_t* dst = (uint8_t*) image->data +
+         (size_t) r->offset.y * image->stride + r->offset.x * 4;
+
+      for (uint32_t y = 0; y < r->extent.height; y++) {
+         memcpy (dst, src, r->extent.width * 4);
+         src += src_stride;
+         dst += image->stride;
+      }
+
+      shm_rects[i] = (struct wsi_rect) {
+         r->offset.x, r->offset.y, r->extent.width, r->extent.height
+      };
+   }
+
+   return wsi_shm_image_present (image, shm_rects, rects_count);
+}
+
+/* Accounts for the latency of 'input', drawn by a frame submitted at
+ * 'submit_time' and handed to the presentation engine (or put in the window)
+ * at 'present_time'. It shows up on screen later still, at best by the next
+ * vertical blank.
+ */
+static void
+record_input_latency (const struct wsi_input_event* input,
+                      uint64_t submit_time,
+                      uint64_t present_time)
+{
+   uint64_t to_submit = submit_time - input->receipt_time;
+   uint64_t to_present = present_time - input->receipt_time;
+
+   input_latency.count++;
+   input_latency.to_submit += to_submit;
+   input_latency.to_present += to_present;
+   if (to_present > input_latency.to_present_max)
+      input_latency.to_present_max = to_present;
+}
+
+/* Draws a frame in every window that needs one: all of it if animating, or
+ * only what was exposed since the last one. Their command buffers go in a
+ * single submit, and their swapchains in a single present.
+ */
+static bool
+draw_frame (struct vk_objects* objs,
+            struct vk_state* windows,
+            uint32_t windows_count)
+{
+   VkResult result;
+   uint64_t start = wsi_get_time ();
+
+   /* one frame in flight: the previous one must be done with the semaphores
+    * (and the N-body buffers) before they are reused
+    */
+   vk.WaitForFences (objs->device, 1, &objs->frame_fence, VK_TRUE, UINT64_MAX);
+
+   /* with '-t', command buffers are recorded for each frame, to write its
+    * own timestamp queries, which are reset first
+    */
+   struct vk_timestamps* ts = gpu_timing ? &timestamps : NULL;
+   VkCommandBuffer timestamps_reset = VK_NULL_HANDLE;
+   if (ts != NULL)
+      timestamps_reset = vk_timestamps_begin_frame (ts);
+
+   /* traced as of the frame recorded, and in CPU time for GPU regions */
+   uint64_t frame = timestamps.frames_begun - 1;
+   trace_cpu ("wait", frame, start);
+
+   /* calibrated as the window traced starts, and again as it ends for its
+    * last frames, read back after it, rather than at a cost to every frame
+    */
+   if (trace.file != NULL && config.calibrated_timestamps &&
+       (frame == trace_first_frame ||
+        frame == trace_first_frame + trace_frames))
+      vk_timestamps_calibrate (&timestamps);
+
+   /* the windows drawn, and what each one adds to the submit and present */
+   struct vk_state* drawn[WSI_MAX_WINDOWS];
+   uint32_t drawn_count = 0;
+   VkCommandBuffer cmd_buffers[WSI_MAX_WINDOWS];
+   VkSemaphore wait_semaphores[WSI_MAX_WINDOWS];
+   VkSemaphore signal_semaphores[WSI_MAX_WINDOWS];
+   VkSwapchainKHR swapchains[WSI_MAX_WINDOWS];
+   uint32_t image_indices[WSI_MAX_WINDOWS];
+   VkRect2D rects[WSI_MAX_WINDOWS][WSI_MAX_DAMAGE_RECTS];
+   VkRectLayerKHR present_rects[WSI_MAX_WINDOWS][WSI_MAX_DAMAGE_RECTS];
+   VkPresentRegionKHR present_regions[WSI_MAX_WINDOWS];
+   uint32_t rects_total = 0;
+
+   for (uint32_t w = 0; w < windows_count; w++) {
+      struct vk_state* state = &windows[w];
+
+      if (! state->damaged)
+         continue;
+
+      /* the N-body simulation (and '-d') redraws continuously (or at frame
+       * deadlines), and entirely
+       */
+      state->damaged = animated () && frame_interval == 0;
+      const struct wsi_rect* damage = state->damage;
+      uint32_t damage_count = animated () ? 0 : state->damage_count;
+
+      /* acquire swapchain's next image, MIT-SHM presents only have one */
+      uint32_t image_index = 0;
+      if (! config.shm_present) {
+         start = wsi_get_time ();
+         result = vk.AcquireNextImageKHR (objs->device,
+                                          state->swapchain,
+                                          1000000,
+                                          state->image_available_semaphore,
+                                          VK_NULL_HANDLE,
+                                          &image_index);
+         trace_cpu ("acquire", frame, start);
+         if (result == VK_ERROR_OUT_OF_DATE_KHR ||
+             result == VK_SUBOPTIMAL_KHR) {
+            state->expose = true;
+            continue;
+         } else if (result == VK_TIMEOUT || result == VK_NOT_READY) {
+            /* no image yet, try again */
+            state->damaged = true;
+            continue;
+         } else if (result != VK_SUCCESS) {
+            printf ("Error: Failed to acquire next image from swap chain\n");
+            return false;
+         }
+      }
+
+      /* clip the damage to the surface, dropping empty rectangles */
+      VkRect2D* window_rects = rects[drawn_count];
+      VkRectLayerKHR* window_present_rects = present_rects[drawn_count];
+      uint32_t rects_count = 0;
+      for (uint32_t i = 0; i < damage_count; i++) {
+         int32_t x0 = damage[i].x > 0 ? damage[i].x : 0;
+         int32_t y0 = damage[i].y > 0 ? damage[i].y : 0;
+         int32_t x1 = damage[i].x + (int32_t) damage[i].width;
+         int32_t y1 = damage[i].y + (int32_t) damage[i].height;
+
+         if (x1 > (int32_t) state->surface_extent.width)
+            x1 = state->surface_extent.width;
+         if (y1 > (int32_t) state->surface_extent.height)
+            y1 = state->surface_extent.height;
+         if (x1 <= x0 || y1 <= y0)
+            continue;
+
+         window_rects[rects_count] = (VkRect2D) {{x0, y0}, {x1 - x0, y1 - y0}};
+         window_present_rects[rects_count] = (VkRectLayerKHR) {
+            window_rects[rects_count].offset,
+            window_rects[rects_count].extent,
+            0
+         };
+         rects_count++;
+      }
+
+      /* redraw the damage only, unless the image misses the previous frame */
+      bool partial = rects_count > 0 && state->image_drawn[image_index];
+      VkCommandBuffer cmd_buffer;
+      start = wsi_get_time ();
+      if (partial) {
+         if (! record_damage (objs,
+                              state,
+                              image_index,
+                              window_rects,
+                              rects_count,
+                              ts))
+            return false;
+         cmd_buffer = state->damage_cmd_buffer;
+         rects_total += rects_count;
+      } else {
+         uint32_t j = nbody.parity * state->swapchain_images_count +
+            image_index;
+
+         /* the previous frame is done with it */
+         if (draw_bench.draws > 0) {
+            uint64_t start = wsi_get_time ();
+            uint32_t commands;
+
+            if (! record_command_buffer (&config, state, j, ts, &commands))
+               return false;
+            draw_bench.record_time += wsi_get_time () - start;
+            draw_bench.commands += commands;
+         } else if (ts != NULL) {
+            uint32_t commands;
+
+            if (! record_command_buffer (&config, state, j, ts, &commands))
+               return false;
+         }
+
+         cmd_buffer = state->cmd_buffers[j];
+         state->image_drawn[image_index] = true;
+         rects_count = 0;
+      }
+      trace_cpu ("record", frame, start);
+
+      /* 0 rectangles present the whole image */
+      present_regions[drawn_count] = (VkPresentRegionKHR) {
+         .rectangleCount = rects_count,
+         .pRectangles = window_present_rects
+      };
+
+      cmd_buffers[drawn_count] = cmd_buffer;
+      wait_semaphores[drawn_count] = state->image_available_semaphore;
+      signal_semaphores[drawn_count] = state->render_finished_semaphore;
+      swapchains[drawn_count] = state->swapchain;
+      image_indices[drawn_count] = image_index;
+      drawn[drawn_count++] = state;
+   }
 
-   result =  vk.QueuePresentKHR (objs->graphics_queue, &present_info);
-   if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
-      expose = true;
+   /* nothing to draw, the simulation waits too */
+   if (drawn_count == 0)
       return true;
-   } else if (result != VK_SUCCESS) {
-      printf ("Error: Failed to present the queue\n");
+
+   /* tag the frame with the latest input it shows */
+   struct wsi_input_event input = pending_input;
+   pending_input.id = 0;
+
+   start = wsi_get_time ();
+   if (ts != NULL && nbody.count > 0) {
+      if (! record_nbody_step_cmd_buffer (&nbody, nbody.parity, ts))
+         return false;
+      trace_cpu ("record", frame, start);
+   }
+
+   /* submit graphics queue, all windows at once: the simulation step first,
+    * then whatever other producers have, then the windows' draws
+    */
+   start = wsi_get_time ();
+   vk.ResetFences (objs->device, 1, &objs->frame_fence);
+   uint64_t submit_start = objs->submit.submit_time;
+
+   if (ts != NULL &&
+       ! vk_submit_add (&objs->submit,
+                        timestamps_reset,
+                        VK_NULL_HANDLE,
+                        0,
+                        VK_NULL_HANDLE))
+      return false;
+
+   if (nbody.count > 0 &&
+       ! vk_submit_add (&objs->submit,
+                        nbody.step_cmd_buffers[nbody.parity],
+                        VK_NULL_HANDLE,
+                        0,
+                        VK_NULL_HANDLE))
+      return false;
+
+   for (uint32_t i = 0; i < submit_bench.count; i++) {
+      if (! vk_submit_add (&objs->submit,
+                           submit_bench.cmd_buffers[i],
+                           VK_NULL_HANDLE,
+                           0,
+                           VK_NULL_HANDLE))
+         return false;
+   }
+
+   for (uint32_t i = 0; i < drawn_count; i++) {
+      if (! vk_submit_add (&objs->submit,
+                           cmd_buffers[i],
+                           config.shm_present ?
+                              VK_NULL_HANDLE : wait_semaphores[i],
+                           VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                           config.shm_present ?
+                              VK_NULL_HANDLE : signal_semaphores[i]))
+         return false;
+   }
+
+   if (! vk_submit_flush (&objs->submit, objs->frame_fence))
       return false;
+   uint64_t submit_time = wsi_get_time ();
+   trace_cpu ("submit", frame, start);
+
+   if (draw_bench.draws > 0) {
+      draw_bench.submit_time += objs->submit.submit_time - submit_start;
+      draw_bench.frames++;
+   }
+   submit_bench.frames++;
+
+   /* the next step reads what this one wrote */
+   if (nbody.count > 0)
+      nbody.parity ^= 1;
+
+   if (config.shm_present) {
+      /* the readbacks are done with the frame */
+      start = wsi_get_time ();
+      vk.WaitForFences (objs->device,
+                        1,
+                        &objs->frame_fence,
+                        VK_TRUE,
+                        UINT64_MAX);
+      trace_cpu ("wait", frame, start);
+
+      start = wsi_get_time ();
+      for (uint32_t i = 0; i < drawn_count; i++) {
+         if (! present_shm (drawn[i],
+                            rects[i],
+                            present_regions[i].rectangleCount))
+            return false;
+      }
+      trace_cpu ("present", frame, start);
+   } else {
+      /* present the frame, telling the compositor what changed if it cares */
+      VkPresentRegionsKHR regions = {
+         .sType = VK_STRUCTURE_TYPE_PRESENT_REGIONS_KHR,
+         .swapchainCount = drawn_count,
+         .pRegions = present_regions
+      };
+
+      VkResult results[WSI_MAX_WINDOWS];
+      VkPresentInfoKHR present_info = {
+         .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+         .pNext = rects_total > 0 && config.incremental_present ?
+            &regions : NULL,
+         .waitSemaphoreCount = drawn_count,
+         .pWaitSemaphores = signal_semaphores,
+         .swapchainCount = drawn_count,
+         .pSwapchains = swapchains,
+         .pImageIndices = image_indices,
+         .pResults = results
+      };
+
+      start = wsi_get_time ();
+      result = vk.QueuePresentKHR (objs->graphics_queue, &present_info);
+      trace_cpu ("present", frame, start);
+      if (result != VK_SUCCESS &&
+          result != VK_ERROR_OUT_OF_DATE_KHR &&
+          result != VK_SUBOPTIMAL_KHR) {
+         printf ("Error: Failed to present the queue\n");
+         return false;
+      }
+
+      /* the swapchains that no longer fit their window are recreated */
+      for (uint32_t i = 0; i < drawn_count; i++) {
+         if (results[i] == VK_ERROR_OUT_OF_DATE_KHR ||
+             results[i] == VK_SUBOPTIMAL_KHR)
+            drawn[i]->expose = true;
+      }
+   }
+
+   if (drawn_count > 1 && rects_total > 0)
+      printf ("Frame! (%u windows, %u rectangles)\n", drawn_count, rects_total);
+   else if (drawn_count > 1)
+      printf ("Frame! (%u windows)\n", drawn_count);
+   else if (rects_total > 0)
+      printf ("Frame! (%u rectangles)\n", rects_total);
+   else
+      printf ("Frame!\n");
+
+   if (input.id != 0)
+      record_input_latency (&input, submit_time, wsi_get_time ());
+
+   return true;
+}
+
+/* True if the surface no longer has the size of the swapchain */
+static bool
+window_resized (struct vk_objects* objs, struct vk_state* state)
+{
+   VkSurfaceCapabilitiesKHR surface_caps;
+   VkExtent2D extent;
+
+   if (config.shm_present) {
+      wsi_get_size (state->window, &extent.width, &extent.height);
+   } else {
+      vk.GetPhysicalDeviceSurfaceCapabilitiesKHR (objs->physical_device,
+                                                  state->surface,
+                                                  &surface_caps);
+      extent = get_surface_extent (state->window, &surface_caps);
+   }
+
+   return extent.width != state->surface_extent.width ||
+      extent.height != state->surface_extent.height;
+}
+
+/* Prints the frame rate about every second, e.g. to compare presents through
+ * a swapchain and through MIT-SHM while animating, or the cost of more
+ * windows, and the latency of the inputs drawn meanwhile. 'cpu_time' is how
+ * long the frame just drawn took to submit and present, in nanoseconds. The
+ * 'last' call, once no more frames come, reports what is left.
+ */
+static void
+report_frame_rate (uint64_t cpu_time, bool last)
+{
+   static struct timespec start = {0, 0};
+   static uint32_t frames = 0;
+   static uint64_t frames_cpu_time = 0;
+   struct timespec now;
+
+   clock_gettime (CLOCK_MONOTONIC, &now);
+   if (! last) {
+      if (frames++ == 0) {
+         start = now;
+         return;
+      }
+      frames_cpu_time += cpu_time;
+   }
+
+   double elapsed = (now.tv_sec - start.tv_sec) +
+      (now.tv_nsec - start.tv_nsec) / 1e9;
+   if (frames < 2 || (elapsed < 1.0 && ! last))
+      return;
+
+   printf ("%u frames in %.2f s: %.1f fps, %.3f ms per frame (%s)\n",
+           frames - 1,
+           elapsed,
+           (frames - 1) / elapsed,
+           1e3 * elapsed / (frames - 1),
+           config.shm_present ? "MIT-SHM" : "swapchain");
+   printf ("%u windows: %.3f ms of CPU per frame, %.3f ms per window\n",
+           windows_count,
+           frames_cpu_time / 1e6 / (frames - 1),
+           frames_cpu_time / 1e6 / (frames - 1) / windows_count);
+
+   if (frame_interval > 0) {
+      printf ("%lu frame deadlines missed\n", (unsigned long) frames_missed);
+      frames_missed = 0;
+   }
+
+   if (submit_bench.count > 0 && objs.submit.submits > 0) {
+      printf ("%.1f command buffers in %.1f submits per frame: %.3f us per "
+              "submit, %.3f us per command buffer\n",
+              (double) objs.submit.cmd_buffers_submitted / submit_bench.frames,
+              (double) objs.submit.submits / submit_bench.frames,
+              objs.submit.submit_time / 1e3 / objs.submit.submits,
+              objs.submit.submit_time / 1e3 /
+              objs.submit.cmd_buffers_submitted);
+      submit_bench.frames = 0;
+      objs.submit.submits = 0;
+      objs.submit.cmd_buffers_submitted = 0;
+      objs.submit.submit_time = 0;
+   }
+
+   if (draw_bench.frames > 0 && draw_bench.commands > 0) {
+      printf ("%lu commands per frame: %.1f ns per command to record, "
+              "%.1f ns to submit (%.3f ms and %.3f ms per frame)\n",
+              (unsigned long) (draw_bench.commands / draw_bench.frames),
+              (double) draw_bench.record_time / draw_bench.commands,
+              (double) draw_bench.submit_time / draw_bench.commands,
+              draw_bench.record_time / 1e6 / draw_bench.frames,
+              draw_bench.submit_time / 1e6 / draw_bench.frames);
+      draw_bench.frames = 0;
+      draw_bench.commands = 0;
+      draw_bench.record_time = 0;
+      draw_bench.submit_time = 0;
+   }
+
+   if (gpu_timing)
+      vk_timestamps_report (&timestamps);
+
+   if (input_latency.count > 0) {
+      printf ("%u inputs: %.3f ms to submit, %.3f ms to present on average, "
+              "%.3f ms at most\n",
+              input_latency.count,
+              input_latency.to_submit / 1e6 / input_latency.count,
+              input_latency.to_present / 1e6 / input_latency.count,
+              input_latency.to_present_max / 1e6);
+      memset (&input_latency, 0, sizeof (input_latency));
+   }
+
+   start = now;
+   frames = 1;
+   frames_cpu_time = 0;
+}
+
+/* Handles window system events, traced as of the next frame */
+static bool
+handle_events (void)
+{
+   uint64_t start = wsi_get_time ();
+   bool result = wsi_poll_events ();
+
+   trace_cpu ("events", timestamps.frames_begun, start);
+
+   return result;
+}
+
+static bool
+on_wsi_events (void* data)
+{
+   bool result = handle_events ();
+
+   /* the fd may be gone, and stay readable (e.g. a hung up terminal) */
+   if (wsi_get_fd () != wsi_fd) {
+      event_loop_remove_fd (&loop, wsi_fd);
+      wsi_fd = -1;
    }
 
-   printf ("Frame!\n");
+   return result;
+}
+
+/* A frame deadline: every window gets the next animation frame */
+static bool
+on_frame_timer (void* data)
+{
+   frames_missed += loop.timer_expirations - 1;
+
+   for (uint32_t i = 0; i < windows_count; i++)
+      windows[i].damaged = true;
 
    return true;
 }
 
+static bool
+on_wake (void* data)
+{
+   /* only Ctrl+C wakes the loop up for now */
+   return running;
+}
+
+static void
+wsi_on_expose (uint32_t window)
+{
+   /* what was exposed is collected by wsi_get_damage() */
+   windows[window].damaged = true;
+}
+
+static void
+wsi_on_input (const struct wsi_input_event* event)
+{
+   /* a whole frame answers input, and only the latest input is measured */
+   pending_input = *event;
+   windows[event->window].damaged = true;
+}
+
 static void
-wsi_on_expose (void)
+print_usage (const char* name)
 {
-   expose = true;
-   damaged = true;
+   printf ("Usage: %s [options]\n"
+           "  -b <name> window system backend: xcb, wayland, display or null\n"
+           "            (default: $WSI_BACKEND, or whichever server is\n"
+           "            running, otherwise display)\n"
+           "  -c <n>[,<batch>] animate, submitting <n> more command buffers\n"
+           "          per frame, at most <batch> per vkQueueSubmit()\n"
+           "          (default: 0, as many as fit), and report the CPU time\n"
+           "          per submit\n"
+           "  -d <draws>[,<p>[,<r>]] animate <draws> draws of the triangle\n"
+           "          per frame, binding another pipeline every <p> draws and\n"
+           "          starting another render pass every <r> draws (default:\n"
+           "          0, never), and report the CPU time per command\n"
+           "  -n <n>  animate an N-body simulation of <n> bodies, instead of\n"
+           "          the triangle (max: %u)\n"
+           "  -p      with -t, count the vertex, primitive, fragment and\n"
+           "          compute invocations of each pass too\n"
+           "  -r <fps> with -c, -d or -n, animate at <fps> frames per second\n"
+           "          on timer deadlines (default: as fast as presents go)\n"
+           "  -s      read frames back and put them in the window through\n"
+           "          MIT-SHM, instead of presenting a swapchain (XCB only)\n"
+           "  -t      time the passes of every frame on the GPU, and report\n"
+           "          their histograms at exit\n"
+           "  -T <file>[,<first>[,<n>]] with -t, write a Chrome trace of\n"
+           "          what the CPU and the GPU did for <n> frames from\n"
+           "          <first> (default: 0, %u)\n"
+           "  -w <n>  open <n> windows, drawn and presented together\n"
+           "          (XCB only, max: %u)\n",
+           name,
+           NBODY_MAX_BODIES,
+           TRACE_FRAMES,
+           WSI_MAX_WINDOWS);
 }
 
 int32_t
 main (int32_t argc, char* argv[])
 {
-   /* XCB setup */
+   int opt;
+
+   while ((opt = getopt (argc, argv, "n:b:c:d:pr:stT:w:h")) != -1) {
+      switch (opt) {
+      case 'b':
+         if (! wsi_select_backend (optarg))
+            return -1;
+         break;
+      case 'c':
+         sscanf (optarg, "%u,%u", &submit_bench.count, &submit_bench.batch);
+         break;
+      case 'd':
+         sscanf (optarg,
+                 "%u,%u,%u",
+                 &draw_bench.draws,
+                 &draw_bench.pipeline_period,
+                 &draw_bench.renderpass_period);
+         break;
+      case 'n':
+         nbody.count = atoi (optarg);
+         break;
+      case 'p':
+         gpu_timing = true;
+         gpu_statistics = true;
+         break;
+      case 'r':
+         if (atoi (optarg) > 0)
+            frame_interval = 1000000000 / atoi (optarg);
+         break;
+      case 's':
+         config.shm_present = true;
+         break;
+      case 't':
+         gpu_timing = true;
+         break;
+      case 'T':
+         sscanf (optarg,
+                 "%255[^,],%lu,%lu",
+                 trace_path,
+                 &trace_first_frame,
+                 &trace_frames);
+         gpu_timing = true;
+         break;
+      case 'w':
+         windows_count = atoi (optarg);
+         break;
+      default:
+         print_usage (argv[0]);
+         return opt == 'h' ? 0 : -1;
+      }
+   }
+   if (nbody.count > NBODY_MAX_BODIES ||
+       (nbody.count > 0 && draw_bench.draws > 0) ||
+       windows_count < 1 || windows_count > WSI_MAX_WINDOWS) {
+      print_usage (argv[0]);
+      return -1;
+   }
+
+   /* WSI setup */
    /* ======================================================================= */
-   wsi_init (NULL, WIDTH, HEIGHT, wsi_on_expose);
+   if (! wsi_init (NULL, WIDTH, HEIGHT, wsi_on_expose))
+      return -1;
+   wsi_set_input_callback (wsi_on_input);
+
+   for (uint32_t i = 1; i < windows_count; i++) {
+      if (! wsi_create_window (NULL, WIDTH, HEIGHT, &windows[i].window)) {
+         wsi_finish ();
+         return -1;
+      }
+   }
+
+   /* wait on the window system along with frame deadlines and wakeups */
+   wsi_fd = wsi_get_fd ();
+   if (! event_loop_init (&loop) ||
+       (wsi_fd != -1 &&
+        ! event_loop_add_fd (&loop, wsi_fd, on_wsi_events, NULL))) {
+      wsi_finish ();
+      return -1;
+   }
+   event_loop_set_wake (&loop, on_wake, NULL);
+
+   /* with no window system, frames go to the null backend's images */
+   if (wsi_get_platform () == WSI_PLATFORM_NULL)
+      config.shm_present = true;
 
    /* Vulkan setup */
    /* ======================================================================= */
@@ -740,8 +2865,8 @@ main (int32_t argc, char* argv[])
    }
 
    /* enummerate supported instance extensions */
-   VkExtensionProperties ext_props[16];
-   uint32_t ext_props_count = 16;
+   VkExtensionProperties ext_props[MAX_EXTENSIONS];
+   uint32_t ext_props_count = MAX_EXTENSIONS;
    if (vk.EnumerateInstanceExtensionProperties (NULL,
                                                 &ext_props_count,
                                                 ext_props) != VK_SUCCESS) {
@@ -770,13 +2895,30 @@ main (int32_t argc, char* argv[])
 
    const char* enabled_extensions[2] = {
       VK_KHR_SURFACE_EXTENSION_NAME,
-      VK_KHR_XCB_SURFACE_EXTENSION_NAME
+      NULL
    };
+   switch (wsi_get_platform ()) {
+#ifdef VK_USE_PLATFORM_XCB_KHR
+   case WSI_PLATFORM_XCB:
+      enabled_extensions[1] = VK_KHR_XCB_SURFACE_EXTENSION_NAME;
+      break;
+#endif
+#ifdef VK_USE_PLATFORM_WAYLAND_KHR
+   case WSI_PLATFORM_WAYLAND:
+      enabled_extensions[1] = VK_KHR_WAYLAND_SURFACE_EXTENSION_NAME;
+      break;
+#endif
+   case WSI_PLATFORM_DISPLAY:
+      enabled_extensions[1] = VK_KHR_DISPLAY_EXTENSION_NAME;
+      break;
+   default:
+      break;
+   }
 
    VkInstanceCreateInfo instance_info = {
       .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
       .pApplicationInfo = &app_info,
-      .enabledExtensionCount = 2,
+      .enabledExtensionCount = enabled_extensions[1] != NULL ? 2 : 1,
       .ppEnabledExtensionNames = enabled_extensions,
    };
    if (vk.CreateInstance (&instance_info,
@@ -810,6 +2952,17 @@ main (int32_t argc, char* argv[])
    vk.GetPhysicalDeviceProperties (physical_device, &physical_device_props);
    printf ("Physical device: %s\n", physical_device_props.deviceName);
 
+   /* the only optional feature used */
+   VkPhysicalDeviceFeatures features;
+   vk.GetPhysicalDeviceFeatures (physical_device, &features);
+   if (gpu_statistics && ! features.pipelineStatisticsQuery) {
+      printf ("Error: Physical device doesn't support pipeline statistics\n");
+      goto free_stuff;
+   }
+   VkPhysicalDeviceFeatures enabled_features = {
+      .pipelineStatisticsQuery = gpu_statistics
+   };
+
    /* query physical device's queue families */
 #define NUM_QUEUE_FAMILIES 5
    uint32_t num_queue_families = NUM_QUEUE_FAMILIES;
@@ -831,8 +2984,16 @@ main (int32_t argc, char* argv[])
    }
    uint32_t queue_family_index = 0;
 
+   /* N-body steps are dispatched on the graphics queue */
+   if (nbody.count > 0 &&
+       ! (queue_families[queue_family_index].queueFlags &
+          VK_QUEUE_COMPUTE_BIT)) {
+      printf ("Error: Queue family doesn't support compute\n");
+      goto free_stuff;
+   }
+
    /* Enummerate supported device extensions */
-   ext_props_count = 16;
+   ext_props_count = MAX_EXTENSIONS;
    if (vk.EnumerateDeviceExtensionProperties (physical_device,
                                               NULL,
                                               &ext_props_count,
@@ -841,44 +3002,48 @@ main (int32_t argc, char* argv[])
       return -1;
    }
    printf ("Device extensions: \n");
-   for (unsigned i = 0; i < ext_props_count; i++)
+   for (unsigned i = 0; i < ext_props_count; i++) {
       printf ("   %s(%u)\n",
               ext_props[i].extensionName,
               ext_props[i].specVersion);
 
-   /* create a vulkan surface, from the XCB window (VkSurfaceKHR) */
-   xcb_window_t* xcb_win = 0;
-   xcb_connection_t* xcb_conn = NULL;
-   wsi_get_connection_and_window ((const void**) &xcb_conn,
-                                  (const void**) &xcb_win);
-
-   VkSurfaceKHR surface = VK_NULL_HANDLE;
-   VkXcbSurfaceCreateInfoKHR surface_info = {
-      .sType = VK_STRUCTURE_TYPE_XCB_SURFACE_CREATE_INFO_KHR,
-      .connection = xcb_conn,
-      .window = *xcb_win,
-   };
-   if (vk.CreateXcbSurfaceKHR (instance,
-                               &surface_info,
-                               allocator,
-                               &surface) != VK_SUCCESS) {
-      printf ("Error: Failed to create a vulkan surface from an XCB window\n ");
-      goto free_stuff;
+      if (strcmp (ext_props[i].extensionName,
+                  VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME) == 0)
+         config.incremental_present = true;
+      else if (strcmp (ext_props[i].extensionName,
+                       VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME) == 0)
+         config.calibrated_timestamps = trace_path[0] != '\0' &&
+            supports_calibration (physical_device);
    }
-   objs.surface = surface;
-   printf ("Vulkan surface created from the XCB window\n");
-
-   /* check for present support in the selected queue family */
-   VkBool32 support_present = VK_FALSE;
-   vk.GetPhysicalDeviceSurfaceSupportKHR (physical_device,
-                                          queue_family_index,
-                                          surface,
-                                          &support_present);
-   if (support_present) {
-      printf ("Queue family supports presentation\n");
-   } else {
-      printf ("Queue family doesn't support presentation\n");
-      goto free_stuff;
+
+   /* create a vulkan surface, from each window (VkSurfaceKHR), unless frames
+    * are put in the windows through MIT-SHM instead
+    */
+   for (uint32_t i = 0; i < windows_count && ! config.shm_present; i++) {
+      VkSurfaceKHR surface = VK_NULL_HANDLE;
+
+      if (! create_surface (instance,
+                            physical_device,
+                            windows[i].window,
+                            &surface)) {
+         printf ("Error: Failed to create a vulkan surface from the window\n");
+         goto free_stuff;
+      }
+      windows[i].surface = surface;
+      printf ("Vulkan surface created from window %u\n", i);
+
+      /* check for present support in the selected queue family */
+      VkBool32 support_present = VK_FALSE;
+      vk.GetPhysicalDeviceSurfaceSupportKHR (physical_device,
+                                             queue_family_index,
+                                             surface,
+                                             &support_present);
+      if (support_present) {
+         printf ("Queue family supports presentation\n");
+      } else {
+         printf ("Queue family doesn't support presentation\n");
+         goto free_stuff;
+      }
    }
 
    /* create logical device */
@@ -893,14 +3058,27 @@ main (int32_t argc, char* argv[])
       .queueFamilyIndex = queue_family_index
    };
 
-   const char* device_extensions[1] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+   /* partial redraws are presented as such where supported, and GPU times
+    * calibrated to trace them
+    */
+   const char* device_extensions[3] = {
+      VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+   };
+   uint32_t device_extensions_count = 1;
+   if (config.incremental_present)
+      device_extensions[device_extensions_count++] =
+         VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME;
+   if (config.calibrated_timestamps)
+      device_extensions[device_extensions_count++] =
+         VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME;
 
    VkDeviceCreateInfo device_info = {
       .sType =  VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
       .pQueueCreateInfos = &queue_info,
       .queueCreateInfoCount = 1,
-      .enabledExtensionCount = 1,
+      .enabledExtensionCount = device_extensions_count,
       .ppEnabledExtensionNames = device_extensions,
+      .pEnabledFeatures = &enabled_features
    };
    if (vk.CreateDevice (devices[0],
                         &device_info,
@@ -912,53 +3090,39 @@ main (int32_t argc, char* argv[])
    objs.device = device;
    printf ("Logical device created\n");
 
-   /* choose a surface format */
-   uint32_t surface_formats_count = 0;
-   vk.GetPhysicalDeviceSurfaceFormatsKHR (physical_device,
-                                          surface,
-                                          &surface_formats_count,
-                                          NULL);
-   printf ("Found %u surface format(s). Choosing first.\n", surface_formats_count);
-   if (surface_formats_count == 0) {
-      printf ("Error: No suitable surface format found\n");
-      goto free_stuff;
-   }
-   surface_formats_count = 1;
-   VkSurfaceFormatKHR surface_format;
-   vk.GetPhysicalDeviceSurfaceFormatsKHR (physical_device,
-                                          surface,
-                                          &surface_formats_count,
-                                          &surface_format);
-   config.surface_format = surface_format;
-
-   /* choose a present mode */
-   uint32_t present_mode_count = 0;
-   vk.GetPhysicalDeviceSurfacePresentModesKHR (physical_device,
-                                               surface,
-                                               &present_mode_count,
-                                               NULL);
-   printf ("Found %u present mode(s). Choosing first.\n", present_mode_count);
-   if (present_mode_count == 0) {
-      printf ("Error: No suitable present modes found\n");
-      goto free_stuff;
+   if (config.shm_present) {
+      /* the layout of 32-bit X pixels, in little endian */
+      config.surface_format = (VkSurfaceFormatKHR) {
+         VK_FORMAT_B8G8R8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR
+      };
+   } else {
+      /* choose a surface format and present mode, all windows are on the
+       * same screen
+       */
+      if (! choose_surface_format (physical_device,
+                                   windows[0].surface,
+                                   &config.surface_format) ||
+          ! choose_present_mode (physical_device,
+                                 windows[0].surface,
+                                 &config.present_mode))
+         goto free_stuff;
    }
-   present_mode_count = 1;
-   VkPresentModeKHR present_mode;
-   vk.GetPhysicalDeviceSurfacePresentModesKHR (physical_device,
-                                               surface,
-                                               &present_mode_count,
-                                               &present_mode);
-   config.present_mode = present_mode;
 
    /* load device-dependent API entry points */
    vk_api_load_from_device (&vk, &device);
 
+   /* N-body points are drawn by their own pair of shaders */
+   const char* vert_spv = nbody.count > 0 ? "points-vert.spv" : "vert.spv";
+   const char* frag_spv = nbody.count > 0 ? "points-frag.spv" : "frag.spv";
+   char spv_path[256];
+
    /* create the vertex shader module */
    size_t shader_code_size;
-   uint32_t* shader_code = load_file (CURRENT_DIR "/vert.spv",
-                                      &shader_code_size);
+   snprintf (spv_path, sizeof (spv_path), "%s/%s", CURRENT_DIR, vert_spv);
+   uint32_t* shader_code = load_file (spv_path, &shader_code_size);
    if (shader_code == NULL) {
-      printf ("Error: Failed to load vertex shader code from 'vert.spv'\n");
+      printf ("Error: Failed to load vertex shader code from '%s'\n",
+              vert_spv);
       goto free_stuff;
    }
 
@@ -979,10 +3143,11 @@ main (int32_t argc, char* argv[])
    printf ("Vertex shader created\n");
 
    /* create the fragment shader module */
-   shader_code = load_file (CURRENT_DIR "/frag.spv",
-                            &shader_code_size);
+   snprintf (spv_path, sizeof (spv_path), "%s/%s", CURRENT_DIR, frag_spv);
+   shader_code = load_file (spv_path, &shader_code_size);
    if (shader_code == NULL) {
-      printf ("Error: Failed to load fragment shader code from 'frag.spv'\n");
+      printf ("Error: Failed to load fragment shader code from '%s'\n",
+              frag_spv);
       goto free_stuff;
    }
 
@@ -1027,11 +3192,13 @@ main (int32_t argc, char* argv[])
    objs.graphics_queue = queue;
    printf ("Got a device queue\n");
 
+   vk_submit_init (&objs.submit, &vk, queue, submit_bench.batch);
+
    /* create command pool */
    VkCommandPool cmd_pool = VK_NULL_HANDLE;;
    VkCommandPoolCreateInfo cmd_pool_info = {
       .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-      .flags = 0,
+      .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
       .queueFamilyIndex = queue_family_index,
    };
    if (vk.CreateCommandPool (device,
@@ -1044,65 +3211,172 @@ main (int32_t argc, char* argv[])
    objs.cmd_pool = cmd_pool;
    printf ("Command pool created\n");
 
-   /* create semaphores */
-   VkSemaphore image_available_semaphore = VK_NULL_HANDLE;
-   VkSemaphore render_finished_semaphore = VK_NULL_HANDLE;
+   if (submit_bench.count > 0 &&
+       ! create_submit_bench_cmd_buffers (&objs, &submit_bench))
+      goto free_stuff;
 
-   VkSemaphoreCreateInfo semaphore_info = {
-      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO  \
-   };
-   if (vk.CreateSemaphore (device,
-                           &semaphore_info,
-                           allocator,
-                           &image_available_semaphore) != VK_SUCCESS ||
-       vk.CreateSemaphore (device,
-                           &semaphore_info,
-                           allocator,
-                           &render_finished_semaphore) != VK_SUCCESS) {
-      printf ("Error: Failed to create semaphores\n");
+   if (gpu_timing &&
+       ! vk_timestamps_init (&timestamps,
+                             &vk,
+                             physical_device,
+                             device,
+                             queue_family_index,
+                             cmd_pool,
+                             gpu_statistics))
       goto free_stuff;
+
+   if (trace_path[0] != '\0') {
+      if (! trace_open (&trace, trace_path, trace_first_frame, trace_frames))
+         goto free_stuff;
+
+      /* CPU events only, if GPU times can't be lined up with them */
+      if (config.calibrated_timestamps)
+         vk_timestamps_set_region_callback (&timestamps, trace_gpu, NULL);
+      else
+         printf ("GPU times can't be calibrated, they won't be traced\n");
+   }
+
+   for (uint32_t i = 0; i < windows_count; i++) {
+      /* the command buffer of partial redraws, reset on every use */
+      VkCommandBufferAllocateInfo damage_cmd_buffer_info = {
+         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+         .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+         .commandBufferCount = 1,
+         .commandPool = cmd_pool
+      };
+      if (vk.AllocateCommandBuffers (device,
+                                     &damage_cmd_buffer_info,
+                                     &windows[i].damage_cmd_buffer) !=
+          VK_SUCCESS) {
+         printf ("Error: Failed to allocate command buffers\n");
+         goto free_stuff;
+      }
+
+      /* create semaphores */
+      VkSemaphoreCreateInfo semaphore_info = {
+         .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO  \
+      };
+      if (vk.CreateSemaphore (device,
+                              &semaphore_info,
+                              allocator,
+                              &windows[i].image_available_semaphore) !=
+          VK_SUCCESS ||
+          vk.CreateSemaphore (device,
+                              &semaphore_info,
+                              allocator,
+                              &windows[i].render_finished_semaphore) !=
+          VK_SUCCESS) {
+         printf ("Error: Failed to create semaphores\n");
+         goto free_stuff;
+      }
    }
-   objs.image_available_semaphore = image_available_semaphore;
-   objs.image_available_semaphore = image_available_semaphore;
    printf ("Semaphores create\n");
 
-   /* create the first swapchain */
-   if (! recreate_swapchain (&objs, &config, &state)) {
-      printf ("Error: Failed to create a swap chain\n");
+   /* create the frame fence, signaled as no frame is in flight yet */
+   VkFence frame_fence = VK_NULL_HANDLE;
+   VkFenceCreateInfo fence_info = {
+      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+      .flags = VK_FENCE_CREATE_SIGNALED_BIT
+   };
+   if (vk.CreateFence (device,
+                       &fence_info,
+                       allocator,
+                       &frame_fence) != VK_SUCCESS) {
+      printf ("Error: Failed to create a fence\n");
+      goto free_stuff;
+   }
+   objs.frame_fence = frame_fence;
+
+   /* create the N-body buffers and compute pipeline */
+   if (nbody.count > 0 &&
+       (! create_nbody_buffers (&objs, &nbody) ||
+        ! create_nbody_pipeline (&objs, &nbody) ||
+        ! create_nbody_step_cmd_buffers (&objs, &nbody)))
       goto free_stuff;
+
+   /* create the first swapchains */
+   for (uint32_t i = 0; i < windows_count; i++) {
+      if (! recreate_swapchain (&objs, &config, &windows[i])) {
+         printf ("Error: Failed to create a swap chain\n");
+         goto free_stuff;
+      }
    }
 
    /* start the show */
    signal (SIGINT, ctrl_c_handler);
 
    running = true;
-   damaged = true;
-   expose = true;
+   for (uint32_t i = 0; i < windows_count; i++) {
+      windows[i].damaged = true;
+      windows[i].expose = true;
+   }
 
-   /* Map the window onto the screen */
+   /* Map the windows onto the screen */
    wsi_window_show ();
 
+   /* animation frames from now on, at absolute deadlines */
+   if (animated () && frame_interval > 0 &&
+       ! event_loop_set_timer (&loop,
+                               wsi_get_time () + frame_interval,
+                               frame_interval,
+                               on_frame_timer,
+                               NULL))
+      goto free_stuff;
+
    while (running) {
-      if (! damaged && ! expose) {
-         if (! wsi_wait_for_events ())
-            break;
-      }
+      /* events queued already don't make the connection readable */
+      if (! handle_events ())
+         break;
+
+      bool damaged = false;
+      for (uint32_t i = 0; i < windows_count; i++)
+         damaged = damaged || windows[i].damaged || windows[i].expose;
+
+      /* sleep until there is something to draw, just check otherwise */
+      if (! event_loop_dispatch (&loop, damaged ? 0 : -1) || ! running)
+         break;
+
+      damaged = false;
+      for (uint32_t i = 0; i < windows_count; i++) {
+         struct vk_state* state = &windows[i];
+
+         /* exposed areas just need a redraw, unless the window was resized */
+         if (state->damaged) {
+            state->damage_count = wsi_get_damage (i, state->damage);
+            if (state->damage_count > 0 && window_resized (&objs, state))
+               state->expose = true;
+         }
 
-      if (expose) {
-         if (! recreate_swapchain (&objs, &config, &state)) {
-            printf ("Error: Failed to create a swap chain\n");
-            break;
+         if (state->expose) {
+            if (! recreate_swapchain (&objs, &config, state)) {
+               printf ("Error: Failed to create a swap chain\n");
+               running = false;
+               break;
+            }
+            state->expose = false;
+            state->damaged = true;
+            state->damage_count = 0;
          }
-         expose = false;
-         damaged = true;
+
+         damaged = damaged || state->damaged;
       }
 
-      if (damaged) {
-         if (! draw_frame (&objs, &state))
+      if (running && damaged) {
+         uint64_t start = wsi_get_time ();
+
+         if (! draw_frame (&objs, windows, windows_count))
             break;
-         damaged = false;
+         report_frame_rate (wsi_get_time () - start, false);
       }
    }
+   /* the last frames are timed once done */
+   if (gpu_timing) {
+      vk.DeviceWaitIdle (device);
+      vk_timestamps_collect (&timestamps);
+   }
+   report_frame_rate (0, true);
+   if (gpu_timing)
+      vk_timestamps_print (&timestamps);
    printf ("Main-loop ended\n");
 
  free_stuff:
@@ -1118,30 +3392,51 @@ main (int32_t argc, char* argv[])
     * destroyed.
     */
 
-   vk.DestroyPipeline (device, state.pipeline, allocator);
-   vk.DestroyPipelineLayout (device, state.pipeline_layout, allocator);
+   destroy_nbody (device, &nbody);
+   free (submit_bench.cmd_buffers);
+   vk_timestamps_destroy (&timestamps);
+   trace_close (&trace);
+
+   for (uint32_t w = 0; w < windows_count; w++) {
+      struct vk_state* state = &windows[w];
 
-   for (uint32_t i = 0; i < state.swapchain_images_count; i++)
-      vk.DestroyFramebuffer (device, state.framebuffers[i], allocator);
+      vk.DestroyPipeline (device, state->pipeline, allocator);
+      vk.DestroyPipeline (device, state->switch_pipeline, allocator);
+      vk.DestroyPipelineLayout (device, state->pipeline_layout, allocator);
 
-   for (uint32_t i = 0; i < state.swapchain_images_count; i++)
-      vk.DestroyImageView (device, state.image_views[i], allocator);
+      for (uint32_t i = 0; i < state->swapchain_images_count; i++)
+         vk.DestroyFramebuffer (device, state->framebuffers[i], allocator);
 
-   vk.DestroyRenderPass (device, state.renderpass, allocator);
-   vk.DestroySwapchainKHR (device, state.previous_swapchain, allocator);
-   vk.DestroySwapchainKHR (device, state.swapchain, allocator);
+      for (uint32_t i = 0; i < state->swapchain_images_count; i++)
+         vk.DestroyImageView (device, state->image_views[i], allocator);
+
+      destroy_offscreen_image (device, state);
+
+      vk.DestroyRenderPass (device, state->renderpass, allocator);
+      vk.DestroyRenderPass (device, state->damage_renderpass, allocator);
+      vk.DestroySwapchainKHR (device, state->previous_swapchain, allocator);
+      vk.DestroySwapchainKHR (device, state->swapchain, allocator);
+
+      vk.DestroySemaphore (device,
+                           state->image_available_semaphore,
+                           allocator);
+      vk.DestroySemaphore (device,
+                           state->render_finished_semaphore,
+                           allocator);
+   }
 
    /* destroy immutable objects */
-   vk.DestroySemaphore (device, image_available_semaphore, allocator);
-   vk.DestroySemaphore (device, render_finished_semaphore, allocator);
+   vk.DestroyFence (device, frame_fence, allocator);
    vk.DestroyCommandPool (device, cmd_pool, allocator);
    vk.DestroyShaderModule (device, vert_shader_module, allocator);
    vk.DestroyShaderModule (device, frag_shader_module, allocator);
    vk.DestroyDevice (device, allocator);
-   vk.DestroySurfaceKHR (instance, surface, allocator);
+   for (uint32_t i = 0; i < windows_count; i++)
+      vk.DestroySurfaceKHR (instance, windows[i].surface, allocator);
    vk.DestroyInstance (instance, allocator);
 
    /* teardown WSI */
+   event_loop_finish (&loop);
    wsi_finish ();
 
    printf ("Clean exit\n");
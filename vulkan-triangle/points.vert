@@ -0,0 +1,24 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+out gl_PerVertex {
+   vec4 gl_Position;
+   float gl_PointSize;
+};
+
+/* xyz, and mass in w (unused) */
+layout(location = 0) in vec4 position;
+
+layout(push_constant) uniform Params {
+   vec2 scale;
+} params;
+
+layout(location = 0) out vec3 color;
+
+void main() {
+   gl_Position = vec4(position.xy * params.scale, 0.5, 1.0);
+   gl_PointSize = 1.0;
+
+   /* nearer bodies (z > 0) are brighter */
+   color = vec3(0.4, 0.6, 1.0) * clamp(0.6 + 0.4 * position.z, 0.2, 1.0);
+}